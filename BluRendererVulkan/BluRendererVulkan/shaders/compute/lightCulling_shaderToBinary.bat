@@ -0,0 +1,2 @@
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe lightCulling.comp -o lightCulling.comp.spv
+pause
\ No newline at end of file
@@ -0,0 +1,75 @@
+// Shared by the occlusion shaders of SSAOPass, matches its descriptor set
+// layout and push constants
+
+layout (set = 0, binding = 1) uniform sampler2D depthMap;
+// Occlusion in rgb, linear depth in a
+layout (set = 0, binding = 3, rgba16f) uniform writeonly image2D occlusionImage;
+layout (set = 0, binding = 4) uniform sampler2D historyMap;
+
+layout (push_constant) uniform Params
+{
+	// View space of this frame to clip space of the last one
+	mat4 reprojection;
+	// [0][0], [1][1], [2][2] and [3][2] of the projection
+	vec4 projection;
+	// Occlusion pixels in use, the images may be larger
+	ivec2 extent;
+	float radius;
+	// Samples per pixel
+	uint kernelSize;
+	// 0 without history
+	float historyWeight;
+	uint frame;
+	// Last frame's occlusion uv to uv of the history image
+	layout (offset = 120) vec2 historyScale;
+} params;
+
+vec2 texelSize()
+{
+	return 1.0 / vec2(params.extent);
+}
+
+vec3 viewPosition(vec2 uv, float depth)
+{
+	float z = -params.projection.w / (depth + params.projection.z);
+	return vec3((uv * 2.0 - 1.0) * -z / params.projection.xy, z);
+}
+
+// From the neighbours closer in depth so the normal does not bend over edges
+vec3 reconstructNormal(vec3 center, vec3 left, vec3 right, vec3 up, vec3 down)
+{
+	vec3 dx = center - left;
+	vec3 dy = center - up;
+	if (abs(right.z - center.z) < abs(dx.z)) {
+		dx = right - center;
+	}
+	if (abs(down.z - center.z) < abs(dy.z)) {
+		dy = down - center;
+	}
+	vec3 normal = normalize(cross(dx, dy));
+	// Facing the eye at the origin
+	return dot(normal, center) > 0.0 ? -normal : normal;
+}
+
+// Interleaved gradient noise, moved on every frame
+float frameNoise(ivec2 pixel)
+{
+	float noise = fract(52.9829189 * fract(dot(vec2(pixel), vec2(0.06711056, 0.00583715))));
+	return fract(noise + 0.618034 * float(params.frame));
+}
+
+// The history is only used where it saw the same surface, the depth it
+// stored has to match the depth of this point in the last frame
+float accumulateHistory(float occlusion, vec3 center)
+{
+	if (params.historyWeight > 0.0) {
+		vec4 previousClip = params.reprojection * vec4(center, 1.0);
+		vec2 previousUV = previousClip.xy / previousClip.w * 0.5 + 0.5;
+		if (all(greaterThanEqual(previousUV, vec2(0.0))) && all(lessThanEqual(previousUV, vec2(1.0)))) {
+			vec4 history = textureLod(historyMap, previousUV * params.historyScale, 0.0);
+			float depthError = abs(history.a - previousClip.w) / previousClip.w;
+			occlusion = mix(occlusion, history.r, depthError < 0.05 ? params.historyWeight : 0.0);
+		}
+	}
+	return occlusion;
+}
@@ -108,17 +108,19 @@ float fxaaLuma(vec3 rgb) {
     return 0.2126*rgb.x + 0.7152*rgb.y + 0.0722*rgb.z;
 }
 
-// Sample center & surrounding pixels, compare luminance and average 
-vec3 applyFXAA() {
-    vec3 rgbC = texture(screenTexture, fragTexCord).rgb;
+// Sample center & surrounding pixels, compare luminance and average.
+// The includer defines FXAA_FETCH(x, y), the color at a pixel offset from the
+// center, and FXAA_SAMPLE(uv), the filtered color used by the edge search
+vec3 applyFXAA(vec2 uv, vec2 rcpFrame) {
+    vec3 rgbC = FXAA_FETCH(0, 0);
     #if FXAA_DISABLE
-        return outColor = vec4(rgbC, 0.0);
+        return rgbC;
     #endif
 
-    vec3 rgbN = textureOffset(screenTexture, fragTexCord, ivec2(0,-1)).rgb;
-    vec3 rgbS = textureOffset(screenTexture, fragTexCord, ivec2(0,1)).rgb;
-    vec3 rgbE = textureOffset(screenTexture, fragTexCord, ivec2(1,0)).rgb;
-    vec3 rgbW = textureOffset(screenTexture, fragTexCord, ivec2(-1,0)).rgb;
+    vec3 rgbN = FXAA_FETCH(0, -1);
+    vec3 rgbS = FXAA_FETCH(0, 1);
+    vec3 rgbE = FXAA_FETCH(1, 0);
+    vec3 rgbW = FXAA_FETCH(-1, 0);
 
     float lumaC = fxaaLuma(rgbC);
     float lumaN = fxaaLuma(rgbN);
@@ -171,10 +173,10 @@ vec3 applyFXAA() {
     #endif
 
     //Neighbors 
-    vec3 rgbNW = textureOffset(screenTexture, fragTexCord, ivec2(-1,-1)).rgb;
-    vec3 rgbNE = textureOffset(screenTexture, fragTexCord, ivec2(1,-1)).rgb;
-    vec3 rgbSW = textureOffset(screenTexture, fragTexCord, ivec2(-1,1)).rgb;
-    vec3 rgbSE = textureOffset(screenTexture, fragTexCord, ivec2(1,1)).rgb;
+    vec3 rgbNW = FXAA_FETCH(-1, -1);
+    vec3 rgbNE = FXAA_FETCH(1, -1);
+    vec3 rgbSW = FXAA_FETCH(-1, 1);
+    vec3 rgbSE = FXAA_FETCH(1, 1);
 
     #if (FXAA_SUBPIX_FASTER == 0) && (FXAA_SUBPIX > 0)
         rgbL += (rgbNW + rgbNE + rgbSW + rgbSE);
@@ -202,8 +204,6 @@ vec3 applyFXAA() {
             return vec3(0.0, 1.0, 0.0);
     #endif
     
-    vec2 texSize = textureSize(screenTexture, 0);
-    vec2 rcpFrame = vec2(1.0 / texSize.x, 1.0 / texSize.y);
     float lengthSign = horzSpan ? -rcpFrame.y : -rcpFrame.x;
     if(!horzSpan) lumaN = lumaW;
     if(!horzSpan) lumaS = lumaE;
@@ -225,8 +225,8 @@ vec3 applyFXAA() {
     if(!pairN) gradientN = gradientS;
     if(!pairN) lengthSign *= -1.0;
     vec2 posN;
-    posN.x = fragTexCord.x + (horzSpan ? 0.0 : lengthSign * 0.5);
-    posN.y = fragTexCord.y + (horzSpan ? lengthSign * 0.5 : 0.0);
+    posN.x = uv.x + (horzSpan ? 0.0 : lengthSign * 0.5);
+    posN.y = uv.y + (horzSpan ? lengthSign * 0.5 : 0.0);
 
 
     // CHOOSE SEARCH LIMITING VALUES
@@ -261,17 +261,8 @@ vec3 applyFXAA() {
         offNP *= vec2(4.0, 4.0);
     #endif
     for(int i = 0; i < FXAA_SEARCH_STEPS; i++) {
-        #if FXAA_SEARCH_ACCELERATION == 1
-            if(!doneN) lumaEndN = 
-                fxaaLuma(texture(screenTexture, posN.xy).rgb);
-            if(!doneP) lumaEndP = 
-                fxaaLuma(texture(screenTexture, posP.xy).rgb);
-        #else
-            if(!doneN) lumaEndN = 
-                fxaaLuma(textureGrad(screenTexture, posN.xy, offNP, offNP).rgb);
-            if(!doneP) lumaEndP = 
-                fxaaLuma(textureGrad(screenTexture, posP.xy, offNP, offNP).rgb);
-        #endif
+        if(!doneN) lumaEndN = fxaaLuma(FXAA_SAMPLE(posN.xy));
+        if(!doneP) lumaEndP = fxaaLuma(FXAA_SAMPLE(posP.xy));
         doneN = doneN || (abs(lumaEndN - lumaN) >= gradientN);
         doneP = doneP || (abs(lumaEndP - lumaN) >= gradientN);
         if(doneN && doneP) break;
@@ -280,8 +271,8 @@ vec3 applyFXAA() {
 
         //   HANDLE IF CENTER IS ON POSITIVE OR NEGATIVE SIDE 
 
-    float dstN = horzSpan ? fragTexCord.x - posN.x : fragTexCord.y - posN.y;
-    float dstP = horzSpan ? posP.x - fragTexCord.x : posP.y - fragTexCord.y;
+    float dstN = horzSpan ? uv.x - posN.x : uv.y - posN.y;
+    float dstP = horzSpan ? posP.x - uv.x : posP.y - uv.y;
     bool directionN = dstN < dstP;
     #if FXAA_DEBUG_NEGPOS
         if(directionN)
@@ -316,8 +307,8 @@ vec3 applyFXAA() {
         return FxaaToVec3(lumaO);
     #endif
 
-    vec3 rgbF = texture(screenTexture, vec2(fragTexCord.x + (horzSpan ? 0.0 : subPixelOffset),
-        fragTexCord.y + (horzSpan ? subPixelOffset : 0.0))).rgb;
+    vec3 rgbF = FXAA_SAMPLE(vec2(uv.x + (horzSpan ? 0.0 : subPixelOffset),
+        uv.y + (horzSpan ? subPixelOffset : 0.0)));
 
     #if FXAA_SUBPIX == 0
         return rgbF;
@@ -0,0 +1,31 @@
+// Shared between the light culling compute shader and the clustered PBR shader
+// The view is split into screen space tiles of CLUSTER_TILE_SIZE pixels and
+// CLUSTER_SLICES exponential depth slices, every cluster holds up to
+// MAX_LIGHTS_PER_CLUSTER indices into the light buffer
+
+#define CLUSTER_TILE_SIZE 64
+#define CLUSTER_SLICES 24
+#define MAX_LIGHTS_PER_CLUSTER 128
+
+layout (set = CLUSTER_SET, binding = 0) uniform ClusterParams {
+	mat4 view;
+	mat4 inverseProjection;
+	// xyz = cluster counts, w = light count
+	uvec4 gridSize;
+	// x = near, y = far, z = slice scale, w = slice bias
+	vec4 depthParams;
+	vec2 screenSize;
+	// Index of the first culled light in the light buffer
+	uint firstLight;
+} clusterParams;
+
+uint getClusterSlice(float viewDepth)
+{
+	float slice = log(max(viewDepth, clusterParams.depthParams.x)) * clusterParams.depthParams.z + clusterParams.depthParams.w;
+	return uint(clamp(slice, 0.0, float(CLUSTER_SLICES - 1)));
+}
+
+uint getClusterIndex(uvec2 tile, uint slice)
+{
+	return (slice * clusterParams.gridSize.y + tile.y) * clusterParams.gridSize.x + tile.x;
+}
@@ -0,0 +1,29 @@
+// Packed light, see GPULightInfo in Light.h. The light type is implied by the
+// packing so every light fits into three vec4s
+
+struct LightSource {
+	// xyz radiance with the constant falloff folded in, w linear and quadratic falloff as two halfs
+	vec4 color;
+	// xyz position, w culling range, negative for directional lights
+	vec4 position;
+	// xyz direction, w spot cutoff, negative for point lights
+	vec4 direction;
+};
+
+#define LIGHT_DIRECTIONAL 0
+#define LIGHT_POINT 1
+#define LIGHT_SPOT 2
+
+int getLightType(LightSource light)
+{
+	if (light.position.w < 0.0) {
+		return LIGHT_DIRECTIONAL;
+	}
+	return light.direction.w < 0.0 ? LIGHT_POINT : LIGHT_SPOT;
+}
+
+float getAttenuation(LightSource light, float distance)
+{
+	vec2 falloff = unpackHalf2x16(floatBitsToUint(light.color.w));
+	return 1.0 / (1.0 + falloff.x * distance + falloff.y * distance * distance);
+}
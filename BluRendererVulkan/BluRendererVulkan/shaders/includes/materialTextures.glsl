@@ -0,0 +1,19 @@
+// Material texture sets are encoded as (texture index << 1) | uv set, or -1
+// when the material has no texture in that slot. The texture index is only
+// used when the shader is built with BINDLESS, otherwise the per material
+// set 1 bindings are sampled directly
+
+#ifdef BINDLESS
+layout (set = 1, binding = 0) uniform sampler2D materialTextures[];
+
+#define MATERIAL_TEXTURE(map, textureSet) materialTextures[nonuniformEXT(max(textureSet, 0) >> 1)]
+#else
+#define MATERIAL_TEXTURE(map, textureSet) map
+#endif
+
+vec2 materialUV(int textureSet)
+{
+	return (textureSet & 1) == 0 ? inUV0 : inUV1;
+}
+
+#define sampleMaterial(map, textureSet) texture(MATERIAL_TEXTURE(map, textureSet), materialUV(textureSet))
@@ -0,0 +1,56 @@
+// Reduction of a tile through shared memory into further mips, shared by the
+// mip chains built in a single dispatch. The including shader defines
+// GROUP_SIZE and TILE_VALUE, the type of a texel, before the include and the
+// two functions declared here after it
+
+// Reduces 2x2 texels of a mip into one of the next
+TILE_VALUE reduceTexels(TILE_VALUE a, TILE_VALUE b, TILE_VALUE c, TILE_VALUE d);
+// Writes a texel of a mip, texels outside of the mip have to be skipped
+void storeMip(uint mip, ivec2 texel, TILE_VALUE value);
+
+// The mip arrays are only indexed with constants, dynamic indexing of storage
+// image arrays is an optional feature. storeMip() switches over the mip with
+// these, after it defined STORE_MIP(MIP) as the case of a single mip
+#define STORE_MIP_CASES_6 \
+	STORE_MIP(0) \
+	STORE_MIP(1) \
+	STORE_MIP(2) \
+	STORE_MIP(3) \
+	STORE_MIP(4) \
+	STORE_MIP(5)
+#define STORE_MIP_CASES_12 \
+	STORE_MIP_CASES_6 \
+	STORE_MIP(6) \
+	STORE_MIP(7) \
+	STORE_MIP(8) \
+	STORE_MIP(9) \
+	STORE_MIP(10) \
+	STORE_MIP(11)
+
+shared TILE_VALUE tile[GROUP_SIZE][GROUP_SIZE];
+
+// value is the texel of mip this invocation wrote, a tile has GROUP_SIZE
+// texels of it per dimension. Writes the mipCount - 1 mips after it
+void reduceTileMips(ivec2 tileId, TILE_VALUE value, uint mip, uint mipCount)
+{
+	ivec2 local = ivec2(gl_LocalInvocationID.xy);
+	tile[local.y][local.x] = value;
+
+	// Every further mip is left to a quarter of the invocations before
+	for (uint level = 1u; level < mipCount; level++) {
+		int size = GROUP_SIZE >> level;
+		bool active = all(lessThan(local, ivec2(size)));
+		memoryBarrierShared();
+		barrier();
+		if (active) {
+			ivec2 texel = local * 2;
+			value = reduceTexels(tile[texel.y][texel.x], tile[texel.y][texel.x + 1],
+				tile[texel.y + 1][texel.x], tile[texel.y + 1][texel.x + 1]);
+		}
+		barrier();
+		if (active) {
+			tile[local.y][local.x] = value;
+			storeMip(mip + level, tileId * size + local, value);
+		}
+	}
+}
@@ -1,32 +1,32 @@
 #version 450
 
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
+
 layout (location = 0) in vec3 inWorldPos;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUV0;
 layout (location = 3) in vec2 inUV1;
 layout (location = 4) in vec4 inColor0;
-layout (location = 5) in vec4 inShadowCoords;
 
 // Scene bindings
 
+#define SHADOW_CASCADE_COUNT 4
+
 layout (set = 0, binding = 0) uniform UBO {
 	mat4 model[16];
-	mat4 lightSpace[2];
+	mat4 cascadeViewProj[SHADOW_CASCADE_COUNT];
+	vec4 cascadeSplits;
 	mat4 projection;
 	mat4 view;
 	vec4 camPos;
 	vec2 screenSize;
 } ubo;
 
-struct LightSource {
-  vec4 color;
-  vec4 position;
-  vec4 direction;
-  vec4 lightFalloff;
-};
+#include "includes/lights.glsl"
 
 layout (set = 0, binding = 1) uniform UBOParams {
-	LightSource lights[2];
 	float lightCount;
 	float prefilteredCubeMipLevels;
 	float debugViewInputs;
@@ -38,18 +38,41 @@ layout (set = 0, binding = 1) uniform UBOParams {
 layout (set = 0, binding = 2) uniform samplerCube samplerIrradiance;
 layout (set = 0, binding = 3) uniform samplerCube prefilteredMap;
 layout (set = 0, binding = 4) uniform sampler2D samplerBRDFLUT;
-layout (set = 0, binding = 5) uniform sampler2D shadowMap;
+layout (set = 0, binding = 5) uniform sampler2D shadowMaps[SHADOW_CASCADE_COUNT];
 layout (set = 0, binding = 6) uniform sampler2D ssaoMap;
 
+layout (std430, set = 0, binding = 7) readonly buffer Lights {
+	LightSource lights[];
+};
+
+// Shadows of point and spot lights, a tile per spot light and per cube face of
+// a point light. Matches vks::ShadowAtlas::GPUData
+#define MAX_SHADOW_TILES 64
+#define MAX_SHADOWED_LIGHTS 16
+
+layout (set = 0, binding = 8) uniform sampler2D shadowAtlas;
+layout (set = 0, binding = 9) uniform ShadowAtlas {
+	mat4 tileViewProj[MAX_SHADOW_TILES];
+	// xy offset and zw size in texture coordinates
+	vec4 tileRects[MAX_SHADOW_TILES];
+	// x light index, y first tile, z tile count
+	uvec4 lights[MAX_SHADOWED_LIGHTS];
+	uint lightCount;
+} shadowAtlasParams;
+
 // Material bindings
 
 // Textures
 
+#ifndef BINDLESS
 layout (set = 1, binding = 0) uniform sampler2D colorMap;
 layout (set = 1, binding = 1) uniform sampler2D physicalDescriptorMap;
 layout (set = 1, binding = 2) uniform sampler2D normalMap;
 layout (set = 1, binding = 3) uniform sampler2D aoMap;
 layout (set = 1, binding = 4) uniform sampler2D emissiveMap;
+#endif
+
+#include "includes/materialTextures.glsl"
 
 // Properties
 
@@ -60,9 +83,29 @@ layout(std430, set = 3, binding = 0) buffer SSBO
    ShaderMaterial materials[ ];
 };
 
+#ifdef CLUSTERED_LIGHTING
+// Point and spot lights binned by the light culling pass, the indices point
+// into the light buffer
+
+#define CLUSTER_SET 4
+#include "includes/clusteredLighting.glsl"
+
+layout (std430, set = 4, binding = 3) readonly buffer LightGrid {
+	uint clusterLightCount[];
+};
+
+layout (std430, set = 4, binding = 4) readonly buffer LightIndices {
+	uint clusterLightIndices[];
+};
+#endif
+
 layout (push_constant) uniform PushConstants {
 	int materialIndex;
 	int transformIndex;
+	// Point and spot lights assigned to the draw on the CPU, two 16 bit light
+	// indices per uint. See DrawLightList in LightAssignment.h
+	uint drawLightCount;
+	uint drawLightIndices[4];
 } pushConstants;
 
 layout (location = 0) out vec4 outColor;
@@ -98,7 +141,7 @@ const float PBR_WORKFLOW_SPECULAR_GLOSSINESS = 1.0;
 vec3 getNormal(ShaderMaterial material)
 {
 	// Perturb normal, see http://www.thetenthplanet.de/archives/1180
-	vec3 tangentNormal = texture(normalMap, material.normalTextureSet == 0 ? inUV0 : inUV1).xyz * 2.0 - 1.0;
+	vec3 tangentNormal = sampleMaterial(normalMap, material.normalTextureSet).xyz * 2.0 - 1.0;
 
 	vec3 q1 = dFdx(inWorldPos);
 	vec3 q2 = dFdy(inWorldPos);
@@ -167,11 +210,29 @@ float microfacetDistribution(PBRInfo pbrInputs)
 	//return roughnessSq / (M_PI * pow(pow(pbrInputs.NdotH, 2) * (roughnessSq - 1) + 1, 2));
 }
 
-float calculateShadow(vec4 shadowCoords, vec2 off)
+const mat4 biasMat = mat4( 
+	0.5, 0.0, 0.0, 0.0,
+	0.0, 0.5, 0.0, 0.0,
+	0.0, 0.0, 1.0, 0.0,
+	0.5, 0.5, 0.0, 1.0 );
+
+// The cascade differs between fragments of a draw, so the sampler array is
+// only indexed with constants
+float sampleShadowMap(int cascade, vec2 uv)
+{
+	switch (cascade) {
+		case 0: return textureLod(shadowMaps[0], uv, 0.0).r;
+		case 1: return textureLod(shadowMaps[1], uv, 0.0).r;
+		case 2: return textureLod(shadowMaps[2], uv, 0.0).r;
+		default: return textureLod(shadowMaps[3], uv, 0.0).r;
+	}
+}
+
+float calculateShadow(vec4 shadowCoords, vec2 off, int cascade)
 {
    if (shadowCoords.z > -1.0 && shadowCoords.z < 1.0)
    {
-      float closestDepth = texture(shadowMap, shadowCoords.xy + off).r;
+      float closestDepth = sampleShadowMap(cascade, shadowCoords.xy + off);
       float currentDepth = shadowCoords.z;
 
       if (closestDepth < currentDepth)
@@ -181,9 +242,9 @@ float calculateShadow(vec4 shadowCoords, vec2 off)
    return 0.0;
 }
 
-float filterPCF(vec4 shadowCoords)
+float filterPCF(vec4 shadowCoords, int cascade)
 {
-   vec2 texelSize = textureSize(shadowMap, 0);
+   vec2 texelSize = textureSize(shadowMaps[0], 0);
    float scale = 1.5;
    float dx = scale * (1.0 / float(texelSize.x));
    float dy = scale * (1.0 / float(texelSize.y));
@@ -198,7 +259,8 @@ float filterPCF(vec4 shadowCoords)
       {
          shadow += calculateShadow(
                shadowCoords,
-               vec2(dx * x, dy * y)
+               vec2(dx * x, dy * y),
+               cascade
          );
          count++;
       }
@@ -207,6 +269,85 @@ float filterPCF(vec4 shadowCoords)
    return shadow / count;
 }
 
+// Light that reaches the fragment through the cascaded shadow map, fragments
+// past the last cascade are unshadowed
+float getCascadedShadow()
+{
+	float viewDepth = -(ubo.view * vec4(inWorldPos, 1.0)).z;
+	if (viewDepth >= ubo.cascadeSplits[SHADOW_CASCADE_COUNT - 1]) {
+		return 1.0;
+	}
+	int cascade = 0;
+	for (int i = 0; i < SHADOW_CASCADE_COUNT - 1; i++) {
+		if (viewDepth > ubo.cascadeSplits[i]) {
+			cascade = i + 1;
+		}
+	}
+
+	vec4 shadowCoords = biasMat * ubo.cascadeViewProj[cascade] * vec4(inWorldPos, 1.0);
+	shadowCoords /= shadowCoords.w;
+	if (int(uboParams.usePCF) == 1) {
+		return 1.0 - filterPCF(shadowCoords, cascade);
+	}
+	return 1.0 - calculateShadow(shadowCoords, vec2(0), cascade);
+}
+
+// Light of a point or spot light that reaches the fragment through its atlas
+// tiles, lights without tiles are unshadowed
+float getAtlasShadow(uint lightIndex, LightSource light)
+{
+	uint entry = 0u;
+	for (; entry < shadowAtlasParams.lightCount; entry++) {
+		if (shadowAtlasParams.lights[entry].x == lightIndex) {
+			break;
+		}
+	}
+	if (entry == shadowAtlasParams.lightCount) {
+		return 1.0;
+	}
+
+	// Cube faces are ordered +X, -X, +Y, -Y, +Z, -Z
+	uint tile = shadowAtlasParams.lights[entry].y;
+	if (shadowAtlasParams.lights[entry].z > 1u) {
+		vec3 toFragment = inWorldPos - light.position.xyz;
+		vec3 absolute = abs(toFragment);
+		if (absolute.x >= absolute.y && absolute.x >= absolute.z) {
+			tile += toFragment.x > 0.0 ? 0u : 1u;
+		} else if (absolute.y >= absolute.z) {
+			tile += toFragment.y > 0.0 ? 2u : 3u;
+		} else {
+			tile += toFragment.z > 0.0 ? 4u : 5u;
+		}
+	}
+
+	vec4 shadowCoords = shadowAtlasParams.tileViewProj[tile] * vec4(inWorldPos, 1.0);
+	shadowCoords /= shadowCoords.w;
+	if (shadowCoords.z <= 0.0 || shadowCoords.z >= 1.0 ||
+		any(greaterThan(abs(shadowCoords.xy), vec2(1.0)))) {
+		return 1.0;
+	}
+
+	// Taps are kept half a texel inside of the tile so filtering does not
+	// bleed into its neighbours
+	vec4 rect = shadowAtlasParams.tileRects[tile];
+	vec2 texelSize = 1.0 / vec2(textureSize(shadowAtlas, 0));
+	vec2 uv = rect.xy + (shadowCoords.xy * 0.5 + 0.5) * rect.zw;
+	vec2 uvMin = rect.xy + texelSize * 0.5;
+	vec2 uvMax = rect.xy + rect.zw - texelSize * 0.5;
+
+	int range = int(uboParams.usePCF) == 1 ? 1 : 0;
+	float lit = 0.0;
+	int count = 0;
+	for (int x = -range; x <= range; x++) {
+		for (int y = -range; y <= range; y++) {
+			vec2 tapUV = clamp(uv + vec2(x, y) * texelSize, uvMin, uvMax);
+			lit += textureLod(shadowAtlas, tapUV, 0.0).r < shadowCoords.z ? 0.0 : 1.0;
+			count++;
+		}
+	}
+	return lit / float(count);
+}
+
 // Gets metallic factor from specular glossiness workflow inputs 
 float convertMetallic(vec3 diffuse, vec3 specular, float maxSpecular) {
 	float perceivedDiffuse = sqrt(0.299 * diffuse.r * diffuse.r + 0.587 * diffuse.g * diffuse.g + 0.114 * diffuse.b * diffuse.b);
@@ -285,10 +426,7 @@ vec3 CalculatePointLight(LightSource light, PBRInfo pbrInputs) {
 	vec3 specular = numerator / max(denominator, 0.0001);
    
 	float distance = length(light.position.xyz - inWorldPos);
-	//light.lightFalloff[0] Constant
-	//light.lightFalloff[1] Linear
-	//light.lightFalloff[2] Quadratic
-	float attenuation = (1.0 / ( light.lightFalloff[0] + light.lightFalloff[1] * distance + light.lightFalloff[2] * (distance * distance)));
+	float attenuation = getAttenuation(light, distance);
 
 	return (attenuation * (diffuse + specular) * inRadiance * pbrInputs.NdotL);
 }
@@ -303,8 +441,8 @@ vec3 CalculateSpotLight(LightSource light, PBRInfo pbrInputs) {
 	pbrInputs.VdotH = clamp(dot(pbrInputs.V, H), 0.0, 1.0);
 
 	float theta = dot(L, normalize(-light.direction.xyz));
-	float epsilon = 0.9978 - light.position.w; // FOV -> light.position.w
-	float intensity = clamp((theta - light.position.w) / epsilon, 0.0, 1.0);
+	float epsilon = 0.9978 - light.direction.w; // FOV -> light.direction.w
+	float intensity = clamp((theta - light.direction.w) / epsilon, 0.0, 1.0);
 
 	vec3 inRadiance = light.color.rbg;
 
@@ -328,14 +466,20 @@ vec3 CalculateSpotLight(LightSource light, PBRInfo pbrInputs) {
 	vec3 specular = numerator / max(denominator, 0.0001) * intensity;
 
 	float distance = length(light.position.xyz - inWorldPos);
-	//light.lightFalloff[0] Constant
-	//light.lightFalloff[1] Linear
-	//light.lightFalloff[2] Quadratic
-	float attenuation = (1.0 / ( light.lightFalloff[0] + light.lightFalloff[1] * distance + light.lightFalloff[2] * (distance * distance)));
+	float attenuation = getAttenuation(light, distance);
 
 	return (attenuation * (diffuse + specular) * inRadiance);
 }
 
+// Fades the light out towards the range used for culling so lights do not pop
+// at cluster or draw borders
+float rangeWindow(LightSource light)
+{
+	float distance = length(light.position.xyz - inWorldPos);
+	float falloff = clamp(1.0 - pow(distance / light.position.w, 4.0), 0.0, 1.0);
+	return falloff * falloff;
+}
+
 void main()
 {
 	ShaderMaterial material = materials[pushConstants.materialIndex];
@@ -348,7 +492,7 @@ void main()
 
 	if (material.alphaMask == 1.0f) {
 		if (material.baseColorTextureSet > -1) {
-			baseColor = SRGBtoLINEAR(texture(colorMap, material.baseColorTextureSet == 0 ? inUV0 : inUV1)) * material.baseColorFactor;
+			baseColor = SRGBtoLINEAR(sampleMaterial(colorMap, material.baseColorTextureSet)) * material.baseColorFactor;
 		} else {
 			baseColor = material.baseColorFactor;
 		}
@@ -366,7 +510,7 @@ void main()
 		if (material.physicalDescriptorTextureSet > -1) {
 			// Roughness is stored in the 'g' channel, metallic is stored in the 'b' channel.
 			// This layout intentionally reserves the 'r' channel for (optional) occlusion map data
-			vec4 mrSample = texture(physicalDescriptorMap, material.physicalDescriptorTextureSet == 0 ? inUV0 : inUV1);
+			vec4 mrSample = sampleMaterial(physicalDescriptorMap, material.physicalDescriptorTextureSet);
 			perceptualRoughness = mrSample.g * perceptualRoughness;
 			metallic = mrSample.b * metallic;
 		} else {
@@ -378,7 +522,7 @@ void main()
 
 		// The albedo may be defined from a base texture or a flat color
 		if (material.baseColorTextureSet > -1) {
-			baseColor = SRGBtoLINEAR(texture(colorMap, material.baseColorTextureSet == 0 ? inUV0 : inUV1)) * material.baseColorFactor;
+			baseColor = SRGBtoLINEAR(sampleMaterial(colorMap, material.baseColorTextureSet)) * material.baseColorFactor;
 		} else {
 			baseColor = material.baseColorFactor;
 		}
@@ -387,15 +531,15 @@ void main()
 	if (material.workflow == PBR_WORKFLOW_SPECULAR_GLOSSINESS) {
 		// Values from specular glossiness workflow are converted to metallic roughness
 		if (material.physicalDescriptorTextureSet > -1) {
-			perceptualRoughness = 1.0 - texture(physicalDescriptorMap, material.physicalDescriptorTextureSet == 0 ? inUV0 : inUV1).a;
+			perceptualRoughness = 1.0 - sampleMaterial(physicalDescriptorMap, material.physicalDescriptorTextureSet).a;
 		} else {
 			perceptualRoughness = 0.0;
 		}
 
 		const float epsilon = 1e-6;
 
-		vec4 diffuse = SRGBtoLINEAR(texture(colorMap, inUV0));
-		vec3 specular = SRGBtoLINEAR(texture(physicalDescriptorMap, inUV0)).rgb;
+		vec4 diffuse = SRGBtoLINEAR(texture(MATERIAL_TEXTURE(colorMap, material.baseColorTextureSet), inUV0));
+		vec3 specular = SRGBtoLINEAR(texture(MATERIAL_TEXTURE(physicalDescriptorMap, material.physicalDescriptorTextureSet), inUV0)).rgb;
 
 		float maxSpecular = max(max(specular.r, specular.g), specular.b);
 
@@ -458,41 +602,67 @@ void main()
 	vec3 color = vec3(0.0);
 
 	//Lights
-	vec3 ibl = getIBLContribution(pbrInputs, reflection) * texture(ssaoMap, (gl_FragCoord.xy / ubo.screenSize)).rgb;
+	vec3 ibl = getIBLContribution(pbrInputs, reflection) * texture(ssaoMap, gl_FragCoord.xy / vec2(textureSize(ssaoMap, 0))).rgb;
 	color += ibl;
 
 	vec3 Lo = vec3(0.0);
 	for(int i = 0; i < int(uboParams.lightCount); i++) {
-		int lightType = int(uboParams.lights[i].color.w);
+		int lightType = getLightType(lights[i]);
 		switch(lightType) {
-			case 0:
-				float shadow;
-				if(int(uboParams.usePCF) == 1) {
-					shadow = (1.0 - filterPCF(inShadowCoords / inShadowCoords.w)); }
-				else {
-					shadow = (1.0 - calculateShadow(inShadowCoords / inShadowCoords.w, vec2(0))); }
-				Lo += CalculateDirLight(uboParams.lights[i], pbrInputs) * shadow;
+			case LIGHT_DIRECTIONAL:
+				// Directional lights lead the light buffer, the first one casts
+				// the cascaded shadows
+				float shadow = i == 0 ? getCascadedShadow() : 1.0;
+				Lo += CalculateDirLight(lights[i], pbrInputs) * shadow;
 				break;
-			case 1:
-				Lo += CalculatePointLight(uboParams.lights[i], pbrInputs);
+			case LIGHT_POINT:
+				Lo += CalculatePointLight(lights[i], pbrInputs) * getAtlasShadow(uint(i), lights[i]);
 				break;
-			case 2:
-				Lo += CalculateSpotLight(uboParams.lights[i], pbrInputs);
+			case LIGHT_SPOT:
+				Lo += CalculateSpotLight(lights[i], pbrInputs) * getAtlasShadow(uint(i), lights[i]);
 				break;
 		}
 	}
 
+#ifndef CLUSTERED_LIGHTING
+	for (uint i = 0u; i < pushConstants.drawLightCount; i++) {
+		uint lightIndex = (pushConstants.drawLightIndices[i / 2u] >> ((i & 1u) * 16u)) & 0xFFFFu;
+		LightSource light = lights[lightIndex];
+		float shadow = rangeWindow(light) * getAtlasShadow(lightIndex, light);
+		if (getLightType(light) == LIGHT_POINT) {
+			Lo += CalculatePointLight(light, pbrInputs) * shadow;
+		} else {
+			Lo += CalculateSpotLight(light, pbrInputs) * shadow;
+		}
+	}
+#else
+	uvec2 tile = uvec2(gl_FragCoord.xy) / CLUSTER_TILE_SIZE;
+	float viewDepth = -(clusterParams.view * vec4(inWorldPos, 1.0)).z;
+	uint cluster = getClusterIndex(tile, getClusterSlice(viewDepth));
+	uint clusterLights = clusterLightCount[cluster];
+	for (uint i = 0u; i < clusterLights; i++) {
+		uint lightIndex = clusterLightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i];
+		LightSource light = lights[lightIndex];
+		float shadow = rangeWindow(light) * getAtlasShadow(lightIndex, light);
+		if (getLightType(light) == LIGHT_POINT) {
+			Lo += CalculatePointLight(light, pbrInputs) * shadow;
+		} else {
+			Lo += CalculateSpotLight(light, pbrInputs) * shadow;
+		}
+	}
+#endif
+
 	color += Lo;
 	const float u_OcclusionStrength = 1.0f;
 	// Apply optional PBR terms for additional (optional) shading
 	if (material.occlusionTextureSet > -1) {
-		float ao = texture(aoMap, (material.occlusionTextureSet == 0 ? inUV0 : inUV1)).r;
+		float ao = sampleMaterial(aoMap, material.occlusionTextureSet).r;
 		color = mix(color, color * ao, u_OcclusionStrength);
 	}
 
 	vec3 emissive = material.emissiveFactor.rgb * material.emissiveStrength;
 	if (material.emissiveTextureSet > -1) {
-		emissive *= SRGBtoLINEAR(texture(emissiveMap, material.emissiveTextureSet == 0 ? inUV0 : inUV1)).rgb;
+		emissive *= SRGBtoLINEAR(sampleMaterial(emissiveMap, material.emissiveTextureSet)).rgb;
 	};
 	color += emissive;
 
@@ -504,25 +674,25 @@ void main()
 		int index = int(uboParams.debugViewInputs);
 		switch (index) {
 			case 1:
-				outColor.rgba = material.baseColorTextureSet > -1 ? texture(colorMap, material.baseColorTextureSet == 0 ? inUV0 : inUV1) : vec4(1.0f);
+				outColor.rgba = material.baseColorTextureSet > -1 ? sampleMaterial(colorMap, material.baseColorTextureSet) : vec4(1.0f);
 				break;
 			case 2:
-				outColor.rgb = (material.normalTextureSet > -1) ? texture(normalMap, material.normalTextureSet == 0 ? inUV0 : inUV1).rgb : normalize(inNormal);
+				outColor.rgb = (material.normalTextureSet > -1) ? sampleMaterial(normalMap, material.normalTextureSet).rgb : normalize(inNormal);
 				break;
 			case 3:
-				outColor.rgb = (material.occlusionTextureSet > -1) ? texture(aoMap, material.occlusionTextureSet == 0 ? inUV0 : inUV1).rrr : texture(ssaoMap, (gl_FragCoord.xy / ubo.screenSize.xy)).rgb;
+				outColor.rgb = (material.occlusionTextureSet > -1) ? sampleMaterial(aoMap, material.occlusionTextureSet).rrr : texture(ssaoMap, gl_FragCoord.xy / vec2(textureSize(ssaoMap, 0))).rgb;
 				break;
 			case 4:
-				outColor.rgb = (material.emissiveTextureSet > -1) ? texture(emissiveMap, material.emissiveTextureSet == 0 ? inUV0 : inUV1).rgb : vec3(0.0f);
+				outColor.rgb = (material.emissiveTextureSet > -1) ? sampleMaterial(emissiveMap, material.emissiveTextureSet).rgb : vec3(0.0f);
 				break;
 			case 5:
-				outColor.rgb = texture(physicalDescriptorMap, inUV0).bbb;
+				outColor.rgb = texture(MATERIAL_TEXTURE(physicalDescriptorMap, material.physicalDescriptorTextureSet), inUV0).bbb;
 				break;
 			case 6:
-				outColor.rgb = texture(physicalDescriptorMap, inUV0).ggg;
+				outColor.rgb = texture(MATERIAL_TEXTURE(physicalDescriptorMap, material.physicalDescriptorTextureSet), inUV0).ggg;
 				break;
 			case 7:
-				vec3 debugF_L = normalize(uboParams.lights[int(uboParams.debugViewLight)].position.xyz - inWorldPos);
+				vec3 debugF_L = normalize(lights[int(uboParams.debugViewLight)].position.xyz - inWorldPos);
 				vec3 debugF_H = normalize (pbrInputs.V + debugF_L);
 				pbrInputs.NdotL = clamp(dot(pbrInputs.N, debugF_L), 0.001, 1.0);
 				pbrInputs.NdotH = clamp(dot(pbrInputs.N, debugF_H), 0.0, 1.0);
@@ -533,7 +703,7 @@ void main()
 				outColor.rgb = F;
 				break;
 			case 8:
-				vec3 debugG_L = normalize(uboParams.lights[int(uboParams.debugViewLight)].position.xyz - inWorldPos);
+				vec3 debugG_L = normalize(lights[int(uboParams.debugViewLight)].position.xyz - inWorldPos);
 				vec3 debugG_H = normalize (pbrInputs.V + debugG_L);
 				pbrInputs.NdotL = clamp(dot(pbrInputs.N, debugG_L), 0.001, 1.0);
 				pbrInputs.NdotH = clamp(dot(pbrInputs.N, debugG_H), 0.0, 1.0);
@@ -545,7 +715,7 @@ void main()
 				outColor.rgb = vec3(G);
 				break;
 			case 9: 
-				vec3 debugD_L = normalize(uboParams.lights[int(uboParams.debugViewLight)].position.xyz - inWorldPos);
+				vec3 debugD_L = normalize(lights[int(uboParams.debugViewLight)].position.xyz - inWorldPos);
 				vec3 debugD_H = normalize (pbrInputs.V + debugD_L);
 				pbrInputs.NdotL = clamp(dot(pbrInputs.N, debugD_L), 0.001, 1.0);
 				pbrInputs.NdotH = clamp(dot(pbrInputs.N, debugD_H), 0.0, 1.0);
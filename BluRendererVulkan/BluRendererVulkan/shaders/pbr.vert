@@ -11,7 +11,8 @@ layout (location = 6) in vec4 inColor0;
 layout (set = 0, binding = 0) uniform UBO 
 {
 	mat4 model[16];
-	mat4 lightSpace[2];
+	mat4 cascadeViewProj[4];
+	vec4 cascadeSplits;
 	mat4 projection;
 	mat4 view;
 	vec3 camPos;
@@ -35,13 +36,10 @@ layout (location = 1) out vec3 outNormal;
 layout (location = 2) out vec2 outUV0;
 layout (location = 3) out vec2 outUV1;
 layout (location = 4) out vec4 outColor0;
-layout (location = 5) out vec4 outShadowCoord;
 
-const mat4 biasMat = mat4( 
-	0.5, 0.0, 0.0, 0.0,
-	0.0, 0.5, 0.0, 0.0,
-	0.0, 0.0, 1.0, 0.0,
-	0.5, 0.5, 0.0, 1.0 );
+// The depth prepass computes the same position, the scene pass tests opaque
+// geometry for equal depth
+invariant gl_Position;
 
 void main() 
 {
@@ -67,6 +65,4 @@ void main()
 	outUV0 = inUV0;
 	outUV1 = inUV1;
 	gl_Position =  ubo.projection * ubo.view * vec4(outWorldPos, 1.0);
-
-	outShadowCoord = ( biasMat * ubo.lightSpace[0] * (ubo.model[pushConstants.transformIndex])) * vec4(inPos, 1.0);
 }
\ No newline at end of file
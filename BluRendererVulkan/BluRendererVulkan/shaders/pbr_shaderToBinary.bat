@@ -1,3 +1,6 @@
 C:\VulkanSDK\1.3.261.1\Bin\glslc.exe pbr.frag -o pbr.frag.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe pbr.frag -DBINDLESS -o pbr_bindless.frag.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe pbr.frag -DCLUSTERED_LIGHTING -o pbr_clustered.frag.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe pbr.frag -DCLUSTERED_LIGHTING -DBINDLESS -o pbr_clustered_bindless.frag.spv
 C:\VulkanSDK\1.3.261.1\Bin\glslc.exe pbr.vert -o pbr.vert.spv
 pause
\ No newline at end of file
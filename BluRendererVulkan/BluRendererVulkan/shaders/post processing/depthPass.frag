@@ -0,0 +1,18 @@
+#version 450
+
+// Motion vectors of the camera prepass, the screen space offset from where
+// the surface was in the last frame to where it is now. TAA reprojects its
+// history along them
+
+layout (location = 0) in vec4 inClipPos;
+layout (location = 1) in vec4 inPreviousClipPos;
+
+layout (location = 0) out vec2 outVelocity;
+
+void main()
+{
+	// In UV units, NDC spans two of them
+	vec2 position = inClipPos.xy / inClipPos.w;
+	vec2 previousPosition = inPreviousClipPos.xy / inPreviousClipPos.w;
+	outVelocity = (position - previousPosition) * 0.5;
+}
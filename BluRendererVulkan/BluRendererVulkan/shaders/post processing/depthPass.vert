@@ -1,34 +1,69 @@
 #version 450
 
+// Camera depth prepass. The position has to match pbr.vert bit for bit, the
+// scene pass tests opaque geometry for equal depth. Also passes where the
+// vertex was in the last frame on for the motion vectors, without the jitter
+
 layout (location = 0) in vec3 inPos;
+layout (location = 4) in uvec4 inJoint0;
+layout (location = 5) in vec4 inWeight0;
 
-layout (binding = 0) uniform UBO
+// Scene UBO, bound next to the depth pass matrices
+layout (set = 0, binding = 1) uniform UBO
 {
-	mat4 depthMVP[4];
+	mat4 model[16];
+	mat4 cascadeViewProj[4];
+	vec4 cascadeSplits;
+	mat4 projection;
+	mat4 view;
+	vec4 camPos;
+	vec2 screenSize;
+	// Camera without the jitter of this frame and the last one
+	mat4 viewProjection;
+	mat4 previousViewProjection;
+	mat4 previousModel[16];
 } ubo;
 
-layout (set = 0, binding = 1) uniform mUBO 
-{
-	mat4 models[16];
-} mUbo;
+#define MAX_NUM_JOINTS 128
+
+layout (set = 1, binding = 0) uniform UBONode {
+	mat4 matrix;
+	mat4 jointMatrix[MAX_NUM_JOINTS];
+	uint jointCount;
+} node;
 
 layout (push_constant) uniform PushConstants {
-	int depthMVPIndex;
+	int materialIndex;
 	int transformIndex;
 } pushConstants;
 
-layout (set = 1, binding = 0) uniform UBONode {
-	mat4 matrix;
-} uboNode;
+layout (location = 0) out vec4 outClipPos;
+layout (location = 1) out vec4 outPreviousClipPos;
 
-out gl_PerVertex
-{
-    vec4 gl_Position;
-};
+invariant gl_Position;
 
 void main()
 {
-	vec4 locPos = mUbo.models[pushConstants.transformIndex] * vec4(inPos, 1.0);
-	//vec3 pos = locPos.xyz / locPos.w;
-	gl_Position =  ubo.depthMVP[pushConstants.depthMVPIndex] * locPos;
-}
\ No newline at end of file
+	vec4 locPos;
+	vec4 previousPos;
+	if (node.jointCount > 0) {
+		// Mesh is skinned
+		mat4 skinMat = 
+			inWeight0.x * node.jointMatrix[inJoint0.x] +
+			inWeight0.y * node.jointMatrix[inJoint0.y] +
+			inWeight0.z * node.jointMatrix[inJoint0.z] +
+			inWeight0.w * node.jointMatrix[inJoint0.w];
+
+		locPos = ubo.model[pushConstants.transformIndex] * node.matrix * skinMat * vec4(inPos, 1.0);
+		// The joints of the last frame are not kept, only the model moves
+		previousPos = ubo.previousModel[pushConstants.transformIndex] * node.matrix * skinMat * vec4(inPos, 1.0);
+	} else {
+		//Static model meshes are pre-transformed
+		locPos = ubo.model[pushConstants.transformIndex] * vec4(inPos, 1.0);
+		previousPos = ubo.previousModel[pushConstants.transformIndex] * vec4(inPos, 1.0);
+	}
+	vec3 worldPos = locPos.xyz / locPos.w;
+	gl_Position =  ubo.projection * ubo.view * vec4(worldPos, 1.0);
+	outClipPos = ubo.viewProjection * vec4(worldPos, 1.0);
+	outPreviousClipPos = ubo.previousViewProjection * vec4(previousPos.xyz / previousPos.w, 1.0);
+}
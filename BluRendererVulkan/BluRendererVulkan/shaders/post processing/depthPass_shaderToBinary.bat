@@ -1,2 +1,3 @@
 C:\VulkanSDK\1.3.261.1\Bin\glslc.exe depthPass.vert -o depthPass.vert.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe depthPass.frag -o depthPass.frag.spv
 pause
\ No newline at end of file
@@ -1,6 +1,14 @@
 C:\VulkanSDK\1.3.261.1\Bin\glslc.exe postProcessing.vert -o postProcessing.vert.spv
-C:\VulkanSDK\1.3.261.1\Bin\glslc.exe antiAliasing.frag -o antiAliasing.frag.spv
-C:\VulkanSDK\1.3.261.1\Bin\glslc.exe ambientOcclusion.vert -o ambientOcclusion.vert.spv
-C:\VulkanSDK\1.3.261.1\Bin\glslc.exe ambientOcclusion.frag -o ambientOcclusion.frag.spv
-C:\VulkanSDK\1.3.261.1\Bin\glslc.exe tonemapping.frag -o tonemapping.frag.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe ambientOcclusion.comp -o ambientOcclusion.comp.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe ambientOcclusionDownsample.comp -o ambientOcclusionDownsample.comp.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe ambientOcclusionHorizon.comp -o ambientOcclusionHorizon.comp.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe ambientOcclusionBlur.comp -o ambientOcclusionBlur.comp.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe ambientOcclusionResolve.comp -o ambientOcclusionResolve.comp.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe temporalAA.comp -o temporalAA.comp.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe bloomDownsample.comp -o bloomDownsample.comp.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe bloomUpsample.comp -o bloomUpsample.comp.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe luminanceHistogram.comp -o luminanceHistogram.comp.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe luminanceAverage.comp -o luminanceAverage.comp.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe postProcess.comp -o postProcess.comp.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe present.frag -o present.frag.spv
 pause
\ No newline at end of file
@@ -0,0 +1,9 @@
+#version 450
+
+#include "../includes/PostProcessing/postProcessingFragGeneric.glsl"
+
+// The post processed image is already tonemapped, it only has to reach the
+// swapchain under the UI
+void main() {
+	outColor = vec4(texture(screenTexture, fragTexCord).rgb, 0.0);
+}
@@ -2,9 +2,14 @@
 
 layout (location = 0) in vec3 inPos;
 
+// Set by the shader build, has to match MAX_DEPTHPASSES of the renderer
+#ifndef MAX_DEPTHPASSES
+#error MAX_DEPTHPASSES is not defined
+#endif
+
 layout (binding = 0) uniform UBO
 {
-	mat4 depthMVP[4];
+	mat4 depthMVP[MAX_DEPTHPASSES];
 } ubo;
 
 layout (set = 0, binding = 1) uniform mUBO 
@@ -1,2 +1,2 @@
-C:\VulkanSDK\1.3.261.1\Bin\glslc.exe shadow.vert -o shadow.vert.spv
+C:\VulkanSDK\1.3.261.1\Bin\glslc.exe shadow.vert -DMAX_DEPTHPASSES=69 -o shadow.vert.spv
 pause
\ No newline at end of file
@@ -1,8 +1,9 @@
 ﻿#include "BluRendererVulkan.h"
 
 #include <chrono>
+#include <cstring>
 #include <thread>
-#include "Render/Renderer/ForwardRenderer.hpp"
+#include "Render/Renderer/ForwardPlusRenderer.hpp"
 
 const float MINFRAMETIME = 0.01666f;
 
@@ -14,9 +15,28 @@ int main(int argc, char** argv) {
 }
 
 int BluRendererVulkan::run(int argc, char** argv) {
-  BaseRenderer* forwardRenderer = new ForwardRenderer();
-  forwardRenderer->start();
-  delete (forwardRenderer);	
+  // Clustered light culling is opt in, --forwardplus selects it.
+  // --pipelinecache <path> moves the pipeline cache file, an empty path
+  // disables it
+  bool forwardPlus = false;
+  const char* pipelineCachePath = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--forwardplus") == 0) {
+      forwardPlus = true;
+    } else if (strcmp(argv[i], "--pipelinecache") == 0 && i + 1 < argc) {
+      pipelineCachePath = argv[++i];
+    }
+  }
+
+  BaseRenderer* renderer = forwardPlus
+                               ? static_cast<BaseRenderer*>(
+                                     new ForwardPlusRenderer())
+                               : new ForwardRenderer();
+  if (pipelineCachePath != nullptr) {
+    renderer->setPipelineCachePath(pipelineCachePath);
+  }
+  renderer->start();
+  delete (renderer);
 
   return 0;
 }
\ No newline at end of file
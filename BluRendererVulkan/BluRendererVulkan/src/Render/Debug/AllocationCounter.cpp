@@ -0,0 +1,64 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+namespace vks {
+namespace debug {
+#ifdef BLU_COUNT_ALLOCATIONS
+static std::atomic<uint64_t> allocationCount{0};
+
+uint64_t getAllocationCount() {
+  return allocationCount.load(std::memory_order_relaxed);
+}
+bool isCountingAllocations() { return true; }
+#else
+uint64_t getAllocationCount() { return 0; }
+bool isCountingAllocations() { return false; }
+#endif
+}  // namespace debug
+}  // namespace vks
+
+#ifdef BLU_COUNT_ALLOCATIONS
+static void* countedAlloc(size_t size) {
+  vks::debug::allocationCount.fetch_add(1, std::memory_order_relaxed);
+  void* memory = malloc(size == 0 ? 1 : size);
+  if (!memory) throw std::bad_alloc();
+  return memory;
+}
+
+static void* countedAlignedAlloc(size_t size, std::align_val_t alignment) {
+  vks::debug::allocationCount.fetch_add(1, std::memory_order_relaxed);
+  void* memory =
+      _aligned_malloc(size == 0 ? 1 : size, static_cast<size_t>(alignment));
+  if (!memory) throw std::bad_alloc();
+  return memory;
+}
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void* operator new(size_t size, std::align_val_t alignment) {
+  return countedAlignedAlloc(size, alignment);
+}
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return countedAlignedAlloc(size, alignment);
+}
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept {
+  _aligned_free(memory);
+}
+void operator delete[](void* memory, std::align_val_t) noexcept {
+  _aligned_free(memory);
+}
+void operator delete(void* memory, size_t, std::align_val_t) noexcept {
+  _aligned_free(memory);
+}
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept {
+  _aligned_free(memory);
+}
+#endif
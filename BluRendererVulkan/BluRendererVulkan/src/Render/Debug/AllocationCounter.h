@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+// Build with BLU_COUNT_ALLOCATIONS defined to replace the global operator
+// new/delete with counting versions. The renderer uses this to check that the
+// steady state frame loop does not allocate from the heap
+namespace vks {
+namespace debug {
+// Number of global operator new calls since startup, 0 when not counting
+uint64_t getAllocationCount();
+bool isCountingAllocations();
+}  // namespace debug
+}  // namespace vks
@@ -218,42 +218,26 @@ void ParticleSystem::prepareCompute(BaseRenderer* baseRenderer) {
   VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, nullptr, 1,
                                            &computePipelineCreateInfo, nullptr,
                                            &computePipeline));
-
-  // Semaphore for compute & graphics sync
-  VkSemaphoreCreateInfo semaphoreCreateInfo =
-      vks::initializers::semaphoreCreateInfo();
-  VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCreateInfo,
-                                    nullptr, &computeSemaphore));
-  //buildComputeBuffer();
 }
 
-//Builds & Dispatches Compute
-void ParticleSystem::buildComputeBuffer(VkCommandBuffer cmdBuf, VkQueue queue) {
-  // Compute Shader updating particle Vertices
-  VkCommandBufferBeginInfo cmdBufInfo =
-      vks::initializers::commandBufferBeginInfo();
-
-  VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuf, &cmdBufInfo));
-
-  // Add memory barrier to ensure that the (graphics) vertex shader has fetched
-  // attributes before compute starts to write to the buffer
-  if (device->queueFamilyIndices.graphics !=
-      device->queueFamilyIndices.compute) {
-    VkBufferMemoryBarrier buffer_barrier = {
-        VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-        nullptr,
-        0,
-        VK_ACCESS_SHADER_WRITE_BIT,
-        device->queueFamilyIndices.graphics,
-        device->queueFamilyIndices.compute,
-        storageBuffer.buffer,
-        0,
-        storageBuffer.size};
-
-    vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1,
-                         &buffer_barrier, 0, nullptr);
-  }
+// Records the simulation step into a command buffer of the graphics queue,
+// the queue that draws the particles
+void ParticleSystem::recordCompute(VkCommandBuffer cmdBuf) {
+  // The vertex shader has to fetch the attributes before compute starts to
+  // write to the buffer
+  VkBufferMemoryBarrier buffer_barrier = {
+      VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      nullptr,
+      VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+      VK_ACCESS_SHADER_WRITE_BIT,
+      VK_QUEUE_FAMILY_IGNORED,
+      VK_QUEUE_FAMILY_IGNORED,
+      storageBuffer.buffer,
+      0,
+      storageBuffer.size};
+  vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1,
+                       &buffer_barrier, 0, nullptr);
 
   vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
   vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE,
@@ -261,42 +245,13 @@ void ParticleSystem::buildComputeBuffer(VkCommandBuffer cmdBuf, VkQueue queue) {
                           0);
   vkCmdDispatch(cmdBuf, info.particleCount / 256, 1, 1);
 
-  // Add barrier to ensure that compute shader has finished writing to the
-  // buffer Without this the (rendering) vertex shader may display incomplete
-  // results (partial data from last frame)
-  if (device->queueFamilyIndices.graphics !=
-      device->queueFamilyIndices.compute) {
-    VkBufferMemoryBarrier buffer_barrier = {
-        VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-        nullptr,
-        VK_ACCESS_SHADER_WRITE_BIT,
-        0,
-        device->queueFamilyIndices.compute,
-        device->queueFamilyIndices.graphics,
-        storageBuffer.buffer,
-        0,
-        storageBuffer.size};
-
-    vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1,
-                         &buffer_barrier, 0, nullptr);
-  }
-
-  vkEndCommandBuffer(cmdBuf);
-
-  // Wait for rendering finished
-  VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-
-  // Submit compute commands
-  VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
-  computeSubmitInfo.commandBufferCount = 1;
-  computeSubmitInfo.pCommandBuffers = &cmdBuf;
-  computeSubmitInfo.waitSemaphoreCount = 1;
-  computeSubmitInfo.pWaitSemaphores = &graphicsSemaphore;
-  computeSubmitInfo.pWaitDstStageMask = &waitStageMask;
-  computeSubmitInfo.signalSemaphoreCount = 1;
-  computeSubmitInfo.pSignalSemaphores = &computeSemaphore;
-  VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
+  // The compute shader has to finish writing before the vertex shader reads
+  // the buffer
+  buffer_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  buffer_barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+  vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1,
+                       &buffer_barrier, 0, nullptr);
 }
 
 void ParticleSystem::prepareStorageBuffer(VkQueue queue) {
@@ -46,9 +46,6 @@ class ParticleSystem {
   VkDescriptorSetLayout computeDescriptorSetLayout;
   VkDescriptorSet computeDescriptorSet;
 
-  VkSemaphore graphicsSemaphore;
-  VkSemaphore computeSemaphore;
-
   // UBO containing particle system parameters
   vks::Buffer computeUniformBuffer;
 
@@ -81,7 +78,7 @@ class ParticleSystem {
   void prepareGraphics(BaseRenderer* br);
   void prepareCommandBuffer();
   void prepareCompute(BaseRenderer* baseRenderer);
-  void buildComputeBuffer(VkCommandBuffer cmdBuf, VkQueue queue);
+  void recordCompute(VkCommandBuffer cmdBuf);
   void draw(VkCommandBuffer);
   void update();
 };
\ No newline at end of file
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "../ResourceManagement/VulkanResources/VulkanDevice.h"
+#include "../ResourceManagement/VulkanResources/VulkanInitializers.hpp"
+#include "../ResourceManagement/VulkanResources/VulkanTools.h"
+
+namespace vks {
+// Exposure from the luminance of the scene without a read back. A histogram
+// pass bins the log luminance of every pixel, each group in shared memory
+// before it adds its bins to the exposure buffer. A single group reduces the
+// histogram to the average luminance and adapts the luminance of the frames
+// before toward it. Post processing exposes for the adapted luminance straight
+// from the buffer.
+// The buffer carries the luminance from frame to frame, so there is only one
+// for all frames in flight. All passes touching it run on one queue, where
+// the barriers here also order them against the frames before. It starts
+// over whenever that queue changes
+class AutoExposure {
+ public:
+  // Matches luminanceHistogram.comp, one bin per invocation
+  static constexpr uint32_t GROUP_SIZE = 16;
+  static constexpr uint32_t BIN_COUNT = GROUP_SIZE * GROUP_SIZE;
+  // Log2 luminance covered by the histogram
+  static constexpr float MIN_LOG_LUMINANCE = -10.0f;
+  static constexpr float LOG_LUMINANCE_RANGE = 12.0f;
+  // Speed the exposure follows the scene with, per second
+  static constexpr float ADAPTATION_RATE = 1.5f;
+
+  void create(vks::VulkanDevice* vulkanDevice, uint32_t frameCount,
+              const VkPipelineShaderStageCreateInfo& histogramStage,
+              const VkPipelineShaderStageCreateInfo& averageStage) {
+    device = vulkanDevice;
+    descriptorSets.resize(frameCount);
+    // Every group adds its bins with atomics, the buffer stays in device
+    // memory. It is cleared by the first record()
+    VK_CHECK_RESULT(device->createBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer, sizeof(Exposure)));
+    createSampler();
+    createPipelines(histogramStage, averageStage);
+  }
+
+  void destroy() {
+    VkDevice logicalDevice = device->logicalDevice;
+    buffer.destroy();
+    vkDestroySampler(logicalDevice, sampler, nullptr);
+    for (VkPipeline pipeline : pipelines) {
+      vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+  }
+
+  // Called once per frame before record() with the queue the passes run on.
+  // The buffer is not handed over between queues, the frames in flight on
+  // the old one finish and the luminance adapts from scratch on the new one
+  void prepare(VkQueue passQueue) {
+    if (passQueue == queue) {
+      return;
+    }
+    if (queue != VK_NULL_HANDLE) {
+      VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+    }
+    queue = passQueue;
+    cleared = false;
+  }
+
+  // Bins the scene, in the shader read only layout, and adapts the luminance
+  // over deltaTime seconds. The buffer is ready for compute shaders after it
+  void record(VkCommandBuffer commandBuffer, uint32_t frame, VkImageView scene,
+              VkExtent2D extent, float deltaTime) {
+    if (!cleared) {
+      // Empty bins, the luminance of 0 is replaced by the first average
+      vkCmdFillBuffer(commandBuffer, buffer.buffer, 0, VK_WHOLE_SIZE, 0);
+      bufferBarrier(commandBuffer, VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT);
+      cleared = true;
+    }
+    VkDescriptorSet descriptorSet = descriptorSets[frame];
+    VkDescriptorImageInfo sceneInfo{sampler, scene,
+                                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkWriteDescriptorSet write = vks::initializers::writeDescriptorSet(
+        descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+        &sceneInfo);
+    vkUpdateDescriptorSets(device->logicalDevice, 1, &write, 0, nullptr);
+
+    const Params params = {MIN_LOG_LUMINANCE, LOG_LUMINANCE_RANGE,
+                           1.0f - std::exp(-deltaTime * ADAPTATION_RATE),
+                           extent.width * extent.height};
+    // After the frame before adapted the luminance and post processing read
+    // it, earlier submissions to the queue are part of the barrier
+    bufferBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, pipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Params),
+                       &params);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipelines[PIPELINE_HISTOGRAM]);
+    vkCmdDispatch(commandBuffer, (extent.width + GROUP_SIZE - 1) / GROUP_SIZE,
+                  (extent.height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+    bufferBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipelines[PIPELINE_AVERAGE]);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    bufferBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_ACCESS_SHADER_READ_BIT);
+  }
+
+  // Bins and the adapted luminance, see luminanceAverage.comp
+  const VkDescriptorBufferInfo& getDescriptor() const {
+    return buffer.descriptor;
+  }
+
+ private:
+  // Matches the buffer of the shaders
+  struct Exposure {
+    std::array<uint32_t, BIN_COUNT> histogram;
+    float luminance;
+  };
+
+  // Matches the push constants of luminanceAverage.comp, the histogram only
+  // reads the first two
+  struct Params {
+    float minLogLuminance;
+    float logLuminanceRange;
+    float adaptation;
+    uint32_t pixelCount;
+  };
+
+  enum Pipeline : uint32_t {
+    PIPELINE_HISTOGRAM,
+    PIPELINE_AVERAGE,
+    PIPELINE_COUNT
+  };
+
+  vks::VulkanDevice* device{nullptr};
+  std::vector<VkDescriptorSet> descriptorSets;
+  vks::Buffer buffer;
+  // Queue of the passes, the buffer is cleared on it once
+  VkQueue queue{VK_NULL_HANDLE};
+  bool cleared = false;
+
+  // Unfiltered, every pixel is read once
+  VkSampler sampler{VK_NULL_HANDLE};
+  VkDescriptorPool descriptorPool{VK_NULL_HANDLE};
+  VkDescriptorSetLayout descriptorSetLayout{VK_NULL_HANDLE};
+  VkPipelineLayout pipelineLayout{VK_NULL_HANDLE};
+  std::array<VkPipeline, PIPELINE_COUNT> pipelines{};
+
+  void createSampler() {
+    VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+    samplerCI.magFilter = VK_FILTER_NEAREST;
+    samplerCI.minFilter = VK_FILTER_NEAREST;
+    samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.maxAnisotropy = 1.0f;
+    samplerCI.minLod = 0.0f;
+    samplerCI.maxLod = 1.0f;
+    samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    VK_CHECK_RESULT(
+        vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &sampler));
+  }
+
+  void bufferBarrier(
+      VkCommandBuffer commandBuffer, VkAccessFlags srcAccess,
+      VkAccessFlags dstAccess,
+      VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) {
+    VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer.buffer;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, srcStages,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                         1, &barrier, 0, nullptr);
+  }
+
+  void createPipelines(const VkPipelineShaderStageCreateInfo& histogramStage,
+                       const VkPipelineShaderStageCreateInfo& averageStage) {
+    VkDevice logicalDevice = device->logicalDevice;
+    const uint32_t frameCount = static_cast<uint32_t>(descriptorSets.size());
+
+    std::vector<VkDescriptorPoolSize> poolSizes = {
+        vks::initializers::descriptorPoolSize(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frameCount),
+        vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                              frameCount)};
+    VkDescriptorPoolCreateInfo descriptorPoolCI =
+        vks::initializers::descriptorPoolCreateInfo(poolSizes, frameCount);
+    VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolCI,
+                                           nullptr, &descriptorPool));
+
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+        // Binding 0 : Scene color
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        // Binding 1 : Histogram and luminance
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1)};
+    VkDescriptorSetLayoutCreateInfo descriptorLayoutCI =
+        vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
+        logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayout));
+
+    std::vector<VkDescriptorSetLayout> setLayouts(frameCount,
+                                                  descriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo =
+        vks::initializers::descriptorSetAllocateInfo(
+            descriptorPool, setLayouts.data(), frameCount);
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo,
+                                             descriptorSets.data()));
+    for (VkDescriptorSet descriptorSet : descriptorSets) {
+      VkWriteDescriptorSet write = vks::initializers::writeDescriptorSet(
+          descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+          &buffer.descriptor);
+      vkUpdateDescriptorSets(logicalDevice, 1, &write, 0, nullptr);
+    }
+
+    VkPushConstantRange pushConstantRange =
+        vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT,
+                                             sizeof(Params), 0);
+    VkPipelineLayoutCreateInfo pipelineLayoutCI =
+        vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+    pipelineLayoutCI.pushConstantRangeCount = 1;
+    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCI,
+                                           nullptr, &pipelineLayout));
+
+    const std::array<VkPipelineShaderStageCreateInfo, PIPELINE_COUNT> stages =
+        {histogramStage, averageStage};
+    for (uint32_t i = 0; i < PIPELINE_COUNT; i++) {
+      VkComputePipelineCreateInfo pipelineCI =
+          vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+      pipelineCI.stage = stages[i];
+      VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice,
+                                               device->pipelineCache, 1,
+                                               &pipelineCI, nullptr,
+                                               &pipelines[i]));
+    }
+  }
+};
+}  // namespace vks
@@ -1,7 +1,10 @@
 #include "BaseRenderer.h"
 
+#include <filesystem>
+#include <fstream>
 #include <map>
 
+#include "../Debug/AllocationCounter.h"
 #include "../Debug/VulkanDebug.h"
 #include "../ResourceManagement/VulkanResources/VulkanTools.h"
 
@@ -37,16 +40,32 @@ BaseRenderer::~BaseRenderer() {
     vkDestroyShaderModule(device, shaderModule, nullptr);
   }
 
+  savePipelineCache();
   vkDestroyPipelineCache(device, pipelineCache, nullptr);
 
   vkFreeCommandBuffers(device, graphicsCmdPool,
                        static_cast<uint32_t>(drawCmdBuffers.size()),
                        drawCmdBuffers.data());
+  vkFreeCommandBuffers(device, graphicsCmdPool,
+                       static_cast<uint32_t>(presentCmdBuffers.size()),
+                       presentCmdBuffers.data());
+  vkFreeCommandBuffers(
+      device, graphicsCmdPool,
+      static_cast<uint32_t>(asyncCompute.preComputeCmdBuffers.size()),
+      asyncCompute.preComputeCmdBuffers.data());
+  vkFreeCommandBuffers(
+      device, graphicsCmdPool,
+      static_cast<uint32_t>(asyncCompute.concurrentCmdBuffers.size()),
+      asyncCompute.concurrentCmdBuffers.data());
   vkDestroyCommandPool(device, graphicsCmdPool, nullptr);
 
   vkFreeCommandBuffers(device, computeCmdPool,
                        static_cast<uint32_t>(computeCmdBuffers.size()),
                        computeCmdBuffers.data());
+  vkFreeCommandBuffers(
+      device, computeCmdPool,
+      static_cast<uint32_t>(asyncCompute.postComputeCmdBuffers.size()),
+      asyncCompute.postComputeCmdBuffers.data());
   vkDestroyCommandPool(device, computeCmdPool, nullptr);
 
   destroySynchronizationPrimitives();
@@ -197,10 +216,75 @@ VkPipelineShaderStageCreateInfo BaseRenderer::loadShader(
 }
 
 void BaseRenderer::createPipelineCache() {
+  const std::vector<char> cacheData = loadPipelineCacheData();
   VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
   pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  pipelineCacheCreateInfo.initialDataSize = cacheData.size();
+  pipelineCacheCreateInfo.pInitialData = cacheData.data();
   VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo,
                                         nullptr, &pipelineCache));
+  vulkanDevice->pipelineCache = pipelineCache;
+}
+
+std::vector<char> BaseRenderer::loadPipelineCacheData() {
+  if (settings.pipelineCachePath.empty()) return {};
+  std::ifstream file(settings.pipelineCachePath,
+                     std::ios::binary | std::ios::ate);
+  if (!file.is_open()) return {};
+  std::vector<char> data(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  if (!file.read(data.data(), data.size())) return {};
+
+  // Drivers should reject a foreign cache themselves, not all of them do
+  VkPipelineCacheHeaderVersionOne header{};
+  if (data.size() < sizeof(header)) return {};
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.headerSize < sizeof(header) || header.headerSize > data.size() ||
+      header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      header.vendorID != deviceProperties.vendorID ||
+      header.deviceID != deviceProperties.deviceID ||
+      memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID,
+             VK_UUID_SIZE) != 0) {
+    std::cerr << "Pipeline cache \"" << settings.pipelineCachePath
+              << "\" does not match the device, starting empty\n";
+    return {};
+  }
+  return data;
+}
+
+void BaseRenderer::savePipelineCache() {
+  if (settings.pipelineCachePath.empty() || pipelineCache == VK_NULL_HANDLE) {
+    return;
+  }
+  size_t size = 0;
+  if (vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) !=
+          VK_SUCCESS ||
+      size == 0) {
+    return;
+  }
+  std::vector<char> data(size);
+  if (vkGetPipelineCacheData(device, pipelineCache, &size, data.data()) !=
+      VK_SUCCESS) {
+    return;
+  }
+
+  const std::string tempPath = settings.pipelineCachePath + ".tmp";
+  std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+  file.write(data.data(), size);
+  file.close();
+  std::error_code error;
+  if (file.fail()) {
+    std::filesystem::remove(tempPath, error);
+    return;
+  }
+  // Replaces the old cache in one step
+  std::filesystem::rename(tempPath, settings.pipelineCachePath, error);
+  if (error) {
+    std::cerr << "Could not save the pipeline cache to \""
+              << settings.pipelineCachePath << "\": " << error.message()
+              << "\n";
+    std::filesystem::remove(tempPath, error);
+  }
 }
 
 void BaseRenderer::setupFrameBuffer() {
@@ -244,7 +328,8 @@ void BaseRenderer::setupRenderPass() {
   attachments[1].format = depthFormat;
   attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
   attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  // Never read after the pass, so it can stay in tile memory
+  attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
   attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -315,7 +400,8 @@ void BaseRenderer::setupDepthStencil() {
   imageCI.arrayLayers = 1;
   imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
   imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-  imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                  VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
 
   VK_CHECK_RESULT(
       vkCreateImage(device, &imageCI, nullptr, &depthStencil.image));
@@ -325,8 +411,8 @@ void BaseRenderer::setupDepthStencil() {
   VkMemoryAllocateInfo memAllloc{};
   memAllloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
   memAllloc.allocationSize = memReqs.size;
-  memAllloc.memoryTypeIndex = vulkanDevice->getMemoryType(
-      memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  memAllloc.memoryTypeIndex =
+      vulkanDevice->getTransientAttachmentMemoryType(memReqs.memoryTypeBits);
   VK_CHECK_RESULT(
       vkAllocateMemory(device, &memAllloc, nullptr, &depthStencil.memory));
   VK_CHECK_RESULT(
@@ -352,9 +438,14 @@ void BaseRenderer::setupDepthStencil() {
 }
 
 void BaseRenderer::createSynchronizationPrimitives() {
-  semaphores.imageAvailableSemaphores.resize(swapChain.imageCount);
+  semaphores.imageAvailableSemaphores.resize(maxFramesInFlight);
+  semaphores.inFlightFences.resize(maxFramesInFlight);
+  asyncCompute.graphicsFinished.resize(maxFramesInFlight);
+  asyncCompute.computeFinished.resize(maxFramesInFlight);
+  asyncCompute.drawFinished.resize(maxFramesInFlight);
+  asyncCompute.postComputeFinished.resize(maxFramesInFlight);
   semaphores.renderFinishedSemaphores.resize(swapChain.imageCount);
-  semaphores.inFlightFences.resize(swapChain.imageCount);
+  semaphores.imagesInFlight.assign(swapChain.imageCount, VK_NULL_HANDLE);
 
   VkSemaphoreCreateInfo semaphoreInfo{};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -363,26 +454,46 @@ void BaseRenderer::createSynchronizationPrimitives() {
   fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-  for (size_t i = 0; i < swapChain.imageCount; i++) {
+  for (size_t i = 0; i < maxFramesInFlight; i++) {
     if (vkCreateSemaphore(device, &semaphoreInfo, nullptr,
                           &semaphores.imageAvailableSemaphores[i]) !=
             VK_SUCCESS ||
-        vkCreateSemaphore(device, &semaphoreInfo, nullptr,
-                          &semaphores.renderFinishedSemaphores[i]) !=
-            VK_SUCCESS ||
         vkCreateFence(device, &fenceInfo, nullptr,
-                      &semaphores.inFlightFences[i]) != VK_SUCCESS) {
+                      &semaphores.inFlightFences[i]) != VK_SUCCESS ||
+        vkCreateSemaphore(device, &semaphoreInfo, nullptr,
+                          &asyncCompute.graphicsFinished[i]) != VK_SUCCESS ||
+        vkCreateSemaphore(device, &semaphoreInfo, nullptr,
+                          &asyncCompute.computeFinished[i]) != VK_SUCCESS ||
+        vkCreateSemaphore(device, &semaphoreInfo, nullptr,
+                          &asyncCompute.drawFinished[i]) != VK_SUCCESS ||
+        vkCreateSemaphore(device, &semaphoreInfo, nullptr,
+                          &asyncCompute.postComputeFinished[i]) != VK_SUCCESS) {
       throw std::runtime_error(
           "failed to create synchronization objects for a frame!");
     }
   }
+  // The presentation engine waits on these, so they belong to the image
+  for (size_t i = 0; i < swapChain.imageCount; i++) {
+    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr,
+                          &semaphores.renderFinishedSemaphores[i]) !=
+        VK_SUCCESS) {
+      throw std::runtime_error(
+          "failed to create synchronization objects for an image!");
+    }
+  }
 }
 
 void BaseRenderer::destroySynchronizationPrimitives() {
-  for (size_t i = 0; i < swapChain.imageCount; i++) {
-    vkDestroySemaphore(device, semaphores.renderFinishedSemaphores[i], nullptr);
+  for (size_t i = 0; i < semaphores.inFlightFences.size(); i++) {
     vkDestroySemaphore(device, semaphores.imageAvailableSemaphores[i], nullptr);
     vkDestroyFence(device, semaphores.inFlightFences[i], nullptr);
+    vkDestroySemaphore(device, asyncCompute.graphicsFinished[i], nullptr);
+    vkDestroySemaphore(device, asyncCompute.computeFinished[i], nullptr);
+    vkDestroySemaphore(device, asyncCompute.drawFinished[i], nullptr);
+    vkDestroySemaphore(device, asyncCompute.postComputeFinished[i], nullptr);
+  }
+  for (size_t i = 0; i < semaphores.renderFinishedSemaphores.size(); i++) {
+    vkDestroySemaphore(device, semaphores.renderFinishedSemaphores[i], nullptr);
   }
 }
 
@@ -396,15 +507,18 @@ void BaseRenderer::createCommandPools() {
 
   VkCommandPoolCreateInfo computeCmdPoolInfo = {};
   computeCmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  computeCmdPoolInfo.queueFamilyIndex = swapChain.computeQueueNodeIndex;
+  // Must match the family computeQueue was taken from, which prefers a
+  // dedicated compute family
+  computeCmdPoolInfo.queueFamilyIndex =
+      vulkanDevice->queueFamilyIndices.compute;
   computeCmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
   VK_CHECK_RESULT(vkCreateCommandPool(device, &computeCmdPoolInfo, nullptr,
                                       &computeCmdPool));
 }
 
 void BaseRenderer::createCommandBuffers() {
-  // Create one command buffer for each swap chain image and reuse for rendering
-  drawCmdBuffers.resize(swapChain.imageCount);
+  // Create one command buffer for each frame in flight and reuse for rendering
+  drawCmdBuffers.resize(maxFramesInFlight);
 
   VkCommandBufferAllocateInfo graphicsCmdBufAllocateInfo =
       vks::initializers::commandBufferAllocateInfo(
@@ -413,7 +527,18 @@ void BaseRenderer::createCommandBuffers() {
 
   VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &graphicsCmdBufAllocateInfo,
                                            drawCmdBuffers.data()));
-  computeCmdBuffers.resize(swapChain.imageCount);
+  presentCmdBuffers.resize(maxFramesInFlight);
+  VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &graphicsCmdBufAllocateInfo,
+                                           presentCmdBuffers.data()));
+  asyncCompute.preComputeCmdBuffers.resize(maxFramesInFlight);
+  VK_CHECK_RESULT(vkAllocateCommandBuffers(
+      device, &graphicsCmdBufAllocateInfo,
+      asyncCompute.preComputeCmdBuffers.data()));
+  asyncCompute.concurrentCmdBuffers.resize(maxFramesInFlight);
+  VK_CHECK_RESULT(vkAllocateCommandBuffers(
+      device, &graphicsCmdBufAllocateInfo,
+      asyncCompute.concurrentCmdBuffers.data()));
+  computeCmdBuffers.resize(maxFramesInFlight);
 
   VkCommandBufferAllocateInfo computeCmdBufAllocateInfo =
       vks::initializers::commandBufferAllocateInfo(
@@ -422,15 +547,34 @@ void BaseRenderer::createCommandBuffers() {
 
   VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &computeCmdBufAllocateInfo,
                                            computeCmdBuffers.data()));
+  asyncCompute.postComputeCmdBuffers.resize(maxFramesInFlight);
+  VK_CHECK_RESULT(vkAllocateCommandBuffers(
+      device, &computeCmdBufAllocateInfo,
+      asyncCompute.postComputeCmdBuffers.data()));
 }
 
 void BaseRenderer::destroyCommandBuffers() {
   vkFreeCommandBuffers(device, graphicsCmdPool,
                        static_cast<uint32_t>(drawCmdBuffers.size()),
                        drawCmdBuffers.data());
+  vkFreeCommandBuffers(device, graphicsCmdPool,
+                       static_cast<uint32_t>(presentCmdBuffers.size()),
+                       presentCmdBuffers.data());
+  vkFreeCommandBuffers(
+      device, graphicsCmdPool,
+      static_cast<uint32_t>(asyncCompute.preComputeCmdBuffers.size()),
+      asyncCompute.preComputeCmdBuffers.data());
+  vkFreeCommandBuffers(
+      device, graphicsCmdPool,
+      static_cast<uint32_t>(asyncCompute.concurrentCmdBuffers.size()),
+      asyncCompute.concurrentCmdBuffers.data());
   vkFreeCommandBuffers(device, computeCmdPool,
                        static_cast<uint32_t>(computeCmdBuffers.size()),
                        computeCmdBuffers.data());
+  vkFreeCommandBuffers(
+      device, computeCmdPool,
+      static_cast<uint32_t>(asyncCompute.postComputeCmdBuffers.size()),
+      asyncCompute.postComputeCmdBuffers.data());
 }
 
 bool BaseRenderer::initVulkan() {
@@ -576,6 +720,7 @@ void BaseRenderer::prepare() {
 
 void BaseRenderer::nextFrame() {
   auto tStart = std::chrono::high_resolution_clock::now();
+  const uint64_t allocationsBefore = vks::debug::getAllocationCount();
   if (viewUpdated) {
     viewUpdated = false;
   }
@@ -583,7 +728,7 @@ void BaseRenderer::nextFrame() {
   polledEvents(window->getWindow());
   render();
   frameCounter++;
-  currentFrameIndex = (currentFrameIndex + 1) % swapChain.imageCount;
+  currentFrameIndex = (currentFrameIndex + 1) % maxFramesInFlight;
   auto tEnd = std::chrono::high_resolution_clock::now();
   auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
 
@@ -609,8 +754,24 @@ void BaseRenderer::nextFrame() {
     lastTimestamp = tEnd;
   }
   tPrevEnd = tEnd;
+
+  // Per frame containers keep their capacity and need a few frames to reach
+  // their high water mark, after that a frame must not touch the heap
+  if (vks::debug::isCountingAllocations() && prepared) {
+    const uint32_t warmupFrames = 64;
+    const uint64_t allocations =
+        vks::debug::getAllocationCount() - allocationsBefore;
+    if (steadyStateFrames >= warmupFrames && allocations != 0) {
+      std::cerr << "Frame allocated " << allocations
+                << " times from the heap in steady state" << std::endl;
+      assert(allocations == 0);
+    }
+    steadyStateFrames++;
+  }
 }
 
+void BaseRenderer::resetSteadyState() { steadyStateFrames = 0; }
+
 void BaseRenderer::renderLoop() {
   lastTimestamp = std::chrono::high_resolution_clock::now();
   tPrevEnd = lastTimestamp;
@@ -655,32 +816,120 @@ void BaseRenderer::prepareFrame() {
     VK_CHECK_RESULT(result);
   }
 
+  // With more frames in flight than swapchain images an image can come back
+  // while an older frame still renders to it
+  VkFence& imageFence = semaphores.imagesInFlight[currentImageIndex];
+  if (imageFence != VK_NULL_HANDLE &&
+      imageFence != semaphores.inFlightFences[currentFrameIndex]) {
+    vkWaitForFences(device, 1, &imageFence, VK_TRUE, UINT64_MAX);
+  }
+  imageFence = semaphores.inFlightFences[currentFrameIndex];
+
   vkResetFences(device, 1, &semaphores.inFlightFences[currentFrameIndex]);
 }
 
-void BaseRenderer::submitFrame() {
-  VkSubmitInfo submitInfo{};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+void BaseRenderer::submitAsyncCompute() {
+  // The compute batch waits on the first graphics batch, the second one runs
+  // next to it
+  VkSubmitInfo graphicsSubmitInfos[2] = {vks::initializers::submitInfo(),
+                                         vks::initializers::submitInfo()};
+  graphicsSubmitInfos[0].commandBufferCount = 1;
+  graphicsSubmitInfos[0].pCommandBuffers =
+      &asyncCompute.preComputeCmdBuffers[currentFrameIndex];
+  graphicsSubmitInfos[0].signalSemaphoreCount = 1;
+  graphicsSubmitInfos[0].pSignalSemaphores =
+      &asyncCompute.graphicsFinished[currentFrameIndex];
+  graphicsSubmitInfos[1].commandBufferCount = 1;
+  graphicsSubmitInfos[1].pCommandBuffers =
+      &asyncCompute.concurrentCmdBuffers[currentFrameIndex];
+  VK_CHECK_RESULT(
+      vkQueueSubmit(graphicsQueue, 2, graphicsSubmitInfos, VK_NULL_HANDLE));
+
+  const VkPipelineStageFlags computeWaitStage =
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
+  computeSubmitInfo.waitSemaphoreCount = 1;
+  computeSubmitInfo.pWaitSemaphores =
+      &asyncCompute.graphicsFinished[currentFrameIndex];
+  computeSubmitInfo.pWaitDstStageMask = &computeWaitStage;
+  computeSubmitInfo.commandBufferCount = 1;
+  computeSubmitInfo.pCommandBuffers = &computeCmdBuffers[currentFrameIndex];
+  computeSubmitInfo.signalSemaphoreCount = 1;
+  computeSubmitInfo.pSignalSemaphores =
+      &asyncCompute.computeFinished[currentFrameIndex];
+  VK_CHECK_RESULT(
+      vkQueueSubmit(computeQueue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
+}
 
-  VkSemaphore waitSemaphores[] = {
-      semaphores.imageAvailableSemaphores[currentFrameIndex]};
-  VkPipelineStageFlags waitStages[] = {
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = waitSemaphores;
-  submitInfo.pWaitDstStageMask = waitStages;
+void BaseRenderer::submitPostCompute() {
+  VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
+  const VkPipelineStageFlags computeWaitStage =
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  computeSubmitInfo.waitSemaphoreCount = 1;
+  computeSubmitInfo.pWaitSemaphores =
+      &asyncCompute.drawFinished[currentFrameIndex];
+  computeSubmitInfo.pWaitDstStageMask = &computeWaitStage;
+  computeSubmitInfo.commandBufferCount = 1;
+  computeSubmitInfo.pCommandBuffers =
+      &asyncCompute.postComputeCmdBuffers[currentFrameIndex];
+  computeSubmitInfo.signalSemaphoreCount = 1;
+  computeSubmitInfo.pSignalSemaphores =
+      &asyncCompute.postComputeFinished[currentFrameIndex];
+  VK_CHECK_RESULT(
+      vkQueueSubmit(computeQueue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
+}
 
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &drawCmdBuffers[currentFrameIndex];
+void BaseRenderer::submitFrame() {
+  // Only the present batch waits for the swapchain image, the frame before it
+  // starts right away
+  VkSubmitInfo submitInfos[2] = {vks::initializers::submitInfo(),
+                                 vks::initializers::submitInfo()};
+  submitInfos[0].commandBufferCount = 1;
+  submitInfos[0].pCommandBuffers = &drawCmdBuffers[currentFrameIndex];
+
+  VkSemaphore presentWaitSemaphores[2] = {
+      semaphores.imageAvailableSemaphores[currentFrameIndex], VK_NULL_HANDLE};
+  const VkPipelineStageFlags presentWaitStages[2] = {
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      asyncCompute.presentWaitStages};
+  VkSubmitInfo* graphicsSubmitInfos = submitInfos;
+  uint32_t graphicsSubmitCount = 2;
+  if (asyncCompute.enabled) {
+    submitAsyncCompute();
+    submitInfos[0].waitSemaphoreCount = 1;
+    submitInfos[0].pWaitSemaphores =
+        &asyncCompute.computeFinished[currentFrameIndex];
+    submitInfos[0].pWaitDstStageMask = &asyncCompute.waitStages;
+    // The signal has to be submitted before the post compute batch waits on
+    // it, present goes in a submission of its own
+    submitInfos[0].signalSemaphoreCount = 1;
+    submitInfos[0].pSignalSemaphores =
+        &asyncCompute.drawFinished[currentFrameIndex];
+    VK_CHECK_RESULT(
+        vkQueueSubmit(graphicsQueue, 1, &submitInfos[0], VK_NULL_HANDLE));
+    submitPostCompute();
+    presentWaitSemaphores[1] =
+        asyncCompute.postComputeFinished[currentFrameIndex];
+    graphicsSubmitInfos = &submitInfos[1];
+    graphicsSubmitCount = 1;
+  }
+
+  submitInfos[1].waitSemaphoreCount = asyncCompute.enabled ? 2 : 1;
+  submitInfos[1].pWaitSemaphores = presentWaitSemaphores;
+  submitInfos[1].pWaitDstStageMask = presentWaitStages;
+  submitInfos[1].commandBufferCount = 1;
+  submitInfos[1].pCommandBuffers = &presentCmdBuffers[currentFrameIndex];
 
   VkSemaphore signalSemaphores[] = {
-      semaphores.renderFinishedSemaphores[currentFrameIndex]};
-  submitInfo.signalSemaphoreCount = 1;
-  submitInfo.pSignalSemaphores = signalSemaphores;
-  VK_CHECK_RESULT(vkQueueSubmit(graphicsQueue, 1, &submitInfo,
+      semaphores.renderFinishedSemaphores[currentImageIndex]};
+  submitInfos[1].signalSemaphoreCount = 1;
+  submitInfos[1].pSignalSemaphores = signalSemaphores;
+  // Present waits on every batch of the frame, its fence covers them all
+  VK_CHECK_RESULT(vkQueueSubmit(graphicsQueue, graphicsSubmitCount,
+                                graphicsSubmitInfos,
                                 semaphores.inFlightFences[currentFrameIndex]));
 
-  VkResult result = swapChain.queuePresent(graphicsQueue, currentFrameIndex,
+  VkResult result = swapChain.queuePresent(graphicsQueue, currentImageIndex,
                                            signalSemaphores);
   // Recreate the swapchain if it's no longer compatible with the surface
   // (OUT_OF_DATE) or no longer optimal for presentation (SUBOPTIMAL)
@@ -783,6 +1032,7 @@ void BaseRenderer::polledEvents(GLFWwindow* window) {
 
 void BaseRenderer::buildCommandBuffer() {
   vkResetCommandBuffer(drawCmdBuffers[currentFrameIndex], 0);
+  vkResetCommandBuffer(presentCmdBuffers[currentFrameIndex], 0);
 }
 
 void BaseRenderer::windowResize() {
@@ -791,6 +1041,7 @@ void BaseRenderer::windowResize() {
   }
   prepared = false;
   resized = true;
+  resetSteadyState();
   currentFrameIndex = 0;
   // Ensure all operations on the device have been finished before destroying
   // resources
@@ -874,6 +1125,12 @@ uint32_t BaseRenderer::getWidth() { return width; }
 
 uint32_t BaseRenderer::getHeight() { return height; }
 
+uint32_t BaseRenderer::getMaxFramesInFlight() { return maxFramesInFlight; }
+
+void BaseRenderer::setPipelineCachePath(const std::string& path) {
+  settings.pipelineCachePath = path;
+}
+
 void BaseRenderer::windowResized() {}
 
 void BaseRenderer::getEnabledFeatures() {}
@@ -52,6 +52,9 @@ class BaseRenderer {
 
   // Debug
   uint32_t lastFPS = 0;
+  // Frames rendered since the last resize/resource change, used to decide
+  // when the frame loop is expected to be allocation free
+  uint32_t steadyStateFrames = 0;
   std::chrono::time_point<std::chrono::high_resolution_clock> lastTimestamp,
       tPrevEnd;
 
@@ -68,6 +71,12 @@ class BaseRenderer {
   void windowResize();
   VkResult createInstance();
   void handleMouseMove(int32_t x, int32_t y);
+  // Contents of the pipeline cache file, empty when it is missing or was
+  // written by another driver or device
+  std::vector<char> loadPipelineCacheData();
+  // Writes a temporary file and renames it over the cache file, an
+  // interrupted write leaves the cache of the last run
+  void savePipelineCache();
 
   // Entry point for the main render loop
   void renderLoop();
@@ -106,8 +115,16 @@ class BaseRenderer {
   VkPipelineStageFlags submitPipelineStages =
       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
   std::vector<VkCommandBuffer> drawCmdBuffers;
+  // Only the work on the acquired swapchain image, submitted after
+  // drawCmdBuffers so the wait for the image does not hold the frame up
+  std::vector<VkCommandBuffer> presentCmdBuffers;
   std::vector<VkCommandBuffer> computeCmdBuffers;
   std::vector<VkFramebuffer> frameBuffers;
+  // Frames the CPU may record ahead of the GPU. Per frame resources (command
+  // buffers, uniform buffers, descriptor sets, offscreen targets) are rings of
+  // this size indexed by currentFrameIndex, only the swapchain framebuffers
+  // are indexed by currentImageIndex. Set before prepare()
+  uint32_t maxFramesInFlight = 2;
   uint32_t currentFrameIndex = 0;
   uint32_t currentImageIndex = 0;
   VkDescriptorPool descriptorPool{VK_NULL_HANDLE};
@@ -125,11 +142,38 @@ class BaseRenderer {
 
   // Synchronization semaphores
   struct {
+    // Per frame in flight
     std::vector<VkSemaphore> imageAvailableSemaphores;
-    std::vector<VkSemaphore> renderFinishedSemaphores;
     std::vector<VkFence> inFlightFences;
+    // Per swapchain image
+    std::vector<VkSemaphore> renderFinishedSemaphores;
+    // Fence of the frame that last rendered to a swapchain image, not owned
+    std::vector<VkFence> imagesInFlight;
   } semaphores;
 
+  // Splits a frame into batches so computeCmdBuffers run on computeQueue next
+  // to graphics work. The compute batch waits on the pre compute batch, the
+  // concurrent batch overlaps with it and drawCmdBuffers wait on it at
+  // waitStages. postComputeCmdBuffers go to computeQueue after
+  // drawCmdBuffers, presentCmdBuffers wait on them at presentWaitStages. All
+  // command buffers are per frame in flight
+  struct {
+    // Set by the renderer for the frame being recorded
+    bool enabled = false;
+    std::vector<VkCommandBuffer> preComputeCmdBuffers;
+    std::vector<VkCommandBuffer> concurrentCmdBuffers;
+    std::vector<VkCommandBuffer> postComputeCmdBuffers;
+    std::vector<VkSemaphore> graphicsFinished;
+    std::vector<VkSemaphore> computeFinished;
+    std::vector<VkSemaphore> drawFinished;
+    std::vector<VkSemaphore> postComputeFinished;
+    VkPipelineStageFlags waitStages =
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    VkPipelineStageFlags presentWaitStages =
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  } asyncCompute;
+
   struct Settings {
     // Activates validation layers (and message output) when set to true
     bool validation = true;
@@ -139,6 +183,9 @@ class BaseRenderer {
     bool vsync = false;
     // Enable UI overlay
     bool overlay = true;
+    // Pipeline cache loaded at startup and saved on exit, empty keeps it in
+    // memory only
+    std::string pipelineCachePath = "pipelineCache.bin";
   } settings;
 
   // State of mouse/touch input
@@ -189,7 +236,16 @@ class BaseRenderer {
   void prepareFrame();
   // Presents the current image to the swap chain
   void submitFrame();
+  // Submits the graphics batches the compute batch overlaps with and the
+  // compute batch itself, drawCmdBuffers, the post compute batch and
+  // presentCmdBuffers follow in submitFrame()
+  void submitAsyncCompute();
+  // Submits postComputeCmdBuffers once drawCmdBuffers were submitted
+  void submitPostCompute();
   void setSampleCount(VkSampleCountFlagBits);
+  // Restarts the warm up before the frame loop is checked for heap
+  // allocations, call after loading or recreating resources
+  void resetSteadyState();
 
  public:
   BaseRenderer();
@@ -202,6 +258,9 @@ class BaseRenderer {
   const char* getTitle();
   uint32_t getWidth();
   uint32_t getHeight();
+  uint32_t getMaxFramesInFlight();
+  // Set before start()
+  void setPipelineCachePath(const std::string& path);
 
   float frameTimer = 1.0f;
 
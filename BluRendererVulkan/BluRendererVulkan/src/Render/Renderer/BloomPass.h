@@ -0,0 +1,311 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "../ResourceManagement/VulkanResources/VulkanDevice.h"
+#include "../ResourceManagement/VulkanResources/VulkanInitializers.hpp"
+#include "../ResourceManagement/VulkanResources/VulkanTools.h"
+
+namespace vks {
+// Bloom of the linear scene as compute passes. A single dispatch downsamples
+// the scene into a chain of MIP_COUNT mips, every group reduces a 64x64 tile
+// through shared memory like DepthPyramid. The upsample walks back up the
+// chain, every mip adds the tent filtered mip below it, so mip 0 ends up with
+// the bloom of all of them and post processing only samples that one.
+// There is one chain per frame in flight, imported into the render graph and
+// written from scratch every frame
+class BloomPass {
+ public:
+  // Matches bloomDownsample.comp and BLOOM_MIP_COUNT of postProcess.comp
+  static constexpr uint32_t MIP_COUNT = 6;
+  static constexpr uint32_t GROUP_SIZE = 16;
+  // Scene pixels per downsample group and dimension
+  static constexpr uint32_t TILE_SIZE = GROUP_SIZE * 4;
+  // Matches local_size of bloomUpsample.comp
+  static constexpr uint32_t UPSAMPLE_GROUP_SIZE = 8;
+  // RGBA16F is a required storage format, the bloom needs the range
+  static constexpr VkFormat FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+  // Share of the bloom in the scene
+  static constexpr float DEFAULT_STRENGTH = 0.04f;
+
+  void create(vks::VulkanDevice* vulkanDevice, uint32_t frameCount,
+              const VkPipelineShaderStageCreateInfo& downsampleStage,
+              const VkPipelineShaderStageCreateInfo& upsampleStage,
+              VkExtent2D sceneExtent) {
+    device = vulkanDevice;
+    frames.resize(frameCount);
+    createSampler();
+    createPipelines(downsampleStage, upsampleStage);
+    resize(sceneExtent);
+  }
+
+  // Recreates the chains for a scene of a new size, the device has to be idle
+  void resize(VkExtent2D sceneExtent) {
+    if (sceneExtent.width == this->sceneExtent.width &&
+        sceneExtent.height == this->sceneExtent.height) {
+      return;
+    }
+    destroyImages();
+    this->sceneExtent = sceneExtent;
+    for (Frame& frame : frames) {
+      createImage(frame);
+    }
+  }
+
+  void destroy() {
+    VkDevice logicalDevice = device->logicalDevice;
+    destroyImages();
+    vkDestroySampler(logicalDevice, sampler, nullptr);
+    for (VkPipeline pipeline : pipelines) {
+      vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+  }
+
+  // Reads the scene in the shader read only layout and writes every mip,
+  // expected in the general layout. The mips are only read by later
+  // dispatches of the pass, the barriers between them are placed here
+  void record(VkCommandBuffer commandBuffer, uint32_t frameIndex,
+              VkImageView scene) {
+    Frame& frame = frames[frameIndex];
+    VkDescriptorImageInfo sceneInfo{sampler, scene,
+                                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkWriteDescriptorSet write = vks::initializers::writeDescriptorSet(
+        frame.descriptorSets[0], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+        &sceneInfo);
+    vkUpdateDescriptorSets(device->logicalDevice, 1, &write, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipelines[PIPELINE_DOWNSAMPLE]);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayout, 0, 1, &frame.descriptorSets[0], 0,
+                            nullptr);
+    vkCmdDispatch(commandBuffer,
+                  (sceneExtent.width + TILE_SIZE - 1) / TILE_SIZE,
+                  (sceneExtent.height + TILE_SIZE - 1) / TILE_SIZE, 1);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipelines[PIPELINE_UPSAMPLE]);
+    for (uint32_t mip = MIP_COUNT - 1; mip > 0; mip--) {
+      // The mip below is complete before it is filtered into this one
+      VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+      barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+      barrier.dstAccessMask =
+          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+      barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+      barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+      barrier.image = frame.image;
+      barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, mip - 1, 2, 0, 1};
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                           0, nullptr, 1, &barrier);
+      vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                              pipelineLayout, 0, 1,
+                              &frame.descriptorSets[mip], 0, nullptr);
+      const VkExtent2D extent = getMipExtent(mip - 1);
+      vkCmdDispatch(
+          commandBuffer,
+          (extent.width + UPSAMPLE_GROUP_SIZE - 1) / UPSAMPLE_GROUP_SIZE,
+          (extent.height + UPSAMPLE_GROUP_SIZE - 1) / UPSAMPLE_GROUP_SIZE, 1);
+    }
+  }
+
+  VkImage getImage(uint32_t frame) const { return frames[frame].image; }
+  // Mip 0, the bloom of the whole chain
+  VkDescriptorImageInfo getDescriptor(uint32_t frame) const {
+    return {sampler, frames[frame].mipViews[0], VK_IMAGE_LAYOUT_GENERAL};
+  }
+
+ private:
+  enum Pipeline : uint32_t {
+    PIPELINE_DOWNSAMPLE,
+    PIPELINE_UPSAMPLE,
+    PIPELINE_COUNT
+  };
+
+  struct Frame {
+    VkImage image{VK_NULL_HANDLE};
+    VkDeviceMemory memory{VK_NULL_HANDLE};
+    std::array<VkImageView, MIP_COUNT> mipViews{};
+    // The downsample, then the upsample into mip - 1 for every further mip
+    std::array<VkDescriptorSet, MIP_COUNT> descriptorSets{};
+  };
+
+  vks::VulkanDevice* device{nullptr};
+  std::vector<Frame> frames;
+  VkExtent2D sceneExtent{};
+
+  // Bilinear, both passes sample between texels
+  VkSampler sampler{VK_NULL_HANDLE};
+  VkDescriptorPool descriptorPool{VK_NULL_HANDLE};
+  VkDescriptorSetLayout descriptorSetLayout{VK_NULL_HANDLE};
+  VkPipelineLayout pipelineLayout{VK_NULL_HANDLE};
+  std::array<VkPipeline, PIPELINE_COUNT> pipelines{};
+
+  // Mip 0 is half the scene, rounded up so every tile covers its texels
+  VkExtent2D getMipExtent(uint32_t mip) const {
+    return {std::max(((sceneExtent.width + 1) / 2) >> mip, 1u),
+            std::max(((sceneExtent.height + 1) / 2) >> mip, 1u)};
+  }
+
+  void createSampler() {
+    VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+    samplerCI.magFilter = VK_FILTER_LINEAR;
+    samplerCI.minFilter = VK_FILTER_LINEAR;
+    samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.maxAnisotropy = 1.0f;
+    samplerCI.minLod = 0.0f;
+    samplerCI.maxLod = 1.0f;
+    samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    VK_CHECK_RESULT(
+        vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &sampler));
+  }
+
+  void createImage(Frame& frame) {
+    VkDevice logicalDevice = device->logicalDevice;
+    const VkExtent2D extent = getMipExtent(0);
+    VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+    imageCI.imageType = VK_IMAGE_TYPE_2D;
+    imageCI.format = FORMAT;
+    imageCI.extent = {extent.width, extent.height, 1};
+    imageCI.mipLevels = MIP_COUNT;
+    imageCI.arrayLayers = 1;
+    imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    VK_CHECK_RESULT(
+        vkCreateImage(logicalDevice, &imageCI, nullptr, &frame.image));
+
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(logicalDevice, frame.image, &memReqs);
+    VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+    memAlloc.allocationSize = memReqs.size;
+    memAlloc.memoryTypeIndex = device->getMemoryType(
+        memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VK_CHECK_RESULT(
+        vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &frame.memory));
+    VK_CHECK_RESULT(
+        vkBindImageMemory(logicalDevice, frame.image, frame.memory, 0));
+
+    VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+    viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewCI.format = FORMAT;
+    viewCI.image = frame.image;
+    for (uint32_t mip = 0; mip < MIP_COUNT; mip++) {
+      viewCI.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 1, 0, 1};
+      VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewCI, nullptr,
+                                        &frame.mipViews[mip]));
+    }
+
+    // The downsample writes every mip. The upsample sets read the mip below
+    // and write the first element, the others only have to be valid
+    std::array<VkDescriptorImageInfo, MIP_COUNT> mipInfos;
+    for (uint32_t mip = 0; mip < MIP_COUNT; mip++) {
+      mipInfos[mip] = {VK_NULL_HANDLE, frame.mipViews[mip],
+                       VK_IMAGE_LAYOUT_GENERAL};
+    }
+    std::vector<VkDescriptorImageInfo> sourceInfos(MIP_COUNT);
+    std::vector<std::array<VkDescriptorImageInfo, MIP_COUNT>> targetInfos(
+        MIP_COUNT);
+    std::vector<VkWriteDescriptorSet> writes = {
+        vks::initializers::writeDescriptorSet(
+            frame.descriptorSets[0], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1,
+            mipInfos.data(), MIP_COUNT)};
+    for (uint32_t mip = 1; mip < MIP_COUNT; mip++) {
+      sourceInfos[mip] = {sampler, frame.mipViews[mip],
+                          VK_IMAGE_LAYOUT_GENERAL};
+      targetInfos[mip].fill(mipInfos[mip - 1]);
+      writes.push_back(vks::initializers::writeDescriptorSet(
+          frame.descriptorSets[mip], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+          0, &sourceInfos[mip]));
+      writes.push_back(vks::initializers::writeDescriptorSet(
+          frame.descriptorSets[mip], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1,
+          targetInfos[mip].data(), MIP_COUNT));
+    }
+    vkUpdateDescriptorSets(logicalDevice,
+                           static_cast<uint32_t>(writes.size()), writes.data(),
+                           0, nullptr);
+  }
+
+  void destroyImages() {
+    VkDevice logicalDevice = device->logicalDevice;
+    for (Frame& frame : frames) {
+      for (VkImageView& mipView : frame.mipViews) {
+        vkDestroyImageView(logicalDevice, mipView, nullptr);
+        mipView = VK_NULL_HANDLE;
+      }
+      vkDestroyImage(logicalDevice, frame.image, nullptr);
+      vkFreeMemory(logicalDevice, frame.memory, nullptr);
+      frame.image = VK_NULL_HANDLE;
+      frame.memory = VK_NULL_HANDLE;
+    }
+  }
+
+  void createPipelines(const VkPipelineShaderStageCreateInfo& downsampleStage,
+                       const VkPipelineShaderStageCreateInfo& upsampleStage) {
+    VkDevice logicalDevice = device->logicalDevice;
+    const uint32_t setCount = static_cast<uint32_t>(frames.size()) * MIP_COUNT;
+    std::vector<VkDescriptorPoolSize> poolSizes = {
+        vks::initializers::descriptorPoolSize(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount),
+        vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                              setCount * MIP_COUNT)};
+    VkDescriptorPoolCreateInfo descriptorPoolCI =
+        vks::initializers::descriptorPoolCreateInfo(poolSizes, setCount);
+    VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolCI,
+                                           nullptr, &descriptorPool));
+
+    // Both passes share the layout
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+        // Binding 0 : Scene or the mip below
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        // Binding 1 : Mips written
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1,
+            MIP_COUNT)};
+    VkDescriptorSetLayoutCreateInfo descriptorLayoutCI =
+        vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
+        logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayout));
+
+    std::vector<VkDescriptorSetLayout> setLayouts(MIP_COUNT,
+                                                  descriptorSetLayout);
+    for (Frame& frame : frames) {
+      VkDescriptorSetAllocateInfo allocInfo =
+          vks::initializers::descriptorSetAllocateInfo(
+              descriptorPool, setLayouts.data(), MIP_COUNT);
+      VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo,
+                                               frame.descriptorSets.data()));
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCI =
+        vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+    VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCI,
+                                           nullptr, &pipelineLayout));
+
+    const std::array<VkPipelineShaderStageCreateInfo, PIPELINE_COUNT> stages =
+        {downsampleStage, upsampleStage};
+    for (uint32_t i = 0; i < PIPELINE_COUNT; i++) {
+      VkComputePipelineCreateInfo pipelineCI =
+          vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+      pipelineCI.stage = stages[i];
+      VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice,
+                                               device->pipelineCache, 1,
+                                               &pipelineCI, nullptr,
+                                               &pipelines[i]));
+    }
+  }
+};
+}  // namespace vks
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <assert.h>
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace vks {
+// Thin wrapper around command recording that remembers the bound state of a
+// command buffer and drops binds that would not change anything. One tracker
+// is used per pass so the counters can be reported per pass
+class CommandStateTracker {
+ public:
+  static constexpr uint32_t MAX_DESCRIPTOR_SETS = 8;
+  static constexpr uint32_t MAX_PUSH_CONSTANT_SIZE = 128;
+
+  struct Stats {
+    uint32_t issued = 0;
+    uint32_t elided = 0;
+    uint32_t draws = 0;
+  };
+
+  // Starts tracking a freshly begun command buffer, secondary command buffers
+  // inherit no bound state so everything is invalidated
+  void begin(VkCommandBuffer commandBuffer) {
+    cmd = commandBuffer;
+    pipeline = VK_NULL_HANDLE;
+    layout = VK_NULL_HANDLE;
+    memset(descriptorSets, 0, sizeof(descriptorSets));
+    vertexBuffer = VK_NULL_HANDLE;
+    vertexOffset = 0;
+    indexBuffer = VK_NULL_HANDLE;
+    indexOffset = 0;
+    pushConstantSize = 0;
+    stats = Stats();
+  }
+
+  VkCommandBuffer getCommandBuffer() const { return cmd; }
+  const Stats& getStats() const { return stats; }
+
+  void bindPipeline(VkPipeline newPipeline) {
+    if (newPipeline == pipeline) {
+      stats.elided++;
+      return;
+    }
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, newPipeline);
+    pipeline = newPipeline;
+    stats.issued++;
+  }
+
+  // Only the range of sets that actually changed is rebound
+  void bindDescriptorSets(VkPipelineLayout pipelineLayout, uint32_t firstSet,
+                          uint32_t setCount, const VkDescriptorSet* sets) {
+    assert(firstSet + setCount <= MAX_DESCRIPTOR_SETS);
+    if (pipelineLayout != layout) {
+      // Conservatively treat sets and push constants as disturbed when the
+      // layout changes
+      memset(descriptorSets, 0, sizeof(descriptorSets));
+      pushConstantSize = 0;
+      layout = pipelineLayout;
+    }
+
+    uint32_t first = setCount;
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < setCount; i++) {
+      if (descriptorSets[firstSet + i] != sets[i]) {
+        first = first < i ? first : i;
+        last = i;
+      }
+    }
+    if (first == setCount) {
+      stats.elided++;
+      return;
+    }
+
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout,
+                            firstSet + first, last - first + 1, &sets[first], 0,
+                            nullptr);
+    for (uint32_t i = first; i <= last; i++) {
+      descriptorSets[firstSet + i] = sets[i];
+    }
+    stats.issued++;
+  }
+
+  void bindVertexBuffer(VkBuffer buffer, VkDeviceSize offset = 0) {
+    if (buffer == vertexBuffer && offset == vertexOffset) {
+      stats.elided++;
+      return;
+    }
+    vkCmdBindVertexBuffers(cmd, 0, 1, &buffer, &offset);
+    vertexBuffer = buffer;
+    vertexOffset = offset;
+    stats.issued++;
+  }
+
+  void bindIndexBuffer(VkBuffer buffer, VkDeviceSize offset = 0) {
+    if (buffer == indexBuffer && offset == indexOffset) {
+      stats.elided++;
+      return;
+    }
+    vkCmdBindIndexBuffer(cmd, buffer, offset, VK_INDEX_TYPE_UINT32);
+    indexBuffer = buffer;
+    indexOffset = offset;
+    stats.issued++;
+  }
+
+  // Push constants are compared by content, the tracker assumes a single
+  // range starting at offset 0 as used by all pipelines in the renderer
+  void pushConstants(VkPipelineLayout pipelineLayout,
+                     VkShaderStageFlags stageFlags, uint32_t size,
+                     const void* data) {
+    assert(size <= MAX_PUSH_CONSTANT_SIZE);
+    if (pipelineLayout != layout) {
+      memset(descriptorSets, 0, sizeof(descriptorSets));
+      pushConstantSize = 0;
+      layout = pipelineLayout;
+    }
+    if (size == pushConstantSize &&
+        memcmp(pushConstantData, data, size) == 0) {
+      stats.elided++;
+      return;
+    }
+    vkCmdPushConstants(cmd, layout, stageFlags, 0, size, data);
+    memcpy(pushConstantData, data, size);
+    pushConstantSize = size;
+    stats.issued++;
+  }
+
+  void drawIndexed(uint32_t indexCount, uint32_t firstIndex) {
+    vkCmdDrawIndexed(cmd, indexCount, 1, firstIndex, 0, 0);
+    stats.draws++;
+  }
+
+  void draw(uint32_t vertexCount) {
+    vkCmdDraw(cmd, vertexCount, 1, 0, 0);
+    stats.draws++;
+  }
+
+ private:
+  VkCommandBuffer cmd{VK_NULL_HANDLE};
+  VkPipeline pipeline{VK_NULL_HANDLE};
+  VkPipelineLayout layout{VK_NULL_HANDLE};
+  VkDescriptorSet descriptorSets[MAX_DESCRIPTOR_SETS]{};
+  VkBuffer vertexBuffer{VK_NULL_HANDLE};
+  VkDeviceSize vertexOffset = 0;
+  VkBuffer indexBuffer{VK_NULL_HANDLE};
+  VkDeviceSize indexOffset = 0;
+  uint8_t pushConstantData[MAX_PUSH_CONSTANT_SIZE]{};
+  uint32_t pushConstantSize = 0;
+  Stats stats;
+};
+}  // namespace vks
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <assert.h>
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "../ResourceManagement/VulkanResources/VulkanDevice.h"
+#include "../ResourceManagement/VulkanResources/VulkanInitializers.hpp"
+#include "../ResourceManagement/VulkanResources/VulkanTools.h"
+
+namespace vks {
+// Min and max depth pyramid (Hi-Z) of the depth prepass, built by a single
+// compute dispatch. Every group reduces a tile of depth into the first mips
+// through shared memory, the last group to finish reduces the rest. Mip 0 is
+// half the depth resolution and every further mip half the one above, both
+// rounded up so the odd last row and column are not dropped. Vulkan rounds
+// mip sizes down, so the image is padded until its mips are at least that
+// large. Layer MIN_LAYER holds the nearest depth, layer
+// MAX_LAYER the farthest. There is one pyramid per frame in flight, like the
+// prepass depth it is built from
+class DepthPyramid {
+ public:
+  // Matches depthPyramid.comp
+  static constexpr uint32_t MAX_MIPS = 12;
+  static constexpr uint32_t GROUP_SIZE = 16;
+  // Depth texels per group and dimension. The second reduction takes tiles of
+  // the same size from the last tile mip, one after the other
+  static constexpr uint32_t TILE_SIZE = GROUP_SIZE * 4;
+  // Mips written per tile
+  static constexpr uint32_t TILE_MIPS = 6;
+  // R32 float is a required storage format, two channel formats are not
+  static constexpr VkFormat FORMAT = VK_FORMAT_R32_SFLOAT;
+  static constexpr uint32_t MIN_LAYER = 0;
+  static constexpr uint32_t MAX_LAYER = 1;
+
+  void create(vks::VulkanDevice* vulkanDevice, uint32_t frameCount,
+              const VkPipelineShaderStageCreateInfo& shaderStage,
+              VkExtent2D depthExtent) {
+    device = vulkanDevice;
+    frames.resize(frameCount);
+    createSampler();
+    createPipeline(shaderStage);
+    for (Frame& frame : frames) {
+      // Every group counts itself with an atomic, the counter stays in device
+      // memory and is cleared by record()
+      VK_CHECK_RESULT(device->createBuffer(
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &frame.counter,
+          sizeof(uint32_t)));
+    }
+    resize(depthExtent);
+  }
+
+  // Recreates the pyramids for depth of a new size, the device has to be idle
+  void resize(VkExtent2D depthExtent) {
+    destroyImages();
+    this->depthExtent = depthExtent;
+    extent = getHalfExtent(depthExtent);
+    mipCount = 1;
+    while (mipCount < MAX_MIPS &&
+           std::max(extent.width, extent.height) >> mipCount != 0) {
+      mipCount++;
+    }
+    const uint32_t lastMipScale = 1u << (mipCount - 1);
+    imageExtent = {
+        (extent.width + lastMipScale - 1) / lastMipScale * lastMipScale,
+        (extent.height + lastMipScale - 1) / lastMipScale * lastMipScale};
+    for (Frame& frame : frames) {
+      createImage(frame);
+    }
+  }
+
+  void destroy() {
+    VkDevice logicalDevice = device->logicalDevice;
+    destroyImages();
+    for (Frame& frame : frames) {
+      frame.counter.destroy();
+    }
+    vkDestroySampler(logicalDevice, sampler, nullptr);
+    vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+    vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+  }
+
+  // Reads the prepass depth of the frame and writes every mip, expected in
+  // the general layout. Only renderExtent of the depth was drawn this frame,
+  // the depth outside of it is undefined and stays out of the pyramid
+  void record(VkCommandBuffer commandBuffer, uint32_t frameIndex,
+              const VkDescriptorImageInfo& depth, VkExtent2D renderExtent) {
+    assert(renderExtent.width <= depthExtent.width &&
+           renderExtent.height <= depthExtent.height);
+    extent = getHalfExtent(renderExtent);
+    Frame& frame = frames[frameIndex];
+    VkWriteDescriptorSet write = vks::initializers::writeDescriptorSet(
+        frame.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+        &depth);
+    vkUpdateDescriptorSets(device->logicalDevice, 1, &write, 0, nullptr);
+
+    // Cleared on the queue the pyramid is built on this frame, which changes
+    // with async compute, so the counter never has to keep its contents when
+    // it moves to another queue family. The fence of the frame slot was
+    // waited on before, the last use of the counter is done
+    vkCmdFillBuffer(commandBuffer, frame.counter.buffer, 0, VK_WHOLE_SIZE, 0);
+    VkBufferMemoryBarrier counterBarrier =
+        vks::initializers::bufferMemoryBarrier();
+    counterBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    counterBarrier.dstAccessMask =
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    counterBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    counterBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    counterBarrier.buffer = frame.counter.buffer;
+    counterBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                         1, &counterBarrier, 0, nullptr);
+
+    const VkExtent2D groups = {
+        (renderExtent.width + TILE_SIZE - 1) / TILE_SIZE,
+        (renderExtent.height + TILE_SIZE - 1) / TILE_SIZE};
+    const Params params = {
+        glm::ivec2(renderExtent.width, renderExtent.height), mipCount,
+        groups.width * groups.height};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayout, 0, 1, &frame.descriptorSet, 0,
+                            nullptr);
+    vkCmdPushConstants(commandBuffer, pipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Params),
+                       &params);
+    vkCmdDispatch(commandBuffer, groups.width, groups.height, 1);
+  }
+
+  VkImage getImage(uint32_t frame) const { return frames[frame].image; }
+  // Both layers and every mip as a 2D array
+  VkImageView getView(uint32_t frame) const { return frames[frame].view; }
+  // Both layers of a single mip as a 2D array
+  VkImageView getMipView(uint32_t frame, uint32_t mip) const {
+    return frames[frame].mipViews[mip];
+  }
+  // Nearest, min and max can not be filtered
+  VkSampler getSampler() const { return sampler; }
+  uint32_t getMipCount() const { return mipCount; }
+  // Of mip 0 for the render extent recorded last, the image may be larger
+  VkExtent2D getExtent() const { return extent; }
+  // Texels of a mip that hold depth of the render extent recorded last, the
+  // texels after them are undefined
+  VkExtent2D getMipExtent(uint32_t mip) const {
+    return {(extent.width + (1u << mip) - 1) >> mip,
+            (extent.height + (1u << mip) - 1) >> mip};
+  }
+
+ private:
+  // Matches the push constants of depthPyramid.comp
+  struct Params {
+    glm::ivec2 depthSize;
+    uint32_t mipCount;
+    uint32_t groupCount;
+  };
+
+  struct Frame {
+    VkImage image{VK_NULL_HANDLE};
+    VkDeviceMemory memory{VK_NULL_HANDLE};
+    VkImageView view{VK_NULL_HANDLE};
+    std::array<VkImageView, MAX_MIPS> mipViews{};
+    // Groups that finished their tile
+    vks::Buffer counter;
+    VkDescriptorSet descriptorSet{VK_NULL_HANDLE};
+  };
+
+  vks::VulkanDevice* device{nullptr};
+  std::vector<Frame> frames;
+  // Largest depth the images are sized for
+  VkExtent2D depthExtent{};
+  VkExtent2D extent{};
+  // Mip 0 of the image, padded so every mip is at least getMipExtent()
+  VkExtent2D imageExtent{};
+  uint32_t mipCount = 0;
+
+  VkSampler sampler{VK_NULL_HANDLE};
+  VkDescriptorPool descriptorPool{VK_NULL_HANDLE};
+  VkDescriptorSetLayout descriptorSetLayout{VK_NULL_HANDLE};
+  VkPipelineLayout pipelineLayout{VK_NULL_HANDLE};
+  VkPipeline pipeline{VK_NULL_HANDLE};
+
+  // Mip 0 is half the depth, rounded up
+  static VkExtent2D getHalfExtent(VkExtent2D depthExtent) {
+    return {std::max((depthExtent.width + 1) / 2, 1u),
+            std::max((depthExtent.height + 1) / 2, 1u)};
+  }
+
+  void createSampler() {
+    VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+    samplerCI.magFilter = VK_FILTER_NEAREST;
+    samplerCI.minFilter = VK_FILTER_NEAREST;
+    samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.maxAnisotropy = 1.0f;
+    samplerCI.minLod = 0.0f;
+    samplerCI.maxLod = static_cast<float>(MAX_MIPS);
+    samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    VK_CHECK_RESULT(
+        vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &sampler));
+  }
+
+  void createImage(Frame& frame) {
+    VkDevice logicalDevice = device->logicalDevice;
+    VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+    imageCI.imageType = VK_IMAGE_TYPE_2D;
+    imageCI.format = FORMAT;
+    imageCI.extent = {imageExtent.width, imageExtent.height, 1};
+    imageCI.mipLevels = mipCount;
+    imageCI.arrayLayers = 2;
+    imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    VK_CHECK_RESULT(
+        vkCreateImage(logicalDevice, &imageCI, nullptr, &frame.image));
+
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(logicalDevice, frame.image, &memReqs);
+    VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+    memAlloc.allocationSize = memReqs.size;
+    memAlloc.memoryTypeIndex = device->getMemoryType(
+        memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VK_CHECK_RESULT(
+        vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &frame.memory));
+    VK_CHECK_RESULT(
+        vkBindImageMemory(logicalDevice, frame.image, frame.memory, 0));
+
+    VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+    viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    viewCI.format = FORMAT;
+    viewCI.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipCount, 0, 2};
+    viewCI.image = frame.image;
+    VK_CHECK_RESULT(
+        vkCreateImageView(logicalDevice, &viewCI, nullptr, &frame.view));
+    for (uint32_t mip = 0; mip < mipCount; mip++) {
+      viewCI.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 1, 0, 2};
+      VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewCI, nullptr,
+                                        &frame.mipViews[mip]));
+    }
+
+    // Every element of the array has to be valid, mips the image does not
+    // have point at the last one and are never written
+    std::array<VkDescriptorImageInfo, MAX_MIPS> mipInfos;
+    for (uint32_t mip = 0; mip < MAX_MIPS; mip++) {
+      mipInfos[mip] = {VK_NULL_HANDLE,
+                       frame.mipViews[std::min(mip, mipCount - 1)],
+                       VK_IMAGE_LAYOUT_GENERAL};
+    }
+    std::array<VkWriteDescriptorSet, 2> writes = {
+        vks::initializers::writeDescriptorSet(
+            frame.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+            &frame.counter.descriptor),
+        vks::initializers::writeDescriptorSet(
+            frame.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2,
+            mipInfos.data(), MAX_MIPS)};
+    vkUpdateDescriptorSets(logicalDevice,
+                           static_cast<uint32_t>(writes.size()), writes.data(),
+                           0, nullptr);
+  }
+
+  void destroyImages() {
+    VkDevice logicalDevice = device->logicalDevice;
+    for (Frame& frame : frames) {
+      for (VkImageView& mipView : frame.mipViews) {
+        vkDestroyImageView(logicalDevice, mipView, nullptr);
+        mipView = VK_NULL_HANDLE;
+      }
+      vkDestroyImageView(logicalDevice, frame.view, nullptr);
+      vkDestroyImage(logicalDevice, frame.image, nullptr);
+      vkFreeMemory(logicalDevice, frame.memory, nullptr);
+      frame.view = VK_NULL_HANDLE;
+      frame.image = VK_NULL_HANDLE;
+      frame.memory = VK_NULL_HANDLE;
+    }
+  }
+
+  void createPipeline(const VkPipelineShaderStageCreateInfo& shaderStage) {
+    VkDevice logicalDevice = device->logicalDevice;
+    const uint32_t frameCount = static_cast<uint32_t>(frames.size());
+    std::vector<VkDescriptorPoolSize> poolSizes = {
+        vks::initializers::descriptorPoolSize(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frameCount),
+        vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                              frameCount),
+        vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                              frameCount * MAX_MIPS)};
+    VkDescriptorPoolCreateInfo descriptorPoolCI =
+        vks::initializers::descriptorPoolCreateInfo(poolSizes, frameCount);
+    VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolCI,
+                                           nullptr, &descriptorPool));
+
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+        // Binding 0 : Prepass depth
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        // Binding 1 : Finished group counter
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        // Binding 2 : Mips
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 2,
+            MAX_MIPS)};
+    VkDescriptorSetLayoutCreateInfo descriptorLayoutCI =
+        vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
+        logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayout));
+
+    for (Frame& frame : frames) {
+      VkDescriptorSetAllocateInfo allocInfo =
+          vks::initializers::descriptorSetAllocateInfo(
+              descriptorPool, &descriptorSetLayout, 1);
+      VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo,
+                                               &frame.descriptorSet));
+    }
+
+    VkPushConstantRange pushConstantRange =
+        vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT,
+                                             sizeof(Params), 0);
+    VkPipelineLayoutCreateInfo pipelineLayoutCI =
+        vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+    pipelineLayoutCI.pushConstantRangeCount = 1;
+    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCI,
+                                           nullptr, &pipelineLayout));
+
+    VkComputePipelineCreateInfo pipelineCI =
+        vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+    pipelineCI.stage = shaderStage;
+    VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice,
+                                             device->pipelineCache, 1,
+                                             &pipelineCI, nullptr, &pipeline));
+  }
+};
+}  // namespace vks
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "../ResourceManagement/VulkanResources/VulkanDevice.h"
+#include "../ResourceManagement/VulkanResources/VulkanTools.h"
+
+namespace vks {
+// Picks the share of the window the scene is drawn at from the GPU time of
+// the frames before. Two timestamps around the command buffers of a frame
+// measure its GPU time, they are read back once the fence of the frame slot
+// was waited on, so reading never stalls. The scale only moves after a few
+// frames at the same scale agree that the frame is off the target time
+class DynamicResolution {
+ public:
+  // Steps of the scale, keeps the render extent from changing every frame
+  static constexpr float SCALE_STEP = 0.05f;
+  // Frames measured at a scale before it is changed again
+  static constexpr uint32_t SETTLE_FRAMES = 8;
+  // Share of the target time the GPU time may be off without a change
+  static constexpr float TOLERANCE = 0.05f;
+  // Weight of a new frame in the smoothed GPU time
+  static constexpr float SMOOTHING = 0.1f;
+
+  struct Settings {
+    // GPU time of a frame in milliseconds the scale aims for
+    float targetFrameTime = 16.0f;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+  } settings;
+
+  // queueFamily is the family the timestamped command buffers run on
+  void create(vks::VulkanDevice* vulkanDevice, uint32_t frameCount,
+              uint32_t queueFamily) {
+    device = vulkanDevice;
+    frames.resize(frameCount);
+    const uint32_t validBits =
+        device->queueFamilyProperties[queueFamily].timestampValidBits;
+    timestampPeriod = device->properties.limits.timestampPeriod;
+    supported = validBits != 0 && timestampPeriod > 0.0f;
+    if (!supported) {
+      return;
+    }
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo queryPoolCI{};
+    queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolCI.queryCount = frameCount * 2;
+    VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolCI,
+                                      nullptr, &queryPool));
+  }
+
+  void destroy() {
+    vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+  }
+
+  // Reads the GPU time of the last frame recorded for this slot and moves the
+  // scale toward the target time. Called after the fence of the slot was
+  // waited on, before the frame is recorded
+  void update(uint32_t frame, bool enabled) {
+    settings.maxScale = std::clamp(settings.maxScale, SCALE_STEP, 1.0f);
+    settings.minScale = std::clamp(settings.minScale, SCALE_STEP,
+                                   settings.maxScale);
+    Frame& slot = frames[frame];
+    if (slot.pending) {
+      slot.pending = false;
+      std::array<uint64_t, 2> timestamps{};
+      if (vkGetQueryPoolResults(device->logicalDevice, queryPool, frame * 2, 2,
+                                sizeof(timestamps), timestamps.data(),
+                                sizeof(uint64_t),
+                                VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        gpuTime = ((timestamps[1] - timestamps[0]) & timestampMask) *
+                  timestampPeriod * 1e-6f;
+        addSample(slot.scale);
+      }
+    }
+    if (!enabled) {
+      scale = settings.maxScale;
+      sampleCount = 0;
+      return;
+    }
+    const float clamped =
+        std::clamp(scale, settings.minScale, settings.maxScale);
+    if (clamped != scale) {
+      scale = clamped;
+      sampleCount = 0;
+    }
+    if (sampleCount < SETTLE_FRAMES ||
+        std::abs(smoothedTime - settings.targetFrameTime) <=
+            TOLERANCE * settings.targetFrameTime) {
+      return;
+    }
+    // The GPU time grows about with the pixel count, the square of the scale
+    float target = scale * std::sqrt(settings.targetFrameTime / smoothedTime);
+    target = std::floor(target / SCALE_STEP + 1e-3f) * SCALE_STEP;
+    if (smoothedTime > settings.targetFrameTime) {
+      target = std::min(target, scale - SCALE_STEP);
+    }
+    target = std::clamp(target, settings.minScale, settings.maxScale);
+    if (std::abs(target - scale) > 1e-3f) {
+      scale = target;
+      sampleCount = 0;
+    }
+  }
+
+  // Around the command buffers of a frame before present, which have to run
+  // on the queue family passed to create() in the order they are recorded.
+  // Present waits for the swapchain image, timing it would count the wait
+  void begin(VkCommandBuffer commandBuffer, uint32_t frame) {
+    if (!supported) {
+      return;
+    }
+    vkCmdResetQueryPool(commandBuffer, queryPool, frame * 2, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        queryPool, frame * 2);
+  }
+  void end(VkCommandBuffer commandBuffer, uint32_t frame) {
+    if (!supported) {
+      return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        queryPool, frame * 2 + 1);
+    frames[frame] = {true, scale};
+  }
+
+  bool isSupported() const { return supported; }
+  // Milliseconds the last measured frame took on the GPU
+  float getGpuTime() const { return gpuTime; }
+  // Share of the window width and height to draw the scene at
+  float getScale() const { return scale; }
+
+ private:
+  struct Frame {
+    // Timestamps were written and not read yet
+    bool pending = false;
+    // Scale the frame was recorded with
+    float scale = 1.0f;
+  };
+
+  vks::VulkanDevice* device{nullptr};
+  VkQueryPool queryPool{VK_NULL_HANDLE};
+  std::vector<Frame> frames;
+  bool supported = false;
+  // Nanoseconds per timestamp tick
+  float timestampPeriod = 0.0f;
+  uint64_t timestampMask = 0;
+
+  float scale = 1.0f;
+  float gpuTime = 0.0f;
+  float smoothedTime = 0.0f;
+  // Frames measured at the current scale
+  uint32_t sampleCount = 0;
+
+  // Only frames drawn at the current scale say something about it
+  void addSample(float frameScale) {
+    if (frameScale != scale) {
+      return;
+    }
+    smoothedTime = sampleCount == 0
+                       ? gpuTime
+                       : smoothedTime + (gpuTime - smoothedTime) * SMOOTHING;
+    sampleCount++;
+  }
+};
+}  // namespace vks
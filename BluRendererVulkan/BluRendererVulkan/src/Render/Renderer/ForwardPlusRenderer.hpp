@@ -0,0 +1,383 @@
+#pragma once
+
+#include "ForwardRenderer.hpp"
+
+// Forward+ renderer. After the depth prepass a compute pass bins point and spot
+// lights into a grid of screen tiles and exponential depth slices, the PBR
+// shader then only evaluates the lights of the cluster a fragment falls into.
+// Directional lights are still looped over for every fragment as they reach
+// every pixel and cast the shadows
+class ForwardPlusRenderer : public ForwardRenderer {
+ public:
+#ifndef VulkanResources
+  // Matches ClusterParams in clusteredLighting.glsl
+  struct ClusterParams {
+    glm::mat4 view;
+    glm::mat4 inverseProjection;
+    // xyz = cluster counts, w = light count
+    glm::uvec4 gridSize;
+    // x = near, y = far, z = slice scale, w = slice bias
+    glm::vec4 depthParams;
+    glm::vec2 screenSize;
+    // Index of the first culled light in the light buffer
+    uint32_t firstLight;
+  } clusterParams;
+
+  struct LightCullingFrame {
+    vks::Buffer params;
+    VkDescriptorSet descriptorSet{VK_NULL_HANDLE};
+  };
+
+  // The light grid and index list are only written and read on the GPU, the
+  // barriers around the culling dispatch let every frame share them
+  struct {
+    std::vector<LightCullingFrame> frames;
+    vks::Buffer lightGrid;
+    vks::Buffer lightIndices;
+    glm::uvec3 gridSize{0};
+    VkDescriptorPool descriptorPool{VK_NULL_HANDLE};
+    VkDescriptorSetLayout descriptorSetLayout{VK_NULL_HANDLE};
+    VkPipelineLayout pipelineLayout{VK_NULL_HANDLE};
+    VkPipeline pipeline{VK_NULL_HANDLE};
+  } lightCulling;
+
+  // Randomly placed point lights to put load on the culling
+  struct DynamicLight {
+    vks::light::Light light;
+    glm::vec3 origin;
+    float phase;
+  };
+  std::vector<DynamicLight> dynamicLights;
+#endif
+
+#ifndef RenderSettings
+// Keep in sync with clusteredLighting.glsl
+#define CLUSTER_TILE_SIZE 64
+#define CLUSTER_SLICES 24
+#define MAX_LIGHTS_PER_CLUSTER 128
+#define MAX_DYNAMIC_LIGHTS 4096
+
+  int dynamicLightCount = 256;
+  bool animateLights = true;
+  float lightTimer = 0.0f;
+#endif
+
+  ForwardPlusRenderer() : ForwardRenderer() { name = "Forward+ Renderer"; }
+
+  ~ForwardPlusRenderer() {
+    vkDestroyPipeline(device, lightCulling.pipeline, nullptr);
+    vkDestroyPipelineLayout(device, lightCulling.pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, lightCulling.descriptorSetLayout,
+                                 nullptr);
+    vkDestroyDescriptorPool(device, lightCulling.descriptorPool, nullptr);
+    for (auto& frame : lightCulling.frames) {
+      frame.params.destroy();
+    }
+    lightCulling.lightGrid.destroy();
+    lightCulling.lightIndices.destroy();
+  }
+
+  std::vector<VkDescriptorSetLayout> getSceneSetLayouts() override {
+    std::vector<VkDescriptorSetLayout> setLayouts =
+        ForwardRenderer::getSceneSetLayouts();
+    setLayouts.push_back(lightCulling.descriptorSetLayout);
+    return setLayouts;
+  }
+
+  std::string getSceneFragmentShader() override {
+    return bindless.enabled ? "shaders/pbr_clustered_bindless.frag.spv"
+                            : "shaders/pbr_clustered.frag.spv";
+  }
+
+  void setupDescriptors(bool updatedMaterials = false) override {
+    ForwardRenderer::setupDescriptors(updatedMaterials);
+    if (lightCulling.pipeline == VK_NULL_HANDLE) {
+      prepareLightCulling();
+    }
+    // Called again on resize, the depth prepass and the tile grid change
+    updateClusterGrid();
+    updateLightCullingDescriptors();
+  }
+
+  void prepareLightCulling() {
+    lightCulling.frames.resize(maxFramesInFlight);
+    for (auto& frame : lightCulling.frames) {
+      VK_CHECK_RESULT(vulkanDevice->createBuffer(
+          VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+          &frame.params, sizeof(ClusterParams)));
+      frame.params.map();
+    }
+
+    std::vector<VkDescriptorPoolSize> poolSizes = {
+        vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                                              maxFramesInFlight),
+        vks::initializers::descriptorPoolSize(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxFramesInFlight),
+        vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                              3 * maxFramesInFlight)};
+    VkDescriptorPoolCreateInfo descriptorPoolCI =
+        vks::initializers::descriptorPoolCreateInfo(poolSizes,
+                                                    maxFramesInFlight);
+    VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr,
+                                           &lightCulling.descriptorPool));
+
+    // Shared by the culling pass and the scene pipelines (set 4)
+    const VkShaderStageFlags stages =
+        VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+        // Binding 0 : Cluster parameters
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, stages, 0),
+        // Binding 1 : Depth prepass
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        // Binding 2 : Lights, the scene's light buffer
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        // Binding 3 : Light count per cluster
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stages, 3),
+        // Binding 4 : Light indices per cluster
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stages, 4)};
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI =
+        vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
+        device, &descriptorSetLayoutCI, nullptr,
+        &lightCulling.descriptorSetLayout));
+
+    for (auto& frame : lightCulling.frames) {
+      VkDescriptorSetAllocateInfo allocInfo =
+          vks::initializers::descriptorSetAllocateInfo(
+              lightCulling.descriptorPool, &lightCulling.descriptorSetLayout,
+              1);
+      VK_CHECK_RESULT(
+          vkAllocateDescriptorSets(device, &allocInfo, &frame.descriptorSet));
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCI =
+        vks::initializers::pipelineLayoutCreateInfo(
+            &lightCulling.descriptorSetLayout, 1);
+    VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr,
+                                           &lightCulling.pipelineLayout));
+    VkComputePipelineCreateInfo computePipelineCI =
+        vks::initializers::computePipelineCreateInfo(
+            lightCulling.pipelineLayout, 0);
+    computePipelineCI.stage = loadShader("shaders/lightCulling.comp.spv",
+                                         VK_SHADER_STAGE_COMPUTE_BIT);
+    VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1,
+                                             &computePipelineCI, nullptr,
+                                             &lightCulling.pipeline));
+  }
+
+  // (Re)creates the cluster buffers when the number of screen tiles changes.
+  // The grid covers the render targets, frames drawn to a part of them only
+  // cull the tiles of that part
+  void updateClusterGrid() {
+    const glm::uvec3 gridSize = glm::uvec3(
+        getTileCount(renderTargetExtent.width),
+        getTileCount(renderTargetExtent.height), CLUSTER_SLICES);
+    if (gridSize == lightCulling.gridSize) {
+      return;
+    }
+    lightCulling.gridSize = gridSize;
+    lightCulling.lightGrid.destroy();
+    lightCulling.lightIndices.destroy();
+
+    const VkDeviceSize clusterCount =
+        static_cast<VkDeviceSize>(gridSize.x) * gridSize.y * gridSize.z;
+    VK_CHECK_RESULT(vulkanDevice->createBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &lightCulling.lightGrid,
+        clusterCount * sizeof(uint32_t)));
+    VK_CHECK_RESULT(vulkanDevice->createBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &lightCulling.lightIndices,
+        clusterCount * MAX_LIGHTS_PER_CLUSTER * sizeof(uint32_t)));
+  }
+
+  void updateLightCullingDescriptors() {
+    for (uint32_t i = 0; i < lightCulling.frames.size(); i++) {
+      LightCullingFrame& frame = lightCulling.frames[i];
+      std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+          vks::initializers::writeDescriptorSet(
+              frame.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
+              &frame.params.descriptor),
+          vks::initializers::writeDescriptorSet(
+              frame.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+              1, &renderTargets.depthPrepass->framebuffers[i].descriptor),
+          vks::initializers::writeDescriptorSet(
+              frame.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2,
+              lightBuffer.getDescriptor(i)),
+          vks::initializers::writeDescriptorSet(
+              frame.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3,
+              &lightCulling.lightGrid.descriptor),
+          vks::initializers::writeDescriptorSet(
+              frame.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4,
+              &lightCulling.lightIndices.descriptor)};
+      vkUpdateDescriptorSets(device,
+                             static_cast<uint32_t>(writeDescriptorSets.size()),
+                             writeDescriptorSets.data(), 0, nullptr);
+    }
+  }
+
+  void buildDepthPrepassConsumers(VkCommandBuffer commandBuffer) override {
+    // The render graph orders the prepass depth, the previous frame's scene
+    // pass may still be reading the cluster buffers
+    VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      lightCulling.pipeline);
+    vkCmdBindDescriptorSets(
+        commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+        lightCulling.pipelineLayout, 0, 1,
+        &lightCulling.frames[currentFrameIndex].descriptorSet, 0, nullptr);
+    // One workgroup per screen tile, each walks all of the tile's slices
+    vkCmdDispatch(commandBuffer, getTileCount(renderExtent.width),
+                  getTileCount(renderExtent.height), 1);
+
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1,
+                         &memoryBarrier, 0, nullptr, 0, nullptr);
+  }
+
+  void bindSceneDescriptorSets(vks::CommandStateTracker& cmd) override {
+    cmd.bindDescriptorSets(
+        pipelineLayouts.scene, 4, 1,
+        &lightCulling.frames[currentFrameIndex].descriptorSet);
+  }
+
+  // Directional lights go first and are evaluated for every fragment, the
+  // rest of the light buffer is culled
+  void updateSceneParams() override {
+    const uint32_t lightCount = static_cast<uint32_t>(
+        lights.size() + benchmarkLights.size() + dynamicLights.size());
+    lightBuffer.resize(lightCount);
+    uint32_t lightIndex = 0;
+    for (auto& light : lights) {
+      if (light.lightType == 0) {
+        lightBuffer.set(lightIndex++, light.lightInfo);
+      }
+    }
+    const uint32_t directionalLightCount = lightIndex;
+    for (auto& light : lights) {
+      if (light.lightType != 0) {
+        lightBuffer.set(lightIndex++, light.lightInfo);
+      }
+    }
+    for (auto& light : benchmarkLights) {
+      lightBuffer.set(lightIndex++, light.lightInfo);
+    }
+    for (auto& dynamicLight : dynamicLights) {
+      lightBuffer.set(lightIndex++, dynamicLight.light.lightInfo);
+    }
+    uploadLights();
+
+    sceneParams.lightCount = directionalLightCount;
+    sceneParams.debugViewInputs = uiSettings.debugOutput;
+    sceneParams.scaleIBLAmbient = uiSettings.IBLstrength;
+    memcpy(dynamicUniformBuffers[currentFrameIndex].params.mapped, &sceneParams,
+           sizeof(SceneParams));
+
+    updateClusterParams(directionalLightCount,
+                        lightCount - directionalLightCount);
+  }
+
+  void updateLightDescriptors() override {
+    ForwardRenderer::updateLightDescriptors();
+    for (uint32_t i = 0; i < lightCulling.frames.size(); i++) {
+      VkWriteDescriptorSet writeDescriptorSet =
+          vks::initializers::writeDescriptorSet(
+              lightCulling.frames[i].descriptorSet,
+              VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2,
+              lightBuffer.getDescriptor(i));
+      vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+    }
+  }
+
+  static uint32_t getTileCount(uint32_t pixels) {
+    return (pixels + CLUSTER_TILE_SIZE - 1) / CLUSTER_TILE_SIZE;
+  }
+
+  void updateClusterParams(uint32_t firstLight, uint32_t lightCount) {
+    if (lightCulling.frames.empty()) {
+      return;
+    }
+    const float zNear = camera.getNearClip();
+    const float zFar = camera.getFarClip();
+    const float logDepthRange = std::log(zFar / zNear);
+    clusterParams.view = camera.matrices.view;
+    clusterParams.inverseProjection = glm::inverse(camera.matrices.perspective);
+    clusterParams.gridSize = glm::uvec4(lightCulling.gridSize, lightCount);
+    // slice = log(depth) * scale + bias maps [near, far] to [0, slices]
+    clusterParams.depthParams =
+        glm::vec4(zNear, zFar, CLUSTER_SLICES / logDepthRange,
+                  -CLUSTER_SLICES * std::log(zNear) / logDepthRange);
+    clusterParams.screenSize =
+        glm::vec2((float)renderExtent.width, (float)renderExtent.height);
+    clusterParams.firstLight = firstLight;
+    memcpy(lightCulling.frames[currentFrameIndex].params.mapped,
+           &clusterParams, sizeof(ClusterParams));
+  }
+
+  // Scatters point lights through the bounds of the scene, lights that already
+  // exist keep their place
+  void generateDynamicLights() {
+    const size_t firstNewLight = dynamicLights.size();
+    dynamicLights.resize(dynamicLightCount);
+    if (dynamicModels.empty()) {
+      return;
+    }
+
+    glm::vec3 boundsMin, boundsMax;
+    getSceneBounds(boundsMin, boundsMax);
+    for (size_t i = firstNewLight; i < dynamicLights.size(); i++) {
+      DynamicLight& dynamicLight = dynamicLights[i];
+      dynamicLight.light = createRandomPointLight(boundsMin, boundsMax);
+      dynamicLight.origin = dynamicLight.light.position;
+      dynamicLight.phase = math::random::randomRange(0.0f, 2.0f * (float)M_PI);
+    }
+  }
+
+  void updateDynamicLights() {
+    if (dynamicLights.size() != static_cast<size_t>(dynamicLightCount)) {
+      generateDynamicLights();
+    }
+    if (!animateLights) {
+      return;
+    }
+    lightTimer += frameTimer;
+    for (auto& dynamicLight : dynamicLights) {
+      dynamicLight.light.position =
+          dynamicLight.origin +
+          glm::vec3(0.0f, std::sin(lightTimer + dynamicLight.phase) * 2.0f,
+                    0.0f);
+      dynamicLight.light.updateLight();
+    }
+  }
+
+  void buildCommandBuffer() override {
+    updateDynamicLights();
+    ForwardRenderer::buildCommandBuffer();
+  }
+
+  void drawRendererSettings() override {
+    if (ImGui::CollapsingHeader("Clustered Lighting")) {
+      ImGui::SliderInt("Dynamic Lights", &dynamicLightCount, 0,
+                       MAX_DYNAMIC_LIGHTS);
+      ImGui::Checkbox("Animate Lights", &animateLights);
+      ImGui::Text("Clusters: %u x %u x %u", lightCulling.gridSize.x,
+                  lightCulling.gridSize.y, lightCulling.gridSize.z);
+    }
+  }
+};
@@ -9,8 +9,24 @@
 #include "../ResourceManagement/ExternalResources/VulkanTexture.hpp"
 #include "../ResourceManagement/ExternalResources/VulkanglTFModel.h"
 #include "../ResourceManagement/VulkanResources/VulkanRenderHelper.h"
+#include "AutoExposure.h"
 #include "BaseRenderer.h"
+#include "BloomPass.h"
+#include "CommandStateTracker.h"
+#include "DepthPyramid.h"
+#include "DynamicResolution.h"
+#include "Frustum.h"
 #include "Lights/Light.h"
+#include "Lights/LightAssignment.h"
+#include "Lights/LightBuffer.h"
+#include "Lights/ShadowCascades.h"
+#include "PostProcessPass.h"
+#include "RenderGraph.h"
+#include "RenderQueue.h"
+#include "SSAOPass.h"
+#include "ShadowAtlas.h"
+#include "ShadowCache.h"
+#include "TAAPass.h"
 #include "vkImGui.h"
 
 struct UISettings {
@@ -24,9 +40,32 @@ struct UISettings {
   bool displayScene = true;
   int activeSceneIndex = 0;
   int aaMode = 0;
+  // Index into renderScales, share of the window the scene is drawn at while
+  // TAA reconstructs the rest
+  int renderScale = 2;
+  // Scale the scene with the GPU time of the frames before instead, within
+  // the bounds of the dynamic resolution settings
+  bool dynamicResolution = false;
+  int aoMode = 1;
+  // Ambient occlusion at full, half or quarter resolution
+  int aoResolution = 1;
+  // Accumulate ambient occlusion over frames, each frame takes fewer samples
+  bool aoTemporal = true;
+  // Share of the bloom added to the scene before tonemapping
+  float bloomStrength = vks::BloomPass::DEFAULT_STRENGTH;
+  // Expose for the average luminance of the frames before
+  bool autoExposure = true;
   float IBLstrength = 1;
   int debugOutput = 0;
   bool usePcfFiltering = true;
+  // Shade point and spot lights through the per draw light lists instead of
+  // looping over every light
+  bool perDrawLightLists = true;
+  // Keep static shadow casters in a cache that is only rendered again when
+  // the cascades change
+  bool shadowCaching = true;
+  // Run ambient occlusion on the compute queue next to the shadow passes
+  bool asyncCompute = true;
 } uiSettings;
 
 class ForwardRenderer : public BaseRenderer {
@@ -58,6 +97,7 @@ class ForwardRenderer : public BaseRenderer {
   std::vector<vkglTF::Model> staticModels;
   std::vector<vkglTF::Model> dynamicModels;
   std::vector<uint32_t> staticModelsToRenderIndices;
+  // Rebuilt every frame, the capacity is kept so it stops allocating
   std::vector<uint32_t> dynamicModelsToRenderIndices;
 
   // We use a material buffer to pass material data ind image indices to the
@@ -80,6 +120,10 @@ class ForwardRenderer : public BaseRenderer {
     float emissiveStrength;
   };
 
+  // Static point lights added by the light benchmark, uploaded after the scene
+  // lights
+  std::vector<vks::light::Light> benchmarkLights;
+
   // TODO: MOVE TO MODEL
   int32_t animationIndex = 0;
   float animationTimer = 0.0f;
@@ -91,6 +135,8 @@ class ForwardRenderer : public BaseRenderer {
     // Doubles as matrix index during depth passes
     uint32_t materialIndex = 0;
     uint32_t transformMatIndex = 0;
+    // Point and spot lights of the draw, only read by the scene pass
+    vks::light::DrawLightList lights;
   };
   struct DynamicDescriptorSets {
     VkDescriptorSet scene{VK_NULL_HANDLE};
@@ -103,6 +149,7 @@ class ForwardRenderer : public BaseRenderer {
     vks::Buffer scene;
     vks::Buffer params;
     vks::Buffer shadow;
+    vks::Buffer shadowAtlas;
   };
 
   std::vector<DynamicDescriptorSets> dynamicDescriptorSets;
@@ -127,10 +174,55 @@ class ForwardRenderer : public BaseRenderer {
   struct {
     VkPipeline skybox{VK_NULL_HANDLE};
     VkPipeline computeParticles{VK_NULL_HANDLE};
+    // Culling disabled, the default prepass pipeline lives on its target
+    VkPipeline depthPrepassDoubleSided{VK_NULL_HANDLE};
   } pipelines;
 
-  std::unordered_map<std::string, VkPipeline> genPipelines;
-  VkPipeline boundPipeline{VK_NULL_HANDLE};
+  // Scene pipeline variants, indexed by a combination of PipelineKeyBits.
+  // Opaque geometry is in the depth prepass and only tests for equal depth,
+  // the depth write variants are for masked materials the prepass skips
+  enum PipelineKeyBits : uint32_t {
+    PIPELINE_KEY_DEFAULT = 0,
+    PIPELINE_KEY_DOUBLE_SIDED = 1 << 0,
+    PIPELINE_KEY_ALPHA_BLENDING = 1 << 1,
+    PIPELINE_KEY_UNLIT = 1 << 2,
+    PIPELINE_KEY_DEPTH_WRITE = 1 << 3,
+    PIPELINE_KEY_COUNT = 1 << 4
+  };
+  std::array<VkPipeline, PIPELINE_KEY_COUNT> genPipelines{};
+
+  // Bound state of the geometry passes, redundant binds are dropped
+  struct {
+    vks::CommandStateTracker depthPrepass;
+    vks::CommandStateTracker shadow;
+    vks::CommandStateTracker shadowCache;
+    vks::CommandStateTracker shadowAtlas;
+    vks::CommandStateTracker scene;
+  } stateTrackers;
+
+  // Sorted list of scene draws, rebuilt every frame
+  vks::RenderQueue renderQueue;
+  // Draws outside of the camera frustum are not queued
+  vks::Frustum viewFrustum;
+  // Point and spot lights touching each queued draw
+  vks::light::LightAssigner lightAssigner;
+
+  // Every light of the scene, bound to the scene set
+  vks::light::LightBuffer lightBuffer;
+
+  // Bindless material textures (VK_EXT_descriptor_indexing). All material
+  // textures live in one array shared by every material, the shader picks the
+  // texture through the index packed into the material's texture sets
+  struct {
+    bool enabled = false;
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT features{};
+    uint32_t maxTextures = 0;
+    VkDescriptorPool descriptorPool{VK_NULL_HANDLE};
+    VkDescriptorSet descriptorSet{VK_NULL_HANDLE};
+    // Slot 0 is the empty texture
+    std::vector<VkDescriptorImageInfo> imageInfos;
+    std::unordered_map<const vkglTF::Texture*, uint32_t> textureIndices;
+  } bindless;
 
   struct {
     VkDescriptorSetLayout scene{VK_NULL_HANDLE};
@@ -162,21 +254,96 @@ class ForwardRenderer : public BaseRenderer {
     std::vector<VkCommandBuffer> shadow;
     std::vector<VkCommandBuffer> aoPrePass;
     std::vector<VkCommandBuffer> compute;
-    std::vector<VkCommandBuffer> aa;
-    std::vector<VkCommandBuffer> ao;
-    std::vector<VkCommandBuffer> tm;
+    std::vector<VkCommandBuffer> present;
   } commandBuffers;
 
   struct {
     vks::VulkanRenderTarget* depthPrepass;
     std::vector<vks::VulkanRenderTarget*> shadowPasses;
-    vks::VulkanRenderTarget* mainPass;
-    vks::VulkanRenderTarget* aoPass;  // Ambient Occlusion
-    vks::VulkanRenderTarget* aaPass;  // Anti Aliasing
-    vks::VulkanRenderTarget* tonemapping;
+    vks::VulkanRenderTarget* scene;
+    vks::VulkanRenderTarget* present;
+    // Min and max of the prepass depth over every mip, for anything that
+    // needs depth at a lower resolution
+    vks::DepthPyramid depthPyramid;
   } renderTargets;
 
+  // Static casters of every shadow cascade
+  vks::ShadowCache shadowCache;
+  // Which casters a shadow pass draws
+  enum class ShadowCasters { All, Static, Moving };
+  // Set once a shadow caster moved since the scene was loaded
+  bool hasMovingCasters = false;
+  // A shadow caster appeared or moved this frame
+  bool shadowCastersChanged = false;
+  // Shadows of point and spot lights
+  vks::ShadowAtlas shadowAtlas;
+  // Compute SSAO or horizon based ambient occlusion from the prepass depth, at
+  // reduced resolution and accumulated over frames
+  vks::SSAOPass ssaoPass;
+  // Compute temporal anti aliasing, also brings a scene drawn below the
+  // window size up to it
+  vks::TAAPass taaPass;
+  // Sub pixel offset of this frame's projection, zero without TAA
+  glm::vec2 taaJitter{0.0f};
+  // Times the frames on the GPU and scales the render extent to the target
+  // time, the render targets keep the size of the largest scale
+  vks::DynamicResolution dynamicResolution;
+  // Compute bloom mip chain of the anti aliased scene
+  vks::BloomPass bloomPass;
+  // Luminance histogram of the scene, adapted on the GPU for the tonemapping
+  vks::AutoExposure autoExposure;
+  // Compute anti aliasing and tonemapping of the scene
+  vks::PostProcessPass postProcessPass;
+
+  // Rebuilt every frame by buildRenderGraph()
+  vks::RenderGraph renderGraph;
+  struct {
+    vks::RenderGraph::Handle depth;
+    // Motion vectors, written along with the prepass depth
+    vks::RenderGraph::Handle velocity;
+    vks::RenderGraph::Handle depthPyramid;
+    vks::RenderGraph::Handle
+        shadowCascades[vks::light::ShadowCascades::CASCADE_COUNT];
+    vks::RenderGraph::Handle shadowAtlas;
+    // Depth and occlusion at the ambient occlusion resolution, the occlusion
+    // is a history image when accumulated over frames
+    vks::RenderGraph::Handle aoDepth;
+    vks::RenderGraph::Handle occlusion;
+    vks::RenderGraph::Handle occlusionHistory;
+    // Horizon based occlusion goes through the blur, the resolve reads the
+    // denoised occlusion
+    vks::RenderGraph::Handle occlusionBlur;
+    vks::RenderGraph::Handle occlusionDenoised;
+    vks::RenderGraph::Handle ambientOcclusion;
+    vks::RenderGraph::Handle scene;
+    // Output of TAA and the one of the last frame it reprojects, post
+    // processing reads the scene directly without TAA
+    vks::RenderGraph::Handle antiAliased;
+    vks::RenderGraph::Handle taaHistory;
+    // Every mip of the bloom chain, post processing samples the first
+    vks::RenderGraph::Handle bloom;
+    vks::RenderGraph::Handle postProcessed;
+    vks::RenderGraph::Handle swapchain;
+  } graphImages;
+  struct {
+    // The resolve, the last of the ambient occlusion passes
+    uint32_t ambientOcclusion;
+  } graphPasses;
+  // Framebuffers around the graph's attachments, per frame in flight
+  struct GraphFramebuffers {
+    VkFramebuffer scene{VK_NULL_HANDLE};
+    // Cleared when the screen texture sets are allocated again
+    bool valid = false;
+  };
+  std::vector<GraphFramebuffers> graphFramebuffers;
+
   VkExtent2D attachmentSize{};
+  // Size of the depth prepass and the scene, below the window size when TAA
+  // upscales. Post processing and present stay at the window size
+  VkExtent2D renderTargetExtent{};
+  // Part of the render targets the scene is drawn to this frame, smaller
+  // than them while dynamic resolution scales the scene down
+  VkExtent2D renderExtent{};
 
   const std::vector<std::string> supportedExtensions = {
       "KHR_texture_basisu", "KHR_materials_pbrSpecularGlossiness",
@@ -188,16 +355,28 @@ class ForwardRenderer : public BaseRenderer {
 
 #ifndef RenderSettings
 #define MAX_MODELS 16
-#define MAX_LIGHTS 2
-#define MAX_DEPTHPASSES 4
-
-  const uint32_t shadowMapSize = 2048;
+#define SHADOW_CASCADE_COUNT vks::light::ShadowCascades::CASCADE_COUNT
+// Camera depth prepass followed by the shadow cascades and the atlas tiles
+#define SHADOW_ATLAS_TILE_OFFSET (1 + SHADOW_CASCADE_COUNT)
+#define MAX_DEPTHPASSES (SHADOW_ATLAS_TILE_OFFSET + vks::ShadowAtlas::MAX_TILES)
+  // shadow.vert sizes its matrix array with the define of the shader build
+  static_assert(MAX_DEPTHPASSES == 69,
+                "Update -DMAX_DEPTHPASSES in shaders/shadow_shaderToBinary.bat");
+#define MAX_BINDLESS_TEXTURES 4096
+
+  // Size of a single shadow cascade
+  const uint32_t shadowMapSize = 1024;
   // Depth bias (and slope) are used to avoid shadowing artifacts
   const float depthBiasConstant = 1.25f;
   const float depthBiasSlope = 1.75f;
 
   const char* antiAliasingSettings[3] = {"Off", "FXAA", "TAA"};
+  // Value of uiSettings.aaMode that resolves the scene with taaPass
+  static constexpr int AA_MODE_TAA = 2;
+  const char* renderScaleSettings[4] = {"100%", "75%", "67%", "50%"};
+  const float renderScales[4] = {1.0f, 0.75f, 2.0f / 3.0f, 0.5f};
   const char* aoSettings[3] = {"Off", "SSAO", "HBAO"};
+  const char* aoResolutionSettings[3] = {"Full", "Half", "Quarter"};
   // NOTE FOR THE BUFFERS, NOT ALL BUFFERS NEED TO BE UPDATE PER FRAME, BUT ALL
   // THE BUFFERS NEED INITIAL UPDATE, FOR EVERY FRAME: THIS SHOULD BE CHANGED TO
   // 1 SHARED BUFFER AS UPDATES ARE RARE AND SHARED BETWEEN FRAMES
@@ -209,7 +388,7 @@ class ForwardRenderer : public BaseRenderer {
     glm::vec2 fovScale = glm::vec2(1.0f);
     float zNear = 1;
     float zFar = 500;
-    float kernelSize = 64;
+    float kernelSize = 16;
     float radius = 0.5f;
     float aaType = 0;
     float aoType = 0;
@@ -220,23 +399,55 @@ class ForwardRenderer : public BaseRenderer {
     glm::mat4 depthMVP[MAX_DEPTHPASSES];
   } shadowParams;
 
+  // Local lights beyond this distance are not shadowed
+  float localShadowDistance = 64.0f;
+  vks::ShadowAtlas::GPUData shadowAtlasParams{};
+
   // Should (M?)VP be precomputed
   struct UBOMatrices {
     glm::mat4 models[MAX_MODELS];
-    glm::mat4 lightSpace[MAX_LIGHTS];
+    // Cascades of the first directional light
+    glm::mat4 cascadeViewProj[SHADOW_CASCADE_COUNT];
+    // Far view depth of each cascade
+    glm::vec4 cascadeSplits;
     glm::mat4 projection;
     glm::mat4 view;
     glm::vec4 camPos;
     glm::vec2 screenSize;
+    // For the motion vectors of the prepass, the camera without the jitter of
+    // this frame and the last one and the models of the last frame
+    alignas(16) glm::mat4 viewProjection;
+    glm::mat4 previousViewProjection;
+    glm::mat4 previousModels[MAX_MODELS];
   } uboMatrices;
+  // Transform of every dynamic model in the last frame, by model index
+  std::vector<glm::mat4> previousModelTransforms;
 
   const char* debugInputs[12] = {"None", "Color Map", "Normals", "AO Map", "Emissive Map", "Metallic Map", "Roughness Map", "F", "G", "D", "IBL Contribution",
                                    "Light Contribution" /*, "Diffuse Contribution",
                                    "Specular Contribution"*/};
 
   std::vector<vks::light::Light> lights;
+  vks::light::ShadowCascades shadowCascades;
+  std::array<vks::Frustum, SHADOW_CASCADE_COUNT> shadowFrustums;
+  // Shadow caster with the cascades it survived culling against. Casters
+  // outside of every cascade are kept for the shadow atlas
+  struct ShadowDraw {
+    vkglTF::Primitive* primitive;
+    vkglTF::Node* node;
+    uint32_t modelIndex;
+    uint32_t transformIndex;
+    // Cascades the caster is drawn into
+    uint32_t cascadeMask;
+    // World space bounds, unbounded casters are never culled
+    bool bounded;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+  };
+  // Rebuilt every frame, the capacity is kept so it stops allocating
+  std::vector<ShadowDraw> shadowDraws;
+  std::array<uint32_t, SHADOW_CASCADE_COUNT> shadowCasterCounts{};
   struct SceneParams {
-    vks::light::GPULightInfo lights[MAX_LIGHTS];
     float lightCount;
     float prefilteredCubeMipLevels;
     float debugViewInputs = 0.0f;
@@ -244,6 +455,19 @@ class ForwardRenderer : public BaseRenderer {
     float scaleIBLAmbient = 1.0f;
     float usePCF = 1;
   } sceneParams;  // TODO: NOT UPDATE EVERY FRAME
+
+  // Light counts the benchmark steps through, each is measured after a few
+  // warm up frames
+  const uint32_t lightBenchmarkCounts[6] = {0, 16, 64, 256, 1024, 4096};
+  const uint32_t lightBenchmarkWarmupFrames = 30;
+  const uint32_t lightBenchmarkFrames = 240;
+  struct {
+    bool running = false;
+    uint32_t step = 0;
+    uint32_t frame = 0;
+    double frameTimeSum = 0.0;
+    uint64_t uploadedLights = 0;
+  } lightBenchmark;
 #endif
 
   ForwardRenderer() : BaseRenderer() {
@@ -272,10 +496,13 @@ class ForwardRenderer : public BaseRenderer {
 
   ~ForwardRenderer() {
     for (auto& pipeline : genPipelines) {
-      vkDestroyPipeline(device, pipeline.second, nullptr);
+      if (pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(device, pipeline, nullptr);
+      }
     }
 
     vkDestroyPipeline(device, pipelines.skybox, nullptr);
+    vkDestroyPipeline(device, pipelines.depthPrepassDoubleSided, nullptr);
 
     vkDestroyPipelineLayout(device, pipelineLayouts.scene, nullptr);
     vkDestroyPipelineLayout(device, pipelineLayouts.skybox, nullptr);
@@ -291,6 +518,10 @@ class ForwardRenderer : public BaseRenderer {
     vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.postProcessing,
                                  nullptr);
     vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.shadow, nullptr);
+    lightBuffer.destroy();
+    if (bindless.descriptorPool != VK_NULL_HANDLE) {
+      vkDestroyDescriptorPool(device, bindless.descriptorPool, nullptr);
+    }
 
     vkDestroyImage(device, multisampleTarget.color.image, nullptr);
     vkDestroyImageView(device, multisampleTarget.color.view, nullptr);
@@ -299,21 +530,33 @@ class ForwardRenderer : public BaseRenderer {
     vkDestroyImageView(device, multisampleTarget.depth.view, nullptr);
     vkFreeMemory(device, multisampleTarget.depth.memory, nullptr);
 
-    for (uint32_t i = 0; i < swapChain.imageCount; i++) {
+    for (uint32_t i = 0; i < maxFramesInFlight; i++) {
       dynamicUniformBuffers[i].scene.destroy();
       dynamicUniformBuffers[i].params.destroy();
       dynamicUniformBuffers[i].shadow.destroy();
+      dynamicUniformBuffers[i].shadowAtlas.destroy();
     }
 
-    delete renderTargets.aaPass;
-    delete renderTargets.tonemapping;
-    delete renderTargets.aoPass;
-    delete renderTargets.mainPass;
+    delete renderTargets.scene;
+    delete renderTargets.present;
     delete renderTargets.depthPrepass;
+    renderTargets.depthPyramid.destroy();
 
     for (auto& shadowTarget : renderTargets.shadowPasses) {
       delete shadowTarget;
     }
+    shadowCache.destroy();
+    shadowAtlas.destroy();
+    ssaoPass.destroy();
+    taaPass.destroy();
+    dynamicResolution.destroy();
+    bloomPass.destroy();
+    autoExposure.destroy();
+    postProcessPass.destroy();
+    renderGraph.destroy();
+    for (GraphFramebuffers& framebuffers : graphFramebuffers) {
+      vkDestroyFramebuffer(device, framebuffers.scene, nullptr);
+    }
 
     staticUniformBuffers.postProcessing.destroy();
 
@@ -343,6 +586,68 @@ class ForwardRenderer : public BaseRenderer {
     }
   }
 
+  // Enables descriptor indexing for bindless material textures if the device
+  // supports everything the material array needs, otherwise the renderer keeps
+  // using one descriptor set per material
+  virtual void getEnabledExtensions() override {
+    if (!vulkanDevice->extensionSupported(
+            VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) ||
+        !vulkanDevice->extensionSupported(VK_KHR_MAINTENANCE3_EXTENSION_NAME)) {
+      return;
+    }
+    auto getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+        vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR"));
+    auto getProperties2 =
+        reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(
+            vkGetInstanceProcAddr(instance,
+                                  "vkGetPhysicalDeviceProperties2KHR"));
+    if (!getFeatures2 || !getProperties2) {
+      return;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT supportedFeatures{};
+    supportedFeatures.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    VkPhysicalDeviceFeatures2KHR features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+    features2.pNext = &supportedFeatures;
+    getFeatures2(physicalDevice, &features2);
+    if (!supportedFeatures.shaderSampledImageArrayNonUniformIndexing ||
+        !supportedFeatures.descriptorBindingPartiallyBound ||
+        !supportedFeatures.descriptorBindingSampledImageUpdateAfterBind ||
+        !supportedFeatures.runtimeDescriptorArray) {
+      return;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties{};
+    indexingProperties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2KHR properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+    properties2.pNext = &indexingProperties;
+    getProperties2(physicalDevice, &properties2);
+    bindless.maxTextures = std::min(
+        {static_cast<uint32_t>(MAX_BINDLESS_TEXTURES),
+         indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+         indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+         indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages});
+
+    // Only enable what the material array uses
+    bindless.features.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    bindless.features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    bindless.features.descriptorBindingPartiallyBound = VK_TRUE;
+    bindless.features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    bindless.features.runtimeDescriptorArray = VK_TRUE;
+    bindless.features.pNext = deviceCreatepNextChain;
+    deviceCreatepNextChain = &bindless.features;
+
+    enabledDeviceExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+    enabledDeviceExtensions.push_back(
+        VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+    bindless.enabled = true;
+  }
+
   void setupDepthStencil() override {
     if (getMSAASampleCount() == VK_SAMPLE_COUNT_1_BIT) {
       BaseRenderer::setupDepthStencil();
@@ -624,15 +929,13 @@ class ForwardRenderer : public BaseRenderer {
 
   void createCommandBuffers() override {
     BaseRenderer::createCommandBuffers();
-    commandBuffers.ui.resize(swapChain.imageCount);
-    commandBuffers.postProcessing.resize(swapChain.imageCount);
-    commandBuffers.scene.resize(swapChain.imageCount);
-    commandBuffers.shadow.resize(swapChain.imageCount);
-    commandBuffers.aoPrePass.resize(swapChain.imageCount);
-    commandBuffers.aa.resize(swapChain.imageCount);
-    commandBuffers.ao.resize(swapChain.imageCount);
-    commandBuffers.tm.resize(swapChain.imageCount);
-    computeCmdBuffers.resize(swapChain.imageCount);
+    commandBuffers.ui.resize(maxFramesInFlight);
+    commandBuffers.postProcessing.resize(maxFramesInFlight);
+    commandBuffers.scene.resize(maxFramesInFlight);
+    // One shadow command buffer per cascade and frame
+    commandBuffers.shadow.resize(maxFramesInFlight * SHADOW_CASCADE_COUNT);
+    commandBuffers.aoPrePass.resize(maxFramesInFlight);
+    commandBuffers.present.resize(maxFramesInFlight);
 
     VkCommandBufferAllocateInfo secondaryGraphicsCmdBufAllocateInfo =
         vks::initializers::commandBufferAllocateInfo(
@@ -648,29 +951,18 @@ class ForwardRenderer : public BaseRenderer {
     VK_CHECK_RESULT(
         vkAllocateCommandBuffers(device, &secondaryGraphicsCmdBufAllocateInfo,
                                  commandBuffers.scene.data()));
-    VK_CHECK_RESULT(
-        vkAllocateCommandBuffers(device, &secondaryGraphicsCmdBufAllocateInfo,
-                                 commandBuffers.shadow.data()));
+    VkCommandBufferAllocateInfo shadowCmdBufAllocateInfo =
+        vks::initializers::commandBufferAllocateInfo(
+            graphicsCmdPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            static_cast<uint32_t>(commandBuffers.shadow.size()));
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &shadowCmdBufAllocateInfo,
+                                             commandBuffers.shadow.data()));
     VK_CHECK_RESULT(
         vkAllocateCommandBuffers(device, &secondaryGraphicsCmdBufAllocateInfo,
                                  commandBuffers.aoPrePass.data()));
     VK_CHECK_RESULT(
         vkAllocateCommandBuffers(device, &secondaryGraphicsCmdBufAllocateInfo,
-                                 commandBuffers.ao.data()));
-    VK_CHECK_RESULT(
-        vkAllocateCommandBuffers(device, &secondaryGraphicsCmdBufAllocateInfo,
-                                 commandBuffers.aa.data()));
-    VK_CHECK_RESULT(
-        vkAllocateCommandBuffers(device, &secondaryGraphicsCmdBufAllocateInfo,
-                                 commandBuffers.tm.data()));
-
-    VkCommandBufferAllocateInfo secondaryComputeCmdBufAllocateInfo =
-        vks::initializers::commandBufferAllocateInfo(
-            computeCmdPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY,
-            static_cast<uint32_t>(computeCmdBuffers.size()));
-
-    VK_CHECK_RESULT(vkAllocateCommandBuffers(
-        device, &secondaryComputeCmdBufAllocateInfo, computeCmdBuffers.data()));
+                                 commandBuffers.present.data()));
   }
 
   void destroyCommandBuffers() override {
@@ -691,13 +983,7 @@ class ForwardRenderer : public BaseRenderer {
                          commandBuffers.scene.data());
     vkFreeCommandBuffers(device, graphicsCmdPool,
                          static_cast<uint32_t>(commandBuffers.scene.size()),
-                         commandBuffers.aa.data());
-    vkFreeCommandBuffers(device, graphicsCmdPool,
-                         static_cast<uint32_t>(commandBuffers.scene.size()),
-                         commandBuffers.tm.data());
-    vkFreeCommandBuffers(device, graphicsCmdPool,
-                         static_cast<uint32_t>(commandBuffers.scene.size()),
-                         commandBuffers.ao.data());
+                         commandBuffers.present.data());
     vkFreeCommandBuffers(device, graphicsCmdPool,
                          static_cast<uint32_t>(commandBuffers.scene.size()),
                          commandBuffers.aoPrePass.data());
@@ -744,6 +1030,27 @@ class ForwardRenderer : public BaseRenderer {
                 (uint32_t)(staticModels.size() + dynamicModels.size()));
     ImGui::Text("Rendered Models: %i", dynamicModelsToRenderIndices.size());
 
+    if (ImGui::CollapsingHeader("Command Statistics")) {
+      const std::pair<const char*, const vks::CommandStateTracker*> passes[5] =
+          {{"Depth Prepass", &stateTrackers.depthPrepass},
+           {"Shadow", &stateTrackers.shadow},
+           {"Shadow Cache", &stateTrackers.shadowCache},
+           {"Shadow Atlas", &stateTrackers.shadowAtlas},
+           {"Scene", &stateTrackers.scene}};
+      for (const auto& pass : passes) {
+        const vks::CommandStateTracker::Stats& stats = pass.second->getStats();
+        ImGui::Text("%s: %u draws, %u binds issued, %u elided", pass.first,
+                    stats.draws, stats.issued, stats.elided);
+      }
+      const vks::RenderGraph::Stats& graphStats = renderGraph.getStats();
+      ImGui::Text("Render graph: %u passes, %u culled", graphStats.passes,
+                  graphStats.culledPasses);
+      ImGui::Text("Transient images: %u in %u blocks, %.1f of %.1f MB",
+                  graphStats.transientImages, graphStats.memoryBlocks,
+                  graphStats.allocatedBytes / (1024.0f * 1024.0f),
+                  graphStats.requestedBytes / (1024.0f * 1024.0f));
+    }
+
     ImGui::SetNextWindowPos(
         ImVec2(20 * uiSettings.scale, 360 * uiSettings.scale),
         ImGuiCond_FirstUseEver);
@@ -774,6 +1081,38 @@ class ForwardRenderer : public BaseRenderer {
     if (ImGui::CollapsingHeader("Light Settings")) {
       ImGui::DragFloat("Ibl Intensity", &uiSettings.IBLstrength, 0.1f, 0.0f,
                        2.0f);
+      ImGui::SliderFloat("Shadow Distance", &shadowCascades.maxDistance, 16.0f,
+                         512.0f);
+      ImGui::SliderFloat("Cascade Split Lambda", &shadowCascades.splitLambda,
+                         0.0f, 1.0f);
+      ImGui::Checkbox("Cache Static Shadows", &uiSettings.shadowCaching);
+      ImGui::Text("Shadow casters per cascade: %u, %u, %u, %u",
+                  shadowCasterCounts[0], shadowCasterCounts[1],
+                  shadowCasterCounts[2], shadowCasterCounts[3]);
+      const vks::ShadowCache::Stats& cacheStats = shadowCache.getStats();
+      ImGui::Text("Shadow cache: %u rebuilds, %u scrolls, %u copies",
+                  cacheStats.rebuilds, cacheStats.scrolls,
+                  cacheStats.composites);
+      const vks::ShadowAtlas::Stats& atlasStats = shadowAtlas.getStats();
+      ImGui::Text("Shadow atlas: %u lights, %u tiles, %u rendered, %u waiting",
+                  atlasStats.lights, atlasStats.tilesUsed,
+                  atlasStats.tilesRendered, atlasStats.pending);
+      int tileBudget = static_cast<int>(shadowAtlas.tileBudget);
+      if (ImGui::SliderInt("Atlas Tiles Per Frame", &tileBudget, 1,
+                           vks::ShadowAtlas::MAX_TILES)) {
+        shadowAtlas.tileBudget = static_cast<uint32_t>(tileBudget);
+      }
+      ImGui::SliderFloat("Local Shadow Distance", &localShadowDistance, 4.0f,
+                         256.0f);
+      const vks::light::LightBuffer::Stats& lightStats = lightBuffer.getStats();
+      ImGui::Text("Lights: %u, uploaded: %u, capacity: %u", lightStats.total,
+                  lightStats.uploaded, lightBuffer.getCapacity());
+      if (lightBenchmark.running) {
+        ImGui::Text("Light benchmark: step %u of %u", lightBenchmark.step + 1,
+                    (uint32_t)std::size(lightBenchmarkCounts));
+      } else if (ImGui::Button("Run Light Benchmark")) {
+        startLightBenchmark();
+      }
       ImGui::Indent();
       for (uint32_t i = 0; i < lights.size(); i++) {
         if (ImGui::CollapsingHeader(
@@ -808,12 +1147,6 @@ class ForwardRenderer : public BaseRenderer {
             if (ImGui::DragFloat3("Target", &lights[i].position.x, 1.0f,
                                   -100.0f, 100.0f))
               updateLight = true;
-            if (ImGui::DragFloat("FOV", &lights[i].lightFOV, 1.0f, 1.0f,
-                                 135.0f))
-              updateLight = true;
-            // ImGui::DragFloat("zNear", &lights[i].lightFOV, 1.0f, 1.0f,
-            // 135.0f); ImGui::DragFloat("zFar",
-            // &lights[i].lightFOV, 1.0f, 1.0f, 135.0f);
           }
           // Point
           else if (lights[i].lightType == 1) {
@@ -823,7 +1156,7 @@ class ForwardRenderer : public BaseRenderer {
 
             ImGui::Text("Light Falloff");
             if (ImGui::DragFloat("Constant", &lights[i].lightConst, 0.01f,
-                                 0.01f, 1.0f))
+                                 vks::light::MIN_FALLOFF_CONSTANT, 1.0f))
               updateLight = true;
             if (ImGui::DragFloat("Linear", &lights[i].lightLinear, 0.01f, 0.0f,
                                  1.0f))
@@ -848,7 +1181,7 @@ class ForwardRenderer : public BaseRenderer {
 
             ImGui::Text("Light Falloff");
             if (ImGui::DragFloat("Constant", &lights[i].lightConst, 0.01f,
-                                 0.01f, 1.0f))
+                                 vks::light::MIN_FALLOFF_CONSTANT, 1.0f))
               updateLight = true;
             if (ImGui::DragFloat("Linear", &lights[i].lightLinear, 0.01f, 0.0f,
                                  1.0f))
@@ -858,7 +1191,7 @@ class ForwardRenderer : public BaseRenderer {
               updateLight = true;
           }
 
-          if (updateLight = true) {
+          if (updateLight) {
             lights[i].updateLight();
           }
           ImGui::PopID();
@@ -923,10 +1256,82 @@ class ForwardRenderer : public BaseRenderer {
         ImGui::EndCombo();
       }
 
-      if (ImGui::DragFloat("SSAO Radius", &postProcessingParams.radius, 0.1f,
-                           0.0f, 10.0f)) {
+      // Applied before the next frame, see updateRenderTargetExtent()
+      const bool dynamicScale = uiSettings.aaMode == AA_MODE_TAA &&
+                                uiSettings.dynamicResolution;
+      if (uiSettings.aaMode == AA_MODE_TAA && !dynamicScale &&
+          ImGui::BeginCombo("Render Scale",
+                            renderScaleSettings[uiSettings.renderScale])) {
+        for (int n = 0; n < sizeof(renderScaleSettings) /
+                                sizeof(renderScaleSettings[0]);
+             n++) {
+          bool is_selected = (n == uiSettings.renderScale);
+          if (ImGui::Selectable(renderScaleSettings[n], is_selected)) {
+            uiSettings.renderScale = n;
+          }
+          if (is_selected) ImGui::SetItemDefaultFocus();
+        }
+        ImGui::EndCombo();
+      }
+      if (uiSettings.aaMode == AA_MODE_TAA &&
+          dynamicResolution.isSupported()) {
+        ImGui::Checkbox("Dynamic Resolution", &uiSettings.dynamicResolution);
+      }
+      if (dynamicScale) {
+        vks::DynamicResolution::Settings& settings =
+            dynamicResolution.settings;
+        ImGui::SliderFloat("Target GPU Time (ms)", &settings.targetFrameTime,
+                           4.0f, 50.0f);
+        ImGui::SliderFloat("Min Render Scale", &settings.minScale, 0.25f,
+                           1.0f);
+        ImGui::SliderFloat("Max Render Scale", &settings.maxScale, 0.25f,
+                           1.0f);
+        ImGui::Text("GPU time: %.2f ms, render scale: %.0f%%",
+                    dynamicResolution.getGpuTime(),
+                    dynamicResolution.getScale() * 100.0f);
+      }
+
+      ImGui::Checkbox("Bloom", &postProcessingParams.enableBloom);
+      if (postProcessingParams.enableBloom) {
+        ImGui::SliderFloat("Bloom Strength", &uiSettings.bloomStrength, 0.0f,
+                           0.25f);
+      }
+      ImGui::Checkbox("Auto Exposure", &uiSettings.autoExposure);
+
+      if (ImGui::BeginCombo("Ambient Occlusion",
+                            aoSettings[uiSettings.aoMode])) {
+        for (int n = 0; n < sizeof(aoSettings) / sizeof(aoSettings[0]); n++) {
+          bool is_selected = (n == uiSettings.aoMode);
+          if (ImGui::Selectable(aoSettings[n], is_selected)) {
+            uiSettings.aoMode = n;
+          }
+          if (is_selected) ImGui::SetItemDefaultFocus();
+        }
+        ImGui::EndCombo();
+      }
+
+      if (ImGui::BeginCombo("Ambient Occlusion Resolution",
+                            aoResolutionSettings[uiSettings.aoResolution])) {
+        for (int n = 0; n < sizeof(aoResolutionSettings) /
+                                sizeof(aoResolutionSettings[0]);
+             n++) {
+          bool is_selected = (n == uiSettings.aoResolution);
+          if (ImGui::Selectable(aoResolutionSettings[n], is_selected)) {
+            uiSettings.aoResolution = n;
+          }
+          if (is_selected) ImGui::SetItemDefaultFocus();
+        }
+        ImGui::EndCombo();
+      }
+      ImGui::Checkbox("Temporal Ambient Occlusion", &uiSettings.aoTemporal);
+
+      if (ImGui::DragFloat("Ambient Occlusion Radius",
+                           &postProcessingParams.radius, 0.1f, 0.0f, 10.0f)) {
         updatePostProcessingParams();
       }
+      ImGui::SliderFloat("Ambient Occlusion Samples",
+                         &postProcessingParams.kernelSize, 4.0f, 64.0f, "%.0f");
+      ImGui::Checkbox("Async Compute", &uiSettings.asyncCompute);
       if (ImGui::Checkbox("Use Shadow PCF Filtering",
                           &uiSettings.usePcfFiltering)) {
         sceneParams.usePCF = uiSettings.usePcfFiltering ? 1 : 0;
@@ -954,55 +1359,31 @@ class ForwardRenderer : public BaseRenderer {
       }
     }
 
+    drawRendererSettings();
+
     ImGui::End();
 
     // Render to generate draw buffers
     ImGui::Render();
   }
 
-  void buildPostProcessingCommandBuffer() {
-    VkCommandBufferInheritanceInfo inheritanceInfo =
-        vks::initializers::commandBufferInheritanceInfo();
-    inheritanceInfo.renderPass = renderPass;
-    inheritanceInfo.framebuffer = frameBuffers[currentFrameIndex];
-
-    VkCommandBufferBeginInfo cmdBufInfo =
-        vks::initializers::commandBufferBeginInfo();
-    cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
-    cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
-
-    VkCommandBuffer currentCommandBuffer =
-        commandBuffers.postProcessing[currentFrameIndex];
-    vkResetCommandBuffer(currentCommandBuffer, 0);
-    VK_CHECK_RESULT(vkBeginCommandBuffer(currentCommandBuffer, &cmdBufInfo));
-
-    VkViewport viewport = vks::initializers::viewport(
-        (float)getWidth(), (float)getHeight(), 0.0f, 1.0f);
-    vkCmdSetViewport(currentCommandBuffer, 0, 1, &viewport);
-    VkRect2D scissor = vks::initializers::rect2D(getWidth(), getHeight(), 0, 0);
-    vkCmdSetScissor(currentCommandBuffer, 0, 1, &scissor);
-
-    VkDeviceSize offsets[1] = {0};
-
-    vkCmdBindDescriptorSets(
-        currentCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-        pipelineLayouts.postProcessing, 0, 1,
-        &renderTargets.aaPass->screenTextureDescriptorSets[currentFrameIndex],
-        0, NULL);
-    vkCmdBindPipeline(currentCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      renderTargets.aoPass->pipeline);
-
-    // Draw triangle
-    vkCmdDraw(currentCommandBuffer, 3, 1, 0, 0);
-
-    VK_CHECK_RESULT(vkEndCommandBuffer(currentCommandBuffer));
+  // Extra UI for derived renderers, drawn into the debug window
+  virtual void drawRendererSettings() {
+    if (ImGui::CollapsingHeader("Light Assignment")) {
+      ImGui::Checkbox("Per Draw Light Lists", &uiSettings.perDrawLightLists);
+      const vks::light::LightAssigner::Stats& stats = lightAssigner.getStats();
+      ImGui::Text("Draws: %u, lights per draw: %.2f", stats.draws,
+                  stats.draws ? (float)stats.assigned / stats.draws : 0.0f);
+      ImGui::Text("Draws over the limit of %u: %u",
+                  vks::light::DrawLightList::MAX_LIGHTS, stats.saturated);
+    }
   }
 
   void buildUICommandBuffer() {
     VkCommandBufferInheritanceInfo inheritanceInfo =
         vks::initializers::commandBufferInheritanceInfo();
     inheritanceInfo.renderPass = renderPass;
-    inheritanceInfo.framebuffer = frameBuffers[currentFrameIndex];
+    inheritanceInfo.framebuffer = frameBuffers[currentImageIndex];
 
     VkCommandBufferBeginInfo cmdBufInfo =
         vks::initializers::commandBufferBeginInfo();
@@ -1022,9 +1403,8 @@ class ForwardRenderer : public BaseRenderer {
   void buildSceneCommandBuffer() {
     VkCommandBufferInheritanceInfo inheritanceInfo =
         vks::initializers::commandBufferInheritanceInfo();
-    inheritanceInfo.renderPass = renderTargets.aaPass->renderPass;
-    inheritanceInfo.framebuffer =
-        renderTargets.aaPass->framebuffers[currentFrameIndex].framebuffer;
+    inheritanceInfo.renderPass = renderTargets.scene->renderPass;
+    inheritanceInfo.framebuffer = graphFramebuffers[currentFrameIndex].scene;
 
     VkCommandBufferBeginInfo cmdBufInfo =
         vks::initializers::commandBufferBeginInfo();
@@ -1037,42 +1417,44 @@ class ForwardRenderer : public BaseRenderer {
     VK_CHECK_RESULT(vkBeginCommandBuffer(currentCommandBuffer, &cmdBufInfo));
 
     VkViewport viewport = vks::initializers::viewport(
-        (float)getWidth(), (float)getHeight(), 0.0f, 1.0f);
+        (float)renderExtent.width, (float)renderExtent.height, 0.0f, 1.0f);
     vkCmdSetViewport(currentCommandBuffer, 0, 1, &viewport);
-    VkRect2D scissor = vks::initializers::rect2D(getWidth(), getHeight(), 0, 0);
+    VkRect2D scissor = vks::initializers::rect2D(renderExtent.width,
+                                                 renderExtent.height, 0, 0);
     vkCmdSetScissor(currentCommandBuffer, 0, 1, &scissor);
 
-    VkDeviceSize offsets[1] = {0};
-
-    for (uint32_t i = 0; i < dynamicModelsToRenderIndices.size(); i++) {
-      vkglTF::Model& model = dynamicModels[dynamicModelsToRenderIndices[i]];
-
-      vkCmdBindVertexBuffers(currentCommandBuffer, 0, 1, &model.vertices.buffer,
-                             offsets);
+    vks::CommandStateTracker& cmd = stateTrackers.scene;
+    cmd.begin(currentCommandBuffer);
+    bindSceneDescriptorSets(cmd);
+    for (const vks::RenderQueue::DrawItem& item : renderQueue.items()) {
+      // Sorting may interleave models, the tracker drops repeated binds
+      vkglTF::Model& model = dynamicModels[item.modelIndex];
+      cmd.bindVertexBuffer(model.vertices.buffer);
       if (model.indices.buffer != VK_NULL_HANDLE) {
-        vkCmdBindIndexBuffer(currentCommandBuffer, model.indices.buffer, 0,
-                             VK_INDEX_TYPE_UINT32);
+        cmd.bindIndexBuffer(model.indices.buffer);
       }
 
-      boundPipeline = VK_NULL_HANDLE;
-      PushConstData pushConst{};
-      pushConst.transformMatIndex = i + 1;
+      cmd.bindPipeline(item.pipeline);
 
-      // Opaque primitives first
-      for (auto node : model.nodes) {
-        renderNode(node, currentFrameIndex, vkglTF::Material::ALPHAMODE_OPAQUE,
-                   currentCommandBuffer, pushConst);
-      }
-      // Alpha masked primitives
-      for (auto node : model.nodes) {
-        renderNode(node, currentFrameIndex, vkglTF::Material::ALPHAMODE_MASK,
-                   currentCommandBuffer, pushConst);
-      }
-      // Transparent primitives
-      // TODO: Correct depth sorting
-      for (auto node : model.nodes) {
-        renderNode(node, currentFrameIndex, vkglTF::Material::ALPHAMODE_BLEND,
-                   currentCommandBuffer, pushConst);
+      const VkDescriptorSet descriptorsets[4] = {
+          dynamicDescriptorSets[currentFrameIndex].scene,
+          item.primitive->material.descriptorSet,
+          item.node->mesh->uniformBuffer.descriptorSet,
+          staticDescriptorSets.materials};
+      cmd.bindDescriptorSets(pipelineLayouts.scene, 0, 4, descriptorsets);
+
+      PushConstData pushConst{};
+      pushConst.materialIndex = item.primitive->material.index;
+      pushConst.transformMatIndex = item.transformIndex;
+      pushConst.lights = lightAssigner.getList(item.lightList);
+      cmd.pushConstants(pipelineLayouts.scene,
+                        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                        sizeof(pushConst), &pushConst);
+
+      if (item.primitive->hasIndices) {
+        cmd.drawIndexed(item.primitive->indexCount, item.primitive->firstIndex);
+      } else {
+        cmd.draw(item.primitive->vertexCount);
       }
     }
 
@@ -1097,11 +1479,21 @@ class ForwardRenderer : public BaseRenderer {
     VK_CHECK_RESULT(vkEndCommandBuffer(currentCommandBuffer));
   }
 
-  void buildShadowCommandBuffer() {
+  // Binds sets that stay the same for every scene draw, called once per frame
+  // before the render queue is recorded
+  virtual void bindSceneDescriptorSets(vks::CommandStateTracker& cmd) {}
+
+  // Recorded outside of any render pass once the depth prepass has finished
+  virtual void buildDepthPrepassConsumers(VkCommandBuffer commandBuffer) {}
+
+  // Records the shadow casters of a cascade into a secondary command buffer
+  // that continues renderPass
+  void buildShadowCommandBuffer(uint32_t cascade, VkRenderPass renderPass,
+                                ShadowCasters casters) {
     VkCommandBufferInheritanceInfo inheritanceInfo =
         vks::initializers::commandBufferInheritanceInfo();
-    inheritanceInfo.renderPass = renderTargets.shadowPasses[0]->renderPass;
-    inheritanceInfo.framebuffer = renderTargets.shadowPasses[0]
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.framebuffer = renderTargets.shadowPasses[cascade]
                                       ->framebuffers[currentFrameIndex]
                                       .framebuffer;
 
@@ -1111,47 +1503,127 @@ class ForwardRenderer : public BaseRenderer {
     cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
 
     VkCommandBuffer currentCommandBuffer =
-        commandBuffers.shadow[currentFrameIndex];
+        commandBuffers.shadow[currentFrameIndex * SHADOW_CASCADE_COUNT +
+                              cascade];
 
     vkResetCommandBuffer(currentCommandBuffer, 0);
     VK_CHECK_RESULT(vkBeginCommandBuffer(currentCommandBuffer, &cmdBufInfo));
 
-    VkViewport viewport = vks::initializers::viewport(
-        (float)shadowMapSize, (float)shadowMapSize, 0.0f, 1.0f);
-    vkCmdSetViewport(currentCommandBuffer, 0, 1, &viewport);
     VkRect2D scissor =
         vks::initializers::rect2D(shadowMapSize, shadowMapSize, 0, 0);
-    vkCmdSetScissor(currentCommandBuffer, 0, 1, &scissor);
+    vks::CommandStateTracker& cmd = stateTrackers.shadow;
+    cmd.begin(currentCommandBuffer);
+    recordShadowCasters(cmd, cascade, scissor, casters);
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(currentCommandBuffer));
+  }
+
+  // Draws the culled shadow casters of a cascade, limited to the scissor.
+  // regionFrustum optionally culls them further to the scissor
+  void recordShadowCasters(vks::CommandStateTracker& cmd, uint32_t cascade,
+                           const VkRect2D& scissor, ShadowCasters casters,
+                           const vks::Frustum* regionFrustum = nullptr) {
+    VkCommandBuffer commandBuffer = cmd.getCommandBuffer();
+    VkViewport viewport = vks::initializers::viewport(
+        (float)shadowMapSize, (float)shadowMapSize, 0.0f, 1.0f);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
     // Set depth bias (aka "Polygon offset")
-    vkCmdSetDepthBias(currentCommandBuffer, depthBiasConstant, 0.0f,
-                      depthBiasSlope);
-    VkDeviceSize offsets[1] = {0};
+    vkCmdSetDepthBias(commandBuffer, depthBiasConstant, 0.0f, depthBiasSlope);
 
-    vkCmdBindPipeline(currentCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      renderTargets.shadowPasses[0]->pipeline);
-    for (uint32_t i = 0; i < dynamicModelsToRenderIndices.size(); i++) {
-      vkglTF::Model& model = dynamicModels[dynamicModelsToRenderIndices[i]];
+    cmd.bindPipeline(renderTargets.shadowPasses[0]->pipeline);
+    const uint32_t cascadeBit = 1u << cascade;
+    for (const ShadowDraw& draw : shadowDraws) {
+      if ((draw.cascadeMask & cascadeBit) == 0) {
+        continue;
+      }
+      if (casters != ShadowCasters::All &&
+          shadowCache.isMoving(draw.modelIndex) !=
+              (casters == ShadowCasters::Moving)) {
+        continue;
+      }
+      if (regionFrustum && draw.bounded &&
+          !regionFrustum->intersectsExtruded(draw.boundsMin, draw.boundsMax)) {
+        continue;
+      }
+      vkglTF::Model& model = dynamicModels[draw.modelIndex];
 
-      vkCmdBindVertexBuffers(currentCommandBuffer, 0, 1, &model.vertices.buffer,
-                             offsets);
+      cmd.bindVertexBuffer(model.vertices.buffer);
       if (model.indices.buffer != VK_NULL_HANDLE) {
-        vkCmdBindIndexBuffer(currentCommandBuffer, model.indices.buffer, 0,
-                             VK_INDEX_TYPE_UINT32);
+        cmd.bindIndexBuffer(model.indices.buffer);
       }
 
       PushConstData pushConst{};
-      pushConst.transformMatIndex = i + 1;
-      pushConst.materialIndex = i + 1;
+      pushConst.transformMatIndex = draw.transformIndex;
+      // Cascade matrices follow the camera's in the depth pass UBO
+      pushConst.materialIndex = cascade + 1;
+      const VkDescriptorSet descriptorsets[2] = {
+          dynamicDescriptorSets[currentFrameIndex].shadow,
+          draw.node->mesh->uniformBuffer.descriptorSet};
+      cmd.pushConstants(pipelineLayouts.shadow, VK_SHADER_STAGE_VERTEX_BIT,
+                        sizeof(pushConst), &pushConst);
+      cmd.bindDescriptorSets(pipelineLayouts.shadow, 0, 2, descriptorsets);
+
+      if (draw.primitive->hasIndices) {
+        cmd.drawIndexed(draw.primitive->indexCount, draw.primitive->firstIndex);
+      } else {
+        cmd.draw(draw.primitive->vertexCount);
+      }
+    }
+  }
 
-      // Opaque primitives first
+  // Culls every primitive against the cascades, extruded toward the light so
+  // casters outside of a cascade still shadow it. Each caster is kept once
+  // with the cascades it lands in, atlas tiles cull the list on their own
+  void buildShadowCasterList() {
+    shadowDraws.clear();
+    shadowCasterCounts.fill(0);
+    for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+      shadowFrustums[cascade].update(shadowCascades.getViewProjection(cascade));
+    }
+    for (uint32_t i = 0; i < dynamicModelsToRenderIndices.size(); i++) {
+      const uint32_t modelIndex = dynamicModelsToRenderIndices[i];
+      vkglTF::Model& model = dynamicModels[modelIndex];
       for (auto node : model.nodes) {
-        renderNode(node, currentFrameIndex, vkglTF::Material::ALPHAMODE_OPAQUE,
-                   currentCommandBuffer, pushConst, true);
+        addNodeToShadowCasters(node, model.transform.transformMat, modelIndex,
+                               i + 1);
       }
     }
+  }
 
-    VK_CHECK_RESULT(vkEndCommandBuffer(currentCommandBuffer));
+  void addNodeToShadowCasters(vkglTF::Node* node, const glm::mat4& transform,
+                              uint32_t modelIndex, uint32_t transformIndex) {
+    if (node->mesh) {
+      for (vkglTF::Primitive* primitive : node->mesh->primitives) {
+        ShadowDraw draw{};
+        draw.primitive = primitive;
+        draw.node = node;
+        draw.modelIndex = modelIndex;
+        draw.transformIndex = transformIndex;
+        draw.bounded = primitive->bb.valid;
+        if (draw.bounded) {
+          const vkglTF::BoundingBox bounds = primitive->bb.getAABB(transform);
+          draw.boundsMin = bounds.min;
+          draw.boundsMax = bounds.max;
+          for (uint32_t c = 0; c < SHADOW_CASCADE_COUNT; c++) {
+            if (shadowFrustums[c].intersectsExtruded(bounds.min, bounds.max)) {
+              draw.cascadeMask |= 1u << c;
+            }
+          }
+        } else {
+          draw.cascadeMask = (1u << SHADOW_CASCADE_COUNT) - 1;
+        }
+        for (uint32_t c = 0; c < SHADOW_CASCADE_COUNT; c++) {
+          shadowCasterCounts[c] += (draw.cascadeMask >> c) & 1;
+        }
+        shadowDraws.push_back(draw);
+      }
+    }
+
+    for (auto child : node->children) {
+      addNodeToShadowCasters(child, transform, modelIndex, transformIndex);
+    }
   }
 
   void buildDepthPrepassCommandBuffer() {
@@ -1173,126 +1645,122 @@ class ForwardRenderer : public BaseRenderer {
     VK_CHECK_RESULT(vkBeginCommandBuffer(currentCommandBuffer, &cmdBufInfo));
 
     VkViewport viewport = vks::initializers::viewport(
-        (float)getWidth(), (float)getHeight(), 0.0f, 1.0f);
+        (float)renderExtent.width, (float)renderExtent.height, 0.0f, 1.0f);
     vkCmdSetViewport(currentCommandBuffer, 0, 1, &viewport);
-    VkRect2D scissor = vks::initializers::rect2D(getWidth(), getHeight(), 0, 0);
+    VkRect2D scissor = vks::initializers::rect2D(renderExtent.width,
+                                                 renderExtent.height, 0, 0);
     vkCmdSetScissor(currentCommandBuffer, 0, 1, &scissor);
 
-    // Set depth bias (aka "Polygon offset")
-    vkCmdSetDepthBias(currentCommandBuffer, 0.0f, 0.0f, 1.0f);
-    VkDeviceSize offsets[1] = {0};
-
-    vkCmdBindPipeline(currentCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      renderTargets.depthPrepass->pipeline);
-    for (uint32_t i = 0; i < dynamicModelsToRenderIndices.size(); i++) {
-      vkglTF::Model& model = dynamicModels[dynamicModelsToRenderIndices[i]];
-
-      vkCmdBindVertexBuffers(currentCommandBuffer, 0, 1, &model.vertices.buffer,
-                             offsets);
+    // Opaque draws of the render queue, front to back. Masked and blended
+    // draws test against this depth in the scene pass but are not part of it
+    vks::CommandStateTracker& cmd = stateTrackers.depthPrepass;
+    cmd.begin(currentCommandBuffer);
+    for (const vks::RenderQueue::DrawItem& item : renderQueue.items()) {
+      const vkglTF::Material& material = item.primitive->material;
+      if (material.alphaMode != vkglTF::Material::ALPHAMODE_OPAQUE) {
+        continue;
+      }
+      vkglTF::Model& model = dynamicModels[item.modelIndex];
+      cmd.bindVertexBuffer(model.vertices.buffer);
       if (model.indices.buffer != VK_NULL_HANDLE) {
-        vkCmdBindIndexBuffer(currentCommandBuffer, model.indices.buffer, 0,
-                             VK_INDEX_TYPE_UINT32);
+        cmd.bindIndexBuffer(model.indices.buffer);
       }
 
-      PushConstData pushConst{};
-      pushConst.transformMatIndex = i + 1;
-      pushConst.materialIndex = 0;
+      cmd.bindPipeline(material.doubleSided
+                           ? pipelines.depthPrepassDoubleSided
+                           : renderTargets.depthPrepass->pipeline);
 
-      // Opaque primitives first
-      for (auto node : model.nodes) {
-        renderNode(node, currentFrameIndex, vkglTF::Material::ALPHAMODE_OPAQUE,
-                   currentCommandBuffer, pushConst, true);
+      const VkDescriptorSet descriptorsets[2] = {
+          dynamicDescriptorSets[currentFrameIndex].shadow,
+          item.node->mesh->uniformBuffer.descriptorSet};
+      cmd.bindDescriptorSets(pipelineLayouts.shadow, 0, 2, descriptorsets);
+
+      PushConstData pushConst{};
+      pushConst.transformMatIndex = item.transformIndex;
+      cmd.pushConstants(pipelineLayouts.shadow, VK_SHADER_STAGE_VERTEX_BIT,
+                        sizeof(pushConst), &pushConst);
+
+      if (item.primitive->hasIndices) {
+        cmd.drawIndexed(item.primitive->indexCount, item.primitive->firstIndex);
+      } else {
+        cmd.draw(item.primitive->vertexCount);
       }
     }
 
     VK_CHECK_RESULT(vkEndCommandBuffer(currentCommandBuffer));
   }
 
-  void renderNode(vkglTF::Node* node, uint32_t cbIndex,
-                  vkglTF::Material::AlphaMode alphaMode, VkCommandBuffer curBuf,
-                  PushConstData pushConst, bool isShadow = false) {
+  // Gathers every visible primitive into the render queue and sorts it
+  // Opaque and masked draws are ordered by state then front to back, blended
+  // draws strictly back to front
+  void buildRenderQueue() {
+    renderQueue.clear();
+    lightAssigner.clearLists();
+    viewFrustum.update(camera.matrices.perspective * camera.matrices.view);
+    const glm::vec3 camPos = glm::vec3(uboMatrices.camPos);
+    for (uint32_t i = 0; i < dynamicModelsToRenderIndices.size(); i++) {
+      const uint32_t modelIndex = dynamicModelsToRenderIndices[i];
+      vkglTF::Model& model = dynamicModels[modelIndex];
+      for (auto node : model.nodes) {
+        addNodeToRenderQueue(node, model.transform.transformMat, camPos,
+                             modelIndex, i + 1);
+      }
+    }
+    renderQueue.sort();
+  }
+
+  void addNodeToRenderQueue(vkglTF::Node* node, const glm::mat4& transform,
+                            const glm::vec3& camPos, uint32_t modelIndex,
+                            uint32_t transformIndex) {
     if (node->mesh) {
-      // Render mesh primitives
       for (vkglTF::Primitive* primitive : node->mesh->primitives) {
-        if (isShadow) {
-          const std::vector<VkDescriptorSet> descriptorsets = {
-              dynamicDescriptorSets[currentFrameIndex].shadow,
-              node->mesh->uniformBuffer.descriptorSet};
-          vkCmdPushConstants(curBuf, pipelineLayouts.shadow,
-                             VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushConst),
-                             &pushConst);
-
-          vkCmdBindDescriptorSets(
-              curBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.shadow,
-              0, descriptorsets.size(), descriptorsets.data(), 0, nullptr);
-
-          if (primitive->hasIndices) {
-            vkCmdDrawIndexed(curBuf, primitive->indexCount, 1,
-                             primitive->firstIndex, 0, 0);
-          } else {
-            vkCmdDraw(curBuf, primitive->vertexCount, 1, 0, 0);
-          }
-        } else if (primitive->material.alphaMode == alphaMode) {
-          std::string pipelineName = "pbr";
-          std::string pipelineVariant = "";
-
-          if (primitive->material.unlit) {
-            // KHR_materials_unlit
-            pipelineName = "unlit";
-          };
-
-          // Material properties define if we e.g. need to bind a pipeline
-          // variant with culling disabled (double sided)
-          if (alphaMode == vkglTF::Material::ALPHAMODE_BLEND) {
-            pipelineVariant = "_alpha_blending";
-          } else {
-            if (primitive->material.doubleSided) {
-              pipelineVariant = "_double_sided";
-            }
-          }
-
-          const VkPipeline pipeline =
-              genPipelines[pipelineName + pipelineVariant];
-
-          if (pipeline != boundPipeline) {
-            vkCmdBindPipeline(curBuf, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                              pipeline);
-            boundPipeline = pipeline;
+        const vkglTF::Material& material = primitive->material;
+        const bool blend =
+            material.alphaMode == vkglTF::Material::ALPHAMODE_BLEND;
+
+        float viewDepth = 0.0f;
+        uint32_t lightList = 0;
+        if (primitive->bb.valid) {
+          const vkglTF::BoundingBox bounds = primitive->bb.getAABB(transform);
+          if (!viewFrustum.intersects(bounds.min, bounds.max)) {
+            continue;
           }
+          viewDepth = glm::length((bounds.min + bounds.max) * 0.5f - camPos);
+          lightList = lightAssigner.assign(bounds.min, bounds.max);
+        } else {
+          lightList = lightAssigner.assignEmpty();
+        }
 
-          const std::vector<VkDescriptorSet> descriptorsets = {
-              dynamicDescriptorSets[currentFrameIndex].scene,
-              primitive->material.descriptorSet,
-              node->mesh->uniformBuffer.descriptorSet,
-              staticDescriptorSets.materials};
-          vkCmdBindDescriptorSets(curBuf, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                  pipelineLayouts.scene, 0,
-                                  static_cast<uint32_t>(descriptorsets.size()),
-                                  descriptorsets.data(), 0, NULL);
-
-          pushConst.materialIndex = primitive->material.index;
-          vkCmdPushConstants(
-              curBuf, pipelineLayouts.scene,
-              VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-              sizeof(pushConst), &pushConst);
-
-          if (primitive->hasIndices) {
-            vkCmdDrawIndexed(curBuf, primitive->indexCount, 1,
-                             primitive->firstIndex, 0, 0);
-          } else {
-            vkCmdDraw(curBuf, primitive->vertexCount, 1, 0, 0);
-          }
+        vks::RenderQueue::Pass pass = vks::RenderQueue::PASS_OPAQUE;
+        if (material.alphaMode == vkglTF::Material::ALPHAMODE_MASK) {
+          pass = vks::RenderQueue::PASS_MASK;
+        } else if (blend) {
+          pass = vks::RenderQueue::PASS_BLEND;
         }
+
+        vks::RenderQueue::DrawItem item{};
+        item.key = vks::RenderQueue::makeKey(
+            pass, material.pipelineKey, static_cast<uint32_t>(material.index),
+            viewDepth);
+        item.primitive = primitive;
+        item.node = node;
+        item.pipeline = material.pipeline;
+        item.modelIndex = modelIndex;
+        item.transformIndex = transformIndex;
+        item.lightList = lightList;
+        renderQueue.push(item);
       }
     }
 
     for (auto child : node->children) {
-      renderNode(child, cbIndex, alphaMode, curBuf, pushConst, isShadow);
+      addNodeToRenderQueue(child, transform, camPos, modelIndex,
+                           transformIndex);
     }
   }
 
   void getObjectsToRender() {
     dynamicModelsToRenderIndices.clear();
+    dynamicModelsToRenderIndices.reserve(dynamicModels.size());
     for (uint32_t i = 0; i < dynamicModels.size(); i++) {
       dynamicModelsToRenderIndices.push_back(i);
     }
@@ -1300,13 +1768,449 @@ class ForwardRenderer : public BaseRenderer {
 
   void buildCommandBuffer() override {
     getObjectsToRender();
-    // Contains the list of secondary command buffers to be submitted
-    std::vector<VkCommandBuffer> secondaryCmdBufs;
-
     BaseRenderer::buildCommandBuffer();
+
+    newUIFrame((frameCounter == 0));
+    imGui->updateBuffers(currentFrameIndex);
+    // The fence of this frame slot was waited on, its timestamps are ready
+    const bool dynamicScale =
+        uiSettings.aaMode == AA_MODE_TAA && uiSettings.dynamicResolution;
+    dynamicResolution.update(currentFrameIndex, dynamicScale);
+    renderExtent = renderTargetExtent;
+    if (dynamicScale) {
+      const float scale = dynamicResolution.getScale();
+      renderExtent = {
+          std::clamp(static_cast<uint32_t>(getWidth() * scale), 1u,
+                     renderTargetExtent.width),
+          std::clamp(static_cast<uint32_t>(getHeight() * scale), 1u,
+                     renderTargetExtent.height)};
+    }
+    updateLightBenchmark();
+    updateSceneParams();
+    updateShadowCasters();
+    updateLightsUBO();
+    updatePostProcessingParams();
+    // The projection in the UBO carries the jitter
+    taaJitter = uiSettings.aaMode == AA_MODE_TAA ? taaPass.nextJitter()
+                                                 : glm::vec2(0.0f);
+    updateGenericUBO();
+
+    // Shared by the depth prepass and the scene pass
+    buildRenderQueue();
+
+    asyncCompute.enabled = uiSettings.asyncCompute;
+    buildRenderGraph();
+    renderGraph.compile(currentFrameIndex);
+    // Occlusion of a frame without the passes can not be accumulated on
+    if (!renderGraph.isLive(graphPasses.ambientOcclusion)) {
+      ssaoPass.getHistory().invalidate();
+    }
+    updateGraphFramebuffers();
+    updateAmbientOcclusionDescriptor();
+
+    // One command buffer per batch of the graph, present is always last
+    std::array<VkCommandBuffer, 6> batchCmdBuffers = {
+        drawCmdBuffers[currentFrameIndex],
+        presentCmdBuffers[currentFrameIndex]};
+    uint32_t batchCount = 2;
+    uint32_t drawBatch = 0;
+    if (asyncCompute.enabled) {
+      batchCmdBuffers = {asyncCompute.preComputeCmdBuffers[currentFrameIndex],
+                         computeCmdBuffers[currentFrameIndex],
+                         asyncCompute.concurrentCmdBuffers[currentFrameIndex],
+                         drawCmdBuffers[currentFrameIndex],
+                         asyncCompute.postComputeCmdBuffers[currentFrameIndex],
+                         presentCmdBuffers[currentFrameIndex]};
+      batchCount = 6;
+      drawBatch = 3;
+    }
     VkCommandBufferBeginInfo cmdBufInfo =
         vks::initializers::commandBufferBeginInfo();
+    for (uint32_t i = 0; i < batchCount; i++) {
+      // drawCmdBuffers and presentCmdBuffers were reset by the base renderer
+      if (i != drawBatch && i + 1 < batchCount) {
+        vkResetCommandBuffer(batchCmdBuffers[i], 0);
+      }
+      VK_CHECK_RESULT(vkBeginCommandBuffer(batchCmdBuffers[i], &cmdBufInfo));
+    }
+    // The first batch and the one of drawCmdBuffers both go to the graphics
+    // queue. Present waits for the swapchain image and stays out of the time,
+    // so does post processing on the compute queue, which runs at the window
+    // size whatever the scale
+    dynamicResolution.begin(batchCmdBuffers[0], currentFrameIndex);
+    renderGraph.execute(batchCmdBuffers.data());
+    dynamicResolution.end(batchCmdBuffers[drawBatch], currentFrameIndex);
+    for (uint32_t i = 0; i < batchCount; i++) {
+      VK_CHECK_RESULT(vkEndCommandBuffer(batchCmdBuffers[i]));
+    }
+  }
 
+  // Declares the frame. With async compute the prepass and the shadows go
+  // into graphics batches of their own and ambient occlusion runs on the
+  // compute queue in between. TAA, bloom, auto exposure and post processing
+  // go back to the compute queue after the scene, the graphics queue is free
+  // for the prepass and shadows of the next frame meanwhile. Otherwise
+  // everything up to present is a single batch. Present is a batch of its
+  // own, the only one waiting for the swapchain image
+  void buildRenderGraph() {
+    using Graph = vks::RenderGraph;
+    const uint32_t frame = currentFrameIndex;
+    const uint32_t graphicsFamily = vulkanDevice->queueFamilyIndices.graphics;
+    renderGraph.reset();
+
+    uint32_t preComputeBatch = renderGraph.addBatch(graphicsQueue,
+                                                    graphicsFamily, 0);
+    uint32_t computeBatch = preComputeBatch;
+    uint32_t concurrentBatch = preComputeBatch;
+    uint32_t finalBatch = preComputeBatch;
+    uint32_t postComputeBatch = preComputeBatch;
+    if (asyncCompute.enabled) {
+      computeBatch = renderGraph.addBatch(
+          computeQueue, vulkanDevice->queueFamilyIndices.compute,
+          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+      concurrentBatch = renderGraph.addBatch(graphicsQueue, graphicsFamily, 0);
+      finalBatch = renderGraph.addBatch(graphicsQueue, graphicsFamily,
+                                        asyncCompute.waitStages);
+      postComputeBatch = renderGraph.addBatch(
+          computeQueue, vulkanDevice->queueFamilyIndices.compute,
+          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+    // Only waits on a batch of another queue with async compute
+    const uint32_t presentBatch = renderGraph.addBatch(
+        graphicsQueue, graphicsFamily, asyncCompute.presentWaitStages);
+    const VkQueue postQueue =
+        asyncCompute.enabled ? computeQueue : graphicsQueue;
+
+    graphImages.depth = renderGraph.importImage(
+        renderTargets.depthPrepass->framebuffers[frame].depth.image,
+        VK_IMAGE_ASPECT_DEPTH_BIT);
+    graphImages.velocity = renderGraph.importImage(
+        renderTargets.depthPrepass->framebuffers[frame].color.image,
+        VK_IMAGE_ASPECT_COLOR_BIT);
+    // Written from scratch every frame
+    graphImages.depthPyramid = renderGraph.importImage(
+        renderTargets.depthPyramid.getImage(frame), VK_IMAGE_ASPECT_COLOR_BIT);
+    for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+      graphImages.shadowCascades[cascade] = renderGraph.importImage(
+          renderTargets.shadowPasses[cascade]->framebuffers[frame].depth.image,
+          VK_IMAGE_ASPECT_DEPTH_BIT);
+    }
+    graphImages.shadowAtlas = renderGraph.importImage(
+        shadowAtlas.getImage(), VK_IMAGE_ASPECT_DEPTH_BIT,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+    graphImages.swapchain = renderGraph.importImage(
+        swapChain.images[currentImageIndex], VK_IMAGE_ASPECT_COLOR_BIT);
+    renderGraph.markOutput(graphImages.swapchain);
+    // Occlusion ends with the scene pass, the post processed image takes its
+    // memory over. Images of the scene size follow the render targets, the
+    // passes only use the render extent of them so a new dynamic scale does
+    // not create them again
+    const VkExtent2D extent = renderTargetExtent;
+    const VkExtent2D outputExtent = {getWidth(), getHeight()};
+    const uint32_t aoDownsample =
+        static_cast<uint32_t>(uiSettings.aoResolution);
+    const VkExtent2D aoExtent = vks::SSAOPass::getExtent(extent, aoDownsample);
+    if (aoDownsample > 0) {
+      graphImages.aoDepth = renderGraph.createImage(
+          {vks::SSAOPass::DEPTH_FORMAT, aoExtent,
+           VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+           VK_IMAGE_ASPECT_COLOR_BIT});
+    }
+    if (uiSettings.aoTemporal) {
+      // Both history images stay in the general layout, the one written this
+      // frame does not need its old contents
+      vks::HistoryImages& history = ssaoPass.getHistory();
+      history.prepare(aoExtent,
+                      asyncCompute.enabled ? computeQueue : graphicsQueue);
+      graphImages.occlusion = renderGraph.importHistory(
+          history.getImage(false), history.getView(false),
+          VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+      graphImages.occlusionHistory = renderGraph.importHistory(
+          history.getImage(true), history.getView(true),
+          VK_IMAGE_ASPECT_COLOR_BIT,
+          history.isValid() ? VK_IMAGE_LAYOUT_GENERAL
+                            : VK_IMAGE_LAYOUT_UNDEFINED,
+          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+    } else {
+      ssaoPass.getHistory().invalidate();
+      graphImages.occlusion = renderGraph.createImage(
+          {vks::SSAOPass::OCCLUSION_FORMAT, aoExtent,
+           VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+           VK_IMAGE_ASPECT_COLOR_BIT});
+    }
+    const bool aoBlur = static_cast<uint32_t>(postProcessingParams.aoType) ==
+                        vks::SSAOPass::TYPE_HORIZON;
+    graphImages.occlusionDenoised = graphImages.occlusion;
+    if (aoBlur) {
+      graphImages.occlusionBlur = renderGraph.createImage(
+          {vks::SSAOPass::OCCLUSION_FORMAT, aoExtent,
+           VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+           VK_IMAGE_ASPECT_COLOR_BIT});
+      graphImages.occlusionDenoised = renderGraph.createImage(
+          {vks::SSAOPass::OCCLUSION_FORMAT, aoExtent,
+           VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+           VK_IMAGE_ASPECT_COLOR_BIT});
+    }
+    graphImages.ambientOcclusion = renderGraph.createImage(
+        {vks::SSAOPass::FORMAT, extent,
+         VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+         VK_IMAGE_ASPECT_COLOR_BIT});
+    graphImages.scene = renderGraph.createImage(
+        {swapChain.colorFormat, extent,
+         VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+         VK_IMAGE_ASPECT_COLOR_BIT});
+    const bool temporalAA = uiSettings.aaMode == AA_MODE_TAA;
+    graphImages.antiAliased = graphImages.scene;
+    if (temporalAA) {
+      // Post processing leaves the output in the shader read only layout, it
+      // is the history of the next frame
+      vks::HistoryImages& history = taaPass.getHistory();
+      history.prepare(outputExtent, postQueue);
+      graphImages.antiAliased = renderGraph.importHistory(
+          history.getImage(false), history.getView(false),
+          VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+      graphImages.taaHistory = renderGraph.importHistory(
+          history.getImage(true), history.getView(true),
+          VK_IMAGE_ASPECT_COLOR_BIT,
+          history.isValid() ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                            : VK_IMAGE_LAYOUT_UNDEFINED,
+          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+    } else {
+      taaPass.getHistory().invalidate();
+    }
+    if (postProcessingParams.enableBloom) {
+      graphImages.bloom = renderGraph.importImage(
+          bloomPass.getImage(frame), VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+    graphImages.postProcessed = renderGraph.createImage(
+        {vks::PostProcessPass::FORMAT, outputExtent,
+         VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+         VK_IMAGE_ASPECT_COLOR_BIT});
+
+    const VkImageLayout depthReadOnly =
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    renderGraph.addPass(
+        "Depth Prepass", preComputeBatch,
+        [&](Graph::PassBuilder& pass) {
+          pass.write(graphImages.depth, Graph::depthAttachment(depthReadOnly));
+          pass.write(graphImages.velocity,
+                     Graph::colorAttachment(
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+        },
+        [this](VkCommandBuffer cmd) { recordDepthPrepass(cmd); });
+    renderGraph.addPass(
+        "Depth Prepass Consumers", preComputeBatch,
+        [&](Graph::PassBuilder& pass) {
+          pass.read(graphImages.depth,
+                    Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                   depthReadOnly));
+          pass.sideEffects();
+        },
+        [this](VkCommandBuffer cmd) { buildDepthPrepassConsumers(cmd); });
+
+    // Culled when nothing reads the pyramid
+    renderGraph.addPass(
+        "Depth Pyramid", computeBatch,
+        [&](Graph::PassBuilder& pass) {
+          pass.read(graphImages.depth,
+                    Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                   depthReadOnly));
+          pass.write(graphImages.depthPyramid,
+                     Graph::storageWrite(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+        },
+        [this](VkCommandBuffer cmd) {
+          renderTargets.depthPyramid.record(
+              cmd, currentFrameIndex,
+              renderTargets.depthPrepass->framebuffers[currentFrameIndex]
+                  .descriptor,
+              renderExtent);
+        });
+
+    // Culled along with their images when the scene does not sample the
+    // occlusion
+    if (aoDownsample > 0) {
+      renderGraph.addPass(
+          "Ambient Occlusion Depth", computeBatch,
+          [&](Graph::PassBuilder& pass) {
+            pass.read(graphImages.depthPyramid,
+                      Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     VK_IMAGE_LAYOUT_GENERAL));
+            pass.write(
+                graphImages.aoDepth,
+                Graph::storageWrite(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+          },
+          [this](VkCommandBuffer cmd) { recordAmbientOcclusionDepth(cmd); });
+    }
+    renderGraph.addPass(
+        "Ambient Occlusion", computeBatch,
+        [&](Graph::PassBuilder& pass) {
+          if (aoDownsample > 0) {
+            pass.read(graphImages.aoDepth,
+                      Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     VK_IMAGE_LAYOUT_GENERAL));
+          } else {
+            pass.read(graphImages.depth,
+                      Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     depthReadOnly));
+          }
+          if (uiSettings.aoTemporal) {
+            pass.read(graphImages.occlusionHistory,
+                      Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     VK_IMAGE_LAYOUT_GENERAL));
+          }
+          pass.write(graphImages.occlusion,
+                     Graph::storageWrite(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+        },
+        [this](VkCommandBuffer cmd) { recordAmbientOcclusion(cmd); });
+    // The history keeps the occlusion before the blur
+    if (aoBlur) {
+      renderGraph.addPass(
+          "Ambient Occlusion Blur X", computeBatch,
+          [&](Graph::PassBuilder& pass) {
+            pass.read(graphImages.occlusion,
+                      Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     VK_IMAGE_LAYOUT_GENERAL));
+            pass.write(
+                graphImages.occlusionBlur,
+                Graph::storageWrite(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+          },
+          [this](VkCommandBuffer cmd) {
+            recordAmbientOcclusionBlur(cmd, false);
+          });
+      renderGraph.addPass(
+          "Ambient Occlusion Blur Y", computeBatch,
+          [&](Graph::PassBuilder& pass) {
+            pass.read(graphImages.occlusionBlur,
+                      Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     VK_IMAGE_LAYOUT_GENERAL));
+            pass.write(
+                graphImages.occlusionDenoised,
+                Graph::storageWrite(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+          },
+          [this](VkCommandBuffer cmd) {
+            recordAmbientOcclusionBlur(cmd, true);
+          });
+    }
+    graphPasses.ambientOcclusion = renderGraph.addPass(
+        "Ambient Occlusion Resolve", computeBatch,
+        [&](Graph::PassBuilder& pass) {
+          pass.read(graphImages.depth,
+                    Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                   depthReadOnly));
+          pass.read(graphImages.occlusionDenoised,
+                    Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                   VK_IMAGE_LAYOUT_GENERAL));
+          pass.write(graphImages.ambientOcclusion,
+                     Graph::storageWrite(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+        },
+        [this](VkCommandBuffer cmd) { recordAmbientOcclusionResolve(cmd); });
+    renderGraph.addPass(
+        "Shadows", concurrentBatch,
+        [&](Graph::PassBuilder& pass) {
+          for (Graph::Handle cascade : graphImages.shadowCascades) {
+            pass.write(cascade, Graph::depthAttachment(depthReadOnly));
+          }
+          pass.write(graphImages.shadowAtlas,
+                     Graph::depthAttachment(depthReadOnly));
+        },
+        [this](VkCommandBuffer cmd) { recordShadows(cmd); });
+
+    const bool ambientOcclusion = uiSettings.aoMode != 0;
+    renderGraph.addPass(
+        "Scene", finalBatch,
+        [&](Graph::PassBuilder& pass) {
+          pass.read(graphImages.depth, Graph::depthReadOnly());
+          for (Graph::Handle cascade : graphImages.shadowCascades) {
+            pass.read(cascade,
+                      Graph::sampled(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                     depthReadOnly));
+          }
+          pass.read(graphImages.shadowAtlas,
+                    Graph::sampled(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                   depthReadOnly));
+          if (ambientOcclusion) {
+            pass.read(graphImages.ambientOcclusion,
+                      Graph::sampled(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT));
+          }
+          pass.write(graphImages.scene,
+                     Graph::colorAttachment(
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+        },
+        [this](VkCommandBuffer cmd) { recordScene(cmd); });
+    if (temporalAA) {
+      renderGraph.addPass(
+          "Temporal Anti Aliasing", postComputeBatch,
+          [&](Graph::PassBuilder& pass) {
+            pass.read(graphImages.scene,
+                      Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+            pass.read(graphImages.depth,
+                      Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     depthReadOnly));
+            pass.read(graphImages.velocity,
+                      Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+            pass.read(graphImages.taaHistory,
+                      Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+            pass.write(
+                graphImages.antiAliased,
+                Graph::storageWrite(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+          },
+          [this](VkCommandBuffer cmd) { recordTemporalAA(cmd); });
+    }
+    if (postProcessingParams.enableBloom) {
+      renderGraph.addPass(
+          "Bloom", postComputeBatch,
+          [&](Graph::PassBuilder& pass) {
+            pass.read(graphImages.antiAliased,
+                      Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+            pass.write(
+                graphImages.bloom,
+                Graph::storageWrite(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+          },
+          [this](VkCommandBuffer cmd) { recordBloom(cmd); });
+    }
+    // The exposure buffer is outside the graph, the pass places its own
+    // barriers and runs on the queue of post processing
+    autoExposure.prepare(postQueue);
+    renderGraph.addPass(
+        "Auto Exposure", postComputeBatch,
+        [&](Graph::PassBuilder& pass) {
+          pass.read(graphImages.antiAliased,
+                    Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+          pass.sideEffects();
+        },
+        [this](VkCommandBuffer cmd) { recordAutoExposure(cmd); });
+    renderGraph.addPass(
+        "Post Processing", postComputeBatch,
+        [&](Graph::PassBuilder& pass) {
+          pass.read(graphImages.antiAliased,
+                    Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+          if (postProcessingParams.enableBloom) {
+            pass.read(graphImages.bloom,
+                      Graph::sampled(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     VK_IMAGE_LAYOUT_GENERAL));
+          }
+          pass.write(graphImages.postProcessed,
+                     Graph::storageWrite(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+        },
+        [this](VkCommandBuffer cmd) { recordPostProcessing(cmd); });
+    renderGraph.addPass(
+        "Present", presentBatch,
+        [&](Graph::PassBuilder& pass) {
+          pass.read(graphImages.postProcessed,
+                    Graph::sampled(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT));
+          pass.write(graphImages.swapchain,
+                     Graph::colorAttachment(VK_IMAGE_LAYOUT_PRESENT_SRC_KHR));
+        },
+        [this](VkCommandBuffer cmd) { recordPresent(cmd); });
+  }
+
+  // Render pass over the whole target, secondary command buffers record the
+  // contents
+  void beginScreenRenderPass(VkCommandBuffer commandBuffer,
+                             VkRenderPass renderPass,
+                             VkFramebuffer framebuffer, VkExtent2D extent) {
     VkClearValue clearValues[2];
     clearValues[0].color = {{uiSettings.skyboxColor.x, uiSettings.skyboxColor.y,
                              uiSettings.skyboxColor.z,
@@ -1315,260 +2219,362 @@ class ForwardRenderer : public BaseRenderer {
 
     VkRenderPassBeginInfo renderPassBeginInfo =
         vks::initializers::renderPassBeginInfo();
+    renderPassBeginInfo.renderPass = renderPass;
+    renderPassBeginInfo.framebuffer = framebuffer;
+    renderPassBeginInfo.renderArea.extent = extent;
+    renderPassBeginInfo.clearValueCount = 2;
+    renderPassBeginInfo.pClearValues = clearValues;
+    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+                         VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  }
 
-    renderPassBeginInfo.renderArea.offset.x = 0;
-    renderPassBeginInfo.renderArea.offset.y = 0;
-    renderPassBeginInfo.renderArea.extent.width = getWidth();
-    renderPassBeginInfo.renderArea.extent.height = getHeight();
-    renderPassBeginInfo.clearValueCount = 1;
-    renderPassBeginInfo.pClearValues = &clearValues[1];
+  void recordDepthPrepass(VkCommandBuffer commandBuffer) {
+    // Depth first, pixels without geometry have no motion
+    VkClearValue clearValues[2];
+    clearValues[0].depthStencil = {1.0f, 0};
+    clearValues[1].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
 
-    newUIFrame((frameCounter == 0));
-    imGui->updateBuffers(currentFrameIndex);
-    updateSceneParams();
-    updateLightsUBO();
-    updatePostProcessingParams();
-    updateGenericUBO();
+    VkRenderPassBeginInfo renderPassBeginInfo =
+        vks::initializers::renderPassBeginInfo();
+    renderPassBeginInfo.renderPass = renderTargets.depthPrepass->renderPass;
+    renderPassBeginInfo.framebuffer =
+        renderTargets.depthPrepass->framebuffers[currentFrameIndex].framebuffer;
+    renderPassBeginInfo.renderArea.extent = renderExtent;
+    renderPassBeginInfo.clearValueCount = 2;
+    renderPassBeginInfo.pClearValues = clearValues;
+    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+                         VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    buildDepthPrepassCommandBuffer();
+    vkCmdExecuteCommands(commandBuffer, 1,
+                         &commandBuffers.aoPrePass[currentFrameIndex]);
+    vkCmdEndRenderPass(commandBuffer);
+  }
 
-    VkCommandBuffer currentCommandBuffer = drawCmdBuffers[currentFrameIndex];
+  VkExtent2D getAmbientOcclusionExtent() {
+    return vks::SSAOPass::getExtent(
+        renderExtent, static_cast<uint32_t>(uiSettings.aoResolution));
+  }
 
-    VK_CHECK_RESULT(vkBeginCommandBuffer(currentCommandBuffer, &cmdBufInfo));
-    {
-      renderPassBeginInfo.renderPass = renderTargets.depthPrepass->renderPass;
-      renderPassBeginInfo.framebuffer =
-          renderTargets.depthPrepass->framebuffers[currentFrameIndex]
-              .framebuffer;
-      vkCmdBeginRenderPass(currentCommandBuffer, &renderPassBeginInfo,
-                           VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  // Depth the occlusion is computed from, the downsampled copy when the
+  // occlusion has a lower resolution
+  VkDescriptorImageInfo getAmbientOcclusionDepth() {
+    if (uiSettings.aoResolution == 0) {
+      return renderTargets.depthPrepass->framebuffers[currentFrameIndex]
+          .descriptor;
+    }
+    return {ssaoPass.getPointSampler(),
+            renderGraph.getView(graphImages.aoDepth), VK_IMAGE_LAYOUT_GENERAL};
+  }
 
-      buildDepthPrepassCommandBuffer();
-      secondaryCmdBufs.push_back(commandBuffers.aoPrePass[currentFrameIndex]);
+  // Mip 0 of the pyramid is half resolution
+  void recordAmbientOcclusionDepth(VkCommandBuffer commandBuffer) {
+    const vks::DepthPyramid& pyramid = renderTargets.depthPyramid;
+    const uint32_t mip =
+        std::min(static_cast<uint32_t>(uiSettings.aoResolution) - 1,
+                 pyramid.getMipCount() - 1);
+    const VkDescriptorImageInfo depth = {
+        pyramid.getSampler(), pyramid.getMipView(currentFrameIndex, mip),
+        VK_IMAGE_LAYOUT_GENERAL};
+    ssaoPass.recordDownsample(commandBuffer, currentFrameIndex, depth,
+                              renderGraph.getView(graphImages.aoDepth),
+                              getAmbientOcclusionExtent());
+  }
 
-      vkCmdExecuteCommands(currentCommandBuffer,
-                           static_cast<uint32_t>(secondaryCmdBufs.size()),
-                           secondaryCmdBufs.data());
-      vkCmdEndRenderPass(currentCommandBuffer);
-      secondaryCmdBufs.clear();
+  void recordAmbientOcclusion(VkCommandBuffer commandBuffer) {
+    VkImageView history = VK_NULL_HANDLE;
+    if (uiSettings.aoTemporal) {
+      history = renderGraph.getView(graphImages.occlusionHistory);
     }
+    ssaoPass.recordOcclusion(
+        commandBuffer, currentFrameIndex, getAmbientOcclusionDepth(),
+        renderGraph.getView(graphImages.occlusion), history,
+        static_cast<uint32_t>(postProcessingParams.aoType), getSSAOParams(),
+        camera.matrices.view, camera.matrices.perspective,
+        getAmbientOcclusionExtent());
+  }
+
+  void recordAmbientOcclusionBlur(VkCommandBuffer commandBuffer,
+                                  bool vertical) {
+    ssaoPass.recordBlur(
+        commandBuffer, currentFrameIndex, vertical,
+        renderGraph.getView(vertical ? graphImages.occlusionBlur
+                                     : graphImages.occlusion),
+        renderGraph.getView(vertical ? graphImages.occlusionDenoised
+                                     : graphImages.occlusionBlur),
+        getSSAOParams(), getAmbientOcclusionExtent());
+  }
+
+  void recordAmbientOcclusionResolve(VkCommandBuffer commandBuffer) {
+    ssaoPass.recordResolve(
+        commandBuffer, currentFrameIndex,
+        renderTargets.depthPrepass->framebuffers[currentFrameIndex].descriptor,
+        renderGraph.getView(graphImages.occlusionDenoised),
+        renderGraph.getView(graphImages.ambientOcclusion), getSSAOParams(),
+        renderExtent);
+  }
 
+  void recordShadows(VkCommandBuffer commandBuffer) {
+    VkClearValue clearValue{};
+    clearValue.depthStencil = {1.0f, 0};
+    VkRenderPassBeginInfo renderPassBeginInfo =
+        vks::initializers::renderPassBeginInfo();
     renderPassBeginInfo.renderArea.extent.width = shadowMapSize;
     renderPassBeginInfo.renderArea.extent.height = shadowMapSize;
     renderPassBeginInfo.clearValueCount = 1;
-    renderPassBeginInfo.pClearValues = &clearValues[1];
-    // Shadows Rendering
-    {
-      renderPassBeginInfo.renderPass =
-          renderTargets.shadowPasses[0]->renderPass;
-      renderPassBeginInfo.framebuffer = renderTargets.shadowPasses[0]
-                                            ->framebuffers[currentFrameIndex]
-                                            .framebuffer;
+    renderPassBeginInfo.pClearValues = &clearValue;
+
+    buildShadowCasterList();
+    // Static casters come from the cache, moving ones are drawn on top of a
+    // copy of it
+    const bool cacheShadows = uiSettings.shadowCaching;
+    for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+      vks::VulkanRenderTarget* shadowPass = renderTargets.shadowPasses[cascade];
+      renderPassBeginInfo.renderPass = shadowPass->renderPass;
+      if (cacheShadows) {
+        shadowCache.update(
+            commandBuffer, cascade, shadowCascades.getViewProjection(cascade),
+            [&](VkCommandBuffer cacheCommandBuffer, const VkRect2D& region) {
+              vks::Frustum regionFrustum;
+              regionFrustum.update(shadowCache.getRegionProjection(
+                  shadowCascades.getViewProjection(cascade), region));
+              vks::CommandStateTracker& cmd = stateTrackers.shadowCache;
+              cmd.begin(cacheCommandBuffer);
+              recordShadowCasters(cmd, cascade, region, ShadowCasters::Static,
+                                  &regionFrustum);
+            });
+        if (!shadowCache.composite(
+                commandBuffer, currentFrameIndex, cascade,
+                shadowPass->framebuffers[currentFrameIndex].depth.image,
+                hasMovingCasters)) {
+          continue;
+        }
+        renderPassBeginInfo.renderPass = shadowCache.getCompositeRenderPass();
+      } else {
+        shadowCache.invalidateTarget(currentFrameIndex, cascade);
+      }
+      renderPassBeginInfo.framebuffer =
+          shadowPass->framebuffers[currentFrameIndex].framebuffer;
 
-      vkCmdBeginRenderPass(currentCommandBuffer, &renderPassBeginInfo,
+      vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
                            VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
-
-      buildShadowCommandBuffer();
-
-      secondaryCmdBufs.push_back(commandBuffers.shadow[currentFrameIndex]);
-
-      vkCmdExecuteCommands(currentCommandBuffer,
-                           static_cast<uint32_t>(secondaryCmdBufs.size()),
-                           secondaryCmdBufs.data());
-      vkCmdEndRenderPass(currentCommandBuffer);
-      secondaryCmdBufs.clear();
+      buildShadowCommandBuffer(
+          cascade, renderPassBeginInfo.renderPass,
+          cacheShadows ? ShadowCasters::Moving : ShadowCasters::All);
+      vkCmdExecuteCommands(
+          commandBuffer, 1,
+          &commandBuffers
+               .shadow[currentFrameIndex * SHADOW_CASCADE_COUNT + cascade]);
+      vkCmdEndRenderPass(commandBuffer);
     }
+    shadowAtlas.render(commandBuffer,
+                       [&](VkCommandBuffer tileCommandBuffer,
+                           uint32_t tileIndex,
+                           const glm::mat4& viewProjection) {
+                         vks::CommandStateTracker& cmd =
+                             stateTrackers.shadowAtlas;
+                         cmd.begin(tileCommandBuffer);
+                         recordShadowAtlasTile(cmd, tileIndex, viewProjection);
+                       });
+  }
 
-    renderPassBeginInfo.renderArea.extent.width = getWidth();
-    renderPassBeginInfo.renderArea.extent.height = getHeight();
-    renderPassBeginInfo.clearValueCount = 2;
-    renderPassBeginInfo.pClearValues = clearValues;
-
-    renderPassBeginInfo.renderPass = renderTargets.aoPass->renderPass;
-    renderPassBeginInfo.framebuffer =
-        renderTargets.aoPass->framebuffers[currentFrameIndex].framebuffer;
-
-    vkCmdBeginRenderPass(currentCommandBuffer, &renderPassBeginInfo,
-                         VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  void recordScene(VkCommandBuffer commandBuffer) {
+    beginScreenRenderPass(commandBuffer, renderTargets.scene->renderPass,
+                          graphFramebuffers[currentFrameIndex].scene,
+                          renderExtent);
+    buildSceneCommandBuffer();
+    vkCmdExecuteCommands(commandBuffer, 1,
+                         &commandBuffers.scene[currentFrameIndex]);
+    vkCmdEndRenderPass(commandBuffer);
+  }
 
+  // Full screen triangle of a post processing target into renderPass
+  void recordScreenPass(VkCommandBuffer secondary, VkRenderPass renderPass,
+                        VkFramebuffer framebuffer,
+                        vks::VulkanRenderTarget* target) {
     VkCommandBufferInheritanceInfo inheritanceInfo =
         vks::initializers::commandBufferInheritanceInfo();
-    inheritanceInfo.renderPass = renderTargets.aoPass->renderPass;
-    inheritanceInfo.framebuffer =
-        renderTargets.aoPass->framebuffers[currentFrameIndex].framebuffer;
-
-    cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.framebuffer = framebuffer;
+    VkCommandBufferBeginInfo cmdBufInfo =
+        vks::initializers::commandBufferBeginInfo();
     cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
     cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
 
-    VkCommandBuffer curBuf = commandBuffers.ao[currentFrameIndex];
-    vkResetCommandBuffer(curBuf, 0);
-    VK_CHECK_RESULT(vkBeginCommandBuffer(curBuf, &cmdBufInfo));
-
+    vkResetCommandBuffer(secondary, 0);
+    VK_CHECK_RESULT(vkBeginCommandBuffer(secondary, &cmdBufInfo));
     VkViewport viewport = vks::initializers::viewport(
         (float)getWidth(), (float)getHeight(), 0.0f, 1.0f);
-    vkCmdSetViewport(curBuf, 0, 1, &viewport);
     VkRect2D scissor = vks::initializers::rect2D(getWidth(), getHeight(), 0, 0);
-    vkCmdSetScissor(curBuf, 0, 1, &scissor);
-
-    VkDeviceSize offsets[1] = {0};
-
-    const std::vector<VkDescriptorSet> descriptorsets = {
-        renderTargets.aoPass->screenTextureDescriptorSets[currentFrameIndex],
-        renderTargets.aoPass->descriptorSets[currentFrameIndex]};
-
-    vkCmdBindDescriptorSets(curBuf, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            renderTargets.aoPass->pipelineLayout, 0,
-                            static_cast<uint32_t>(descriptorsets.size()),
-                            descriptorsets.data(), 0, NULL);
-    vkCmdBindPipeline(curBuf, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      renderTargets.aoPass->pipeline);
-    vkCmdDraw(curBuf, 3, 1, 0, 0);
-    VK_CHECK_RESULT(vkEndCommandBuffer(curBuf));
-    secondaryCmdBufs.push_back(curBuf);
-    // Execute render commands from the secondary command buffer
-    vkCmdExecuteCommands(currentCommandBuffer,
-                         static_cast<uint32_t>(secondaryCmdBufs.size()),
-                         secondaryCmdBufs.data());
-    secondaryCmdBufs.clear();
-    vkCmdEndRenderPass(currentCommandBuffer);
-
-    // Scene Rendering
-    {
-      renderPassBeginInfo.renderPass = renderTargets.aaPass->renderPass;
-      renderPassBeginInfo.framebuffer =
-          renderTargets.aaPass->framebuffers[currentFrameIndex].framebuffer;
+    vkCmdSetViewport(secondary, 0, 1, &viewport);
+    vkCmdSetScissor(secondary, 0, 1, &scissor);
+    vkCmdBindDescriptorSets(
+        secondary, VK_PIPELINE_BIND_POINT_GRAPHICS, target->pipelineLayout, 0,
+        1, &target->screenTextureDescriptorSets[currentFrameIndex], 0, NULL);
+    vkCmdBindPipeline(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      target->pipeline);
+    vkCmdDraw(secondary, 3, 1, 0, 0);
+    VK_CHECK_RESULT(vkEndCommandBuffer(secondary));
+  }
 
-      vkCmdBeginRenderPass(currentCommandBuffer, &renderPassBeginInfo,
-                           VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  // Upscales to the window size when the scene was drawn below it
+  void recordTemporalAA(VkCommandBuffer commandBuffer) {
+    vks::TAAPass::Params params{};
+    params.jitter = taaJitter;
+    params.renderExtent = glm::ivec2(renderExtent.width, renderExtent.height);
+    const vks::VulkanRenderTarget::FrameBuffer& prepass =
+        renderTargets.depthPrepass->framebuffers[currentFrameIndex];
+    const VkDescriptorImageInfo velocity = {
+        renderTargets.depthPrepass->sampler, prepass.color.view,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    taaPass.record(
+        commandBuffer, currentFrameIndex,
+        renderGraph.getView(graphImages.scene), prepass.descriptor, velocity,
+        renderGraph.getView(graphImages.taaHistory),
+        renderGraph.getView(graphImages.antiAliased), params,
+        camera.matrices.perspective * camera.matrices.view,
+        {getWidth(), getHeight()});
+  }
 
-      buildSceneCommandBuffer();
+  void recordBloom(VkCommandBuffer commandBuffer) {
+    bloomPass.record(commandBuffer, currentFrameIndex,
+                     renderGraph.getView(graphImages.antiAliased));
+  }
 
-      secondaryCmdBufs.push_back(commandBuffers.scene[currentFrameIndex]);
+  // Adapts over the time of the last frame, the tonemapping of this frame
+  // already exposes for it
+  void recordAutoExposure(VkCommandBuffer commandBuffer) {
+    autoExposure.record(commandBuffer, currentFrameIndex,
+                        renderGraph.getView(graphImages.antiAliased),
+                        {getWidth(), getHeight()}, frameTimer);
+  }
 
-      // Execute render commands from the secondary command buffer
-      vkCmdExecuteCommands(currentCommandBuffer,
-                           static_cast<uint32_t>(secondaryCmdBufs.size()),
-                           secondaryCmdBufs.data());
-      secondaryCmdBufs.clear();
-      vkCmdEndRenderPass(currentCommandBuffer);
+  void recordPostProcessing(VkCommandBuffer commandBuffer) {
+    vks::PostProcessPass::Params params{};
+    params.invResolution = glm::vec2(1.0f / getWidth(), 1.0f / getHeight());
+    params.aaType = static_cast<uint32_t>(uiSettings.aaMode);
+    params.autoExposure = uiSettings.autoExposure ? 1 : 0;
+    // The bloom binding still needs an image while bloom is off
+    VkDescriptorImageInfo bloom = textures.empty.descriptor;
+    if (postProcessingParams.enableBloom) {
+      bloom = bloomPass.getDescriptor(currentFrameIndex);
+      params.bloomStrength = uiSettings.bloomStrength;
     }
+    postProcessPass.record(commandBuffer, currentFrameIndex,
+                           renderGraph.getView(graphImages.antiAliased),
+                           renderGraph.getView(graphImages.postProcessed),
+                           bloom, autoExposure.getDescriptor(), params,
+                           {getWidth(), getHeight()});
+  }
 
-    // Post Processing & UI Rendering
-    {
-      // Foreach Post Processing Pass render into the next
-      // Then, Render final image into Swapchain image
-      renderPassBeginInfo.renderPass = renderTargets.tonemapping->renderPass;
-      renderPassBeginInfo.framebuffer =
-          renderTargets.tonemapping->framebuffers[currentFrameIndex]
-              .framebuffer;
-
-      vkCmdBeginRenderPass(currentCommandBuffer, &renderPassBeginInfo,
-                           VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
-
-      VkCommandBufferInheritanceInfo inheritanceInfo =
-          vks::initializers::commandBufferInheritanceInfo();
-      inheritanceInfo.renderPass = renderTargets.tonemapping->renderPass;
-      inheritanceInfo.framebuffer =
-          renderTargets.tonemapping->framebuffers[currentFrameIndex]
-              .framebuffer;
-
-      cmdBufInfo = vks::initializers::commandBufferBeginInfo();
-      cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
-      cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
-
-      VkCommandBuffer curBuf = commandBuffers.aa[currentFrameIndex];
-      vkResetCommandBuffer(curBuf, 0);
-      VK_CHECK_RESULT(vkBeginCommandBuffer(curBuf, &cmdBufInfo));
-
-      vkCmdSetViewport(curBuf, 0, 1, &viewport);
-      vkCmdSetScissor(curBuf, 0, 1, &scissor);
-
-      vkCmdBindDescriptorSets(
-          curBuf, VK_PIPELINE_BIND_POINT_GRAPHICS,
-          renderTargets.aaPass->pipelineLayout, 0, 1,
-          &renderTargets.aaPass->screenTextureDescriptorSets[currentFrameIndex],
-          0, NULL);
-      vkCmdBindPipeline(curBuf, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        renderTargets.aaPass->pipeline);
-      vkCmdDraw(curBuf, 3, 1, 0, 0);
-      VK_CHECK_RESULT(vkEndCommandBuffer(curBuf));
-      secondaryCmdBufs.push_back(commandBuffers.aa[currentFrameIndex]);
-
-      // Execute render commands from the secondary command buffer
-      vkCmdExecuteCommands(currentCommandBuffer,
-                           static_cast<uint32_t>(secondaryCmdBufs.size()),
-                           secondaryCmdBufs.data());
-      secondaryCmdBufs.clear();
-
-      vkCmdEndRenderPass(currentCommandBuffer);
-
-      renderPassBeginInfo.renderPass = renderPass;
-      renderPassBeginInfo.framebuffer = frameBuffers[currentFrameIndex];
-
-      vkCmdBeginRenderPass(currentCommandBuffer, &renderPassBeginInfo,
-                           VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
-
-      inheritanceInfo = vks::initializers::commandBufferInheritanceInfo();
-      inheritanceInfo.renderPass = renderPass;
-      inheritanceInfo.framebuffer = frameBuffers[currentFrameIndex];
-
-      cmdBufInfo = vks::initializers::commandBufferBeginInfo();
-      cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
-      cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
+  // Copy of the post processed image into the swapchain with the UI on top
+  void recordPresent(VkCommandBuffer commandBuffer) {
+    VkFramebuffer framebuffer = frameBuffers[currentImageIndex];
+    beginScreenRenderPass(commandBuffer, renderPass, framebuffer,
+                          {getWidth(), getHeight()});
+    recordScreenPass(commandBuffers.present[currentFrameIndex], renderPass,
+                     framebuffer, renderTargets.present);
+    buildUICommandBuffer();
+    const VkCommandBuffer secondaries[2] = {
+        commandBuffers.present[currentFrameIndex],
+        commandBuffers.ui[currentFrameIndex]};
+    vkCmdExecuteCommands(commandBuffer, 2, secondaries);
+    vkCmdEndRenderPass(commandBuffer);
+  }
 
-      curBuf = commandBuffers.tm[currentFrameIndex];
-      vkResetCommandBuffer(curBuf, 0);
-      VK_CHECK_RESULT(vkBeginCommandBuffer(curBuf, &cmdBufInfo));
+  vks::SSAOPass::Params getSSAOParams() {
+    const glm::mat4& projection = camera.matrices.perspective;
+    vks::SSAOPass::Params params{};
+    params.projection = glm::vec4(projection[0][0], projection[1][1],
+                                  projection[2][2], projection[3][2]);
+    params.radius = postProcessingParams.radius;
+    params.kernelSize = static_cast<uint32_t>(postProcessingParams.kernelSize);
+    const VkExtent2D extent = getAmbientOcclusionExtent();
+    params.extent = glm::ivec2(extent.width, extent.height);
+    return params;
+  }
 
-      vkCmdSetViewport(curBuf, 0, 1, &viewport);
-      vkCmdSetScissor(curBuf, 0, 1, &scissor);
+  // Framebuffers and screen texture sets of this frame follow the graph when
+  // it placed its images somewhere else
+  void updateGraphFramebuffers() {
+    GraphFramebuffers& framebuffers = graphFramebuffers[currentFrameIndex];
+    if (framebuffers.valid && !renderGraph.transientsChanged()) return;
+    vkDestroyFramebuffer(device, framebuffers.scene, nullptr);
+    framebuffers.scene = vks::rendering::createFramebuffer(
+        renderTargets.scene, renderGraph.getView(graphImages.scene),
+        currentFrameIndex, renderTargetExtent.width,
+        renderTargetExtent.height);
+    framebuffers.valid = true;
+
+    // Present samples the post processed image
+    const VkDescriptorImageInfo image = {
+        renderTargets.present->sampler,
+        renderGraph.getView(graphImages.postProcessed),
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkWriteDescriptorSet write = vks::initializers::writeDescriptorSet(
+        renderTargets.present->screenTextureDescriptorSets[currentFrameIndex],
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &image);
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+  }
 
-      vkCmdBindDescriptorSets(
-          curBuf, VK_PIPELINE_BIND_POINT_GRAPHICS,
-          renderTargets.tonemapping->pipelineLayout, 0, 1,
-          &renderTargets.tonemapping
-               ->screenTextureDescriptorSets[currentFrameIndex],
-          0, NULL);
-      vkCmdBindPipeline(curBuf, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        renderTargets.tonemapping->pipeline);
-      vkCmdDraw(curBuf, 3, 1, 0, 0);
-      VK_CHECK_RESULT(vkEndCommandBuffer(curBuf));
-
-      buildUICommandBuffer();
-
-      secondaryCmdBufs.push_back(commandBuffers.tm[currentFrameIndex]);
-      secondaryCmdBufs.push_back(commandBuffers.ui[currentFrameIndex]);
-
-      // Execute render commands from the secondary command buffer
-      vkCmdExecuteCommands(currentCommandBuffer,
-                           static_cast<uint32_t>(secondaryCmdBufs.size()),
-                           secondaryCmdBufs.data());
-
-      vkCmdEndRenderPass(currentCommandBuffer);
+  // Points the scene at this frame's occlusion image, or at a white texture
+  // when the pass was culled
+  void updateAmbientOcclusionDescriptor() {
+    VkDescriptorImageInfo occlusion = textures.empty.descriptor;
+    if (renderGraph.isLive(graphPasses.ambientOcclusion)) {
+      occlusion = {ssaoPass.getSampler(),
+                   renderGraph.getView(graphImages.ambientOcclusion),
+                   VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
     }
-
-    VK_CHECK_RESULT(vkEndCommandBuffer(currentCommandBuffer));
+    VkWriteDescriptorSet write = vks::initializers::writeDescriptorSet(
+        dynamicDescriptorSets[currentFrameIndex].scene,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6, &occlusion);
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
   }
 
   void windowResized() override {
     BaseRenderer::windowResized();
+    resizeRenderTargets();
+    bloomPass.resize({getWidth(), getHeight()});
+  }
 
+  // Size of the scene targets, the window scaled down by the render scale
+  // while TAA brings it back up. Dynamic resolution draws to a part of
+  // targets of its largest scale
+  VkExtent2D getRenderTargetExtent() {
+    if (uiSettings.aaMode != AA_MODE_TAA) {
+      return {getWidth(), getHeight()};
+    }
+    const float scale = uiSettings.dynamicResolution
+                            ? dynamicResolution.settings.maxScale
+                            : renderScales[uiSettings.renderScale];
+    return {std::max(static_cast<uint32_t>(getWidth() * scale), 1u),
+            std::max(static_cast<uint32_t>(getHeight() * scale), 1u)};
+  }
+
+  // Called before a frame starts, a new render scale or anti aliasing mode
+  // recreates the targets of the scene size once the device is idle
+  void updateRenderTargetExtent() {
+    const VkExtent2D extent = getRenderTargetExtent();
+    if (extent.width == renderTargetExtent.width &&
+        extent.height == renderTargetExtent.height) {
+      return;
+    }
+    vkDeviceWaitIdle(device);
+    resizeRenderTargets();
+  }
+
+  void resizeRenderTargets() {
+    renderTargetExtent = getRenderTargetExtent();
+    renderExtent = renderTargetExtent;
     vks::rendering::recreateDepthRenderTargetResources(
-        renderTargets.depthPrepass, swapChain.imageCount, getWidth(),
-        getHeight());
-    vks::rendering::recreateColorDepthRenderTargetResources(
-        renderTargets.mainPass, swapChain.imageCount, getWidth(), getHeight());
-    vks::rendering::recreateColorDepthRenderTargetResources(
-        renderTargets.aoPass, swapChain.imageCount, getWidth(), getHeight());
-    vks::rendering::recreateColorDepthRenderTargetResources(
-        renderTargets.aaPass, swapChain.imageCount, getWidth(), getHeight());
-    vks::rendering::recreateColorDepthRenderTargetResources(
-        renderTargets.tonemapping, swapChain.imageCount, getWidth(),
-        getHeight());
+        renderTargets.depthPrepass, maxFramesInFlight,
+        renderTargetExtent.width, renderTargetExtent.height);
+    renderTargets.depthPyramid.resize(renderTargetExtent);
 
     setupDescriptors();
   }
 
-  void setupDescriptors(bool updatedMaterials = false) {
+  virtual void setupDescriptors(bool updatedMaterials = false) {
     /*
             Descriptor Pool
     */
@@ -1584,10 +2590,15 @@ class ForwardRenderer : public BaseRenderer {
       imageSamplerCount += 3;
       // Shadows?
       meshCount += 7;
-      dynamicDescriptorSets.resize(swapChain.imageCount);
+      // Shadow cascades and the shadow atlas
+      imageSamplerCount += SHADOW_CASCADE_COUNT + 1;
+      dynamicDescriptorSets.resize(maxFramesInFlight);
       for (auto& model : dynamicModels) {
         for (auto& material : model.materials) {
-          imageSamplerCount += 5;
+          // Bindless textures come from their own pool
+          if (!bindless.enabled) {
+            imageSamplerCount += 5;
+          }
           materialCount++;
         }
         for (auto node : model.linearNodes) {
@@ -1599,17 +2610,18 @@ class ForwardRenderer : public BaseRenderer {
 
       std::vector<VkDescriptorPoolSize> poolSizes = {
           {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-           (4 + meshCount) * swapChain.imageCount},
+           (5 + meshCount) * maxFramesInFlight},
           {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-           imageSamplerCount * swapChain.imageCount},
-          // One SSBO for the shader material buffer
-          {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1}};
+           imageSamplerCount * maxFramesInFlight},
+          // One SSBO for the shader material buffer, one light buffer per
+          // frame
+          {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 + maxFramesInFlight}};
       VkDescriptorPoolCreateInfo descriptorPoolCI{};
       descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
       descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
       descriptorPoolCI.pPoolSizes = poolSizes.data();
       descriptorPoolCI.maxSets =
-          (2 + materialCount + meshCount) * swapChain.imageCount;
+          (2 + materialCount + meshCount) * maxFramesInFlight;
       VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr,
                                              &descriptorPool));
     }
@@ -1632,10 +2644,16 @@ class ForwardRenderer : public BaseRenderer {
              VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
             {4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
              VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
-            {5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+            {5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, SHADOW_CASCADE_COUNT,
              VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
             {6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
              VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
+            {7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+             VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
+            {8, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+             VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
+            {9, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
+             VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
         };
         VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
         descriptorSetLayoutCI.sType =
@@ -1659,7 +2677,14 @@ class ForwardRenderer : public BaseRenderer {
         }
       }
       for (auto i = 0; i < dynamicDescriptorSets.size(); i++) {
-        std::array<VkWriteDescriptorSet, 7> writeDescriptorSets{};
+        std::array<VkDescriptorImageInfo, SHADOW_CASCADE_COUNT>
+            shadowMapDescriptors;
+        for (uint32_t j = 0; j < SHADOW_CASCADE_COUNT; j++) {
+          shadowMapDescriptors[j] =
+              renderTargets.shadowPasses[j]->framebuffers[i].descriptor;
+        }
+
+        std::array<VkWriteDescriptorSet, 10> writeDescriptorSets{};
 
         writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         writeDescriptorSets[0].descriptorType =
@@ -1707,11 +2732,10 @@ class ForwardRenderer : public BaseRenderer {
         writeDescriptorSets[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         writeDescriptorSets[5].descriptorType =
             VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        writeDescriptorSets[5].descriptorCount = 1;
+        writeDescriptorSets[5].descriptorCount = SHADOW_CASCADE_COUNT;
         writeDescriptorSets[5].dstSet = dynamicDescriptorSets[i].scene;
         writeDescriptorSets[5].dstBinding = 5;
-        writeDescriptorSets[5].pImageInfo =
-            &renderTargets.shadowPasses[0]->framebuffers[i].descriptor;
+        writeDescriptorSets[5].pImageInfo = shadowMapDescriptors.data();
 
         writeDescriptorSets[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         writeDescriptorSets[6].descriptorType =
@@ -1719,8 +2743,32 @@ class ForwardRenderer : public BaseRenderer {
         writeDescriptorSets[6].descriptorCount = 1;
         writeDescriptorSets[6].dstSet = dynamicDescriptorSets[i].scene;
         writeDescriptorSets[6].dstBinding = 6;
-        writeDescriptorSets[6].pImageInfo =
-            &renderTargets.aoPass->framebuffers[i].descriptor;
+        writeDescriptorSets[6].pImageInfo = &textures.empty.descriptor;
+
+        writeDescriptorSets[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSets[7].descriptorType =
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writeDescriptorSets[7].descriptorCount = 1;
+        writeDescriptorSets[7].dstSet = dynamicDescriptorSets[i].scene;
+        writeDescriptorSets[7].dstBinding = 7;
+        writeDescriptorSets[7].pBufferInfo = lightBuffer.getDescriptor(i);
+
+        writeDescriptorSets[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSets[8].descriptorType =
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writeDescriptorSets[8].descriptorCount = 1;
+        writeDescriptorSets[8].dstSet = dynamicDescriptorSets[i].scene;
+        writeDescriptorSets[8].dstBinding = 8;
+        writeDescriptorSets[8].pImageInfo = &shadowAtlas.getDescriptor();
+
+        writeDescriptorSets[9].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSets[9].descriptorType =
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        writeDescriptorSets[9].descriptorCount = 1;
+        writeDescriptorSets[9].dstSet = dynamicDescriptorSets[i].scene;
+        writeDescriptorSets[9].dstBinding = 9;
+        writeDescriptorSets[9].pBufferInfo =
+            &dynamicUniformBuffers[i].shadowAtlas.descriptor;
 
         vkUpdateDescriptorSets(
             device, static_cast<uint32_t>(writeDescriptorSets.size()),
@@ -1730,7 +2778,12 @@ class ForwardRenderer : public BaseRenderer {
 
     // Material (samplers)
     {
-      if (descriptorSetLayouts.material == VK_NULL_HANDLE || updatedMaterials) {
+      if (bindless.enabled) {
+        // The texture array layout does not depend on the scene, so it is
+        // kept across scene loads and only the array contents are rewritten
+        setupBindlessDescriptors();
+      } else if (descriptorSetLayouts.material == VK_NULL_HANDLE ||
+                 updatedMaterials) {
         if (updatedMaterials) {
           vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.material,
                                        nullptr);
@@ -1773,6 +2826,12 @@ class ForwardRenderer : public BaseRenderer {
       // Per-Material descriptor sets
       for (auto& model : dynamicModels) {
         for (auto& material : model.materials) {
+          if (bindless.enabled) {
+            // All materials share one set, so binds between materials are
+            // elided by the state tracker
+            material.descriptorSet = bindless.descriptorSet;
+            continue;
+          }
           std::vector<VkDescriptorImageInfo> imageDescriptors = {
               textures.empty.descriptor, textures.empty.descriptor,
               material.normalTexture ? material.normalTexture->descriptor
@@ -1984,32 +3043,8 @@ class ForwardRenderer : public BaseRenderer {
             vks::initializers::descriptorSetAllocateInfo(
                 descriptorPool, &descriptorSetLayouts.postProcessing, 1);
 
-        // renderTargets.aoPass
-        setLayoutBindings = {
-            {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
-             VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
-            {1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
-             VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
-            {2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
-             VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
-        };
-        descriptorSetLayoutCI.sType =
-            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
-        descriptorSetLayoutCI.bindingCount =
-            static_cast<uint32_t>(setLayoutBindings.size());
-        VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
-            device, &descriptorSetLayoutCI, nullptr,
-            &renderTargets.aoPass->descriptorSetLayout));
-
-        allocInfo = vks::initializers::descriptorSetAllocateInfo(
-            descriptorPool, &renderTargets.aoPass->descriptorSetLayout, 1);
-
-        renderTargets.aoPass->descriptorSets.resize(
-            dynamicDescriptorSets.size());
-        renderTargets.aoPass->screenTextureDescriptorSets.resize(
+        renderTargets.present->screenTextureDescriptorSets.resize(
             dynamicDescriptorSets.size());
-
         for (auto i = 0; i < dynamicDescriptorSets.size(); i++) {
           descriptorSetAllocInfo.sType =
               VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
@@ -2019,94 +3054,18 @@ class ForwardRenderer : public BaseRenderer {
           descriptorSetAllocInfo.descriptorSetCount = 1;
           VK_CHECK_RESULT(vkAllocateDescriptorSets(
               device, &descriptorSetAllocInfo,
-              &renderTargets.aoPass->screenTextureDescriptorSets[i]));
-
-          descriptorSetAllocInfo.pSetLayouts =
-              &renderTargets.aoPass->descriptorSetLayout;
-          descriptorSetAllocInfo.descriptorSetCount = 1;
-          VK_CHECK_RESULT(vkAllocateDescriptorSets(
-              device, &descriptorSetAllocInfo,
-              &renderTargets.aoPass->descriptorSets[i]));
-        }
-
-        renderTargets.aaPass->screenTextureDescriptorSets.resize(
-            dynamicDescriptorSets.size());
-        renderTargets.tonemapping->screenTextureDescriptorSets.resize(
-            dynamicDescriptorSets.size());
-        for (auto i = 0; i < dynamicDescriptorSets.size(); i++) {
-          descriptorSetAllocInfo.pSetLayouts =
-              &descriptorSetLayouts.postProcessing;
-          descriptorSetAllocInfo.descriptorSetCount = 1;
-          VK_CHECK_RESULT(vkAllocateDescriptorSets(
-              device, &descriptorSetAllocInfo,
-              &renderTargets.aaPass->screenTextureDescriptorSets[i]));
-          VK_CHECK_RESULT(vkAllocateDescriptorSets(
-              device, &descriptorSetAllocInfo,
-              &renderTargets.tonemapping->screenTextureDescriptorSets[i]));
+              &renderTargets.present->screenTextureDescriptorSets[i]));
         }
       }
+      // The sampled image is written by updateGraphFramebuffers()
       for (auto i = 0; i < dynamicDescriptorSets.size(); i++) {
-        std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
-        writeDescriptorSets[0] = vks::initializers::writeDescriptorSet(
-            renderTargets.aoPass->screenTextureDescriptorSets[i],
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-            &staticUniformBuffers.postProcessing.descriptor);
-        writeDescriptorSets[1] = vks::initializers::writeDescriptorSet(
-            renderTargets.aoPass->screenTextureDescriptorSets[i],
-            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
-            &renderTargets.aoPass->framebuffers[i].descriptor);
-        vkUpdateDescriptorSets(
-            device, static_cast<uint32_t>(writeDescriptorSets.size()),
-            writeDescriptorSets.data(), 0, nullptr);
-      }
-
-      for (auto i = 0; i < dynamicDescriptorSets.size(); i++) {
-        std::array<VkWriteDescriptorSet, 3> writeDescriptorSets{};
-        writeDescriptorSets[0] = vks::initializers::writeDescriptorSet(
-            renderTargets.aoPass->descriptorSets[i],
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-            &renderTargets.aoPass->passBuffers[0].descriptor);
-        writeDescriptorSets[1] = vks::initializers::writeDescriptorSet(
-            renderTargets.aoPass->descriptorSets[i],
-            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
-            &renderTargets.aoPass->passImages[0].descriptor);
-        writeDescriptorSets[2] = vks::initializers::writeDescriptorSet(
-            renderTargets.aoPass->descriptorSets[i],
-            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2,
-            &renderTargets.depthPrepass->framebuffers[i].descriptor);
-        vkUpdateDescriptorSets(
-            device, static_cast<uint32_t>(writeDescriptorSets.size()),
-            writeDescriptorSets.data(), 0, nullptr);
-      }
-
-      // renderpass.AA
-      for (auto i = 0; i < dynamicDescriptorSets.size(); i++) {
-        std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
-        writeDescriptorSets[0] = vks::initializers::writeDescriptorSet(
-            renderTargets.aaPass->screenTextureDescriptorSets[i],
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-            &staticUniformBuffers.postProcessing.descriptor);
-        writeDescriptorSets[1] = vks::initializers::writeDescriptorSet(
-            renderTargets.aaPass->screenTextureDescriptorSets[i],
-            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
-            &renderTargets.aaPass->framebuffers[i].descriptor);
-        vkUpdateDescriptorSets(
-            device, static_cast<uint32_t>(writeDescriptorSets.size()),
-            writeDescriptorSets.data(), 0, nullptr);
-      }
-      for (auto i = 0; i < dynamicDescriptorSets.size(); i++) {
-        std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
-        writeDescriptorSets[0] = vks::initializers::writeDescriptorSet(
-            renderTargets.tonemapping->screenTextureDescriptorSets[i],
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-            &staticUniformBuffers.postProcessing.descriptor);
-        writeDescriptorSets[1] = vks::initializers::writeDescriptorSet(
-            renderTargets.tonemapping->screenTextureDescriptorSets[i],
-            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
-            &renderTargets.tonemapping->framebuffers[i].descriptor);
-        vkUpdateDescriptorSets(
-            device, static_cast<uint32_t>(writeDescriptorSets.size()),
-            writeDescriptorSets.data(), 0, nullptr);
+        VkWriteDescriptorSet writeDescriptorSet =
+            vks::initializers::writeDescriptorSet(
+                renderTargets.present->screenTextureDescriptorSets[i],
+                VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
+                &staticUniformBuffers.postProcessing.descriptor);
+        vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+        graphFramebuffers[i].valid = false;
       }
     }
 
@@ -2162,7 +3121,64 @@ class ForwardRenderer : public BaseRenderer {
     }
   }
 
-  void addPipelineSet(const std::string prefix, const std::string vertexShader,
+  // Pipeline key for a material, the blend variant already disables culling
+  static uint32_t getPipelineKey(const vkglTF::Material& material) {
+    uint32_t key = PIPELINE_KEY_DEFAULT;
+    if (material.unlit) {
+      // KHR_materials_unlit
+      key |= PIPELINE_KEY_UNLIT;
+    }
+    if (material.alphaMode == vkglTF::Material::ALPHAMODE_BLEND) {
+      key |= PIPELINE_KEY_ALPHA_BLENDING;
+    } else if (material.doubleSided) {
+      key |= PIPELINE_KEY_DOUBLE_SIDED;
+    }
+    if (material.alphaMode == vkglTF::Material::ALPHAMODE_MASK) {
+      key |= PIPELINE_KEY_DEPTH_WRITE;
+    }
+    return key;
+  }
+
+  void setPipelineVariant(uint32_t key, VkPipeline pipeline) {
+    assert(key < PIPELINE_KEY_COUNT);
+    if (genPipelines[key] != VK_NULL_HANDLE) {
+      vkDestroyPipeline(device, genPipelines[key], nullptr);
+    }
+    genPipelines[key] = pipeline;
+  }
+
+  // Falls back to the lit variant when no unlit pipeline set was created
+  VkPipeline getPipelineVariant(uint32_t key) const {
+    assert(key < PIPELINE_KEY_COUNT);
+    if (genPipelines[key] == VK_NULL_HANDLE) {
+      return genPipelines[key & ~PIPELINE_KEY_UNLIT];
+    }
+    return genPipelines[key];
+  }
+
+  // Stores the pipeline on every material so draws never look it up
+  void resolveMaterialPipelines() {
+    for (auto& model : dynamicModels) {
+      for (auto& material : model.materials) {
+        material.pipelineKey = getPipelineKey(material);
+        material.pipeline = getPipelineVariant(material.pipelineKey);
+      }
+    }
+  }
+
+  // Descriptor set layouts of the scene pipelines, derived renderers append
+  // their own sets after the base ones
+  virtual std::vector<VkDescriptorSetLayout> getSceneSetLayouts() {
+    return {descriptorSetLayouts.scene, descriptorSetLayouts.material,
+            descriptorSetLayouts.node, descriptorSetLayouts.materialBuffer};
+  }
+
+  virtual std::string getSceneFragmentShader() {
+    return bindless.enabled ? "shaders/pbr_bindless.frag.spv"
+                            : "shaders/pbr.frag.spv";
+  }
+
+  void addPipelineSet(uint32_t baseKey, const std::string vertexShader,
                       const std::string fragmentShader,
                       bool emptyVertexInput = false) {
     VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI =
@@ -2184,9 +3200,10 @@ class ForwardRenderer : public BaseRenderer {
         vks::initializers::pipelineColorBlendStateCreateInfo(
             1, &blendAttachmentState);
 
+    // Opaque depth is already in the prepass
     VkPipelineDepthStencilStateCreateInfo depthStencilStateCI =
         vks::initializers::pipelineDepthStencilStateCreateInfo(
-            VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
+            VK_TRUE, VK_FALSE, VK_COMPARE_OP_EQUAL);
 
     VkPipelineViewportStateCreateInfo viewportStateCI =
         vks::initializers::pipelineViewportStateCreateInfo(1, 1);
@@ -2201,9 +3218,7 @@ class ForwardRenderer : public BaseRenderer {
         vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables);
 
     // Pipeline layout
-    const std::vector<VkDescriptorSetLayout> setLayouts = {
-        descriptorSetLayouts.scene, descriptorSetLayouts.material,
-        descriptorSetLayouts.node, descriptorSetLayouts.materialBuffer};
+    const std::vector<VkDescriptorSetLayout> setLayouts = getSceneSetLayouts();
     VkPipelineLayoutCreateInfo pipelineLayoutCI{};
     pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutCI.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
@@ -2246,7 +3261,7 @@ class ForwardRenderer : public BaseRenderer {
     VkGraphicsPipelineCreateInfo pipelineCI{};
     pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     pipelineCI.layout = pipelineLayouts.scene;
-    pipelineCI.renderPass = renderTargets.aaPass->renderPass;
+    pipelineCI.renderPass = renderTargets.scene->renderPass;
     pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
     pipelineCI.pVertexInputState = &vertexInputStateCI;
     pipelineCI.pRasterizationState = &rasterizationStateCI;
@@ -2265,12 +3280,25 @@ class ForwardRenderer : public BaseRenderer {
     // Default pipeline with back-face culling
     VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1,
                                               &pipelineCI, nullptr, &pipeline));
-    genPipelines[prefix] = pipeline;
+    setPipelineVariant(baseKey, pipeline);
     // Double sided
     rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
     VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1,
                                               &pipelineCI, nullptr, &pipeline));
-    genPipelines[prefix + "_double_sided"] = pipeline;
+    setPipelineVariant(baseKey | PIPELINE_KEY_DOUBLE_SIDED, pipeline);
+    // Masked, not part of the prepass
+    depthStencilStateCI.depthWriteEnable = VK_TRUE;
+    depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    rasterizationStateCI.cullMode = VK_CULL_MODE_BACK_BIT;
+    VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1,
+                                              &pipelineCI, nullptr, &pipeline));
+    setPipelineVariant(baseKey | PIPELINE_KEY_DEPTH_WRITE, pipeline);
+    rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
+    VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1,
+                                              &pipelineCI, nullptr, &pipeline));
+    setPipelineVariant(
+        baseKey | PIPELINE_KEY_DEPTH_WRITE | PIPELINE_KEY_DOUBLE_SIDED,
+        pipeline);
     // Alpha blending
     rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
     blendAttachmentState.blendEnable = VK_TRUE;
@@ -2287,7 +3315,7 @@ class ForwardRenderer : public BaseRenderer {
     blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
     VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1,
                                               &pipelineCI, nullptr, &pipeline));
-    genPipelines[prefix + "_alpha_blending"] = pipeline;
+    setPipelineVariant(baseKey | PIPELINE_KEY_ALPHA_BLENDING, pipeline);
   }
 
   void preparePipelines() {
@@ -2332,7 +3360,7 @@ class ForwardRenderer : public BaseRenderer {
                                            nullptr, &pipelineLayouts.skybox));
     VkGraphicsPipelineCreateInfo pipelineCI =
         vks::initializers::graphicsPipelineCreateInfo(
-            pipelineLayouts.skybox, renderTargets.aaPass->renderPass);
+            pipelineLayouts.skybox, renderTargets.scene->renderPass);
 
     pipelineCI.pInputAssemblyState = &inputAssemblyState;
     pipelineCI.pRasterizationState = &rasterizationState;
@@ -2372,83 +3400,19 @@ class ForwardRenderer : public BaseRenderer {
     emptyInputState.vertexBindingDescriptionCount = 0;
     emptyInputState.pVertexBindingDescriptions = nullptr;
 
-    // AO PASS
-    std::vector<VkDescriptorSetLayout> setLayouts = {
-        descriptorSetLayouts.postProcessing,
-        renderTargets.aoPass->descriptorSetLayout};
-
     rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
 
+    // Copy of the post processed image into the swapchain
     VkGraphicsPipelineCreateInfo postProcessingpipelineCI;
+    std::vector<VkDescriptorSetLayout> setLayouts = {
+        descriptorSetLayouts.postProcessing};
     pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(
         setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
     VK_CHECK_RESULT(
         vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr,
-                               &renderTargets.aoPass->pipelineLayout));
-
-    postProcessingpipelineCI = vks::initializers::graphicsPipelineCreateInfo(
-        renderTargets.aoPass->pipelineLayout, renderTargets.aoPass->renderPass);
-
-    shaderStages[0] = loadShader(renderTargets.aoPass->vertexShaderPath,
-                                 VK_SHADER_STAGE_VERTEX_BIT);
-    shaderStages[1] = loadShader(renderTargets.aoPass->fragmentShaderPath,
-                                 VK_SHADER_STAGE_FRAGMENT_BIT);
-
-    postProcessingpipelineCI.pInputAssemblyState = &inputAssemblyState;
-    postProcessingpipelineCI.pRasterizationState = &rasterizationState;
-    postProcessingpipelineCI.pColorBlendState = &colorBlendState;
-    postProcessingpipelineCI.pMultisampleState = &multisampleState;
-    postProcessingpipelineCI.pViewportState = &viewportState;
-    postProcessingpipelineCI.pDepthStencilState = &depthStencilState;
-    postProcessingpipelineCI.pDynamicState = &dynamicState;
-    postProcessingpipelineCI.pVertexInputState = &emptyInputState;
-    postProcessingpipelineCI.stageCount =
-        static_cast<uint32_t>(shaderStages.size());
-    postProcessingpipelineCI.pStages = shaderStages.data();
-
-    VK_CHECK_RESULT(
-        vkCreateGraphicsPipelines(device, nullptr, 1, &postProcessingpipelineCI,
-                                  nullptr, &renderTargets.aoPass->pipeline));
-
-    setLayouts = {descriptorSetLayouts.postProcessing};
-    pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(
-        setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
-    VK_CHECK_RESULT(
-        vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr,
-                               &renderTargets.aaPass->pipelineLayout));
-
-    postProcessingpipelineCI = vks::initializers::graphicsPipelineCreateInfo(
-        renderTargets.aaPass->pipelineLayout, renderTargets.tonemapping->renderPass);
-    rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
-    postProcessingpipelineCI.pInputAssemblyState = &inputAssemblyState;
-    postProcessingpipelineCI.pRasterizationState = &rasterizationState;
-    postProcessingpipelineCI.pColorBlendState = &colorBlendState;
-    postProcessingpipelineCI.pMultisampleState = &multisampleState;
-    postProcessingpipelineCI.pViewportState = &viewportState;
-    postProcessingpipelineCI.pDepthStencilState = &depthStencilState;
-    postProcessingpipelineCI.pDynamicState = &dynamicState;
-    postProcessingpipelineCI.stageCount =
-        static_cast<uint32_t>(shaderStages.size());
-    postProcessingpipelineCI.pStages = shaderStages.data();
-    postProcessingpipelineCI.pVertexInputState = &emptyInputState;
-
-    shaderStages[0] = loadShader(renderTargets.aaPass->vertexShaderPath,
-                                 VK_SHADER_STAGE_VERTEX_BIT);
-    shaderStages[1] = loadShader(renderTargets.aaPass->fragmentShaderPath,
-                                 VK_SHADER_STAGE_FRAGMENT_BIT);
-
-    VK_CHECK_RESULT(
-        vkCreateGraphicsPipelines(device, nullptr, 1, &postProcessingpipelineCI,
-                                  nullptr, &renderTargets.aaPass->pipeline));
-
-    setLayouts = {descriptorSetLayouts.postProcessing};
-    pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(
-        setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
-    VK_CHECK_RESULT(
-        vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr,
-                               &renderTargets.tonemapping->pipelineLayout));
+                               &renderTargets.present->pipelineLayout));
     postProcessingpipelineCI = vks::initializers::graphicsPipelineCreateInfo(
-        renderTargets.tonemapping->pipelineLayout, renderPass);
+        renderTargets.present->pipelineLayout, renderPass);
 
     rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
     postProcessingpipelineCI.pInputAssemblyState = &inputAssemblyState;
@@ -2463,14 +3427,14 @@ class ForwardRenderer : public BaseRenderer {
     postProcessingpipelineCI.pStages = shaderStages.data();
     postProcessingpipelineCI.pVertexInputState = &emptyInputState;
 
-    shaderStages[0] = loadShader(renderTargets.tonemapping->vertexShaderPath,
+    shaderStages[0] = loadShader(renderTargets.present->vertexShaderPath,
                                  VK_SHADER_STAGE_VERTEX_BIT);
-    shaderStages[1] = loadShader(renderTargets.tonemapping->fragmentShaderPath,
+    shaderStages[1] = loadShader(renderTargets.present->fragmentShaderPath,
                                  VK_SHADER_STAGE_FRAGMENT_BIT);
 
     VK_CHECK_RESULT(vkCreateGraphicsPipelines(
-        device, nullptr, 1, &postProcessingpipelineCI, nullptr,
-        &renderTargets.tonemapping->pipeline));
+        device, pipelineCache, 1, &postProcessingpipelineCI, nullptr,
+        &renderTargets.present->pipeline));
 
     // Shadow
     rasterizationState.cullMode = VK_CULL_MODE_NONE;
@@ -2527,15 +3491,43 @@ class ForwardRenderer : public BaseRenderer {
         device, pipelineCache, 1, &shadowPipelineCI, nullptr,
         &renderTargets.shadowPasses[0]->pipeline));
 
+    // Depth prepass, positions are computed exactly like pbr.vert does so the
+    // scene pass can test opaque geometry for equal depth. The fragment
+    // shader writes the motion vectors
     shadowPipelineCI = vks::initializers::graphicsPipelineCreateInfo(
         pipelineLayouts.shadow, renderTargets.depthPrepass->renderPass);
 
     shaderStages[0] = loadShader(renderTargets.depthPrepass->vertexShaderPath,
                                  VK_SHADER_STAGE_VERTEX_BIT);
+    shaderStages[1] =
+        loadShader(renderTargets.depthPrepass->fragmentShaderPath,
+                   VK_SHADER_STAGE_FRAGMENT_BIT);
 
     dynamicStateEnables = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
     dynamicState =
         vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables);
+
+    // Same locations and formats as the scene pipelines
+    VkVertexInputBindingDescription prepassVertexBinding = {
+        0, sizeof(vkglTF::Vertex), VK_VERTEX_INPUT_RATE_VERTEX};
+    const std::array<VkVertexInputAttributeDescription, 3>
+        prepassVertexAttributes = {{
+            {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(vkglTF::Vertex, pos)},
+            {4, 0, VK_FORMAT_R32G32B32A32_UINT,
+             offsetof(vkglTF::Vertex, joint0)},
+            {5, 0, VK_FORMAT_R32G32B32A32_SFLOAT,
+             offsetof(vkglTF::Vertex, weight0)},
+        }};
+    VkPipelineVertexInputStateCreateInfo prepassVertexInputState{};
+    prepassVertexInputState.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    prepassVertexInputState.vertexBindingDescriptionCount = 1;
+    prepassVertexInputState.pVertexBindingDescriptions = &prepassVertexBinding;
+    prepassVertexInputState.vertexAttributeDescriptionCount =
+        static_cast<uint32_t>(prepassVertexAttributes.size());
+    prepassVertexInputState.pVertexAttributeDescriptions =
+        prepassVertexAttributes.data();
+
     shadowPipelineCI.pInputAssemblyState = &inputAssemblyState;
     shadowPipelineCI.pRasterizationState = &rasterizationState;
     shadowPipelineCI.pColorBlendState = &colorBlendState;
@@ -2543,24 +3535,31 @@ class ForwardRenderer : public BaseRenderer {
     shadowPipelineCI.pViewportState = &viewportState;
     shadowPipelineCI.pDepthStencilState = &depthStencilState;
     shadowPipelineCI.pDynamicState = &dynamicState;
-    shadowPipelineCI.stageCount = 1;
-    shadowPipelineCI.pStages = &shaderStages[0];
-    shadowPipelineCI.pVertexInputState =
-        vkglTF::Vertex::getPipelineVertexInputState(
-            {vkglTF::VertexComponent::Position});
+    shadowPipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
+    shadowPipelineCI.pStages = shaderStages.data();
+    shadowPipelineCI.pVertexInputState = &prepassVertexInputState;
 
-    // No blend attachment states (no color attachments used)
-    colorBlendState.attachmentCount = 0;
+    // The motion vectors are the only color attachment, never blended
+    colorBlendState.attachmentCount = 1;
     depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS;
-    // Enable depth bias
-    // rasterizationState.depthBiasEnable = VK_TRUE;
+    // A bias would break the equal test of the scene pass
+    rasterizationState.depthBiasEnable = VK_FALSE;
+    // Culling matches the scene pipeline of the material
+    rasterizationState.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 
     shadowPipelineCI.renderPass = renderTargets.depthPrepass->renderPass;
     VK_CHECK_RESULT(vkCreateGraphicsPipelines(
         device, pipelineCache, 1, &shadowPipelineCI, nullptr,
         &renderTargets.depthPrepass->pipeline));
+    rasterizationState.cullMode = VK_CULL_MODE_NONE;
+    VK_CHECK_RESULT(vkCreateGraphicsPipelines(
+        device, pipelineCache, 1, &shadowPipelineCI, nullptr,
+        &pipelines.depthPrepassDoubleSided));
 
-    addPipelineSet("pbr", "shaders/pbr.vert.spv", "shaders/pbr.frag.spv");
+    addPipelineSet(PIPELINE_KEY_DEFAULT, "shaders/pbr.vert.spv",
+                   getSceneFragmentShader());
+    resolveMaterialPipelines();
   }
 
   // Generate a BRDF integration map used as a look-up-table (Roughness/dotNV)
@@ -3721,7 +4720,8 @@ class ForwardRenderer : public BaseRenderer {
   }
 
   void prepareUniformBuffers() {
-    dynamicUniformBuffers.resize(swapChain.imageCount);
+    dynamicUniformBuffers.resize(maxFramesInFlight);
+    lightBuffer.create(vulkanDevice, maxFramesInFlight);
 
     for (auto& uniformBuffer : dynamicUniformBuffers) {
       VK_CHECK_RESULT(vulkanDevice->createBuffer(
@@ -3739,10 +4739,16 @@ class ForwardRenderer : public BaseRenderer {
           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
           &uniformBuffer.shadow, sizeof(shadowParams)));
+      VK_CHECK_RESULT(vulkanDevice->createBuffer(
+          VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+          &uniformBuffer.shadowAtlas, sizeof(shadowAtlasParams)));
 
       uniformBuffer.scene.map();
       uniformBuffer.params.map();
       uniformBuffer.shadow.map();
+      uniformBuffer.shadowAtlas.map();
     }
 
     VK_CHECK_RESULT(vulkanDevice->createBuffer(
@@ -3752,63 +4758,131 @@ class ForwardRenderer : public BaseRenderer {
         &staticUniformBuffers.postProcessing, sizeof(postProcessingParams)));
     staticUniformBuffers.postProcessing.map();
 
-    renderTargets.aoPass->passBuffers.resize(1);
-    VK_CHECK_RESULT(vulkanDevice->createBuffer(
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        &renderTargets.aoPass->passBuffers[0], sizeof(float) * 64 * 3));
-    renderTargets.aoPass->passBuffers[0].map();
-
-    // Hemisphere points
-    float mSSAOKernel[64 * 3];
-    for (int i = 0; i < 64; i++) {
-      int index = i * 3;
-      mSSAOKernel[index] = math::random::randomRange(-1.0f, 1.0f);
-      mSSAOKernel[index + 1] = math::random::randomRange(-1.0f, 1.0f);
-      mSSAOKernel[index + 2] = math::random::randomRange(0.0f, 1.0f);
-
-      float scale = (float)i / 64.0f;
-      float scaleMul = math::linear::lerp(0.1f, 1.0f, scale * scale);
-
-      mSSAOKernel[index] *= scaleMul;
-      mSSAOKernel[index + 1] *= scaleMul;
-      mSSAOKernel[index + 2] *= scaleMul;
-    }
-    memcpy(renderTargets.aoPass->passBuffers[0].mapped, &mSSAOKernel,
-           sizeof(mSSAOKernel));
-
     updateSceneParams();
     updateLightsUBO();
     updateGenericUBO();
     updatePostProcessingParams();
   }
 
+  // Returns the slot of a texture in the bindless texture array, textures are
+  // added on first use
+  uint32_t getBindlessTextureIndex(const vkglTF::Texture* texture) {
+    if (!bindless.enabled) {
+      return 0;
+    }
+    auto it = bindless.textureIndices.find(texture);
+    if (it != bindless.textureIndices.end()) {
+      return it->second;
+    }
+    const uint32_t index = static_cast<uint32_t>(bindless.imageInfos.size());
+    if (index >= bindless.maxTextures) {
+      vks::tools::exitFatal("Scene exceeds the bindless texture limit of " +
+                                std::to_string(bindless.maxTextures),
+                            -1);
+    }
+    bindless.imageInfos.push_back(texture->descriptor);
+    bindless.textureIndices[texture] = index;
+    return index;
+  }
+
+  // Packs a material texture slot as (texture index << 1) | uv set,
+  // -1 = texture not used for this material. The texture index is always 0
+  // when not using bindless textures
+  int32_t encodeTextureSet(const vkglTF::Texture* texture,
+                           uint8_t texCoordSet) {
+    if (texture == nullptr) {
+      return -1;
+    }
+    return static_cast<int32_t>(getBindlessTextureIndex(texture) << 1) |
+           (texCoordSet & 1);
+  }
+
+  void setupBindlessDescriptors() {
+    if (descriptorSetLayouts.material == VK_NULL_HANDLE) {
+      VkDescriptorSetLayoutBinding setLayoutBinding{
+          0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, bindless.maxTextures,
+          VK_SHADER_STAGE_FRAGMENT_BIT, nullptr};
+      // Slots past the scene's textures are never written
+      VkDescriptorBindingFlagsEXT bindingFlags =
+          VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+          VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT;
+      VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsCI{};
+      bindingFlagsCI.sType =
+          VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+      bindingFlagsCI.bindingCount = 1;
+      bindingFlagsCI.pBindingFlags = &bindingFlags;
+
+      VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
+      descriptorSetLayoutCI.sType =
+          VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+      descriptorSetLayoutCI.pNext = &bindingFlagsCI;
+      descriptorSetLayoutCI.flags =
+          VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+      descriptorSetLayoutCI.pBindings = &setLayoutBinding;
+      descriptorSetLayoutCI.bindingCount = 1;
+      VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
+          device, &descriptorSetLayoutCI, nullptr,
+          &descriptorSetLayouts.material));
+
+      VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                    bindless.maxTextures};
+      VkDescriptorPoolCreateInfo descriptorPoolCI{};
+      descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+      descriptorPoolCI.flags =
+          VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+      descriptorPoolCI.poolSizeCount = 1;
+      descriptorPoolCI.pPoolSizes = &poolSize;
+      descriptorPoolCI.maxSets = 1;
+      VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr,
+                                             &bindless.descriptorPool));
+
+      VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+      descriptorSetAllocInfo.sType =
+          VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+      descriptorSetAllocInfo.descriptorPool = bindless.descriptorPool;
+      descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayouts.material;
+      descriptorSetAllocInfo.descriptorSetCount = 1;
+      VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo,
+                                               &bindless.descriptorSet));
+    }
+
+    VkWriteDescriptorSet writeDescriptorSet{};
+    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDescriptorSet.descriptorType =
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writeDescriptorSet.descriptorCount =
+        static_cast<uint32_t>(bindless.imageInfos.size());
+    writeDescriptorSet.dstSet = bindless.descriptorSet;
+    writeDescriptorSet.dstBinding = 0;
+    writeDescriptorSet.dstArrayElement = 0;
+    writeDescriptorSet.pImageInfo = bindless.imageInfos.data();
+    vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+  }
+
   // All materials for the current scene are stored in an SSBO allowing
   // indexing from a push constant set per primitive
   void createMaterialBuffer() {
+    // The texture array is rebuilt alongside the material buffer
+    bindless.imageInfos.clear();
+    bindless.textureIndices.clear();
+    bindless.imageInfos.push_back(textures.empty.descriptor);
+
     std::vector<ShaderMaterial> shaderMaterials{};
     for (auto& model : dynamicModels) {
       for (auto& material : model.materials) {
         ShaderMaterial shaderMaterial{};
 
         shaderMaterial.emissiveFactor = material.emissiveFactor;
-        // To save space, availabilty and texture coordinate set are combined
-        // -1 = texture not used for this material, >= 0 texture used and
-        // index of texture coordinate set
-        shaderMaterial.colorTextureSet = material.baseColorTexture != nullptr
-                                             ? material.texCoordSets.baseColor
-                                             : -1;
-        shaderMaterial.normalTextureSet = material.normalTexture != nullptr
-                                              ? material.texCoordSets.normal
-                                              : -1;
-        shaderMaterial.occlusionTextureSet =
-            material.occlusionTexture != nullptr
-                ? material.texCoordSets.occlusion
-                : -1;
-        shaderMaterial.emissiveTextureSet = material.emissiveTexture != nullptr
-                                                ? material.texCoordSets.emissive
-                                                : -1;
+        // To save space, availabilty, texture index and texture coordinate
+        // set are combined, see encodeTextureSet
+        shaderMaterial.colorTextureSet = encodeTextureSet(
+            material.baseColorTexture, material.texCoordSets.baseColor);
+        shaderMaterial.normalTextureSet = encodeTextureSet(
+            material.normalTexture, material.texCoordSets.normal);
+        shaderMaterial.occlusionTextureSet = encodeTextureSet(
+            material.occlusionTexture, material.texCoordSets.occlusion);
+        shaderMaterial.emissiveTextureSet = encodeTextureSet(
+            material.emissiveTexture, material.texCoordSets.emissive);
         shaderMaterial.alphaMask = static_cast<float>(
             material.alphaMode == vkglTF::Material::ALPHAMODE_MASK);
         shaderMaterial.alphaMaskCutoff = material.alphaCutoff;
@@ -3822,25 +4896,19 @@ class ForwardRenderer : public BaseRenderer {
           shaderMaterial.metallicFactor = material.metallicFactor;
           shaderMaterial.roughnessFactor = material.roughnessFactor;
           shaderMaterial.PhysicalDescriptorTextureSet =
-              material.metallicRoughnessTexture != nullptr
-                  ? material.texCoordSets.metallicRoughness
-                  : -1;
-          shaderMaterial.colorTextureSet = material.baseColorTexture != nullptr
-                                               ? material.texCoordSets.baseColor
-                                               : -1;
+              encodeTextureSet(material.metallicRoughnessTexture,
+                               material.texCoordSets.metallicRoughness);
         } else {
           if (material.pbrWorkflows.specularGlossiness) {
             // Specular glossiness workflow
             shaderMaterial.workflow =
                 static_cast<float>(PBR_WORKFLOW_SPECULAR_GLOSSINESS);
             shaderMaterial.PhysicalDescriptorTextureSet =
-                material.extension.specularGlossinessTexture != nullptr
-                    ? material.texCoordSets.specularGlossiness
-                    : -1;
+                encodeTextureSet(material.extension.specularGlossinessTexture,
+                                 material.texCoordSets.specularGlossiness);
             shaderMaterial.colorTextureSet =
-                material.extension.diffuseTexture != nullptr
-                    ? material.texCoordSets.baseColor
-                    : -1;
+                encodeTextureSet(material.extension.diffuseTexture,
+                                 material.texCoordSets.baseColor);
             shaderMaterial.diffuseFactor = material.extension.diffuseFactor;
             shaderMaterial.specularFactor =
                 glm::vec4(material.extension.specularFactor, 1.0f);
@@ -3886,49 +4954,310 @@ class ForwardRenderer : public BaseRenderer {
   }
 
   void updateLightsUBO() {
-    for (int i = 0; i < lights.size(); i++) {
-      if (lights[i].lightType == 0) /*Directional Light*/ {
-        uboMatrices.lightSpace[i] = lights[i].lightSpace;
-        shadowParams.depthMVP[i + 1] = lights[i].lightSpace;
+    // The first directional light casts the cascaded shadows
+    for (auto& light : lights) {
+      if (light.lightType == 0 /*Directional Light*/) {
+        glm::vec3 sceneMin, sceneMax;
+        getSceneBounds(sceneMin, sceneMax);
+        shadowCascades.update(camera.matrices.view, camera.matrices.perspective,
+                              camera.getNearClip(), camera.getFarClip(),
+                              light.rotation, sceneMin, sceneMax,
+                              shadowMapSize);
+        break;
       }
     }
+    for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+      uboMatrices.cascadeViewProj[i] = shadowCascades.getViewProjection(i);
+      shadowParams.depthMVP[i + 1] = shadowCascades.getViewProjection(i);
+    }
+    uboMatrices.cascadeSplits = shadowCascades.getSplitDepths();
 
     shadowParams.depthMVP[0] =
         camera.matrices.perspective * camera.matrices.view;
+    updateShadowAtlas();
 
     memcpy(dynamicUniformBuffers[currentFrameIndex].shadow.mapped,
            &shadowParams, sizeof(shadowParams));
   }
 
+  // Tracks which casters moved, the shadow cache keeps the static ones and
+  // the shadow atlas redraws its tiles whenever anything moves
+  void updateShadowCasters() {
+    hasMovingCasters = false;
+    shadowCastersChanged = false;
+    for (uint32_t i = 0; i < dynamicModelsToRenderIndices.size(); i++) {
+      const uint32_t modelIndex = dynamicModelsToRenderIndices[i];
+      shadowCastersChanged |= shadowCache.updateCaster(
+          modelIndex, dynamicModels[modelIndex].transform.transformMat);
+      hasMovingCasters |= shadowCache.isMoving(modelIndex);
+    }
+  }
+
+  // Requests atlas tiles for the visible point and spot lights of the scene,
+  // sized by how much of the screen their range covers
+  void updateShadowAtlas() {
+    shadowAtlas.beginFrame();
+    vks::Frustum cameraFrustum;
+    cameraFrustum.update(camera.matrices.perspective * camera.matrices.view);
+    const glm::vec3 camPos = glm::vec3(glm::inverse(camera.matrices.view)[3]);
+    const float tanHalfFov = 1.0f / std::abs(camera.matrices.perspective[1][1]);
+
+    // Light buffer order, directional lights come first
+    uint32_t lightIndex = 0;
+    for (auto& light : lights) {
+      lightIndex += light.lightType == 0 ? 1 : 0;
+    }
+    for (auto& light : lights) {
+      if (light.lightType == 0) {
+        continue;
+      }
+      const uint32_t index = lightIndex++;
+      const float range = std::min(light.getRange(), localShadowDistance);
+      const glm::vec3 extent(range);
+      if (!cameraFrustum.intersects(light.position - extent,
+                                    light.position + extent)) {
+        continue;
+      }
+      const float distance = glm::length(light.position - camPos);
+      const float coverage =
+          distance <= range
+              ? 1.0f
+              : std::min(range / (distance * tanHalfFov), 1.0f);
+
+      glm::mat4 faceViewProj[vks::ShadowAtlas::CUBE_FACES];
+      const uint32_t faceCount =
+          light.getShadowViewProjections(faceViewProj, localShadowDistance);
+      if (faceCount > 0) {
+        shadowAtlas.addLight(index, faceCount, coverage,
+                             renderTargetExtent.height, faceViewProj);
+      }
+    }
+    shadowAtlas.update(shadowCastersChanged, shadowAtlasParams);
+
+    for (uint32_t i = 0; i < vks::ShadowAtlas::MAX_TILES; i++) {
+      shadowParams.depthMVP[SHADOW_ATLAS_TILE_OFFSET + i] =
+          shadowAtlasParams.tileViewProj[i];
+    }
+    memcpy(dynamicUniformBuffers[currentFrameIndex].shadowAtlas.mapped,
+           &shadowAtlasParams, sizeof(shadowAtlasParams));
+  }
+
+  // Draws the casters inside of an atlas tile's frustum, the tile's viewport
+  // and scissor are already set
+  void recordShadowAtlasTile(vks::CommandStateTracker& cmd, uint32_t tileIndex,
+                             const glm::mat4& viewProjection) {
+    vks::Frustum tileFrustum;
+    tileFrustum.update(viewProjection);
+    vkCmdSetDepthBias(cmd.getCommandBuffer(), depthBiasConstant, 0.0f,
+                      depthBiasSlope);
+    cmd.bindPipeline(renderTargets.shadowPasses[0]->pipeline);
+    for (const ShadowDraw& draw : shadowDraws) {
+      if (draw.bounded &&
+          !tileFrustum.intersects(draw.boundsMin, draw.boundsMax)) {
+        continue;
+      }
+      vkglTF::Model& model = dynamicModels[draw.modelIndex];
+
+      cmd.bindVertexBuffer(model.vertices.buffer);
+      if (model.indices.buffer != VK_NULL_HANDLE) {
+        cmd.bindIndexBuffer(model.indices.buffer);
+      }
+
+      PushConstData pushConst{};
+      pushConst.transformMatIndex = draw.transformIndex;
+      pushConst.materialIndex = SHADOW_ATLAS_TILE_OFFSET + tileIndex;
+      const VkDescriptorSet descriptorsets[2] = {
+          dynamicDescriptorSets[currentFrameIndex].shadow,
+          draw.node->mesh->uniformBuffer.descriptorSet};
+      cmd.pushConstants(pipelineLayouts.shadow, VK_SHADER_STAGE_VERTEX_BIT,
+                        sizeof(pushConst), &pushConst);
+      cmd.bindDescriptorSets(pipelineLayouts.shadow, 0, 2, descriptorsets);
+
+      if (draw.primitive->hasIndices) {
+        cmd.drawIndexed(draw.primitive->indexCount, draw.primitive->firstIndex);
+      } else {
+        cmd.draw(draw.primitive->vertexCount);
+      }
+    }
+  }
+
   void updateGenericUBO() {
-    uboMatrices.projection = camera.matrices.perspective;
+    uboMatrices.projection = vks::TAAPass::jitterProjection(
+        camera.matrices.perspective, taaJitter, renderExtent);
     uboMatrices.view = camera.matrices.view;
     glm::mat4 cv = glm::inverse(camera.matrices.view);
     uboMatrices.camPos = glm::vec4(cv[3]);
-    uboMatrices.screenSize = glm::vec2((float)getWidth(), (float)getHeight());
+    uboMatrices.screenSize =
+        glm::vec2((float)renderExtent.width, (float)renderExtent.height);
+
+    // Matrices of the first frame are never read, TAA has no history then
+    uboMatrices.previousViewProjection = uboMatrices.viewProjection;
+    uboMatrices.viewProjection =
+        camera.matrices.perspective * camera.matrices.view;
 
     skybox.transform.transformMat =
         glm::mat4(glm::mat3(camera.matrices.view)) * skybox.transform.scaleMat;
     uboMatrices.models[0] = skybox.transform.transformMat;
+    uboMatrices.previousModels[0] = skybox.transform.transformMat;
+    // Models added since the last frame start without motion
+    for (size_t i = previousModelTransforms.size(); i < dynamicModels.size();
+         i++) {
+      previousModelTransforms.push_back(
+          dynamicModels[i].transform.transformMat);
+    }
     for (uint32_t i = 0; i < dynamicModelsToRenderIndices.size(); i++) {
-      uboMatrices.models[i + 1] =
-          dynamicModels[dynamicModelsToRenderIndices[i]].transform.transformMat;
+      const uint32_t modelIndex = dynamicModelsToRenderIndices[i];
+      const glm::mat4& transform =
+          dynamicModels[modelIndex].transform.transformMat;
+      uboMatrices.models[i + 1] = transform;
+      uboMatrices.previousModels[i + 1] = previousModelTransforms[modelIndex];
+      previousModelTransforms[modelIndex] = transform;
     }
     memcpy(dynamicUniformBuffers[currentFrameIndex].scene.mapped, &uboMatrices,
            sizeof(uboMatrices));
   }
 
-  void updateSceneParams() {
-    for (int i = 0; i < lights.size(); i++) {
-      sceneParams.lights[i] = lights[i].lightInfo;
+  virtual void updateSceneParams() {
+    const uint32_t lightCount =
+        static_cast<uint32_t>(lights.size() + benchmarkLights.size());
+    lightBuffer.resize(lightCount);
+    lightAssigner.clearLights();
+    // Directional lights first, the shader loops over them for every draw
+    uint32_t lightIndex = 0;
+    for (auto& light : lights) {
+      if (light.lightType == 0) {
+        lightBuffer.set(lightIndex++, light.lightInfo);
+      }
     }
-    sceneParams.lightCount = lights.size();
+    const uint32_t directionalLightCount = lightIndex;
+    for (auto& light : lights) {
+      if (light.lightType != 0) {
+        addLocalLight(lightIndex++, light.lightInfo);
+      }
+    }
+    for (auto& light : benchmarkLights) {
+      addLocalLight(lightIndex++, light.lightInfo);
+    }
+    uploadLights();
+
+    sceneParams.lightCount =
+        uiSettings.perDrawLightLists ? directionalLightCount : lightCount;
     sceneParams.debugViewInputs = uiSettings.debugOutput;
     sceneParams.scaleIBLAmbient = uiSettings.IBLstrength;
     memcpy(dynamicUniformBuffers[currentFrameIndex].params.mapped, &sceneParams,
            sizeof(SceneParams));
   }
 
+  void addLocalLight(uint32_t lightIndex,
+                     const vks::light::GPULightInfo& light) {
+    lightBuffer.set(lightIndex, light);
+    if (uiSettings.perDrawLightLists) {
+      lightAssigner.addLight(lightIndex, light);
+    }
+  }
+
+  void uploadLights() {
+    if (lightBuffer.upload(currentFrameIndex)) {
+      updateLightDescriptors();
+    }
+  }
+
+  // Points the scene sets at the light buffers after they were reallocated
+  virtual void updateLightDescriptors() {
+    for (uint32_t i = 0; i < dynamicDescriptorSets.size(); i++) {
+      if (dynamicDescriptorSets[i].scene == VK_NULL_HANDLE) continue;
+      VkWriteDescriptorSet writeDescriptorSet =
+          vks::initializers::writeDescriptorSet(
+              dynamicDescriptorSets[i].scene, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+              7, lightBuffer.getDescriptor(i));
+      vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+    }
+  }
+
+  // World space bounds of the loaded scene
+  void getSceneBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) {
+    boundsMin = glm::vec3(FLT_MAX);
+    boundsMax = glm::vec3(-FLT_MAX);
+    for (auto& model : dynamicModels) {
+      for (uint32_t i = 0; i < 8; i++) {
+        const glm::vec3 corner = glm::vec3(
+            (i & 1) ? model.dimensions.max.x : model.dimensions.min.x,
+            (i & 2) ? model.dimensions.max.y : model.dimensions.min.y,
+            (i & 4) ? model.dimensions.max.z : model.dimensions.min.z);
+        const glm::vec3 worldCorner =
+            glm::vec3(model.transform.transformMat * glm::vec4(corner, 1.0f));
+        boundsMin = glm::min(boundsMin, worldCorner);
+        boundsMax = glm::max(boundsMax, worldCorner);
+      }
+    }
+  }
+
+  // Small randomly colored point light, reaches roughly 12 units before it
+  // drops below the culling cutoff
+  static vks::light::Light createRandomPointLight(const glm::vec3& boundsMin,
+                                                  const glm::vec3& boundsMax) {
+    const glm::vec3 position =
+        glm::vec3(math::random::randomRange(boundsMin.x, boundsMax.x),
+                  math::random::randomRange(boundsMin.y, boundsMax.y),
+                  math::random::randomRange(boundsMin.z, boundsMax.z));
+    const glm::vec4 color = glm::vec4(math::random::randomRange(0.2f, 1.0f),
+                                      math::random::randomRange(0.2f, 1.0f),
+                                      math::random::randomRange(0.2f, 1.0f),
+                                      1.0f);
+    vks::light::Light light;
+    light.createPointLight(color, position, 1.0f, 0.7f, 1.8f);
+    return light;
+  }
+
+  // Measures the average frame time for an increasing number of static point
+  // lights, results are written to the console
+  void startLightBenchmark() {
+    lightBenchmark.running = true;
+    lightBenchmark.step = 0;
+    setBenchmarkLightCount(lightBenchmarkCounts[0]);
+    std::cout << "Light benchmark (" << name << ")" << std::endl;
+  }
+
+  void setBenchmarkLightCount(uint32_t count) {
+    glm::vec3 boundsMin, boundsMax;
+    getSceneBounds(boundsMin, boundsMax);
+    benchmarkLights.resize(count);
+    for (auto& light : benchmarkLights) {
+      light = createRandomPointLight(boundsMin, boundsMax);
+    }
+    lightBenchmark.frame = 0;
+    lightBenchmark.frameTimeSum = 0.0;
+    lightBenchmark.uploadedLights = 0;
+    resetSteadyState();
+  }
+
+  void updateLightBenchmark() {
+    if (!lightBenchmark.running) return;
+
+    lightBenchmark.frame++;
+    if (lightBenchmark.frame > lightBenchmarkWarmupFrames) {
+      lightBenchmark.frameTimeSum += frameTimer * 1000.0;
+      lightBenchmark.uploadedLights += lightBuffer.getStats().uploaded;
+    }
+    if (lightBenchmark.frame < lightBenchmarkWarmupFrames + lightBenchmarkFrames)
+      return;
+
+    std::cout << "  " << lightBuffer.size() << " lights: "
+              << lightBenchmark.frameTimeSum / lightBenchmarkFrames
+              << " ms/frame, "
+              << (double)lightBenchmark.uploadedLights / lightBenchmarkFrames
+              << " lights uploaded/frame" << std::endl;
+
+    lightBenchmark.step++;
+    if (lightBenchmark.step == std::size(lightBenchmarkCounts)) {
+      lightBenchmark.running = false;
+      benchmarkLights.clear();
+      resetSteadyState();
+      return;
+    }
+    setBenchmarkLightCount(lightBenchmarkCounts[lightBenchmark.step]);
+  }
+
   void updatePostProcessingParams() {
     auto perspective = glm::inverse(camera.matrices.perspective);
     postProcessingParams.inverseViewMat = glm::inverse(camera.matrices.view);
@@ -3942,6 +5271,7 @@ class ForwardRenderer : public BaseRenderer {
                   glm::tan(glm::radians(60.0) * 0.5));
     postProcessingParams.fovScale *= 2;
     postProcessingParams.aaType = uiSettings.aaMode;
+    postProcessingParams.aoType = uiSettings.aoMode;
     memcpy(staticUniformBuffers.postProcessing.mapped, &postProcessingParams,
            sizeof(PostProcessingParams));
   }
@@ -3997,11 +5327,13 @@ class ForwardRenderer : public BaseRenderer {
     dynamicModels[index].transform.updateRotation(
         glm::vec3(0.0f, -90.0f, 0.0f));
     createMaterialBuffer();
+    // Every model starts out as a static shadow caster again
+    shadowCache.resetCasters();
     lights.clear();
     auto mainLight = vks::light::Light();
     mainLight.createDirectionalLight(
         glm::vec4(1.0f, 1.0f, 1.0f, 2.8f), glm::vec3(0.4f, 0.7f, 0.0f),
-        glm::vec3(0.0f), 90.0f, 1.0f, 16.0f, 128.0f);
+        glm::vec3(0.0f));
     lights.push_back(mainLight);
     auto spotLight = vks::light::Light();
     spotLight.createSpotLight(
@@ -4011,7 +5343,9 @@ class ForwardRenderer : public BaseRenderer {
 
     if (!firstTime) {
       setupDescriptors(true);
+      resolveMaterialPipelines();
     }
+    resetSteadyState();
     // Check and list unsupported extensions
     for (auto& ext : dynamicModels[index].extensions) {
       if (std::find(supportedExtensions.begin(), supportedExtensions.end(),
@@ -4059,59 +5393,90 @@ class ForwardRenderer : public BaseRenderer {
   }
 
   void preparePasses() {
+    renderTargetExtent = getRenderTargetExtent();
+    renderExtent = renderTargetExtent;
     // PREPASSES
     renderTargets.depthPrepass = vks::rendering::createDepthRenderTarget(
         vulkanDevice, VK_FORMAT_D32_SFLOAT, VK_FILTER_LINEAR,
-        swapChain.imageCount, getWidth(), getHeight(),
-        "shaders/depthPass.vert.spv");
-    renderTargets.shadowPasses.push_back(
-        vks::rendering::createDepthRenderTarget(
-            vulkanDevice, VK_FORMAT_D16_UNORM,
-            vks::tools::formatIsFilterable(physicalDevice, VK_FORMAT_D16_UNORM,
-                                           VK_IMAGE_TILING_OPTIMAL)
-                ? VK_FILTER_LINEAR
-                : VK_FILTER_NEAREST,
-            swapChain.imageCount, shadowMapSize, shadowMapSize,
-            "shaders/shadow.vert.spv"));
-
-    renderTargets.aoPass = vks::rendering::createColorDepthRenderTarget(
-        vulkanDevice, swapChain.colorFormat, depthFormat, swapChain.imageCount,
-        getWidth(), getHeight(), "shaders/ambientOcclusion.vert.spv",
-        "shaders/ambientOcclusion.frag.spv");
-
-    // Random Image
-    {
-      float noiseTextureData[192];
-      float zero = 0.0f;
-      float min = -1.0f;
-      float max = 1.0f;
-      for (int i = 0; i < 64; i++) {
-        int index = i * 3;
-        noiseTextureData[index] = math::random::randomRange(min, max);
-        noiseTextureData[index + 1] = math::random::randomRange(min, max);
-        noiseTextureData[index + 2] = math::random::randomRange(min, max);
-      }
-      vks::rendering::createImageFromBuffer(
-          renderTargets.aoPass, (void**)noiseTextureData,
-          sizeof(noiseTextureData), 8, 8, swapChain.colorFormat, graphicsQueue);
+        maxFramesInFlight, renderTargetExtent.width, renderTargetExtent.height,
+        "shaders/depthPass.vert.spv", vks::TAAPass::VELOCITY_FORMAT,
+        "shaders/depthPass.frag.spv");
+    renderTargets.depthPyramid.create(
+        vulkanDevice, maxFramesInFlight,
+        loadShader("shaders/depthPyramid.comp.spv",
+                   VK_SHADER_STAGE_COMPUTE_BIT),
+        renderTargetExtent);
+    // One target per cascade, all share the pipeline of the first
+    for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+      renderTargets.shadowPasses.push_back(
+          vks::rendering::createDepthRenderTarget(
+              vulkanDevice, VK_FORMAT_D16_UNORM,
+              vks::tools::formatIsFilterable(physicalDevice,
+                                             VK_FORMAT_D16_UNORM,
+                                             VK_IMAGE_TILING_OPTIMAL)
+                  ? VK_FILTER_LINEAR
+                  : VK_FILTER_NEAREST,
+              maxFramesInFlight, shadowMapSize, shadowMapSize,
+              "shaders/shadow.vert.spv"));
     }
-
-    // RENDERING
-    renderTargets.mainPass = vks::rendering::createColorDepthRenderTarget(
-        vulkanDevice, swapChain.colorFormat, depthFormat, swapChain.imageCount,
-        getWidth(), getHeight(), "", "");
+    shadowCache.create(vulkanDevice, VK_FORMAT_D16_UNORM, shadowMapSize,
+                       SHADOW_CASCADE_COUNT, maxFramesInFlight);
+    shadowAtlas.create(vulkanDevice, VK_FORMAT_D16_UNORM,
+                       vks::tools::formatIsFilterable(physicalDevice,
+                                                      VK_FORMAT_D16_UNORM,
+                                                      VK_IMAGE_TILING_OPTIMAL)
+                           ? VK_FILTER_LINEAR
+                           : VK_FILTER_NEAREST);
+
+    ssaoPass.create(vulkanDevice, maxFramesInFlight,
+                    loadShader("shaders/ambientOcclusionDownsample.comp.spv",
+                               VK_SHADER_STAGE_COMPUTE_BIT),
+                    loadShader("shaders/ambientOcclusion.comp.spv",
+                               VK_SHADER_STAGE_COMPUTE_BIT),
+                    loadShader("shaders/ambientOcclusionHorizon.comp.spv",
+                               VK_SHADER_STAGE_COMPUTE_BIT),
+                    loadShader("shaders/ambientOcclusionBlur.comp.spv",
+                               VK_SHADER_STAGE_COMPUTE_BIT),
+                    loadShader("shaders/ambientOcclusionResolve.comp.spv",
+                               VK_SHADER_STAGE_COMPUTE_BIT));
+    taaPass.create(vulkanDevice, maxFramesInFlight,
+                   loadShader("shaders/temporalAA.comp.spv",
+                              VK_SHADER_STAGE_COMPUTE_BIT));
+    dynamicResolution.create(vulkanDevice, maxFramesInFlight,
+                             vulkanDevice->queueFamilyIndices.graphics);
+    bloomPass.create(vulkanDevice, maxFramesInFlight,
+                     loadShader("shaders/bloomDownsample.comp.spv",
+                                VK_SHADER_STAGE_COMPUTE_BIT),
+                     loadShader("shaders/bloomUpsample.comp.spv",
+                                VK_SHADER_STAGE_COMPUTE_BIT),
+                     {getWidth(), getHeight()});
+    autoExposure.create(vulkanDevice, maxFramesInFlight,
+                        loadShader("shaders/luminanceHistogram.comp.spv",
+                                   VK_SHADER_STAGE_COMPUTE_BIT),
+                        loadShader("shaders/luminanceAverage.comp.spv",
+                                   VK_SHADER_STAGE_COMPUTE_BIT));
+    postProcessPass.create(vulkanDevice, maxFramesInFlight,
+                           loadShader("shaders/postProcess.comp.spv",
+                                      VK_SHADER_STAGE_COMPUTE_BIT));
+    renderGraph.create(vulkanDevice, maxFramesInFlight);
 
     // POSTPROCESSING
-
-    renderTargets.aaPass = vks::rendering::createColorDepthRenderTarget(
-        vulkanDevice, swapChain.colorFormat, depthFormat, swapChain.imageCount,
-        getWidth(), getHeight(), "shaders/postProcessing.vert.spv",
-        "shaders/antiAliasing.frag.spv");
-
-    renderTargets.tonemapping = vks::rendering::createColorDepthRenderTarget(
-        vulkanDevice, swapChain.colorFormat, depthFormat, swapChain.imageCount,
-        getWidth(), getHeight(), "shaders/postProcessing.vert.spv",
-        "shaders/tonemapping.frag.spv");
+    // The scene color attachment comes from the render graph, see
+    // updateGraphFramebuffers()
+
+    // The scene is drawn here and continues on the depth of the prepass,
+    // anti aliasing and tonemapping are done by postProcessPass
+    renderTargets.scene = vks::rendering::createColorDepthRenderTarget(
+        vulkanDevice, swapChain.colorFormat, depthFormat, 0,
+        renderTargetExtent.width, renderTargetExtent.height, "", "",
+        renderTargets.depthPrepass);
+
+    // Only the pipeline and screen texture sets are used, the copy is drawn
+    // in the swapchain render pass
+    renderTargets.present = vks::rendering::createColorRenderTarget(
+        vulkanDevice, swapChain.colorFormat, 0, getWidth(), getHeight(),
+        "shaders/postProcessing.vert.spv", "shaders/present.frag.spv");
+    graphFramebuffers.resize(maxFramesInFlight);
   }
 
   void prepare() override {
@@ -4134,6 +5499,7 @@ class ForwardRenderer : public BaseRenderer {
   }
 
   void draw() {
+    updateRenderTargetExtent();
     BaseRenderer::prepareFrame();
     buildCommandBuffer();
     BaseRenderer::submitFrame();
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+namespace vks {
+// Planes of a view frustum extracted from a view projection matrix (zero to
+// one depth). The planes are not normalized, only the sign of a distance is
+// ever used
+class Frustum {
+ public:
+  enum Side { LEFT = 0, RIGHT, BOTTOM, TOP, NEAR_PLANE, FAR_PLANE };
+
+  void update(const glm::mat4& viewProjection) {
+    const glm::mat4 m = glm::transpose(viewProjection);
+    planes[LEFT] = m[3] + m[0];
+    planes[RIGHT] = m[3] - m[0];
+    planes[BOTTOM] = m[3] + m[1];
+    planes[TOP] = m[3] - m[1];
+    planes[NEAR_PLANE] = m[2];
+    planes[FAR_PLANE] = m[3] - m[2];
+  }
+
+  // Conservative box test, only the corner furthest along each plane normal
+  // is checked
+  bool intersects(const glm::vec3& boundsMin,
+                  const glm::vec3& boundsMax) const {
+    return intersectsPlanes(boundsMin, boundsMax, false);
+  }
+
+  // Same test against the frustum extruded toward its origin (the near plane
+  // is dropped), so shadow casters between a light and its frustum pass
+  bool intersectsExtruded(const glm::vec3& boundsMin,
+                          const glm::vec3& boundsMax) const {
+    return intersectsPlanes(boundsMin, boundsMax, true);
+  }
+
+ private:
+  std::array<glm::vec4, 6> planes{};
+
+  bool intersectsPlanes(const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+                        bool skipNear) const {
+    for (uint32_t i = 0; i < planes.size(); i++) {
+      if (skipNear && i == NEAR_PLANE) continue;
+      const glm::vec4& plane = planes[i];
+      const glm::vec3 corner(plane.x > 0.0f ? boundsMax.x : boundsMin.x,
+                             plane.y > 0.0f ? boundsMax.y : boundsMin.y,
+                             plane.z > 0.0f ? boundsMax.z : boundsMin.z);
+      if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+}  // namespace vks
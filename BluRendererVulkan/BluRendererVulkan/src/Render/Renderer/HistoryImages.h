@@ -0,0 +1,148 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+
+#include "../ResourceManagement/VulkanResources/VulkanDevice.h"
+#include "../ResourceManagement/VulkanResources/VulkanInitializers.hpp"
+#include "../ResourceManagement/VulkanResources/VulkanTools.h"
+
+namespace vks {
+// The two images of a temporal pass, one written this frame and the one
+// written the frame before, which swap every frame. They are kept outside of
+// the render graph and imported into it every frame. Also tracks whether the
+// image of the last frame holds a history the pass can read
+class HistoryImages {
+ public:
+  void create(vks::VulkanDevice* vulkanDevice, VkFormat imageFormat) {
+    device = vulkanDevice;
+    format = imageFormat;
+    createSampler();
+  }
+
+  void destroy() {
+    destroyImages();
+    vkDestroySampler(device->logicalDevice, sampler, nullptr);
+  }
+
+  // Called once per frame that uses the history, before the images are
+  // handed to the graph. queue is the queue of the passes using them. The
+  // history is started over when the extent or the queue changed
+  void prepare(VkExtent2D imageExtent, VkQueue passQueue) {
+    const bool resized = imageExtent.width != extent.width ||
+                         imageExtent.height != extent.height;
+    if (resized || passQueue != queue) {
+      // Frames in flight may still use the images on the old queue
+      if (queue != VK_NULL_HANDLE) {
+        VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+      }
+      if (resized) {
+        destroyImages();
+        createImages(imageExtent);
+      }
+      queue = passQueue;
+      valid = false;
+    }
+    current ^= 1;
+  }
+
+  // Drops the history, e.g. when a frame skipped the pass
+  void invalidate() { valid = false; }
+  // Called by the pass once it recorded the write of this frame's image
+  void markWritten() { valid = true; }
+  bool isValid() const { return valid; }
+  // The image written this frame or the one of the last frame
+  VkImage getImage(bool previous) const {
+    return images[current ^ previous].image;
+  }
+  VkImageView getView(bool previous) const {
+    return images[current ^ previous].view;
+  }
+  // Of both images, a pass may use a part of them
+  VkExtent2D getExtent() const { return extent; }
+  // Bilinear, the history is read between pixels
+  VkSampler getSampler() const { return sampler; }
+
+ private:
+  struct Image {
+    VkImage image{VK_NULL_HANDLE};
+    VkImageView view{VK_NULL_HANDLE};
+    VkDeviceMemory memory{VK_NULL_HANDLE};
+  };
+
+  vks::VulkanDevice* device{nullptr};
+  VkFormat format{VK_FORMAT_UNDEFINED};
+  VkSampler sampler{VK_NULL_HANDLE};
+  std::array<Image, 2> images{};
+  VkExtent2D extent{};
+  VkQueue queue{VK_NULL_HANDLE};
+  uint32_t current = 0;
+  bool valid = false;
+
+  void createSampler() {
+    VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+    samplerCI.magFilter = VK_FILTER_LINEAR;
+    samplerCI.minFilter = VK_FILTER_LINEAR;
+    samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.maxAnisotropy = 1.0f;
+    samplerCI.minLod = 0.0f;
+    samplerCI.maxLod = 1.0f;
+    samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    VK_CHECK_RESULT(
+        vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &sampler));
+  }
+
+  void createImages(VkExtent2D imageExtent) {
+    VkDevice logicalDevice = device->logicalDevice;
+    for (Image& image : images) {
+      VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+      imageCI.imageType = VK_IMAGE_TYPE_2D;
+      imageCI.format = format;
+      imageCI.extent = {imageExtent.width, imageExtent.height, 1};
+      imageCI.mipLevels = 1;
+      imageCI.arrayLayers = 1;
+      imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+      imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+      imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+      VK_CHECK_RESULT(
+          vkCreateImage(logicalDevice, &imageCI, nullptr, &image.image));
+
+      VkMemoryRequirements memReqs;
+      vkGetImageMemoryRequirements(logicalDevice, image.image, &memReqs);
+      VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+      memAlloc.allocationSize = memReqs.size;
+      memAlloc.memoryTypeIndex = device->getMemoryType(
+          memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+      VK_CHECK_RESULT(
+          vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &image.memory));
+      VK_CHECK_RESULT(
+          vkBindImageMemory(logicalDevice, image.image, image.memory, 0));
+
+      VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+      viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      viewCI.format = format;
+      viewCI.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+      viewCI.image = image.image;
+      VK_CHECK_RESULT(
+          vkCreateImageView(logicalDevice, &viewCI, nullptr, &image.view));
+    }
+    extent = imageExtent;
+  }
+
+  void destroyImages() {
+    VkDevice logicalDevice = device->logicalDevice;
+    for (Image& image : images) {
+      vkDestroyImageView(logicalDevice, image.view, nullptr);
+      vkDestroyImage(logicalDevice, image.image, nullptr);
+      vkFreeMemory(logicalDevice, image.memory, nullptr);
+      image = Image();
+    }
+    extent = {};
+  }
+};
+}  // namespace vks
@@ -1,22 +1,35 @@
 #pragma once
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <glm/ext/matrix_clip_space.hpp>
 #include <glm/ext/matrix_float4x4.hpp>
 #include <glm/ext/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/trigonometric.hpp>
 
 namespace vks {
 namespace light {
 const char* debugLightType[3] = {"Directional", "Area", "Spot"};
 
-//TODO: Compress light falloff into single float
+// Packed light as stored in the light buffer, matches LightSource in
+// lights.glsl. The light type is implied by the packing:
+// color     - XYZ radiance with the constant falloff folded in, W linear and
+//             quadratic falloff packed as two halfs
+// position  - XYZ position, W culling range, negative for directional lights
+// direction - XYZ direction, W spot cutoff, NO_SPOT_CUTOFF for point lights
 struct GPULightInfo {
   glm::vec4 color;
   glm::vec4 position;
-  glm::vec4 rotation;
-  glm::vec4 lightFalloff;
+  glm::vec4 direction;
 };
 
+const float NO_SPOT_CUTOFF = -1.0f;
+// Smallest constant falloff term packFalloff() divides by, 0 would write inf
+// into the light buffer
+const float MIN_FALLOFF_CONSTANT = 0.01f;
+
 struct Light {
   glm::vec4 color;  // XYZ - RGB, W - Intensity
   glm::vec3 position;
@@ -28,58 +41,103 @@ struct Light {
   float lightLinear;
   float lightQuadratic;
 
-  float aspect;
-  float zNear;
-  float zFar;
-
-  glm::mat4 depthProjectionMatrix;
-  glm::mat4 depthViewMatrix;
-  glm::mat4 lightSpace;
-
   GPULightInfo lightInfo;
 
   void updateLight() {
     lightInfo = GPULightInfo();
-    lightInfo.color = glm::vec4(glm::vec3(color) * color.w, lightType);
+    lightInfo.color = glm::vec4(glm::vec3(color) * color.w, 0.0f);
 
-    // Directional Light
+    // Directional Light, shadowed by ShadowCascades
     if (lightType == 0) {
-      depthProjectionMatrix =
-          glm::perspective(glm::radians(lightFOV), aspect, zNear, zFar);
-      depthViewMatrix = glm::lookAt(glm::vec3(rotation * -100.0f), position,
-                                    glm::vec3(0, 1, 0));
-
-      lightSpace = depthProjectionMatrix * depthViewMatrix;
-      // Light info for packed for GPU
-      lightInfo.rotation = glm::vec4(rotation, 0.0f);
+      lightInfo.position = glm::vec4(position, -1.0f);
+      lightInfo.direction = glm::vec4(rotation, 0.0f);
     }
     // Point Light
     else if (lightType == 1) {
-      lightInfo.position = glm::vec4(position, 0.0f);
-      lightInfo.lightFalloff =
-          glm::vec4(lightConst, lightLinear, lightQuadratic, 0.0f);
+      packFalloff();
+      lightInfo.position = glm::vec4(position, getRange());
+      lightInfo.direction = glm::vec4(0.0f, 0.0f, 0.0f, NO_SPOT_CUTOFF);
     }
     // Spot Light
     else if (lightType == 2) {
-      lightInfo.position = glm::vec4(position, 1 - lightFOV / 180.0f);
-      lightInfo.rotation = glm::vec4(rotation, 0.0f);
-      lightInfo.lightFalloff =
-          glm::vec4(lightConst, lightLinear, lightQuadratic, 0.0f);
+      packFalloff();
+      lightInfo.position = glm::vec4(position, getRange());
+      lightInfo.direction = glm::vec4(rotation, 1 - lightFOV / 180.0f);
     }
   }
 
-  // Directional Light: TODO, figure out shadows
-  void createDirectionalLight(glm::vec4 col, glm::vec3 dir,
-                              glm::vec3 target, float fov,
-                              float aspect, float zNear, float zFar) {
+  // Divides the falloff by its constant term so only the linear and quadratic
+  // terms remain, both fit into a single float as halfs
+  void packFalloff() {
+    const float constant = std::max(lightConst, MIN_FALLOFF_CONSTANT);
+    lightInfo.color /= constant;
+    lightInfo.color.w = glm::uintBitsToFloat(glm::packHalf2x16(
+        glm::vec2(lightLinear, lightQuadratic) / constant));
+  }
+
+  // Distance at which the attenuated light drops below the cutoff, lights are
+  // treated as spheres of this radius when culled
+  float getRange(float cutoff = 1.0f / 256.0f) const {
+    const float intensity = std::max({color.r, color.g, color.b}) * color.w;
+    // Solve intensity / (c + l * d + q * d^2) = cutoff for d
+    const float c = lightConst - intensity / cutoff;
+    if (lightQuadratic > 0.0f) {
+      const float discriminant =
+          lightLinear * lightLinear - 4.0f * lightQuadratic * c;
+      return (-lightLinear + std::sqrt(std::max(discriminant, 0.0f))) /
+             (2.0f * lightQuadratic);
+    }
+    if (lightLinear > 0.0f) {
+      return std::max(-c / lightLinear, 0.0f);
+    }
+    // No falloff, the light reaches everything
+    return FLT_MAX;
+  }
+
+  // Shadow view projections of a point light (cube faces +X, -X, +Y, -Y, +Z,
+  // -Z) or a spot light (one, along the light direction). Shadows end at the
+  // light's range or maxDistance. Returns the number of matrices written
+  uint32_t getShadowViewProjections(glm::mat4* viewProjections,
+                                    float maxDistance) const {
+    const float zFar = std::min(getRange(), maxDistance);
+    const float zNear = std::min(0.05f, zFar * 0.5f);
+    if (lightType == 1) {
+      const glm::vec3 directions[6] = {{1, 0, 0},  {-1, 0, 0}, {0, 1, 0},
+                                       {0, -1, 0}, {0, 0, 1},  {0, 0, -1}};
+      const glm::vec3 ups[6] = {{0, -1, 0}, {0, -1, 0}, {0, 0, 1},
+                                {0, 0, -1}, {0, -1, 0}, {0, -1, 0}};
+      const glm::mat4 projection =
+          glm::perspectiveZO(glm::radians(90.0f), 1.0f, zNear, zFar);
+      for (uint32_t face = 0; face < 6; face++) {
+        viewProjections[face] =
+            projection *
+            glm::lookAt(position, position + directions[face], ups[face]);
+      }
+      return 6;
+    }
+    if (lightType == 2) {
+      // The spot cutoff is the cosine of the cone's half angle
+      const float cutoff = std::clamp(1.0f - lightFOV / 180.0f, -1.0f, 1.0f);
+      const float fov =
+          std::min(2.0f * std::acos(cutoff) + glm::radians(2.0f),
+                   glm::radians(170.0f));
+      const glm::vec3 direction = glm::normalize(rotation);
+      const glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0, 0, 1)
+                                                         : glm::vec3(0, 1, 0);
+      viewProjections[0] =
+          glm::perspectiveZO(fov, 1.0f, zNear, zFar) *
+          glm::lookAt(position, position + direction, up);
+      return 1;
+    }
+    return 0;
+  }
+
+  // Directional Light
+  void createDirectionalLight(glm::vec4 col, glm::vec3 dir, glm::vec3 target) {
     lightType = 0;
     color = col;
     rotation = dir;
     position = target;
-    lightFOV = fov;
-    this->aspect = aspect;
-    this->zNear = zNear;
-    this->zFar = zFar;
     updateLight();
   }
 
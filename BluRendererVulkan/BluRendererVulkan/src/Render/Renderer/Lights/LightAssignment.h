@@ -0,0 +1,250 @@
+#pragma once
+
+#include <xmmintrin.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Light.h"
+
+namespace vks {
+namespace light {
+// Lights assigned to a single draw, indices into the light buffer packed as
+// two 16 bit values per uint. Matches the push constants of pbr.frag
+struct DrawLightList {
+  static constexpr uint32_t MAX_LIGHTS = 8;
+
+  uint32_t count = 0;
+  uint32_t indices[MAX_LIGHTS / 2]{};
+};
+
+// Assigns point and spot lights to draws on the CPU as a cheaper alternative
+// to clustered culling. The local lights are kept as structure of arrays so
+// one SSE test covers four lights against the bounds of a draw. Draws touched
+// by more lights than fit into a list keep the closest ones relative to the
+// light range
+class LightAssigner {
+ public:
+  struct Stats {
+    uint32_t draws = 0;
+    uint32_t assigned = 0;
+    // Draws that had to drop lights
+    uint32_t saturated = 0;
+  };
+
+  void clearLights() {
+    count = 0;
+    for (auto* lane : lanes()) lane->clear();
+    lightIndices.clear();
+  }
+
+  // Lists are rebuilt with the render queue every frame
+  void clearLists() {
+    lists.clear();
+    stats = Stats();
+  }
+
+  // Adds a point or spot light, directional lights are shaded for every draw
+  // and are skipped
+  void addLight(uint32_t lightIndex, const GPULightInfo& light) {
+    const float range = light.position.w;
+    // The packed indices are 16 bit
+    if (range < 0.0f || lightIndex > 0xFFFF) return;
+
+    // Point lights become cones that never cull, the zero direction keeps
+    // them from being rejected by the front and back tests
+    glm::vec3 direction(0.0f);
+    float cosAngle = -1.0f;
+    float sinAngle = 0.0f;
+    if (light.direction.w != NO_SPOT_CUTOFF) {
+      direction = glm::normalize(glm::vec3(light.direction));
+      cosAngle = std::clamp(light.direction.w, -1.0f, 1.0f);
+      sinAngle = std::sqrt(1.0f - cosAngle * cosAngle);
+    }
+
+    // Ranges of lights without falloff are clamped so the scoring stays finite
+    const float clampedRange = std::min(range, 1e18f);
+
+    // Padding lanes of the last batch are overwritten
+    if (count == posX.size()) {
+      for (auto* lane : lanes()) lane->resize(count + 4);
+      // Far away and without range, padding lanes never pass the sphere test
+      for (uint32_t i = count; i < count + 4; i++) {
+        posX[i] = posY[i] = posZ[i] = FLT_MAX;
+        ranges[i] = 0.0f;
+        invRangesSq[i] = 0.0f;
+        dirX[i] = dirY[i] = dirZ[i] = 0.0f;
+        cosAngles[i] = -1.0f;
+        sinAngles[i] = 0.0f;
+      }
+    }
+    posX[count] = light.position.x;
+    posY[count] = light.position.y;
+    posZ[count] = light.position.z;
+    ranges[count] = clampedRange;
+    invRangesSq[count] =
+        clampedRange > 0.0f ? 1.0f / (clampedRange * clampedRange) : 0.0f;
+    dirX[count] = direction.x;
+    dirY[count] = direction.y;
+    dirZ[count] = direction.z;
+    cosAngles[count] = cosAngle;
+    sinAngles[count] = sinAngle;
+    lightIndices.push_back(lightIndex);
+    count++;
+  }
+
+  uint32_t lightCount() const { return count; }
+
+  // Tests the world space bounds of a draw against every local light and
+  // stores the resulting list, returns its index for getList()
+  uint32_t assign(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    const uint32_t listIndex = static_cast<uint32_t>(lists.size());
+    DrawLightList& list = lists.emplace_back();
+    stats.draws++;
+    if (count == 0) return listIndex;
+
+    // Candidates sorted by score, lower is closer relative to the light range
+    uint32_t candidates[DrawLightList::MAX_LIGHTS];
+    float scores[DrawLightList::MAX_LIGHTS];
+    uint32_t candidateCount = 0;
+    bool saturated = false;
+
+    const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    const float radius = glm::length(boundsMax - boundsMin) * 0.5f;
+
+    const __m128 minX = _mm_set1_ps(boundsMin.x);
+    const __m128 minY = _mm_set1_ps(boundsMin.y);
+    const __m128 minZ = _mm_set1_ps(boundsMin.z);
+    const __m128 maxX = _mm_set1_ps(boundsMax.x);
+    const __m128 maxY = _mm_set1_ps(boundsMax.y);
+    const __m128 maxZ = _mm_set1_ps(boundsMax.z);
+    const __m128 centerX = _mm_set1_ps(center.x);
+    const __m128 centerY = _mm_set1_ps(center.y);
+    const __m128 centerZ = _mm_set1_ps(center.z);
+    const __m128 sphereRadius = _mm_set1_ps(radius);
+    const __m128 negSphereRadius = _mm_set1_ps(-radius);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (uint32_t i = 0; i < count; i += 4) {
+      const __m128 px = _mm_loadu_ps(&posX[i]);
+      const __m128 py = _mm_loadu_ps(&posY[i]);
+      const __m128 pz = _mm_loadu_ps(&posZ[i]);
+      const __m128 range = _mm_loadu_ps(&ranges[i]);
+
+      // Squared distance from the light to the closest point of the box
+      const __m128 dx = _mm_sub_ps(px, _mm_min_ps(_mm_max_ps(px, minX), maxX));
+      const __m128 dy = _mm_sub_ps(py, _mm_min_ps(_mm_max_ps(py, minY), maxY));
+      const __m128 dz = _mm_sub_ps(pz, _mm_min_ps(_mm_max_ps(pz, minZ), maxZ));
+      const __m128 boxDistSq = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+          _mm_mul_ps(dz, dz));
+      const __m128 inRange = _mm_cmple_ps(boxDistSq, _mm_mul_ps(range, range));
+      if (_mm_movemask_ps(inRange) == 0) continue;
+
+      // Cone against the bounding sphere of the box
+      const __m128 vx = _mm_sub_ps(centerX, px);
+      const __m128 vy = _mm_sub_ps(centerY, py);
+      const __m128 vz = _mm_sub_ps(centerZ, pz);
+      const __m128 lengthSq = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)),
+          _mm_mul_ps(vz, vz));
+      const __m128 axisLength = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(vx, _mm_loadu_ps(&dirX[i])),
+                     _mm_mul_ps(vy, _mm_loadu_ps(&dirY[i]))),
+          _mm_mul_ps(vz, _mm_loadu_ps(&dirZ[i])));
+      const __m128 sideLength = _mm_sqrt_ps(_mm_max_ps(
+          _mm_sub_ps(lengthSq, _mm_mul_ps(axisLength, axisLength)), zero));
+      const __m128 closestDistance =
+          _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&cosAngles[i]), sideLength),
+                     _mm_mul_ps(axisLength, _mm_loadu_ps(&sinAngles[i])));
+      const __m128 culled = _mm_or_ps(
+          _mm_cmpgt_ps(closestDistance, sphereRadius),
+          _mm_or_ps(
+              _mm_cmpgt_ps(axisLength, _mm_add_ps(sphereRadius, range)),
+              _mm_cmplt_ps(axisLength, negSphereRadius)));
+
+      uint32_t mask = static_cast<uint32_t>(
+          _mm_movemask_ps(_mm_andnot_ps(culled, inRange)));
+      if (mask == 0) continue;
+
+      alignas(16) float laneScores[4];
+      _mm_store_ps(laneScores,
+                   _mm_mul_ps(lengthSq, _mm_loadu_ps(&invRangesSq[i])));
+      while (mask) {
+        const uint32_t lane = std::countr_zero(mask);
+        mask &= mask - 1;
+        saturated |= !insertCandidate(lightIndices[i + lane], laneScores[lane],
+                                      candidates, scores, candidateCount);
+      }
+    }
+
+    list.count = candidateCount;
+    for (uint32_t i = 0; i < candidateCount; i++) {
+      list.indices[i / 2] |= candidates[i] << ((i & 1) * 16);
+    }
+    stats.assigned += candidateCount;
+    stats.saturated += saturated ? 1 : 0;
+    return listIndex;
+  }
+
+  // List for draws without bounds, only directional lights are shaded
+  uint32_t assignEmpty() {
+    lists.emplace_back();
+    stats.draws++;
+    return static_cast<uint32_t>(lists.size() - 1);
+  }
+
+  const DrawLightList& getList(uint32_t listIndex) const {
+    return lists[listIndex];
+  }
+  const Stats& getStats() const { return stats; }
+
+ private:
+  // Structure of arrays, padded to a multiple of four lights
+  std::vector<float> posX, posY, posZ;
+  std::vector<float> ranges, invRangesSq;
+  std::vector<float> dirX, dirY, dirZ;
+  std::vector<float> cosAngles, sinAngles;
+  std::vector<uint32_t> lightIndices;
+  uint32_t count = 0;
+
+  // Lists of the current frame, indexed by the draws
+  std::vector<DrawLightList> lists;
+  Stats stats;
+
+  std::array<std::vector<float>*, 10> lanes() {
+    return {&posX, &posY, &posZ,      &ranges,   &invRangesSq,
+            &dirX, &dirY, &dirZ, &cosAngles, &sinAngles};
+  }
+
+  // Insertion into the sorted candidates, returns false if a light was dropped
+  static bool insertCandidate(uint32_t lightIndex, float score,
+                              uint32_t* candidates, float* scores,
+                              uint32_t& candidateCount) {
+    bool dropped = false;
+    uint32_t slot = candidateCount;
+    if (candidateCount == DrawLightList::MAX_LIGHTS) {
+      dropped = true;
+      if (score >= scores[candidateCount - 1]) return false;
+      slot--;
+    } else {
+      candidateCount++;
+    }
+    while (slot > 0 && scores[slot - 1] > score) {
+      candidates[slot] = candidates[slot - 1];
+      scores[slot] = scores[slot - 1];
+      slot--;
+    }
+    candidates[slot] = lightIndex;
+    scores[slot] = score;
+    return !dropped;
+  }
+};
+}  // namespace light
+}  // namespace vks
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "../../ResourceManagement/VulkanResources/VulkanDevice.h"
+#include "Light.h"
+
+namespace vks {
+namespace light {
+// Storage buffer holding the packed lights of the scene, one buffer per frame
+// in flight. A CPU copy of the packed lights is kept so set() can tell which
+// lights changed, upload() then only copies those into the frame's buffer.
+// The buffers grow to the next power of two when the light count exceeds them
+class LightBuffer {
+ public:
+  struct Stats {
+    uint32_t uploaded = 0;
+    uint32_t total = 0;
+  };
+
+  void create(vks::VulkanDevice* vulkanDevice, uint32_t frameCount,
+              uint32_t initialCapacity = 64) {
+    device = vulkanDevice;
+    buffers.resize(frameCount);
+    allFrames = (1u << frameCount) - 1;
+    capacity = initialCapacity;
+    allocate();
+  }
+
+  void destroy() {
+    for (auto& buffer : buffers) {
+      buffer.destroy();
+    }
+  }
+
+  void resize(uint32_t count) {
+    if (count == lights.size()) return;
+    lights.resize(count);
+    pendingFrames.resize(count, allFrames);
+    if (count > capacity) {
+      while (capacity < count) capacity *= 2;
+      reallocate = true;
+    }
+  }
+
+  void set(uint32_t index, const GPULightInfo& light) {
+    if (memcmp(&lights[index], &light, sizeof(GPULightInfo)) == 0) return;
+    lights[index] = light;
+    pendingFrames[index] = allFrames;
+  }
+
+  // Copies the lights this frame has not seen yet, contiguous runs are copied
+  // at once. Returns true if the buffers were reallocated, descriptors that
+  // reference them have to be rewritten
+  bool upload(uint32_t frameIndex) {
+    const bool reallocated = reallocate;
+    if (reallocate) {
+      // Other frames may still read the old buffers
+      vkDeviceWaitIdle(device->logicalDevice);
+      destroy();
+      allocate();
+      for (auto& pending : pendingFrames) pending = allFrames;
+      reallocate = false;
+    }
+
+    const uint32_t frameBit = 1u << frameIndex;
+    GPULightInfo* mapped =
+        static_cast<GPULightInfo*>(buffers[frameIndex].mapped);
+    stats.uploaded = 0;
+    stats.total = static_cast<uint32_t>(lights.size());
+    for (uint32_t i = 0; i < lights.size();) {
+      if (!(pendingFrames[i] & frameBit)) {
+        i++;
+        continue;
+      }
+      uint32_t runEnd = i;
+      while (runEnd < lights.size() && (pendingFrames[runEnd] & frameBit)) {
+        pendingFrames[runEnd] &= ~frameBit;
+        runEnd++;
+      }
+      memcpy(mapped + i, &lights[i], (runEnd - i) * sizeof(GPULightInfo));
+      stats.uploaded += runEnd - i;
+      i = runEnd;
+    }
+    return reallocated;
+  }
+
+  VkDescriptorBufferInfo* getDescriptor(uint32_t frameIndex) {
+    return &buffers[frameIndex].descriptor;
+  }
+  uint32_t size() const { return static_cast<uint32_t>(lights.size()); }
+  uint32_t getCapacity() const { return capacity; }
+  const Stats& getStats() const { return stats; }
+
+ private:
+  vks::VulkanDevice* device = nullptr;
+  std::vector<vks::Buffer> buffers;
+  std::vector<GPULightInfo> lights;
+  // One bit per frame whose buffer still holds an outdated copy of the light
+  std::vector<uint32_t> pendingFrames;
+  uint32_t allFrames = 0;
+  uint32_t capacity = 0;
+  bool reallocate = false;
+  Stats stats;
+
+  void allocate() {
+    for (auto& buffer : buffers) {
+      VK_CHECK_RESULT(device->createBuffer(
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+          &buffer, capacity * sizeof(GPULightInfo)));
+      buffer.map();
+    }
+  }
+};
+}  // namespace light
+}  // namespace vks
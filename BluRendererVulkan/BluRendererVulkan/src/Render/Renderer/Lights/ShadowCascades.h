@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/glm.hpp>
+
+namespace vks {
+namespace light {
+// Cascaded shadow maps of a directional light. The camera frustum is split
+// into slices, each slice gets an orthographic projection fitted around its
+// bounding sphere so the projection keeps its size when the camera turns. The
+// projection is then snapped to whole shadow map texels, which keeps shadow
+// edges from shimmering while the camera moves. Between updates a cascade only
+// moves by whole texels unless the light, the slice size or the scene changed
+class ShadowCascades {
+ public:
+  static constexpr uint32_t CASCADE_COUNT = 4;
+
+  // Shadows end at this view depth, a shorter distance gives tighter cascades
+  float maxDistance = 128.0f;
+  // Blend between uniform (0) and logarithmic (1) split distances
+  float splitLambda = 0.9f;
+
+  // lightDirection is the direction the light travels in. The scene bounds
+  // set the depth range so casters outside of a slice still shadow it
+  void update(const glm::mat4& view, const glm::mat4& projection, float zNear,
+              float zFar, const glm::vec3& lightDirection,
+              const glm::vec3& sceneMin, const glm::vec3& sceneMax,
+              uint32_t mapSize) {
+    const glm::vec3 direction = glm::normalize(lightDirection);
+    const glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0, 0, 1)
+                                                       : glm::vec3(0, 1, 0);
+
+    // Rays from the eye through the far plane corners, scaled so a point at
+    // view depth d is eye + ray * d
+    const glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+    const glm::vec3 eye = glm::vec3(glm::inverse(view)[3]);
+    const glm::vec2 ndcCorners[4] = {
+        {-1.0f, -1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}, {-1.0f, 1.0f}};
+    glm::vec3 rays[4];
+    for (uint32_t i = 0; i < 4; i++) {
+      const glm::vec4 corner =
+          inverseViewProjection * glm::vec4(ndcCorners[i], 1.0f, 1.0f);
+      rays[i] = (glm::vec3(corner) / corner.w - eye) / zFar;
+    }
+
+    // The light view has no translation, so the light space axes (and with
+    // them the texel grid) stay fixed in the world
+    const glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+    const bool validScene = sceneMin.x <= sceneMax.x;
+    float sceneDepthNear = FLT_MAX;
+    float sceneDepthFar = -FLT_MAX;
+    if (validScene) {
+      for (uint32_t i = 0; i < 8; i++) {
+        const glm::vec3 corner(i & 1 ? sceneMax.x : sceneMin.x,
+                               i & 2 ? sceneMax.y : sceneMin.y,
+                               i & 4 ? sceneMax.z : sceneMin.z);
+        const float depth = glm::dot(corner, direction);
+        sceneDepthNear = std::min(sceneDepthNear, depth);
+        sceneDepthFar = std::max(sceneDepthFar, depth);
+      }
+      // Keeps geometry on the bounds off the clip planes
+      sceneDepthNear -= 1.0f;
+      sceneDepthFar += 1.0f;
+    }
+    const float farDepth = std::min(maxDistance, zFar);
+    float splitNear = zNear;
+    for (uint32_t cascade = 0; cascade < CASCADE_COUNT; cascade++) {
+      const float p = (cascade + 1) / static_cast<float>(CASCADE_COUNT);
+      const float logSplit = zNear * std::pow(farDepth / zNear, p);
+      const float uniformSplit = zNear + (farDepth - zNear) * p;
+      const float splitFar =
+          splitLambda * (logSplit - uniformSplit) + uniformSplit;
+
+      glm::vec3 corners[8];
+      glm::vec3 center(0.0f);
+      for (uint32_t i = 0; i < 4; i++) {
+        corners[i] = eye + rays[i] * splitNear;
+        corners[i + 4] = eye + rays[i] * splitFar;
+        center += corners[i] + corners[i + 4];
+      }
+      center /= 8.0f;
+
+      float radius = 0.0f;
+      for (const glm::vec3& corner : corners) {
+        radius = std::max(radius, glm::length(corner - center));
+      }
+      // Quantized so small float changes do not resize the projection
+      radius = std::ceil(radius * 16.0f) / 16.0f;
+
+      // Light space position of the slice, snapped to whole shadow map
+      // texels so shadow edges do not shimmer while the camera moves
+      const glm::vec3 lightCenter =
+          glm::vec3(lightView * glm::vec4(center, 1.0f));
+      const float texelSize = 2.0f * radius / mapSize;
+      const glm::vec2 snappedCenter =
+          glm::floor(glm::vec2(lightCenter) / texelSize) * texelSize;
+
+      // Depth covers the whole scene along the light so every caster lands in
+      // the map and depth only depends on the world position, which lets the
+      // shadow cache scroll its contents
+      float depthNear = -lightCenter.z - radius;
+      float depthFar = -lightCenter.z + radius;
+      if (validScene) {
+        depthNear = sceneDepthNear;
+        depthFar = sceneDepthFar;
+      }
+
+      glm::mat4 lightProjection = glm::orthoZO(-radius, radius, -radius,
+                                               radius, depthNear, depthFar);
+      lightProjection[3][0] = -snappedCenter.x * lightProjection[0][0];
+      lightProjection[3][1] = -snappedCenter.y * lightProjection[1][1];
+
+      viewProjections[cascade] = lightProjection * lightView;
+      splitDepths[cascade] = splitFar;
+      splitNear = splitFar;
+    }
+  }
+
+  const glm::mat4& getViewProjection(uint32_t cascade) const {
+    return viewProjections[cascade];
+  }
+  // Far view depth of every cascade
+  glm::vec4 getSplitDepths() const {
+    return glm::vec4(splitDepths[0], splitDepths[1], splitDepths[2],
+                     splitDepths[3]);
+  }
+
+ private:
+  glm::mat4 viewProjections[CASCADE_COUNT]{};
+  float splitDepths[CASCADE_COUNT]{};
+
+  static_assert(CASCADE_COUNT == 4, "Split depths are packed into a vec4");
+};
+}  // namespace light
+}  // namespace vks
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "../ResourceManagement/VulkanResources/VulkanDevice.h"
+#include "../ResourceManagement/VulkanResources/VulkanInitializers.hpp"
+#include "../ResourceManagement/VulkanResources/VulkanTools.h"
+
+namespace vks {
+// Anti aliasing, bloom composite and tonemapping of the scene fused into one
+// compute pass. The images belong to the render graph, which also places the
+// barriers, the exposure buffer is ordered by AutoExposure
+class PostProcessPass {
+ public:
+  // Matches local_size of postProcess.comp
+  static constexpr uint32_t GROUP_SIZE = 16;
+  // RGBA8 is a required storage format, the swapchain may not be
+  static constexpr VkFormat FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+
+  // Matches the push constants of postProcess.comp
+  struct Params {
+    glm::vec2 invResolution;
+    // 0 off, 1 FXAA, 2 TAA which resolved the scene before the pass
+    uint32_t aaType;
+    // 0 leaves the bloom image unsampled
+    float bloomStrength;
+    // Exposes for the adapted luminance instead of a fixed exposure
+    uint32_t autoExposure;
+  };
+
+  void create(vks::VulkanDevice* vulkanDevice, uint32_t frameCount,
+              const VkPipelineShaderStageCreateInfo& shaderStage) {
+    device = vulkanDevice;
+    descriptorSets.resize(frameCount);
+    createSampler();
+    createPipeline(shaderStage);
+  }
+
+  void destroy() {
+    VkDevice logicalDevice = device->logicalDevice;
+    vkDestroySampler(logicalDevice, sampler, nullptr);
+    vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+    vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+  }
+
+  // Reads the scene in the shader read only layout and writes the output,
+  // expected in the general layout. The set of the frame is updated every
+  // time since the graph may have placed the images somewhere else
+  void record(VkCommandBuffer commandBuffer, uint32_t frame, VkImageView scene,
+              VkImageView output, const VkDescriptorImageInfo& bloom,
+              const VkDescriptorBufferInfo& exposure, const Params& params,
+              VkExtent2D extent) {
+    VkDescriptorSet descriptorSet = descriptorSets[frame];
+    VkDescriptorImageInfo sceneInfo{sampler, scene,
+                                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkDescriptorImageInfo outputInfo{VK_NULL_HANDLE, output,
+                                     VK_IMAGE_LAYOUT_GENERAL};
+    std::array<VkWriteDescriptorSet, 4> writes = {
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+            &sceneInfo),
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &outputInfo),
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2,
+            &bloom),
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &exposure)};
+    vkUpdateDescriptorSets(device->logicalDevice,
+                           static_cast<uint32_t>(writes.size()), writes.data(),
+                           0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, pipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Params),
+                       &params);
+    vkCmdDispatch(commandBuffer, (extent.width + GROUP_SIZE - 1) / GROUP_SIZE,
+                  (extent.height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+  }
+
+ private:
+  vks::VulkanDevice* device{nullptr};
+  std::vector<VkDescriptorSet> descriptorSets;
+
+  // Bilinear, the FXAA edge search samples between pixels
+  VkSampler sampler{VK_NULL_HANDLE};
+  VkDescriptorPool descriptorPool{VK_NULL_HANDLE};
+  VkDescriptorSetLayout descriptorSetLayout{VK_NULL_HANDLE};
+  VkPipelineLayout pipelineLayout{VK_NULL_HANDLE};
+  VkPipeline pipeline{VK_NULL_HANDLE};
+
+  void createSampler() {
+    VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+    samplerCI.magFilter = VK_FILTER_LINEAR;
+    samplerCI.minFilter = VK_FILTER_LINEAR;
+    samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.maxAnisotropy = 1.0f;
+    samplerCI.minLod = 0.0f;
+    samplerCI.maxLod = 1.0f;
+    samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    VK_CHECK_RESULT(
+        vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &sampler));
+  }
+
+  void createPipeline(const VkPipelineShaderStageCreateInfo& shaderStage) {
+    VkDevice logicalDevice = device->logicalDevice;
+    const uint32_t frameCount = static_cast<uint32_t>(descriptorSets.size());
+    std::vector<VkDescriptorPoolSize> poolSizes = {
+        vks::initializers::descriptorPoolSize(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * frameCount),
+        vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                              frameCount),
+        vks::initializers::descriptorPoolSize(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount)};
+    VkDescriptorPoolCreateInfo descriptorPoolCI =
+        vks::initializers::descriptorPoolCreateInfo(poolSizes, frameCount);
+    VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolCI,
+                                           nullptr, &descriptorPool));
+
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+        // Binding 0 : Scene color
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        // Binding 1 : Output
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        // Binding 2 : Bloom
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        // Binding 3 : Exposure
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT,
+            3)};
+    VkDescriptorSetLayoutCreateInfo descriptorLayoutCI =
+        vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
+        logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayout));
+
+    std::vector<VkDescriptorSetLayout> setLayouts(frameCount,
+                                                  descriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo =
+        vks::initializers::descriptorSetAllocateInfo(
+            descriptorPool, setLayouts.data(), frameCount);
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo,
+                                             descriptorSets.data()));
+
+    VkPushConstantRange pushConstantRange =
+        vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT,
+                                             sizeof(Params), 0);
+    VkPipelineLayoutCreateInfo pipelineLayoutCI =
+        vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+    pipelineLayoutCI.pushConstantRangeCount = 1;
+    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCI,
+                                           nullptr, &pipelineLayout));
+
+    VkComputePipelineCreateInfo pipelineCI =
+        vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+    pipelineCI.stage = shaderStage;
+    VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice,
+                                             device->pipelineCache, 1,
+                                             &pipelineCI, nullptr, &pipeline));
+  }
+};
+}  // namespace vks
@@ -0,0 +1,698 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "../ResourceManagement/VulkanResources/VulkanDevice.h"
+#include "../ResourceManagement/VulkanResources/VulkanInitializers.hpp"
+#include "../ResourceManagement/VulkanResources/VulkanTools.h"
+
+namespace vks {
+// Passes of a frame declare the images they read and write, the graph is
+// rebuilt every frame from that. compile() culls passes nobody consumes,
+// places transient images with disjoint lifetimes in the same memory and
+// derives the barriers execute() records around each pass. Passes are split
+// into batches, one command buffer each, and images that move to a batch of
+// another queue family change ownership. Buffers are not tracked, passes
+// synchronize those themselves
+class RenderGraph {
+ public:
+  using Handle = uint32_t;
+  static constexpr Handle INVALID_HANDLE = UINT32_MAX;
+
+  // How a pass touches an image. layout is the layout the pass expects,
+  // VK_IMAGE_LAYOUT_UNDEFINED when it discards the contents or transitions
+  // the image itself (render passes starting from an undefined layout).
+  // finalLayout is the layout the pass leaves the image in
+  struct Usage {
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    VkImageLayout layout;
+    VkImageLayout finalLayout;
+  };
+
+  static Usage sampled(
+      VkPipelineStageFlags stages,
+      VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+    return {stages, VK_ACCESS_SHADER_READ_BIT, layout, layout};
+  }
+  static Usage storageWrite(VkPipelineStageFlags stages) {
+    return {stages, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_LAYOUT_GENERAL};
+  }
+  // Cleared or discarded by a render pass
+  static Usage colorAttachment(VkImageLayout finalLayout) {
+    return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+            finalLayout};
+  }
+  static Usage depthAttachment(VkImageLayout finalLayout) {
+    return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, finalLayout};
+  }
+  // Depth tested against but not written
+  static Usage depthReadOnly() {
+    return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+  }
+
+  struct ImageDesc {
+    VkFormat format;
+    VkExtent2D extent;
+    VkImageUsageFlags usage;
+    VkImageAspectFlags aspect;
+
+    bool operator==(const ImageDesc& other) const {
+      return format == other.format && extent.width == other.extent.width &&
+             extent.height == other.extent.height && usage == other.usage &&
+             aspect == other.aspect;
+    }
+  };
+
+  struct Stats {
+    uint32_t passes = 0;
+    uint32_t culledPasses = 0;
+    uint32_t transientImages = 0;
+    uint32_t memoryBlocks = 0;
+    // Of a single frame in flight, requested is the sum of the image sizes
+    VkDeviceSize allocatedBytes = 0;
+    VkDeviceSize requestedBytes = 0;
+  };
+
+  class PassBuilder {
+   public:
+    void read(Handle image, const Usage& usage) { add(image, usage, false); }
+    void write(Handle image, const Usage& usage) { add(image, usage, true); }
+    // Never culled, for passes whose results the graph does not see
+    void sideEffects() { graph.passes[pass].sideEffects = true; }
+
+   private:
+    friend class RenderGraph;
+    PassBuilder(RenderGraph& graph, uint32_t pass) : graph(graph), pass(pass) {}
+
+    RenderGraph& graph;
+    uint32_t pass;
+
+    void add(Handle image, const Usage& usage, bool write) {
+      assert(image < graph.resources.size());
+      graph.accesses.push_back({image, usage, write});
+    }
+  };
+
+  void create(vks::VulkanDevice* vulkanDevice, uint32_t frameCount) {
+    device = vulkanDevice;
+    frames.resize(frameCount);
+  }
+
+  void destroy() {
+    for (FrameResources& frame : frames) {
+      destroyTransients(frame);
+    }
+  }
+
+  // Starts a new frame, handles and passes of the last one become invalid
+  void reset() {
+    resources.clear();
+    accesses.clear();
+    passes.clear();
+    batches.clear();
+    barriers.clear();
+    releases.clear();
+  }
+
+  // Batches are recorded into command buffers of their own and submitted in
+  // index order. A batch on another queue than an earlier one it depends on
+  // has to wait on it with a semaphore at waitStages
+  uint32_t addBatch(VkQueue queue, uint32_t queueFamily,
+                    VkPipelineStageFlags waitStages) {
+    batches.push_back({queue, queueFamily, waitStages});
+    return static_cast<uint32_t>(batches.size() - 1);
+  }
+
+  // layout is the layout the image is in when the frame starts
+  Handle importImage(VkImage image, VkImageAspectFlags aspect,
+                     VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED) {
+    Resource& resource = resources.emplace_back();
+    resource.image = image;
+    resource.aspect = aspect;
+    resource.initialLayout = layout;
+    return static_cast<Handle>(resources.size() - 1);
+  }
+
+  // Image kept across frames on one queue, e.g. a temporal history. The first
+  // access of the frame waits for stages and access of earlier frames
+  Handle importHistory(VkImage image, VkImageView view,
+                       VkImageAspectFlags aspect, VkImageLayout layout,
+                       VkPipelineStageFlags stages, VkAccessFlags access) {
+    Handle handle = importImage(image, aspect, layout);
+    Resource& resource = resources[handle];
+    resource.view = view;
+    resource.historyStages = stages;
+    resource.historyAccess = access;
+    return handle;
+  }
+
+  // Owned by the graph, contents do not survive the frame
+  Handle createImage(const ImageDesc& desc) {
+    Resource& resource = resources.emplace_back();
+    resource.aspect = desc.aspect;
+    resource.transient = true;
+    resource.desc = desc;
+    return static_cast<Handle>(resources.size() - 1);
+  }
+
+  // Keeps the passes writing image alive
+  void markOutput(Handle image) { resources[image].output = true; }
+
+  // setup(PassBuilder&) declares the images, execute(VkCommandBuffer) records
+  // the pass into the command buffer of its batch. Passes have to be added in
+  // the order they are submitted in
+  template <typename SetupFn, typename ExecuteFn>
+  uint32_t addPass(const char* name, uint32_t batch, SetupFn&& setup,
+                   ExecuteFn&& execute) {
+    assert(batch < batches.size());
+    assert(passes.empty() || passes.back().batch <= batch);
+    const uint32_t index = static_cast<uint32_t>(passes.size());
+    Pass& pass = passes.emplace_back();
+    pass.name = name;
+    pass.batch = batch;
+    pass.firstAccess = static_cast<uint32_t>(accesses.size());
+    pass.execute = std::forward<ExecuteFn>(execute);
+    PassBuilder builder(*this, index);
+    setup(builder);
+    passes[index].accessCount =
+        static_cast<uint32_t>(accesses.size()) - passes[index].firstAccess;
+    return index;
+  }
+
+  void compile(uint32_t frameIndex) {
+    cull();
+    allocateTransients(frames[frameIndex]);
+    buildBarriers();
+  }
+
+  // commandBuffers holds one recording command buffer per batch
+  void execute(const VkCommandBuffer* commandBuffers) {
+    for (uint32_t i = 0; i < passes.size(); i++) {
+      const Pass& pass = passes[i];
+      if (!pass.live) continue;
+      VkCommandBuffer commandBuffer = commandBuffers[pass.batch];
+      if (pass.barrierCount > 0) {
+        vkCmdPipelineBarrier(commandBuffer, pass.srcStages, pass.dstStages, 0,
+                             0, nullptr, 0, nullptr, pass.barrierCount,
+                             &barriers[pass.firstBarrier]);
+      }
+      pass.execute(commandBuffer);
+      for (const Release& release : releases) {
+        if (release.pass != i) continue;
+        vkCmdPipelineBarrier(commandBuffer, release.srcStages,
+                             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+                             nullptr, 0, nullptr, 1, &release.barrier);
+      }
+    }
+  }
+
+  bool isLive(uint32_t pass) const { return passes[pass].live; }
+  VkImage getImage(Handle image) const { return resources[image].image; }
+  // Transient and history images only
+  VkImageView getView(Handle image) const { return resources[image].view; }
+  const Stats& getStats() const { return stats; }
+  // Set by compile() when the transient images of the frame were created
+  // again, views and framebuffers built around them have to follow
+  bool transientsChanged() const { return transientsRecreated; }
+
+ private:
+  static constexpr uint32_t NONE = UINT32_MAX;
+  static constexpr VkAccessFlags WRITE_ACCESS =
+      VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+      VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT |
+      VK_ACCESS_MEMORY_WRITE_BIT;
+
+  struct Batch {
+    VkQueue queue;
+    uint32_t queueFamily;
+    VkPipelineStageFlags waitStages;
+  };
+
+  // Where an image stands while the barriers are derived
+  struct State {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags writeStages = 0;
+    VkAccessFlags writeAccess = 0;
+    // Reads since the last write
+    VkPipelineStageFlags readStages = 0;
+    // Scopes the last write was made visible to
+    VkPipelineStageFlags visibleStages = 0;
+    VkAccessFlags visibleAccess = 0;
+    uint32_t lastPass = NONE;
+  };
+
+  struct Resource {
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkImageAspectFlags aspect = 0;
+    VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    bool transient = false;
+    bool output = false;
+    // Access of earlier frames to a history image
+    VkPipelineStageFlags historyStages = 0;
+    VkAccessFlags historyAccess = 0;
+    ImageDesc desc{};
+    // Live passes using the image
+    uint32_t firstPass = NONE;
+    uint32_t lastPass = NONE;
+    bool multipleQueues = false;
+    // Transient image that used the memory before this one
+    Handle previousAlias = INVALID_HANDLE;
+    State state;
+  };
+
+  struct Access {
+    Handle image;
+    Usage usage;
+    bool write;
+  };
+
+  struct Pass {
+    const char* name = nullptr;
+    uint32_t batch = 0;
+    uint32_t firstAccess = 0;
+    uint32_t accessCount = 0;
+    bool sideEffects = false;
+    bool live = false;
+    std::function<void(VkCommandBuffer)> execute;
+    uint32_t firstBarrier = 0;
+    uint32_t barrierCount = 0;
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+  };
+
+  // Hands an image to another queue family after a pass
+  struct Release {
+    uint32_t pass;
+    VkPipelineStageFlags srcStages;
+    VkImageMemoryBarrier barrier;
+  };
+
+  // Transient images of one frame in flight, kept as long as the graph
+  // asks for the same images with the same lifetimes
+  struct TransientImage {
+    ImageDesc desc;
+    uint32_t firstPass;
+    uint32_t lastPass;
+    bool multipleQueues;
+    // Queue of the first pass, the only one when multipleQueues is not set
+    VkQueue queue;
+    VkImage image;
+    VkImageView view;
+    Handle previousAlias;
+  };
+  struct FrameResources {
+    std::vector<TransientImage> images;
+    std::vector<VkDeviceMemory> memory;
+  };
+
+  vks::VulkanDevice* device{nullptr};
+  std::vector<Resource> resources;
+  std::vector<Access> accesses;
+  std::vector<Pass> passes;
+  std::vector<Batch> batches;
+  std::vector<VkImageMemoryBarrier> barriers;
+  std::vector<Release> releases;
+  std::vector<uint8_t> needed;
+  std::vector<TransientImage> requested;
+  std::vector<Handle> transientHandles;
+  std::vector<FrameResources> frames;
+  Stats stats;
+  bool transientsRecreated = false;
+
+  // Walks the passes backwards from the outputs, a pass only stays if it
+  // writes something a later live pass reads
+  void cull() {
+    needed.assign(resources.size(), 0);
+    for (uint32_t i = 0; i < resources.size(); i++) {
+      needed[i] = resources[i].output;
+    }
+    stats.passes = static_cast<uint32_t>(passes.size());
+    stats.culledPasses = 0;
+    for (uint32_t i = static_cast<uint32_t>(passes.size()); i-- > 0;) {
+      Pass& pass = passes[i];
+      pass.live = pass.sideEffects;
+      for (uint32_t a = 0; a < pass.accessCount && !pass.live; a++) {
+        const Access& access = accesses[pass.firstAccess + a];
+        pass.live = access.write && needed[access.image];
+      }
+      if (!pass.live) {
+        stats.culledPasses++;
+        continue;
+      }
+      // Writes replace what earlier passes left, unless the pass reads it too
+      for (uint32_t a = 0; a < pass.accessCount; a++) {
+        const Access& access = accesses[pass.firstAccess + a];
+        if (access.write) needed[access.image] = 0;
+      }
+      for (uint32_t a = 0; a < pass.accessCount; a++) {
+        const Access& access = accesses[pass.firstAccess + a];
+        if (!access.write) needed[access.image] = 1;
+      }
+    }
+
+    for (uint32_t i = 0; i < passes.size(); i++) {
+      const Pass& pass = passes[i];
+      if (!pass.live) continue;
+      for (uint32_t a = 0; a < pass.accessCount; a++) {
+        Resource& resource = resources[accesses[pass.firstAccess + a].image];
+        if (resource.firstPass == NONE) {
+          resource.firstPass = i;
+        } else if (batches[passes[resource.firstPass].batch].queue !=
+                   batches[pass.batch].queue) {
+          resource.multipleQueues = true;
+        }
+        resource.lastPass = i;
+      }
+    }
+  }
+
+  // Greedy first fit in order of first use. Images only share memory with
+  // images of the same queue, where submission order keeps their lifetimes
+  // apart
+  void allocateTransients(FrameResources& frame) {
+    requested.clear();
+    for (Resource& resource : resources) {
+      if (!resource.transient || resource.firstPass == NONE) continue;
+      requested.push_back({resource.desc, resource.firstPass,
+                           resource.lastPass, resource.multipleQueues,
+                           batches[passes[resource.firstPass].batch].queue,
+                           VK_NULL_HANDLE, VK_NULL_HANDLE, INVALID_HANDLE});
+    }
+
+    bool unchanged = requested.size() == frame.images.size();
+    for (uint32_t i = 0; i < requested.size() && unchanged; i++) {
+      const TransientImage& a = requested[i];
+      const TransientImage& b = frame.images[i];
+      unchanged = a.desc == b.desc && a.firstPass == b.firstPass &&
+                  a.lastPass == b.lastPass &&
+                  a.multipleQueues == b.multipleQueues && a.queue == b.queue;
+    }
+    transientsRecreated = !unchanged;
+    if (!unchanged) {
+      destroyTransients(frame);
+      frame.images = requested;
+      createTransients(frame);
+    }
+
+    transientHandles.clear();
+    for (Handle handle = 0; handle < resources.size(); handle++) {
+      const Resource& resource = resources[handle];
+      if (resource.transient && resource.firstPass != NONE) {
+        transientHandles.push_back(handle);
+      }
+    }
+    for (uint32_t i = 0; i < transientHandles.size(); i++) {
+      Resource& resource = resources[transientHandles[i]];
+      const TransientImage& transient = frame.images[i];
+      resource.image = transient.image;
+      resource.view = transient.view;
+      // Aliases are stored as indices into the transient images
+      if (transient.previousAlias != INVALID_HANDLE) {
+        resource.previousAlias = transientHandles[transient.previousAlias];
+      }
+    }
+  }
+
+  void createTransients(FrameResources& frame) {
+    VkDevice logicalDevice = device->logicalDevice;
+    struct Block {
+      VkDeviceSize size = 0;
+      uint32_t typeBits = ~0u;
+      uint32_t lastPass = 0;
+      uint32_t lastImage = 0;
+      // Queue of the images placed so far
+      VkQueue queue = VK_NULL_HANDLE;
+      bool shared = true;
+      bool lazy = false;
+    };
+    std::vector<Block> blocks;
+    std::vector<uint32_t> imageBlocks(frame.images.size());
+    std::vector<uint32_t> order(frame.images.size());
+    for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      return frame.images[a].firstPass < frame.images[b].firstPass;
+    });
+
+    stats.allocatedBytes = 0;
+    stats.requestedBytes = 0;
+    for (uint32_t index : order) {
+      TransientImage& transient = frame.images[index];
+      VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+      imageCI.imageType = VK_IMAGE_TYPE_2D;
+      imageCI.format = transient.desc.format;
+      imageCI.extent = {transient.desc.extent.width,
+                        transient.desc.extent.height, 1};
+      imageCI.mipLevels = 1;
+      imageCI.arrayLayers = 1;
+      imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+      imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+      imageCI.usage = transient.desc.usage;
+      VK_CHECK_RESULT(
+          vkCreateImage(logicalDevice, &imageCI, nullptr, &transient.image));
+
+      VkMemoryRequirements memReqs;
+      vkGetImageMemoryRequirements(logicalDevice, transient.image, &memReqs);
+      stats.requestedBytes += memReqs.size;
+
+      // Attachments that only live inside a render pass get lazily allocated
+      // memory of their own
+      const bool lazy =
+          (transient.desc.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+      const bool shareable = !transient.multipleQueues && !lazy;
+      uint32_t block = 0;
+      for (; block < blocks.size(); block++) {
+        const Block& candidate = blocks[block];
+        if (candidate.shared && shareable &&
+            candidate.queue == transient.queue &&
+            candidate.lastPass < transient.firstPass &&
+            (candidate.typeBits & memReqs.memoryTypeBits) != 0) {
+          break;
+        }
+      }
+      if (block == blocks.size()) {
+        blocks.emplace_back();
+      } else {
+        transient.previousAlias = blocks[block].lastImage;
+      }
+      Block& target = blocks[block];
+      target.size = std::max(target.size, memReqs.size);
+      target.typeBits &= memReqs.memoryTypeBits;
+      target.lastPass = transient.lastPass;
+      target.lastImage = index;
+      target.queue = transient.queue;
+      target.shared = shareable;
+      target.lazy = lazy;
+      imageBlocks[index] = block;
+    }
+
+    frame.memory.resize(blocks.size());
+    for (uint32_t i = 0; i < blocks.size(); i++) {
+      VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+      memAlloc.allocationSize = blocks[i].size;
+      memAlloc.memoryTypeIndex =
+          blocks[i].lazy
+              ? device->getTransientAttachmentMemoryType(blocks[i].typeBits)
+              : device->getMemoryType(blocks[i].typeBits,
+                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+      VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr,
+                                       &frame.memory[i]));
+      stats.allocatedBytes += blocks[i].size;
+    }
+    stats.transientImages = static_cast<uint32_t>(frame.images.size());
+    stats.memoryBlocks = static_cast<uint32_t>(blocks.size());
+
+    for (uint32_t i = 0; i < frame.images.size(); i++) {
+      TransientImage& transient = frame.images[i];
+      VK_CHECK_RESULT(vkBindImageMemory(logicalDevice, transient.image,
+                                        frame.memory[imageBlocks[i]], 0));
+      VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+      viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      viewCI.format = transient.desc.format;
+      viewCI.subresourceRange = {transient.desc.aspect, 0, 1, 0, 1};
+      viewCI.image = transient.image;
+      VK_CHECK_RESULT(
+          vkCreateImageView(logicalDevice, &viewCI, nullptr, &transient.view));
+    }
+  }
+
+  void destroyTransients(FrameResources& frame) {
+    VkDevice logicalDevice = device->logicalDevice;
+    for (TransientImage& transient : frame.images) {
+      vkDestroyImageView(logicalDevice, transient.view, nullptr);
+      vkDestroyImage(logicalDevice, transient.image, nullptr);
+    }
+    for (VkDeviceMemory memory : frame.memory) {
+      vkFreeMemory(logicalDevice, memory, nullptr);
+    }
+    frame.images.clear();
+    frame.memory.clear();
+  }
+
+  VkImageMemoryBarrier imageBarrier(const Resource& resource,
+                                    VkImageLayout oldLayout,
+                                    VkImageLayout newLayout) const {
+    VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.image = resource.image;
+    // Imported images may have mips or layers, the graph tracks them as one
+    barrier.subresourceRange = {resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0,
+                                VK_REMAINING_ARRAY_LAYERS};
+    return barrier;
+  }
+
+  void buildBarriers() {
+    for (Resource& resource : resources) {
+      resource.state = State();
+      resource.state.layout = resource.transient ? VK_IMAGE_LAYOUT_UNDEFINED
+                                                 : resource.initialLayout;
+      resource.state.writeStages = resource.historyStages;
+      resource.state.writeAccess = resource.historyAccess;
+    }
+
+    for (uint32_t i = 0; i < passes.size(); i++) {
+      Pass& pass = passes[i];
+      pass.firstBarrier = static_cast<uint32_t>(barriers.size());
+      pass.srcStages = 0;
+      pass.dstStages = 0;
+      pass.barrierCount = 0;
+      if (!pass.live) continue;
+      for (uint32_t a = 0; a < pass.accessCount; a++) {
+        addAccess(i, pass, accesses[pass.firstAccess + a]);
+      }
+      pass.barrierCount =
+          static_cast<uint32_t>(barriers.size()) - pass.firstBarrier;
+    }
+  }
+
+  void addAccess(uint32_t passIndex, Pass& pass, const Access& access) {
+    Resource& resource = resources[access.image];
+    State& state = resource.state;
+    const Usage& usage = access.usage;
+    const Batch& batch = batches[pass.batch];
+    const bool discard = usage.layout == VK_IMAGE_LAYOUT_UNDEFINED;
+    // Barriers can not target the undefined layout, a discarded image that
+    // has none yet is moved to the layout the pass leaves it in
+    VkImageLayout newLayout = usage.layout;
+    if (discard) {
+      newLayout = state.layout != VK_IMAGE_LAYOUT_UNDEFINED ? state.layout
+                                                            : usage.finalLayout;
+    }
+    const bool transition = !discard && newLayout != state.layout;
+
+    VkPipelineStageFlags srcStages = 0;
+    VkAccessFlags srcAccess = 0;
+    uint32_t srcFamily = VK_QUEUE_FAMILY_IGNORED;
+    uint32_t dstFamily = VK_QUEUE_FAMILY_IGNORED;
+    bool needsBarrier = transition;
+    if (state.lastPass == NONE) {
+      // Memory of an alias is handed over once its last user is done
+      if (resource.previousAlias != INVALID_HANDLE) {
+        const State& alias = resources[resource.previousAlias].state;
+        srcStages = alias.writeStages | alias.readStages;
+        srcAccess = alias.writeAccess;
+        needsBarrier |= srcStages != 0;
+      } else if (state.writeStages != 0) {
+        // History images wait for the frames before
+        srcStages = state.writeStages;
+        srcAccess = state.writeAccess;
+        needsBarrier = true;
+      }
+    } else if (passes[state.lastPass].batch != pass.batch &&
+               batches[passes[state.lastPass].batch].queue != batch.queue) {
+      // The batch waits on the last user's batch with a semaphore, which
+      // makes its writes available and visible
+      srcStages = batch.waitStages;
+      state.writeStages = 0;
+      state.writeAccess = 0;
+      state.readStages = 0;
+      const uint32_t lastFamily =
+          batches[passes[state.lastPass].batch].queueFamily;
+      if (lastFamily != batch.queueFamily && !discard) {
+        const Access& last = accesses[findAccess(state.lastPass, access.image)];
+        VkImageMemoryBarrier release =
+            imageBarrier(resource, state.layout, newLayout);
+        release.srcAccessMask =
+            last.write ? last.usage.access & WRITE_ACCESS : 0;
+        release.srcQueueFamilyIndex = lastFamily;
+        release.dstQueueFamilyIndex = batch.queueFamily;
+        releases.push_back({state.lastPass, last.usage.stages, release});
+        srcFamily = lastFamily;
+        dstFamily = batch.queueFamily;
+        needsBarrier = true;
+      }
+    } else {
+      const bool readAfterWrite =
+          !access.write && state.writeStages != 0 &&
+          ((usage.stages & ~state.visibleStages) != 0 ||
+           (usage.access & ~state.visibleAccess) != 0);
+      const bool afterAccess =
+          access.write && (state.writeStages | state.readStages) != 0;
+      srcStages = state.writeStages | state.readStages;
+      srcAccess = state.writeAccess;
+      needsBarrier |= readAfterWrite || afterAccess;
+    }
+
+    if (needsBarrier) {
+      VkImageMemoryBarrier barrier =
+          imageBarrier(resource, state.layout, newLayout);
+      // An acquire repeats the release, its source access is empty
+      barrier.srcAccessMask =
+          srcFamily == VK_QUEUE_FAMILY_IGNORED ? srcAccess : 0;
+      barrier.dstAccessMask = usage.access;
+      barrier.srcQueueFamilyIndex = srcFamily;
+      barrier.dstQueueFamilyIndex = dstFamily;
+      barriers.push_back(barrier);
+      pass.srcStages |=
+          srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+      pass.dstStages |= usage.stages;
+    }
+
+    if (access.write) {
+      state.writeStages = usage.stages;
+      state.writeAccess = usage.access & WRITE_ACCESS;
+      state.readStages = 0;
+      state.visibleStages = 0;
+      state.visibleAccess = 0;
+    } else {
+      state.readStages |= usage.stages;
+      if (needsBarrier) {
+        state.visibleStages |= usage.stages;
+        state.visibleAccess |= usage.access;
+      }
+    }
+    state.layout = usage.finalLayout;
+    state.lastPass = passIndex;
+  }
+
+  uint32_t findAccess(uint32_t passIndex, Handle image) const {
+    const Pass& pass = passes[passIndex];
+    for (uint32_t a = 0; a < pass.accessCount; a++) {
+      if (accesses[pass.firstAccess + a].image == image) {
+        return pass.firstAccess + a;
+      }
+    }
+    return pass.firstAccess;
+  }
+};
+}  // namespace vks
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "../ResourceManagement/ExternalResources/VulkanglTFModel.h"
+
+namespace vks {
+// Flat list of draws for a single frame, ordered by a packed 64 bit sort key.
+// Draws are gathered in one walk over the scene and then radix sorted, so the
+// command buffer is recorded in a single linear pass
+class RenderQueue {
+ public:
+  // Coarse ordering, opaque geometry first so later passes get early-z
+  enum Pass : uint8_t {
+    PASS_OPAQUE = 0,
+    PASS_MASK = 1,
+    PASS_BLEND = 2,
+  };
+
+  // Key layout
+  // Opaque/Mask: [63..60] pass | [59..48] pipeline | [47..32] material |
+  //              [31..0] depth (front to back)
+  // Blend:       [63..60] pass | [59..28] depth (back to front) |
+  //              [27..16] pipeline | [15..0] material
+  // Blended draws need strict depth order, so depth takes priority over state
+  static constexpr uint32_t PIPELINE_BITS = 12;
+  static constexpr uint32_t MATERIAL_BITS = 16;
+
+  struct DrawItem {
+    uint64_t key;
+    vkglTF::Primitive* primitive;
+    vkglTF::Node* node;
+    VkPipeline pipeline;
+    // Index into the renderer's model list, used for vertex/index buffers
+    uint32_t modelIndex;
+    // Index into the model matrices of the scene UBO
+    uint32_t transformIndex;
+    // Per draw light list, see LightAssigner::getList
+    uint32_t lightList;
+  };
+
+  static uint64_t makeKey(Pass pass, uint32_t pipelineId, uint32_t materialId,
+                          float viewDepth) {
+    const uint64_t passBits = static_cast<uint64_t>(pass & 0xF) << 60;
+    const uint64_t pipelineBits = pipelineId & ((1u << PIPELINE_BITS) - 1);
+    const uint64_t materialBits = materialId & ((1u << MATERIAL_BITS) - 1);
+    const uint64_t depthBits = depthToBits(viewDepth);
+
+    if (pass == PASS_BLEND) {
+      return passBits | ((~depthBits & 0xFFFFFFFFull) << 28) |
+             (pipelineBits << 16) | materialBits;
+    }
+    return passBits | (pipelineBits << 48) | (materialBits << 32) | depthBits;
+  }
+
+  void clear() { drawItems.clear(); }
+
+  void reserve(size_t count) {
+    drawItems.reserve(count);
+    scratch.reserve(count);
+  }
+
+  void push(const DrawItem& item) { drawItems.push_back(item); }
+
+  // LSD radix sort on the key, 8 bits per pass. Passes where every key shares
+  // the same digit are skipped, which is common for the pass/pipeline bits
+  void sort() {
+    const size_t count = drawItems.size();
+    if (count < 2) return;
+    scratch.resize(count);
+
+    DrawItem* src = drawItems.data();
+    DrawItem* dst = scratch.data();
+    for (uint32_t shift = 0; shift < 64; shift += 8) {
+      uint32_t histogram[256] = {};
+      for (size_t i = 0; i < count; i++) {
+        histogram[(src[i].key >> shift) & 0xFF]++;
+      }
+      if (histogram[(src[0].key >> shift) & 0xFF] == count) continue;
+
+      uint32_t offset = 0;
+      for (uint32_t& bucket : histogram) {
+        const uint32_t bucketCount = bucket;
+        bucket = offset;
+        offset += bucketCount;
+      }
+      for (size_t i = 0; i < count; i++) {
+        dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+      }
+      std::swap(src, dst);
+    }
+
+    if (src != drawItems.data()) {
+      memcpy(drawItems.data(), src, count * sizeof(DrawItem));
+    }
+  }
+
+  const std::vector<DrawItem>& items() const { return drawItems; }
+  size_t size() const { return drawItems.size(); }
+  bool empty() const { return drawItems.empty(); }
+
+ private:
+  std::vector<DrawItem> drawItems;
+  std::vector<DrawItem> scratch;
+
+  // Positive floats keep their ordering when compared as unsigned integers
+  static uint64_t depthToBits(float viewDepth) {
+    if (!(viewDepth > 0.0f)) return 0;
+    uint32_t bits;
+    memcpy(&bits, &viewDepth, sizeof(bits));
+    return bits;
+  }
+};
+}  // namespace vks
@@ -0,0 +1,425 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "../ResourceManagement/ExternalResources/MathTools.h"
+#include "../ResourceManagement/VulkanResources/VulkanDevice.h"
+#include "../ResourceManagement/VulkanResources/VulkanInitializers.hpp"
+#include "../ResourceManagement/VulkanResources/VulkanTools.h"
+#include "HistoryImages.h"
+
+namespace vks {
+// Screen space ambient occlusion as compute passes over the depth prepass,
+// either hemisphere sampled SSAO or horizon based GTAO with a bilateral blur.
+// Occlusion can run at a fraction of the screen resolution on depth taken
+// from the depth pyramid, a depth aware resolve brings it back to full
+// resolution. With temporal accumulation every frame adds its samples to the
+// reprojected occlusion of the frames before, so few samples per frame are
+// enough.
+// The images belong to the render graph, which also places the barriers and
+// queue family transfers around the passes
+class SSAOPass {
+ public:
+  static constexpr uint32_t KERNEL_SIZE = 64;
+  static constexpr uint32_t GROUP_SIZE = 8;
+  // Resolved occlusion, RGBA8 is a required storage format, the scene
+  // samples all three channels
+  static constexpr VkFormat FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+  // Occlusion and linear depth at the occlusion resolution, also the history
+  static constexpr VkFormat OCCLUSION_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+  static constexpr VkFormat DEPTH_FORMAT = VK_FORMAT_R32_SFLOAT;
+  // Share of the history in the accumulated occlusion
+  static constexpr float HISTORY_WEIGHT = 0.9f;
+  // Occlusion methods of recordOcclusion()
+  static constexpr uint32_t TYPE_SSAO = 1;
+  static constexpr uint32_t TYPE_HORIZON = 2;
+
+  // Matches the push constants of the occlusion shaders, the other passes
+  // only read the projection or the blur direction
+  struct Params {
+    // View space of this frame to clip space of the last one, set by
+    // recordOcclusion()
+    glm::mat4 reprojection;
+    // [0][0], [1][1], [2][2] and [3][2] of the camera projection, enough to
+    // go between view space and the depth buffer
+    glm::vec4 projection;
+    // Occlusion pixels in use, the images may be larger while the render
+    // extent scales
+    glm::ivec2 extent;
+    float radius;
+    uint32_t kernelSize;
+    // Set by recordOcclusion(), 0 without history
+    float historyWeight;
+    uint32_t frame;
+    // Set by recordBlur()
+    glm::ivec2 blurDirection;
+    // Set by recordResolve()
+    glm::ivec2 resolvedExtent;
+    // Last frame's occlusion uv to uv of the history image, set by
+    // recordOcclusion()
+    glm::vec2 historyScale;
+  };
+
+  void create(vks::VulkanDevice* vulkanDevice, uint32_t frameCount,
+              const VkPipelineShaderStageCreateInfo& downsampleStage,
+              const VkPipelineShaderStageCreateInfo& occlusionStage,
+              const VkPipelineShaderStageCreateInfo& horizonStage,
+              const VkPipelineShaderStageCreateInfo& blurStage,
+              const VkPipelineShaderStageCreateInfo& resolveStage) {
+    device = vulkanDevice;
+    descriptorSets.resize(frameCount * STAGE_COUNT);
+    createKernel();
+    createSamplers();
+    history.create(device, OCCLUSION_FORMAT);
+    createPipelines({downsampleStage, occlusionStage, horizonStage, blurStage,
+                     resolveStage});
+  }
+
+  void destroy() {
+    VkDevice logicalDevice = device->logicalDevice;
+    history.destroy();
+    kernel.destroy();
+    vkDestroySampler(logicalDevice, sampler, nullptr);
+    vkDestroySampler(logicalDevice, pointSampler, nullptr);
+    for (VkPipeline pipeline : pipelines) {
+      vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+  }
+
+  // Size of the occlusion when the screen is divided downsample times by two
+  static VkExtent2D getExtent(VkExtent2D extent, uint32_t downsample) {
+    return {std::max(extent.width >> downsample, 1u),
+            std::max(extent.height >> downsample, 1u)};
+  }
+
+  // The accumulated occlusion of this frame and of the last one, both stay
+  // in the general layout. Prepared once per frame that accumulates
+  // occlusion with the largest occlusion extent, smaller ones use a part of
+  // the images
+  vks::HistoryImages& getHistory() { return history; }
+
+  // Writes the nearest or farthest depth of each pixel of the occlusion
+  // resolution into the storage image. depth is the mip of the depth pyramid
+  // at that resolution in the general layout
+  void recordDownsample(VkCommandBuffer commandBuffer, uint32_t frame,
+                        const VkDescriptorImageInfo& depth,
+                        VkImageView downsampledDepth, VkExtent2D extent) {
+    VkDescriptorSet descriptorSet = getDescriptorSet(frame, DOWNSAMPLE);
+    VkDescriptorImageInfo storage{VK_NULL_HANDLE, downsampledDepth,
+                                  VK_IMAGE_LAYOUT_GENERAL};
+    std::array<VkWriteDescriptorSet, 2> writes = {
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+            &depth),
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2, &storage)};
+    dispatch(commandBuffer, PIPELINE_DOWNSAMPLE, descriptorSet, writes.data(),
+             static_cast<uint32_t>(writes.size()), nullptr, extent);
+  }
+
+  // Writes occlusion of the extent sized depth into the storage image with
+  // the method type, TYPE_SSAO or TYPE_HORIZON. depth is the prepass depth or
+  // the downsampled one in the general layout.
+  // historyView is the last frame's history for temporal accumulation,
+  // VK_NULL_HANDLE without
+  void recordOcclusion(VkCommandBuffer commandBuffer, uint32_t frame,
+                       const VkDescriptorImageInfo& depth,
+                       VkImageView occlusion, VkImageView historyView,
+                       uint32_t type, Params params, const glm::mat4& view,
+                       const glm::mat4& projection, VkExtent2D extent) {
+    VkDescriptorSet descriptorSet = getDescriptorSet(frame, OCCLUSION);
+    VkDescriptorImageInfo storage{VK_NULL_HANDLE, occlusion,
+                                  VK_IMAGE_LAYOUT_GENERAL};
+    // The shader never reads the depth standing in for a missing history
+    VkDescriptorImageInfo historyInfo =
+        historyView != VK_NULL_HANDLE
+            ? VkDescriptorImageInfo{sampler, historyView,
+                                    VK_IMAGE_LAYOUT_GENERAL}
+            : depth;
+    std::array<VkWriteDescriptorSet, 3> writes = {
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+            &depth),
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3, &storage),
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4,
+            &historyInfo)};
+
+    const glm::mat4 viewProjection = projection * view;
+    const bool temporal = historyView != VK_NULL_HANDLE;
+    params.reprojection = previousViewProjection * glm::inverse(view);
+    params.historyWeight =
+        temporal && history.isValid() ? HISTORY_WEIGHT : 0.0f;
+    params.frame = temporal ? frameCounter++ : 0;
+    if (temporal) {
+      const VkExtent2D historyExtent = history.getExtent();
+      params.historyScale =
+          glm::vec2(previousExtent.width, previousExtent.height) /
+          glm::vec2(historyExtent.width, historyExtent.height);
+    }
+    previousViewProjection = viewProjection;
+    previousExtent = extent;
+    if (temporal) {
+      history.markWritten();
+    } else {
+      history.invalidate();
+    }
+
+    const Pipeline pipeline =
+        type == TYPE_HORIZON ? PIPELINE_HORIZON : PIPELINE_SSAO;
+    dispatch(commandBuffer, pipeline, descriptorSet, writes.data(),
+             static_cast<uint32_t>(writes.size()), &params, extent);
+  }
+
+  // One direction of the bilateral blur over occlusion in the general layout
+  void recordBlur(VkCommandBuffer commandBuffer, uint32_t frame, bool vertical,
+                  VkImageView occlusion, VkImageView blurred, Params params,
+                  VkExtent2D extent) {
+    VkDescriptorSet descriptorSet =
+        getDescriptorSet(frame, vertical ? BLUR_VERTICAL : BLUR_HORIZONTAL);
+    VkDescriptorImageInfo occlusionInfo{pointSampler, occlusion,
+                                        VK_IMAGE_LAYOUT_GENERAL};
+    VkDescriptorImageInfo storage{VK_NULL_HANDLE, blurred,
+                                  VK_IMAGE_LAYOUT_GENERAL};
+    std::array<VkWriteDescriptorSet, 2> writes = {
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3, &storage),
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5,
+            &occlusionInfo)};
+    params.blurDirection = vertical ? glm::ivec2(0, 1) : glm::ivec2(1, 0);
+    dispatch(commandBuffer, PIPELINE_BLUR, descriptorSet, writes.data(),
+             static_cast<uint32_t>(writes.size()), &params, extent);
+  }
+
+  // Brings the occlusion to extent, the part of the prepass depth the scene
+  // was drawn to
+  void recordResolve(VkCommandBuffer commandBuffer, uint32_t frame,
+                     const VkDescriptorImageInfo& depth, VkImageView occlusion,
+                     VkImageView resolved, Params params, VkExtent2D extent) {
+    VkDescriptorSet descriptorSet = getDescriptorSet(frame, RESOLVE);
+    VkDescriptorImageInfo occlusionInfo{pointSampler, occlusion,
+                                        VK_IMAGE_LAYOUT_GENERAL};
+    VkDescriptorImageInfo storage{VK_NULL_HANDLE, resolved,
+                                  VK_IMAGE_LAYOUT_GENERAL};
+    std::array<VkWriteDescriptorSet, 3> writes = {
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+            &depth),
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5,
+            &occlusionInfo),
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 6, &storage)};
+    params.resolvedExtent = glm::ivec2(extent.width, extent.height);
+    dispatch(commandBuffer, PIPELINE_RESOLVE, descriptorSet, writes.data(),
+             static_cast<uint32_t>(writes.size()), &params, extent);
+  }
+
+  // Filters the occlusion image when the scene samples it
+  VkSampler getSampler() const { return sampler; }
+  // Downsampled depth is read texel by texel
+  VkSampler getPointSampler() const { return pointSampler; }
+
+ private:
+  // Each stage has a descriptor set per frame
+  enum Stage : uint32_t {
+    DOWNSAMPLE,
+    OCCLUSION,
+    BLUR_HORIZONTAL,
+    BLUR_VERTICAL,
+    RESOLVE,
+    STAGE_COUNT
+  };
+  enum Pipeline : uint32_t {
+    PIPELINE_DOWNSAMPLE,
+    PIPELINE_SSAO,
+    PIPELINE_HORIZON,
+    PIPELINE_BLUR,
+    PIPELINE_RESOLVE,
+    PIPELINE_COUNT
+  };
+
+  vks::VulkanDevice* device{nullptr};
+  // One set per stage and frame
+  std::vector<VkDescriptorSet> descriptorSets;
+
+  // Hemisphere samples, xyz used
+  vks::Buffer kernel;
+  VkSampler sampler{VK_NULL_HANDLE};
+  VkSampler pointSampler{VK_NULL_HANDLE};
+  VkDescriptorPool descriptorPool{VK_NULL_HANDLE};
+  // Shared by all stages, each one uses some of the bindings
+  VkDescriptorSetLayout descriptorSetLayout{VK_NULL_HANDLE};
+  VkPipelineLayout pipelineLayout{VK_NULL_HANDLE};
+  std::array<VkPipeline, PIPELINE_COUNT> pipelines{};
+
+  vks::HistoryImages history;
+  glm::mat4 previousViewProjection{1.0f};
+  // Occlusion extent of the last frame, the part of the history it wrote
+  VkExtent2D previousExtent{};
+  // Rotates the samples between frames
+  uint32_t frameCounter = 0;
+
+  VkDescriptorSet getDescriptorSet(uint32_t frame, Stage stage) const {
+    return descriptorSets[frame * STAGE_COUNT + stage];
+  }
+
+  // The set of the frame is updated every time since the graph may have
+  // placed the images somewhere else
+  void dispatch(VkCommandBuffer commandBuffer, Pipeline pipeline,
+                VkDescriptorSet descriptorSet,
+                const VkWriteDescriptorSet* writes, uint32_t writeCount,
+                const Params* params, VkExtent2D extent) {
+    vkUpdateDescriptorSets(device->logicalDevice, writeCount, writes, 0,
+                           nullptr);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipelines[pipeline]);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    if (params != nullptr) {
+      vkCmdPushConstants(commandBuffer, pipelineLayout,
+                         VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Params),
+                         params);
+    }
+    vkCmdDispatch(commandBuffer, (extent.width + GROUP_SIZE - 1) / GROUP_SIZE,
+                  (extent.height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+  }
+
+  void createKernel() {
+    VK_CHECK_RESULT(device->createBuffer(
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &kernel, sizeof(glm::vec4) * KERNEL_SIZE));
+    VK_CHECK_RESULT(kernel.map());
+
+    // Denser toward the center of the hemisphere
+    glm::vec4 samples[KERNEL_SIZE];
+    for (uint32_t i = 0; i < KERNEL_SIZE; i++) {
+      glm::vec3 sample(math::random::randomRange(-1.0f, 1.0f),
+                       math::random::randomRange(-1.0f, 1.0f),
+                       math::random::randomRange(0.0f, 1.0f));
+      const float scale = (float)i / KERNEL_SIZE;
+      sample *= math::linear::lerp(0.1f, 1.0f, scale * scale);
+      samples[i] = glm::vec4(sample, 0.0f);
+    }
+    memcpy(kernel.mapped, samples, sizeof(samples));
+  }
+
+  void createSamplers() {
+    VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+    samplerCI.magFilter = VK_FILTER_LINEAR;
+    samplerCI.minFilter = VK_FILTER_LINEAR;
+    samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.maxAnisotropy = 1.0f;
+    samplerCI.minLod = 0.0f;
+    samplerCI.maxLod = 1.0f;
+    samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    VK_CHECK_RESULT(
+        vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &sampler));
+    // R32 float is not guaranteed to be filterable
+    samplerCI.magFilter = VK_FILTER_NEAREST;
+    samplerCI.minFilter = VK_FILTER_NEAREST;
+    VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr,
+                                    &pointSampler));
+  }
+
+  void createPipelines(
+      const std::array<VkPipelineShaderStageCreateInfo, PIPELINE_COUNT>&
+          shaderStages) {
+    VkDevice logicalDevice = device->logicalDevice;
+    const uint32_t setCount = static_cast<uint32_t>(descriptorSets.size());
+    const uint32_t frameCount = setCount / STAGE_COUNT;
+    std::vector<VkDescriptorPoolSize> poolSizes = {
+        vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                                              frameCount),
+        vks::initializers::descriptorPoolSize(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frameCount * 7),
+        vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                              setCount)};
+    VkDescriptorPoolCreateInfo descriptorPoolCI =
+        vks::initializers::descriptorPoolCreateInfo(poolSizes, setCount);
+    VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolCI,
+                                           nullptr, &descriptorPool));
+
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+        // Binding 0 : Kernel
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        // Binding 1 : Depth, or the depth pyramid for the downsample
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        // Binding 2 : Downsampled depth
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        // Binding 3 : Occlusion
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+        // Binding 4 : History
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 4),
+        // Binding 5 : Occlusion to blur or resolve
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 5),
+        // Binding 6 : Resolved occlusion
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 6)};
+    VkDescriptorSetLayoutCreateInfo descriptorLayoutCI =
+        vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
+        logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayout));
+
+    std::vector<VkDescriptorSetLayout> setLayouts(setCount,
+                                                  descriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo =
+        vks::initializers::descriptorSetAllocateInfo(
+            descriptorPool, setLayouts.data(), setCount);
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo,
+                                             descriptorSets.data()));
+    for (uint32_t frame = 0; frame < frameCount; frame++) {
+      VkWriteDescriptorSet write = vks::initializers::writeDescriptorSet(
+          getDescriptorSet(frame, OCCLUSION), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+          0, &kernel.descriptor);
+      vkUpdateDescriptorSets(logicalDevice, 1, &write, 0, nullptr);
+    }
+
+    VkPushConstantRange pushConstantRange =
+        vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT,
+                                             sizeof(Params), 0);
+    VkPipelineLayoutCreateInfo pipelineLayoutCI =
+        vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+    pipelineLayoutCI.pushConstantRangeCount = 1;
+    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCI,
+                                           nullptr, &pipelineLayout));
+
+    for (uint32_t pipeline = 0; pipeline < PIPELINE_COUNT; pipeline++) {
+      VkComputePipelineCreateInfo pipelineCI =
+          vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+      pipelineCI.stage = shaderStages[pipeline];
+      VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice,
+                                               device->pipelineCache, 1,
+                                               &pipelineCI, nullptr,
+                                               &pipelines[pipeline]));
+    }
+  }
+};
+}  // namespace vks
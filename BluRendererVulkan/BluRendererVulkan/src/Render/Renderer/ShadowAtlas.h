@@ -0,0 +1,552 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "../ResourceManagement/VulkanResources/VulkanDevice.h"
+#include "../ResourceManagement/VulkanResources/VulkanInitializers.hpp"
+#include "../ResourceManagement/VulkanResources/VulkanTools.h"
+
+namespace vks {
+// Shadow maps of point and spot lights packed into a single depth texture.
+// Lights request square tiles sized by their screen coverage, point lights
+// one per cube face. Tiles are handed out by a quadtree so they can be freed
+// and resized independently. The atlas persists across frames and only a
+// budget of tiles is rendered per frame, the lights waiting the longest
+// relative to their priority go first. Lights keep the matrices their tiles
+// were rendered with until they are updated again
+class ShadowAtlas {
+ public:
+  static constexpr uint32_t ATLAS_SIZE = 4096;
+  static constexpr uint32_t MIN_TILE_SIZE = 128;
+  static constexpr uint32_t MAX_TILE_SIZE = 1024;
+  static constexpr uint32_t MAX_TILES = 64;
+  static constexpr uint32_t MAX_LIGHTS = 16;
+  static constexpr uint32_t CUBE_FACES = 6;
+
+  // Matches the ShadowAtlas uniform block of pbr.frag
+  struct GPUData {
+    glm::mat4 tileViewProj[MAX_TILES];
+    // XY offset and ZW size in texture coordinates
+    glm::vec4 tileRects[MAX_TILES];
+    // X light buffer index, Y first tile, Z tile count
+    glm::uvec4 lights[MAX_LIGHTS];
+    uint32_t lightCount;
+    uint32_t padding[3];
+  };
+
+  struct Stats {
+    uint32_t lights = 0;
+    uint32_t tilesUsed = 0;
+    uint32_t tilesRendered = 0;
+    // Lights that need an update but did not fit into the budget
+    uint32_t pending = 0;
+  };
+
+  // Tiles rendered per frame, a point light takes six
+  uint32_t tileBudget = 12;
+
+  void create(vks::VulkanDevice* vulkanDevice, VkFormat depthFormat,
+              VkFilter filter) {
+    device = vulkanDevice;
+    format = depthFormat;
+    buildQuadtree();
+    requests.reserve(MAX_LIGHTS);
+    entries.reserve(MAX_LIGHTS);
+    dirtyEntries.reserve(MAX_LIGHTS);
+    scheduled.reserve(MAX_TILES);
+    createRenderPass();
+    createImage(filter);
+  }
+
+  void destroy() {
+    VkDevice logicalDevice = device->logicalDevice;
+    vkDestroyFramebuffer(logicalDevice, framebuffer, nullptr);
+    vkDestroySampler(logicalDevice, sampler, nullptr);
+    vkDestroyImageView(logicalDevice, view, nullptr);
+    vkDestroyImage(logicalDevice, image, nullptr);
+    vkFreeMemory(logicalDevice, memory, nullptr);
+    vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
+  }
+
+  // Starts collecting this frame's shadowed lights
+  void beginFrame() {
+    requests.clear();
+    scheduled.clear();
+  }
+
+  // faceCount is 1 for spot and 6 for point lights. Coverage is the fraction
+  // of the screen height the light covers, it sizes the tiles and orders the
+  // updates. Every light is kept until update() picks the MAX_LIGHTS with the
+  // highest coverage
+  void addLight(uint32_t lightIndex, uint32_t faceCount, float coverage,
+                uint32_t screenHeight, const glm::mat4* faceViewProj) {
+    Request& request = requests.emplace_back();
+    request.lightIndex = lightIndex;
+    request.faceCount = faceCount;
+    request.priority = coverage;
+    // Cube faces only cover a quarter of the view each
+    const float pixels =
+        coverage * screenHeight * (faceCount > 1 ? 0.5f : 1.0f);
+    uint32_t size = MIN_TILE_SIZE;
+    while (size < MAX_TILE_SIZE && size < pixels) size *= 2;
+    request.tileSize = size;
+    std::copy(faceViewProj, faceViewProj + faceCount, request.faceViewProj);
+  }
+
+  // Allocates tiles for the requested lights, schedules the updates of this
+  // frame and fills the shader data. Only lights whose tiles were rendered
+  // are shadowed
+  void update(bool invalidateAll, GPUData& data) {
+    // Higher coverage is allocated first and falls back to smaller tiles when
+    // the atlas is full, lights past MAX_LIGHTS are not shadowed this frame
+    const auto byPriority = [](const Request& a, const Request& b) {
+      return a.priority > b.priority;
+    };
+    const size_t lightCount = std::min<size_t>(requests.size(), MAX_LIGHTS);
+    std::partial_sort(requests.begin(), requests.begin() + lightCount,
+                      requests.end(), byPriority);
+    requests.resize(lightCount);
+
+    // Lights that are gone or no longer among them release their tiles
+    bool tilesFreed = false;
+    for (auto it = entries.begin(); it != entries.end();) {
+      const bool requested =
+          std::any_of(requests.begin(), requests.end(), [&](const Request& r) {
+            return r.lightIndex == it->lightIndex;
+          });
+      if (!requested) {
+        tilesFreed |= it->faceCount > 0;
+        freeTiles(*it);
+        it = entries.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    for (const Request& request : requests) {
+      Entry* entry = findEntry(request.lightIndex);
+      if (!entry) {
+        entry = &entries.emplace_back();
+        entry->lightIndex = request.lightIndex;
+      }
+      entry->priority = request.priority;
+      // Lights that did not fit retry once other tiles were released
+      const bool failed = entry->requestedFaces > 0 && entry->faceCount == 0;
+      if (entry->requestedFaces != request.faceCount ||
+          entry->requestedSize != request.tileSize ||
+          (failed && tilesFreed)) {
+        tilesFreed |= entry->faceCount > 0;
+        freeTiles(*entry);
+        allocateTiles(*entry, request.faceCount, request.tileSize);
+      }
+      bool changed = invalidateAll || !entry->rendered;
+      for (uint32_t face = 0; face < entry->faceCount; face++) {
+        changed |= entry->faceViewProj[face] != request.faceViewProj[face];
+      }
+      if (changed) {
+        entry->dirty = true;
+        std::copy(request.faceViewProj,
+                  request.faceViewProj + request.faceCount,
+                  entry->pendingViewProj);
+      }
+    }
+
+    schedule();
+
+    stats = Stats();
+    stats.lights = static_cast<uint32_t>(requests.size());
+    data.lightCount = 0;
+    uint32_t tileCount = 0;
+    for (Entry& entry : entries) {
+      stats.tilesUsed += entry.faceCount;
+      stats.pending += entry.dirty ? 1 : 0;
+      if (!entry.rendered || tileCount + entry.faceCount > MAX_TILES) {
+        entry.firstTile = UINT32_MAX;
+        continue;
+      }
+      entry.firstTile = tileCount;
+      for (uint32_t face = 0; face < entry.faceCount; face++) {
+        const VkRect2D& rect = nodeRects[entry.nodes[face]];
+        data.tileViewProj[tileCount] = entry.faceViewProj[face];
+        data.tileRects[tileCount] =
+            glm::vec4(rect.offset.x, rect.offset.y, rect.extent.width,
+                      rect.extent.height) /
+            static_cast<float>(ATLAS_SIZE);
+        tileCount++;
+      }
+      data.lights[data.lightCount++] =
+          glm::uvec4(entry.lightIndex, entry.firstTile, entry.faceCount, 0);
+    }
+    stats.tilesRendered = static_cast<uint32_t>(scheduled.size());
+  }
+
+  // Renders the scheduled tiles, drawTile(commandBuffer, tileIndex, viewProj)
+  // records the casters of a tile with viewport and scissor already set
+  template <typename DrawFn>
+  void render(VkCommandBuffer commandBuffer, DrawFn&& drawTile) {
+    if (!initialized) {
+      // Nothing is sampled before a tile was rendered, only the layout has to
+      // be valid
+      vks::tools::setImageLayout(
+          commandBuffer, image, VK_IMAGE_ASPECT_DEPTH_BIT,
+          VK_IMAGE_LAYOUT_UNDEFINED,
+          VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+      initialized = true;
+    }
+    if (scheduled.empty()) return;
+
+    VkRenderPassBeginInfo renderPassBeginInfo =
+        vks::initializers::renderPassBeginInfo();
+    renderPassBeginInfo.renderPass = renderPass;
+    renderPassBeginInfo.framebuffer = framebuffer;
+    renderPassBeginInfo.renderArea =
+        vks::initializers::rect2D(ATLAS_SIZE, ATLAS_SIZE, 0, 0);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+                         VK_SUBPASS_CONTENTS_INLINE);
+
+    std::array<VkClearRect, MAX_TILES> clearRects{};
+    for (uint32_t i = 0; i < scheduled.size(); i++) {
+      clearRects[i] = {nodeRects[scheduled[i].node], 0, 1};
+    }
+    VkClearAttachment clearAttachment{};
+    clearAttachment.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    clearAttachment.clearValue.depthStencil = {1.0f, 0};
+    vkCmdClearAttachments(commandBuffer, 1, &clearAttachment,
+                          static_cast<uint32_t>(scheduled.size()),
+                          clearRects.data());
+
+    for (const ScheduledTile& tile : scheduled) {
+      const VkRect2D& rect = nodeRects[tile.node];
+      VkViewport viewport = vks::initializers::viewport(
+          (float)rect.extent.width, (float)rect.extent.height, 0.0f, 1.0f);
+      viewport.x = (float)rect.offset.x;
+      viewport.y = (float)rect.offset.y;
+      vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+      vkCmdSetScissor(commandBuffer, 0, 1, &rect);
+      drawTile(commandBuffer, tile.tileIndex, tile.viewProjection);
+    }
+    vkCmdEndRenderPass(commandBuffer);
+  }
+
+  const VkDescriptorImageInfo& getDescriptor() const { return descriptor; }
+  VkImage getImage() const { return image; }
+  const Stats& getStats() const { return stats; }
+
+ private:
+  // Quadtree over the atlas, level 0 is the whole atlas and children of node
+  // n are 4n + 1 to 4n + 4
+  static constexpr uint32_t LEVEL_COUNT = 6;
+  static_assert(ATLAS_SIZE >> (LEVEL_COUNT - 1) == MIN_TILE_SIZE,
+                "The last level holds the smallest tiles");
+  enum class NodeState : uint8_t { Free, Split, Used };
+
+  struct Request {
+    uint32_t lightIndex;
+    uint32_t faceCount;
+    uint32_t tileSize;
+    float priority;
+    glm::mat4 faceViewProj[CUBE_FACES];
+  };
+
+  struct Entry {
+    uint32_t lightIndex = 0;
+    // Tiles asked for, the allocation may have fallen back to smaller ones
+    uint32_t requestedFaces = 0;
+    uint32_t requestedSize = 0;
+    uint32_t faceCount = 0;
+    uint32_t tileSize = 0;
+    std::array<uint32_t, CUBE_FACES> nodes{};
+    // Matrices the tiles were rendered with, and the ones still waiting
+    glm::mat4 faceViewProj[CUBE_FACES]{};
+    glm::mat4 pendingViewProj[CUBE_FACES]{};
+    float priority = 0.0f;
+    uint32_t framesWaiting = 0;
+    uint32_t firstTile = UINT32_MAX;
+    bool rendered = false;
+    bool dirty = false;
+    // Rendered this frame
+    bool updated = false;
+  };
+
+  struct ScheduledTile {
+    uint32_t node;
+    uint32_t tileIndex;
+    glm::mat4 viewProjection;
+  };
+
+  vks::VulkanDevice* device = nullptr;
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  VkImage image{VK_NULL_HANDLE};
+  VkDeviceMemory memory{VK_NULL_HANDLE};
+  VkImageView view{VK_NULL_HANDLE};
+  VkSampler sampler{VK_NULL_HANDLE};
+  VkFramebuffer framebuffer{VK_NULL_HANDLE};
+  VkRenderPass renderPass{VK_NULL_HANDLE};
+  VkDescriptorImageInfo descriptor{};
+  bool initialized = false;
+
+  std::vector<NodeState> nodeStates;
+  std::vector<VkRect2D> nodeRects;
+  std::vector<Entry> entries;
+  std::vector<Request> requests;
+  std::vector<Entry*> dirtyEntries;
+  std::vector<ScheduledTile> scheduled;
+  Stats stats;
+
+  Entry* findEntry(uint32_t lightIndex) {
+    for (Entry& entry : entries) {
+      if (entry.lightIndex == lightIndex) return &entry;
+    }
+    return nullptr;
+  }
+
+  // Dirty lights are updated whole, ordered by how long they waited scaled by
+  // their priority. The first light is always updated so a budget smaller
+  // than a point light does not starve it
+  void schedule() {
+    dirtyEntries.clear();
+    for (Entry& entry : entries) {
+      entry.updated = false;
+      if (entry.dirty && entry.faceCount > 0) dirtyEntries.push_back(&entry);
+    }
+    std::sort(dirtyEntries.begin(), dirtyEntries.end(),
+              [](const Entry* a, const Entry* b) {
+                return a->priority * (a->framesWaiting + 1) >
+                       b->priority * (b->framesWaiting + 1);
+              });
+
+    uint32_t budget = tileBudget;
+    for (Entry* entry : dirtyEntries) {
+      if (entry->faceCount > budget && budget != tileBudget) {
+        entry->framesWaiting++;
+        continue;
+      }
+      budget -= std::min(budget, entry->faceCount);
+      std::copy(entry->pendingViewProj,
+                entry->pendingViewProj + entry->faceCount,
+                entry->faceViewProj);
+      entry->dirty = false;
+      entry->rendered = true;
+      entry->updated = true;
+      entry->framesWaiting = 0;
+    }
+
+    // Shader tiles are numbered in entry order, update() repeats this
+    uint32_t tileCount = 0;
+    for (const Entry& entry : entries) {
+      if (!entry.rendered || tileCount + entry.faceCount > MAX_TILES) continue;
+      for (uint32_t face = 0; face < entry.faceCount; face++) {
+        if (entry.updated) {
+          scheduled.push_back(
+              {entry.nodes[face], tileCount, entry.faceViewProj[face]});
+        }
+        tileCount++;
+      }
+    }
+  }
+
+  void allocateTiles(Entry& entry, uint32_t faceCount, uint32_t tileSize) {
+    entry.requestedFaces = faceCount;
+    entry.requestedSize = tileSize;
+    entry.faceCount = 0;
+    entry.rendered = false;
+    // Shrinks the tiles until every face fits, the light stays unshadowed if
+    // even the smallest tiles do not
+    for (uint32_t size = tileSize; size >= MIN_TILE_SIZE; size /= 2) {
+      uint32_t level = 0;
+      while ((ATLAS_SIZE >> level) > size) level++;
+      uint32_t allocated = 0;
+      for (; allocated < faceCount; allocated++) {
+        const int32_t node = allocateNode(0, 0, level);
+        if (node < 0) break;
+        entry.nodes[allocated] = static_cast<uint32_t>(node);
+      }
+      if (allocated == faceCount) {
+        entry.faceCount = faceCount;
+        entry.tileSize = size;
+        return;
+      }
+      for (uint32_t i = 0; i < allocated; i++) freeNode(entry.nodes[i]);
+    }
+  }
+
+  void freeTiles(Entry& entry) {
+    for (uint32_t i = 0; i < entry.faceCount; i++) freeNode(entry.nodes[i]);
+    entry.faceCount = 0;
+    entry.rendered = false;
+  }
+
+  int32_t allocateNode(uint32_t node, uint32_t level, uint32_t targetLevel) {
+    if (nodeStates[node] == NodeState::Used) return -1;
+    if (level == targetLevel) {
+      if (nodeStates[node] != NodeState::Free) return -1;
+      nodeStates[node] = NodeState::Used;
+      return static_cast<int32_t>(node);
+    }
+    nodeStates[node] = NodeState::Split;
+    for (uint32_t child = 4 * node + 1; child <= 4 * node + 4; child++) {
+      const int32_t result = allocateNode(child, level + 1, targetLevel);
+      if (result >= 0) return result;
+    }
+    mergeNode(node);
+    return -1;
+  }
+
+  void freeNode(uint32_t node) {
+    nodeStates[node] = NodeState::Free;
+    while (node > 0) {
+      node = (node - 1) / 4;
+      if (!mergeNode(node)) break;
+    }
+  }
+
+  // A split node whose children are all free becomes free again
+  bool mergeNode(uint32_t node) {
+    for (uint32_t child = 4 * node + 1; child <= 4 * node + 4; child++) {
+      if (nodeStates[child] != NodeState::Free) return false;
+    }
+    nodeStates[node] = NodeState::Free;
+    return true;
+  }
+
+  void buildQuadtree() {
+    uint32_t nodeCount = 0;
+    for (uint32_t level = 0; level < LEVEL_COUNT; level++) {
+      nodeCount += 1u << (2 * level);
+    }
+    nodeStates.assign(nodeCount, NodeState::Free);
+    nodeRects.resize(nodeCount);
+    nodeRects[0] = vks::initializers::rect2D(ATLAS_SIZE, ATLAS_SIZE, 0, 0);
+    for (uint32_t node = 0; 4 * node + 4 < nodeCount; node++) {
+      const VkRect2D& parent = nodeRects[node];
+      const int32_t half = static_cast<int32_t>(parent.extent.width / 2);
+      for (uint32_t i = 0; i < 4; i++) {
+        nodeRects[4 * node + 1 + i] = vks::initializers::rect2D(
+            half, half, parent.offset.x + (i & 1) * half,
+            parent.offset.y + (i >> 1) * half);
+      }
+    }
+    // Leaves have no children, merging only ever looks at inner nodes
+  }
+
+  // Same attachment as the shadow passes so the shadow pipeline can be used,
+  // tiles that are not rendered are loaded
+  void createRenderPass() {
+    VkAttachmentDescription attachment{};
+    attachment.format = format;
+    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    VkAttachmentReference depthReference = {
+        0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+    VkSubpassDescription subpassDescription{};
+    subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpassDescription.pDepthStencilAttachment = &depthReference;
+
+    std::array<VkSubpassDependency, 2> dependencies{};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    dependencies[0].dstAccessMask =
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].srcAccessMask =
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &attachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpassDescription;
+    renderPassInfo.dependencyCount =
+        static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
+    VK_CHECK_RESULT(vkCreateRenderPass(device->logicalDevice, &renderPassInfo,
+                                       nullptr, &renderPass));
+  }
+
+  void createImage(VkFilter filter) {
+    VkDevice logicalDevice = device->logicalDevice;
+    VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+    imageCI.imageType = VK_IMAGE_TYPE_2D;
+    imageCI.format = format;
+    imageCI.extent = {ATLAS_SIZE, ATLAS_SIZE, 1};
+    imageCI.mipLevels = 1;
+    imageCI.arrayLayers = 1;
+    imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                    VK_IMAGE_USAGE_SAMPLED_BIT;
+    VK_CHECK_RESULT(vkCreateImage(logicalDevice, &imageCI, nullptr, &image));
+
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(logicalDevice, image, &memReqs);
+    VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+    memAlloc.allocationSize = memReqs.size;
+    memAlloc.memoryTypeIndex = device->getMemoryType(
+        memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VK_CHECK_RESULT(
+        vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &memory));
+    VK_CHECK_RESULT(vkBindImageMemory(logicalDevice, image, memory, 0));
+
+    VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+    viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewCI.format = format;
+    viewCI.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+    viewCI.image = image;
+    VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewCI, nullptr, &view));
+
+    // Filter taps are clamped to their tile in the shader
+    VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+    samplerCI.magFilter = filter;
+    samplerCI.minFilter = filter;
+    samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.maxAnisotropy = 1.0f;
+    samplerCI.minLod = 0.0f;
+    samplerCI.maxLod = 1.0f;
+    samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    VK_CHECK_RESULT(
+        vkCreateSampler(logicalDevice, &samplerCI, nullptr, &sampler));
+
+    VkFramebufferCreateInfo framebufferCI =
+        vks::initializers::framebufferCreateInfo();
+    framebufferCI.renderPass = renderPass;
+    framebufferCI.attachmentCount = 1;
+    framebufferCI.pAttachments = &view;
+    framebufferCI.width = ATLAS_SIZE;
+    framebufferCI.height = ATLAS_SIZE;
+    framebufferCI.layers = 1;
+    VK_CHECK_RESULT(vkCreateFramebuffer(logicalDevice, &framebufferCI, nullptr,
+                                        &framebuffer));
+
+    descriptor.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    descriptor.imageView = view;
+    descriptor.sampler = sampler;
+  }
+};
+}  // namespace vks
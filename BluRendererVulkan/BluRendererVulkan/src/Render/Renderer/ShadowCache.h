@@ -0,0 +1,443 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "../ResourceManagement/VulkanResources/VulkanDevice.h"
+#include "../ResourceManagement/VulkanResources/VulkanInitializers.hpp"
+#include "../ResourceManagement/VulkanResources/VulkanTools.h"
+
+namespace vks {
+// Caches the depth of static shadow casters per shadow cascade. The cache is
+// only rendered again when the cascade projection changes in a way other than
+// a whole texel shift (light, cascade size or depth range changed) or when a
+// static caster moved. Whole texel shifts, which is how cascades follow the
+// camera, scroll the cached depth and only render the newly exposed strips.
+// Every frame the cache is copied into the frame's shadow target and moving
+// casters are drawn on top of it, frames whose target already holds the cache
+// and have nothing moving to draw skip the shadow pass entirely
+class ShadowCache {
+ public:
+  struct Stats {
+    uint32_t rebuilds = 0;
+    uint32_t scrolls = 0;
+    uint32_t composites = 0;
+  };
+
+  void create(vks::VulkanDevice* vulkanDevice, VkFormat depthFormat,
+              uint32_t mapSize, uint32_t cascadeCount, uint32_t frameCount) {
+    device = vulkanDevice;
+    format = depthFormat;
+    size = mapSize;
+    cascades.resize(cascadeCount);
+    frameTargets.resize(frameCount * cascadeCount);
+    createRenderPasses();
+    for (Cascade& cascade : cascades) {
+      for (CacheImage& image : cascade.images) {
+        createImage(image);
+      }
+    }
+  }
+
+  void destroy() {
+    VkDevice logicalDevice = device->logicalDevice;
+    for (Cascade& cascade : cascades) {
+      for (CacheImage& image : cascade.images) {
+        vkDestroyFramebuffer(logicalDevice, image.framebuffer, nullptr);
+        vkDestroyImageView(logicalDevice, image.view, nullptr);
+        vkDestroyImage(logicalDevice, image.image, nullptr);
+        vkFreeMemory(logicalDevice, image.memory, nullptr);
+      }
+    }
+    cascades.clear();
+    vkDestroyRenderPass(logicalDevice, cacheRenderPass, nullptr);
+    vkDestroyRenderPass(logicalDevice, compositeRenderPass, nullptr);
+  }
+
+  // Forces every cascade to be rendered again, e.g. after a static caster
+  // moved
+  void invalidate() {
+    for (Cascade& cascade : cascades) {
+      cascade.valid = false;
+    }
+  }
+
+  // The frame's target was rendered without the cache
+  void invalidateTarget(uint32_t frameIndex, uint32_t cascadeIndex) {
+    frameTargets[frameIndex * cascades.size() + cascadeIndex] = FrameTarget();
+  }
+
+  // Casters start out static. A caster whose transform changes is moved to
+  // the moving set for good and the caches are rebuilt without it. Returns
+  // true if the caster is new or moved since the last call
+  bool updateCaster(uint32_t casterIndex, const glm::mat4& transform) {
+    if (casterIndex >= casters.size()) {
+      casters.resize(casterIndex + 1);
+    }
+    Caster& caster = casters[casterIndex];
+    if (!caster.known) {
+      caster.known = true;
+      caster.transform = transform;
+      invalidate();
+      return true;
+    }
+    if (caster.transform == transform) {
+      return false;
+    }
+    caster.transform = transform;
+    if (!caster.moving) {
+      caster.moving = true;
+      invalidate();
+    }
+    return true;
+  }
+
+  bool isMoving(uint32_t casterIndex) const {
+    return casterIndex < casters.size() && casters[casterIndex].moving;
+  }
+
+  void resetCasters() {
+    casters.clear();
+    invalidate();
+  }
+
+  // Brings the cached static depth of a cascade up to date with its new
+  // projection. drawStatic(commandBuffer, region) records the static casters
+  // with the region as scissor, it is called once per region to re-render
+  template <typename DrawFn>
+  void update(VkCommandBuffer commandBuffer, uint32_t cascadeIndex,
+              const glm::mat4& viewProjection, DrawFn&& drawStatic) {
+    Cascade& cascade = cascades[cascadeIndex];
+    std::array<VkRect2D, 2> regions{};
+    uint32_t regionCount = 0;
+
+    glm::ivec2 shift(0);
+    const bool scroll = cascade.valid && getTexelShift(cascade.viewProjection,
+                                                       viewProjection, shift);
+    if (scroll && shift == glm::ivec2(0)) {
+      return;
+    }
+
+    const uint32_t source = cascade.current;
+    const uint32_t target = 1 - cascade.current;
+    VkImage targetImage = cascade.images[target].image;
+    if (scroll) {
+      // Content moves by the shift, keep the overlap and render the strips
+      // that scrolled into view
+      setImageLayout(commandBuffer, targetImage, VK_IMAGE_LAYOUT_UNDEFINED,
+                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT);
+      VkImageCopy copyRegion{};
+      copyRegion.srcSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1};
+      copyRegion.dstSubresource = copyRegion.srcSubresource;
+      copyRegion.srcOffset = {std::max(-shift.x, 0), std::max(-shift.y, 0), 0};
+      copyRegion.dstOffset = {std::max(shift.x, 0), std::max(shift.y, 0), 0};
+      copyRegion.extent = {size - std::abs(shift.x), size - std::abs(shift.y),
+                           1};
+      vkCmdCopyImage(commandBuffer, cascade.images[source].image,
+                     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, targetImage,
+                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+      setImageLayout(commandBuffer, targetImage,
+                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                     VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+                     VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT);
+
+      if (shift.x != 0) {
+        regions[regionCount++] = vks::initializers::rect2D(
+            std::abs(shift.x), size, shift.x > 0 ? 0 : size + shift.x, 0);
+      }
+      if (shift.y != 0) {
+        regions[regionCount++] = vks::initializers::rect2D(
+            size, std::abs(shift.y), 0, shift.y > 0 ? 0 : size + shift.y);
+      }
+      stats.scrolls++;
+    } else {
+      setImageLayout(commandBuffer, targetImage, VK_IMAGE_LAYOUT_UNDEFINED,
+                     VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+                     VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT);
+      regions[regionCount++] = vks::initializers::rect2D(size, size, 0, 0);
+      stats.rebuilds++;
+    }
+
+    VkRenderPassBeginInfo renderPassBeginInfo =
+        vks::initializers::renderPassBeginInfo();
+    renderPassBeginInfo.renderPass = cacheRenderPass;
+    renderPassBeginInfo.framebuffer = cascade.images[target].framebuffer;
+    renderPassBeginInfo.renderArea =
+        vks::initializers::rect2D(size, size, 0, 0);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+                         VK_SUBPASS_CONTENTS_INLINE);
+
+    // All regions are cleared first, they may overlap in a corner
+    std::array<VkClearRect, 2> clearRects{};
+    for (uint32_t i = 0; i < regionCount; i++) {
+      clearRects[i] = {regions[i], 0, 1};
+    }
+    VkClearAttachment clearAttachment{};
+    clearAttachment.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    clearAttachment.clearValue.depthStencil = {1.0f, 0};
+    vkCmdClearAttachments(commandBuffer, 1, &clearAttachment, regionCount,
+                          clearRects.data());
+    for (uint32_t i = 0; i < regionCount; i++) {
+      drawStatic(commandBuffer, regions[i]);
+    }
+    vkCmdEndRenderPass(commandBuffer);
+    setImageLayout(commandBuffer, targetImage,
+                   VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    cascade.current = target;
+    cascade.viewProjection = viewProjection;
+    cascade.valid = true;
+    cascade.version++;
+  }
+
+  // Copies the cache into the frame's shadow target before the moving casters
+  // are drawn with getCompositeRenderPass(). Returns false if the target
+  // already holds the cache and there is nothing moving to draw
+  bool composite(VkCommandBuffer commandBuffer, uint32_t frameIndex,
+                 uint32_t cascadeIndex, VkImage targetImage,
+                 bool hasMovingCasters) {
+    const Cascade& cascade = cascades[cascadeIndex];
+    FrameTarget& frameTarget =
+        frameTargets[frameIndex * cascades.size() + cascadeIndex];
+    if (frameTarget.version == cascade.version && !frameTarget.hadMoving &&
+        !hasMovingCasters) {
+      return false;
+    }
+
+    // The previous contents were sampled by an earlier frame
+    setImageLayout(commandBuffer, targetImage, VK_IMAGE_LAYOUT_UNDEFINED,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT);
+    VkImageCopy copyRegion{};
+    copyRegion.srcSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1};
+    copyRegion.dstSubresource = copyRegion.srcSubresource;
+    copyRegion.extent = {size, size, 1};
+    vkCmdCopyImage(commandBuffer, cascade.images[cascade.current].image,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, targetImage,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+    setImageLayout(commandBuffer, targetImage,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT,
+                   VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT);
+
+    frameTarget.version = cascade.version;
+    frameTarget.hadMoving = hasMovingCasters;
+    stats.composites++;
+    return true;
+  }
+
+  // Projection that maps only the region of the map to clip space, used to
+  // cull casters against a strip that is rendered again
+  glm::mat4 getRegionProjection(const glm::mat4& viewProjection,
+                                const VkRect2D& region) const {
+    const glm::vec2 offset(region.offset.x, region.offset.y);
+    const glm::vec2 extent(region.extent.width, region.extent.height);
+    const float mapSize = static_cast<float>(size);
+    const glm::vec2 scale = mapSize / extent;
+    const glm::vec2 center = (offset * 2.0f + extent) / mapSize - 1.0f;
+    glm::mat4 crop(1.0f);
+    crop[0][0] = scale.x;
+    crop[1][1] = scale.y;
+    crop[3][0] = -center.x * scale.x;
+    crop[3][1] = -center.y * scale.y;
+    return crop * viewProjection;
+  }
+
+  // Loads the copied cache, compatible with the shadow pass framebuffers
+  VkRenderPass getCompositeRenderPass() const { return compositeRenderPass; }
+
+  const Stats& getStats() const { return stats; }
+
+ private:
+  struct CacheImage {
+    VkImage image{VK_NULL_HANDLE};
+    VkDeviceMemory memory{VK_NULL_HANDLE};
+    VkImageView view{VK_NULL_HANDLE};
+    VkFramebuffer framebuffer{VK_NULL_HANDLE};
+  };
+
+  struct Cascade {
+    // Ping pong pair, scrolling copies from one into the other
+    std::array<CacheImage, 2> images;
+    uint32_t current = 0;
+    glm::mat4 viewProjection{1.0f};
+    bool valid = false;
+    uint32_t version = 0;
+  };
+
+  struct FrameTarget {
+    uint32_t version = UINT32_MAX;
+    bool hadMoving = false;
+  };
+
+  struct Caster {
+    glm::mat4 transform{1.0f};
+    bool known = false;
+    bool moving = false;
+  };
+
+  vks::VulkanDevice* device = nullptr;
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  uint32_t size = 0;
+  std::vector<Cascade> cascades;
+  std::vector<FrameTarget> frameTargets;
+  std::vector<Caster> casters;
+  VkRenderPass cacheRenderPass{VK_NULL_HANDLE};
+  VkRenderPass compositeRenderPass{VK_NULL_HANDLE};
+  Stats stats;
+
+  // A projection that only moved by whole texels shares its depth with the
+  // previous one, the shift is in texels of the new map
+  bool getTexelShift(const glm::mat4& previous, const glm::mat4& next,
+                     glm::ivec2& shift) const {
+    for (uint32_t column = 0; column < 3; column++) {
+      if (glm::any(glm::notEqual(previous[column], next[column]))) {
+        return false;
+      }
+    }
+    if (previous[3].z != next[3].z || previous[3].w != next[3].w) {
+      return false;
+    }
+    const glm::vec2 texels =
+        glm::vec2(next[3] - previous[3]) * (size * 0.5f);
+    const glm::vec2 rounded = glm::round(texels);
+    if (glm::any(glm::greaterThan(glm::abs(texels - rounded),
+                                  glm::vec2(0.01f))) ||
+        std::abs(rounded.x) >= size || std::abs(rounded.y) >= size) {
+      return false;
+    }
+    shift = glm::ivec2(rounded);
+    return true;
+  }
+
+  void setImageLayout(VkCommandBuffer commandBuffer, VkImage image,
+                      VkImageLayout oldLayout, VkImageLayout newLayout,
+                      VkPipelineStageFlags srcStage,
+                      VkPipelineStageFlags dstStage) {
+    vks::tools::setImageLayout(commandBuffer, image, VK_IMAGE_ASPECT_DEPTH_BIT,
+                               oldLayout, newLayout, srcStage, dstStage);
+  }
+
+  // Both passes only differ from the shadow pass in layouts and load ops, so
+  // they stay compatible with its framebuffers and pipeline. Transfers are
+  // synchronized with explicit barriers around them
+  void createRenderPasses() {
+    VkAttachmentDescription attachment{};
+    attachment.format = format;
+    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depthReference = {
+        0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+    VkSubpassDescription subpassDescription{};
+    subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpassDescription.pDepthStencilAttachment = &depthReference;
+
+    std::array<VkSubpassDependency, 2> dependencies{};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    dependencies[0].dstAccessMask =
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].srcAccessMask =
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &attachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpassDescription;
+    renderPassInfo.dependencyCount =
+        static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
+
+    // Cache: static casters on top of the scrolled depth
+    attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    VK_CHECK_RESULT(vkCreateRenderPass(device->logicalDevice, &renderPassInfo,
+                                       nullptr, &cacheRenderPass));
+
+    // Composite: moving casters on top of the copied cache, sampled by the
+    // scene
+    attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    VK_CHECK_RESULT(vkCreateRenderPass(device->logicalDevice, &renderPassInfo,
+                                       nullptr, &compositeRenderPass));
+  }
+
+  void createImage(CacheImage& cacheImage) {
+    VkDevice logicalDevice = device->logicalDevice;
+    VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+    imageCI.imageType = VK_IMAGE_TYPE_2D;
+    imageCI.format = format;
+    imageCI.extent = {size, size, 1};
+    imageCI.mipLevels = 1;
+    imageCI.arrayLayers = 1;
+    imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                    VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                    VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    VK_CHECK_RESULT(
+        vkCreateImage(logicalDevice, &imageCI, nullptr, &cacheImage.image));
+
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(logicalDevice, cacheImage.image, &memReqs);
+    VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+    memAlloc.allocationSize = memReqs.size;
+    memAlloc.memoryTypeIndex = device->getMemoryType(
+        memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr,
+                                     &cacheImage.memory));
+    VK_CHECK_RESULT(vkBindImageMemory(logicalDevice, cacheImage.image,
+                                      cacheImage.memory, 0));
+
+    VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+    viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewCI.format = format;
+    viewCI.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+    viewCI.image = cacheImage.image;
+    VK_CHECK_RESULT(
+        vkCreateImageView(logicalDevice, &viewCI, nullptr, &cacheImage.view));
+
+    VkFramebufferCreateInfo framebufferCI =
+        vks::initializers::framebufferCreateInfo();
+    framebufferCI.renderPass = cacheRenderPass;
+    framebufferCI.attachmentCount = 1;
+    framebufferCI.pAttachments = &cacheImage.view;
+    framebufferCI.width = size;
+    framebufferCI.height = size;
+    framebufferCI.layers = 1;
+    VK_CHECK_RESULT(vkCreateFramebuffer(logicalDevice, &framebufferCI, nullptr,
+                                        &cacheImage.framebuffer));
+  }
+};
+}  // namespace vks
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "../ResourceManagement/VulkanResources/VulkanDevice.h"
+#include "../ResourceManagement/VulkanResources/VulkanInitializers.hpp"
+#include "../ResourceManagement/VulkanResources/VulkanTools.h"
+#include "HistoryImages.h"
+
+namespace vks {
+// Temporal anti aliasing and upscaling as a compute pass. The scene is drawn
+// with a sub pixel jitter that changes every frame, the pass reconstructs the
+// output resolution from the scene, which may be smaller, and the history of
+// the frames before. The history is reprojected along the motion vectors of
+// the prepass, or the camera motion rebuilt from its depth where it drew
+// nothing, and clamped to the neighbourhood of the current frame so it can
+// not drag stale colors along.
+// The scene belongs to the render graph, the two history images are kept
+// here and imported into the graph every frame
+class TAAPass {
+ public:
+  // Matches local_size of temporalAA.comp
+  static constexpr uint32_t GROUP_SIZE = 8;
+  // Linear color, the tonemapping after the pass needs the range
+  static constexpr VkFormat FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+  // Motion vectors of the prepass in UV units, matches depthPass.frag
+  static constexpr VkFormat VELOCITY_FORMAT = VK_FORMAT_R16G16_SFLOAT;
+  // Share of the history in the output
+  static constexpr float HISTORY_WEIGHT = 0.9f;
+  // Jitter offsets before the sequence repeats, enough to cover every output
+  // pixel at half the render resolution
+  static constexpr uint32_t JITTER_PHASES = 16;
+
+  // Matches the push constants of temporalAA.comp
+  struct Params {
+    // Depth buffer position of this frame to clip space of the last one, set
+    // by record()
+    glm::mat4 reprojection;
+    // Jitter of the scene in its pixels
+    glm::vec2 jitter;
+    // Scene pixels in use, the scene and depth images may be larger
+    glm::ivec2 renderExtent;
+    // Set by record(), 0 without history
+    float historyWeight;
+  };
+
+  void create(vks::VulkanDevice* vulkanDevice, uint32_t frameCount,
+              const VkPipelineShaderStageCreateInfo& shaderStage) {
+    device = vulkanDevice;
+    descriptorSets.resize(frameCount);
+    history.create(device, FORMAT);
+    createPipeline(shaderStage);
+  }
+
+  void destroy() {
+    VkDevice logicalDevice = device->logicalDevice;
+    history.destroy();
+    vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+    vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+  }
+
+  // Jitter of the next frame in pixels, within half a pixel of the center.
+  // Halton(2, 3) covers the pixel evenly for any number of frames
+  glm::vec2 nextJitter() {
+    const uint32_t index = (jitterIndex++ % JITTER_PHASES) + 1;
+    return glm::vec2(halton(index, 2), halton(index, 3)) - 0.5f;
+  }
+
+  // Moves everything projection draws by jitter pixels of a target of extent
+  static glm::mat4 jitterProjection(const glm::mat4& projection,
+                                    glm::vec2 jitter, VkExtent2D extent) {
+    const glm::vec2 offset =
+        2.0f * jitter / glm::vec2(extent.width, extent.height);
+    return glm::translate(glm::mat4(1.0f), glm::vec3(offset, 0.0f)) *
+           projection;
+  }
+
+  // The output of this frame and of the last one. Prepared once per frame
+  // with TAA on the queue of post processing. The pass writes the output in
+  // the general layout, after that it is only sampled
+  vks::HistoryImages& getHistory() { return history; }
+
+  // Resolves the scene in the shader read only layout into output, expected
+  // in the general layout. depth and velocity are the prepass targets the
+  // scene was drawn with, viewProjection the camera without the jitter
+  void record(VkCommandBuffer commandBuffer, uint32_t frame, VkImageView scene,
+              const VkDescriptorImageInfo& depth,
+              const VkDescriptorImageInfo& velocity, VkImageView historyView,
+              VkImageView output, Params params,
+              const glm::mat4& viewProjection, VkExtent2D extent) {
+    VkDescriptorSet descriptorSet = descriptorSets[frame];
+    // The scene is read between pixels like the history
+    const VkSampler sampler = history.getSampler();
+    VkDescriptorImageInfo sceneInfo{sampler, scene,
+                                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkDescriptorImageInfo historyInfo{sampler, historyView,
+                                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkDescriptorImageInfo outputInfo{VK_NULL_HANDLE, output,
+                                     VK_IMAGE_LAYOUT_GENERAL};
+    std::array<VkWriteDescriptorSet, 5> writes = {
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+            &sceneInfo),
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+            &depth),
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2,
+            &historyInfo),
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3, &outputInfo),
+        vks::initializers::writeDescriptorSet(
+            descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4,
+            &velocity)};
+    vkUpdateDescriptorSets(device->logicalDevice,
+                           static_cast<uint32_t>(writes.size()), writes.data(),
+                           0, nullptr);
+
+    params.reprojection =
+        previousViewProjection * glm::inverse(viewProjection);
+    params.historyWeight = history.isValid() ? HISTORY_WEIGHT : 0.0f;
+    previousViewProjection = viewProjection;
+    history.markWritten();
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, pipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Params),
+                       &params);
+    vkCmdDispatch(commandBuffer, (extent.width + GROUP_SIZE - 1) / GROUP_SIZE,
+                  (extent.height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+  }
+
+ private:
+  vks::VulkanDevice* device{nullptr};
+  std::vector<VkDescriptorSet> descriptorSets;
+
+  VkDescriptorPool descriptorPool{VK_NULL_HANDLE};
+  VkDescriptorSetLayout descriptorSetLayout{VK_NULL_HANDLE};
+  VkPipelineLayout pipelineLayout{VK_NULL_HANDLE};
+  VkPipeline pipeline{VK_NULL_HANDLE};
+
+  vks::HistoryImages history;
+  glm::mat4 previousViewProjection{1.0f};
+  uint32_t jitterIndex = 0;
+
+  static float halton(uint32_t index, uint32_t base) {
+    float fraction = 1.0f;
+    float result = 0.0f;
+    while (index > 0) {
+      fraction /= static_cast<float>(base);
+      result += fraction * static_cast<float>(index % base);
+      index /= base;
+    }
+    return result;
+  }
+
+  void createPipeline(const VkPipelineShaderStageCreateInfo& shaderStage) {
+    VkDevice logicalDevice = device->logicalDevice;
+    const uint32_t frameCount = static_cast<uint32_t>(descriptorSets.size());
+    std::vector<VkDescriptorPoolSize> poolSizes = {
+        vks::initializers::descriptorPoolSize(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frameCount * 4),
+        vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                              frameCount)};
+    VkDescriptorPoolCreateInfo descriptorPoolCI =
+        vks::initializers::descriptorPoolCreateInfo(poolSizes, frameCount);
+    VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolCI,
+                                           nullptr, &descriptorPool));
+
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+        // Binding 0 : Scene color
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        // Binding 1 : Depth
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        // Binding 2 : History
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        // Binding 3 : Output
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+        // Binding 4 : Motion vectors
+        vks::initializers::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 4)};
+    VkDescriptorSetLayoutCreateInfo descriptorLayoutCI =
+        vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
+        logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayout));
+
+    std::vector<VkDescriptorSetLayout> setLayouts(frameCount,
+                                                  descriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo =
+        vks::initializers::descriptorSetAllocateInfo(
+            descriptorPool, setLayouts.data(), frameCount);
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo,
+                                             descriptorSets.data()));
+
+    VkPushConstantRange pushConstantRange =
+        vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT,
+                                             sizeof(Params), 0);
+    VkPipelineLayoutCreateInfo pipelineLayoutCI =
+        vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+    pipelineLayoutCI.pushConstantRangeCount = 1;
+    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCI,
+                                           nullptr, &pipelineLayout));
+
+    VkComputePipelineCreateInfo pipelineCI =
+        vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+    pipelineCI.stage = shaderStage;
+    VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice,
+                                             device->pipelineCache, 1,
+                                             &pipelineCI, nullptr, &pipeline));
+  }
+};
+}  // namespace vks
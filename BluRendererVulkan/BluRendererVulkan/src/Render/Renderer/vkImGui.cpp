@@ -21,7 +21,6 @@ vkImGUI::~vkImGUI() {
   vkDestroyImageView(device->logicalDevice, fontView, nullptr);
   vkFreeMemory(device->logicalDevice, fontMemory, nullptr);
   vkDestroySampler(device->logicalDevice, sampler, nullptr);
-  vkDestroyPipelineCache(device->logicalDevice, pipelineCache, nullptr);
   vkDestroyPipeline(device->logicalDevice, pipeline, nullptr);
   vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
   vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
@@ -124,10 +123,10 @@ void vkImGUI::initResources(BaseRenderer* br, VkQueue copyQueue,
     vkGetPhysicalDeviceProperties2(device->physicalDevice, &deviceProperties2);
   }
 
-  vertexBuffers.resize(br->swapChain.imageCount);
-  vertexCounts.resize(br->swapChain.imageCount);
-  indexBuffers.resize(br->swapChain.imageCount);
-  indexCounts.resize(br->swapChain.imageCount);
+  vertexBuffers.resize(br->getMaxFramesInFlight());
+  vertexCounts.resize(br->getMaxFramesInFlight());
+  indexBuffers.resize(br->getMaxFramesInFlight());
+  indexCounts.resize(br->getMaxFramesInFlight());
 
   // Create target image for copy
   VkImageCreateInfo imageInfo = vks::initializers::imageCreateInfo();
@@ -261,13 +260,6 @@ void vkImGUI::initResources(BaseRenderer* br, VkQueue copyQueue,
                          static_cast<uint32_t>(writeDescriptorSets.size()),
                          writeDescriptorSets.data(), 0, nullptr);
 
-  // Pipeline cache
-  VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-  pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-  VK_CHECK_RESULT(vkCreatePipelineCache(device->logicalDevice,
-                                        &pipelineCacheCreateInfo, nullptr,
-                                        &pipelineCache));
-
   // Pipeline layout
   // Push constants for UI rendering parameters
   VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(
@@ -375,8 +367,8 @@ void vkImGUI::initResources(BaseRenderer* br, VkQueue copyQueue,
                                              VK_SHADER_STAGE_FRAGMENT_BIT);
 
   VK_CHECK_RESULT(
-      vkCreateGraphicsPipelines(device->logicalDevice, pipelineCache, 1,
-                                &pipelineCreateInfo, nullptr, &pipeline));
+      vkCreateGraphicsPipelines(device->logicalDevice, device->pipelineCache,
+                                1, &pipelineCreateInfo, nullptr, &pipeline));
 }
 
 // Update vertex and index buffer containing the imGui elements when required
@@ -16,7 +16,6 @@ class vkImGUI {
   VkDeviceMemory fontMemory = VK_NULL_HANDLE;
   VkImage fontImage = VK_NULL_HANDLE;
   VkImageView fontView = VK_NULL_HANDLE;
-  VkPipelineCache pipelineCache;
   VkPipelineLayout pipelineLayout;
   VkPipeline pipeline;
   VkDescriptorPool descriptorPool;
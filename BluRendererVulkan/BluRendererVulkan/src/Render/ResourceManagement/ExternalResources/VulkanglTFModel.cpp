@@ -1272,6 +1272,19 @@ void Model::loadFromFile(std::string filename, vks::VulkanDevice *device,
               vertex.color = primitive->material.baseColorFactor * vertex.color;
             }
           }
+          // Keep primitive bounds in the same space as the vertex data, so
+          // the renderer only needs the model transform to place them
+          if (primitive->bb.valid) {
+            if (preTransform) {
+              primitive->bb = primitive->bb.getAABB(localMatrix);
+              primitive->bb.valid = true;
+            }
+            if (flipY) {
+              const float minY = primitive->bb.min.y;
+              primitive->bb.min.y = -primitive->bb.max.y;
+              primitive->bb.max.y = -minY;
+            }
+          }
         }
       }
     }
@@ -101,6 +101,9 @@ struct Material {
     bool specularGlossiness = false;
   } pbrWorkflows;
   VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+  // Pipeline variant bits and handle, resolved by the renderer after load
+  uint32_t pipelineKey = 0;
+  VkPipeline pipeline = VK_NULL_HANDLE;
   int index = 0;
   bool unlit = false;
   float emissiveStrength = 1.0f;
@@ -97,6 +97,24 @@ uint32_t VulkanDevice::getMemoryType(uint32_t typeBits,
   }
 }
 
+/**
+ * Get the memory type for an image created with
+ * VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT
+ *
+ * @param typeBits Bit mask of the memory types supported by the image
+ *
+ * @return Lazily allocated memory where the device has it (tile based GPUs
+ * only back it when a render pass has to spill), device local otherwise
+ */
+uint32_t VulkanDevice::getTransientAttachmentMemoryType(
+    uint32_t typeBits) const {
+  VkBool32 found = false;
+  const uint32_t lazy = getMemoryType(
+      typeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &found);
+  return found ? lazy
+               : getMemoryType(typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
 /**
  * Get the index of a queue family that supports the requested queue flags
  * SRS - support VkQueueFlags parameter for requesting multiple flags vs.
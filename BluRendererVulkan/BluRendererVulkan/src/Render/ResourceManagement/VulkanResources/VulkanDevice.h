@@ -32,6 +32,8 @@ class VulkanDevice {
   std::vector<std::string> supportedExtensions;
   /** @brief Default command pool for the graphics queue family index */
   VkCommandPool commandPool = VK_NULL_HANDLE;
+  /** @brief Pipeline cache of the renderer, kept on disk between runs */
+  VkPipelineCache pipelineCache = VK_NULL_HANDLE;
   /** @brief Contains queue family indices */
   struct {
     uint32_t graphics;
@@ -43,6 +45,7 @@ class VulkanDevice {
   ~VulkanDevice();
   uint32_t getMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties,
                          VkBool32 *memTypeFound = nullptr) const;
+  uint32_t getTransientAttachmentMemoryType(uint32_t typeBits) const;
   uint32_t getQueueFamilyIndex(VkQueueFlags queueFlags) const;
   VkResult createLogicalDevice(
       VkPhysicalDeviceFeatures enabledFeatures,
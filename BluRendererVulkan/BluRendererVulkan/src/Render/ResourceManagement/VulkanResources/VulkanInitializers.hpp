@@ -277,7 +277,7 @@ inline VkDescriptorImageInfo descriptorImageInfo(VkSampler sampler,
 
 inline VkWriteDescriptorSet writeDescriptorSet(
     VkDescriptorSet dstSet, VkDescriptorType type, uint32_t binding,
-    VkDescriptorBufferInfo* bufferInfo, uint32_t descriptorCount = 1) {
+    const VkDescriptorBufferInfo* bufferInfo, uint32_t descriptorCount = 1) {
   VkWriteDescriptorSet writeDescriptorSet{};
   writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
   writeDescriptorSet.dstSet = dstSet;
@@ -288,11 +288,9 @@ inline VkWriteDescriptorSet writeDescriptorSet(
   return writeDescriptorSet;
 }
 
-inline VkWriteDescriptorSet writeDescriptorSet(VkDescriptorSet dstSet,
-                                               VkDescriptorType type,
-                                               uint32_t binding,
-                                               VkDescriptorImageInfo* imageInfo,
-                                               uint32_t descriptorCount = 1) {
+inline VkWriteDescriptorSet writeDescriptorSet(
+    VkDescriptorSet dstSet, VkDescriptorType type, uint32_t binding,
+    const VkDescriptorImageInfo* imageInfo, uint32_t descriptorCount = 1) {
   VkWriteDescriptorSet writeDescriptorSet{};
   writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
   writeDescriptorSet.dstSet = dstSet;
@@ -7,13 +7,17 @@ namespace rendering {
 vks::VulkanRenderTarget* createDepthRenderTarget(
     vks::VulkanDevice* device, VkFormat depthFormat, VkFilter samplerFilter,
     uint32_t imageCount, float depthMapWidth, float depthMapHeight,
-    std::string vertexShaderPath) {
+    std::string vertexShaderPath, VkFormat colorFormat,
+    std::string fragmentShaderPath) {
   vks::VulkanRenderTarget* newTarget = new vks::VulkanRenderTarget;
   newTarget->device = device;
   newTarget->vertexShaderPath = vertexShaderPath;
+  newTarget->fragmentShaderPath = fragmentShaderPath;
+  newTarget->colorFormat = colorFormat;
   newTarget->depthFormat = depthFormat;
+  const bool hasColor = colorFormat != VK_FORMAT_UNDEFINED;
 
-  std::array<VkAttachmentDescription, 1> attchmentDescriptions = {};
+  std::array<VkAttachmentDescription, 2> attchmentDescriptions = {};
   // Depth attachment
   attchmentDescriptions[0].format = depthFormat;
   attchmentDescriptions[0].samples = VK_SAMPLE_COUNT_1_BIT;
@@ -25,12 +29,26 @@ vks::VulkanRenderTarget* createDepthRenderTarget(
   attchmentDescriptions[0].finalLayout =
       VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
+  // Color attachment, after the depth so depth only targets keep index 0
+  attchmentDescriptions[1].format = colorFormat;
+  attchmentDescriptions[1].samples = VK_SAMPLE_COUNT_1_BIT;
+  attchmentDescriptions[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attchmentDescriptions[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attchmentDescriptions[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attchmentDescriptions[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attchmentDescriptions[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attchmentDescriptions[1].finalLayout =
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
   VkAttachmentReference depthReference = {
       0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference colorReference = {
+      1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
 
   VkSubpassDescription subpassDescription = {};
   subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-  subpassDescription.colorAttachmentCount = 0;
+  subpassDescription.colorAttachmentCount = hasColor ? 1 : 0;
+  subpassDescription.pColorAttachments = hasColor ? &colorReference : nullptr;
   subpassDescription.pDepthStencilAttachment = &depthReference;
 
   // Use subpass dependencies for layout transitions
@@ -52,11 +70,19 @@ vks::VulkanRenderTarget* createDepthRenderTarget(
   dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
   dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+  if (hasColor) {
+    dependencies[0].dstStageMask |=
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].srcStageMask |=
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  }
+
   // Create the actual renderpass
   VkRenderPassCreateInfo renderPassInfo = {};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-  renderPassInfo.attachmentCount =
-      static_cast<uint32_t>(attchmentDescriptions.size());
+  renderPassInfo.attachmentCount = hasColor ? 2 : 1;
   renderPassInfo.pAttachments = attchmentDescriptions.data();
   renderPassInfo.subpassCount = 1;
   renderPassInfo.pSubpasses = &subpassDescription;
@@ -89,13 +115,15 @@ vks::VulkanRenderTarget* createDepthRenderTarget(
 VulkanRenderTarget* createColorDepthRenderTarget(
     vks::VulkanDevice* device, VkFormat colorFormat, VkFormat depthFormat,
     uint32_t imageCount, float width, float height,
-    std::string vertexShaderPath, std::string fragmentShaderPath) {
+    std::string vertexShaderPath, std::string fragmentShaderPath,
+    vks::VulkanRenderTarget* sharedDepth) {
   VulkanRenderTarget* newTarget = new VulkanRenderTarget();
   newTarget->device = device;
   newTarget->vertexShaderPath = vertexShaderPath;
   newTarget->fragmentShaderPath = fragmentShaderPath;
   newTarget->colorFormat = colorFormat;
-  newTarget->depthFormat = depthFormat;
+  newTarget->depthFormat = sharedDepth ? sharedDepth->depthFormat : depthFormat;
+  newTarget->sharedDepth = sharedDepth;
 
   std::array<VkAttachmentDescription, 2> attchmentDescriptions = {};
   // Color attachment
@@ -109,7 +137,7 @@ VulkanRenderTarget* createColorDepthRenderTarget(
   attchmentDescriptions[0].finalLayout =
       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
   // Depth attachment
-  attchmentDescriptions[1].format = depthFormat;
+  attchmentDescriptions[1].format = newTarget->depthFormat;
   attchmentDescriptions[1].samples = VK_SAMPLE_COUNT_1_BIT;
   attchmentDescriptions[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
   attchmentDescriptions[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -118,6 +146,15 @@ VulkanRenderTarget* createColorDepthRenderTarget(
   attchmentDescriptions[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
   attchmentDescriptions[1].finalLayout =
       VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  if (sharedDepth) {
+    // Depth comes from the shared target and stays readable for later passes
+    attchmentDescriptions[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attchmentDescriptions[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attchmentDescriptions[1].initialLayout =
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    attchmentDescriptions[1].finalLayout =
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  }
 
   VkAttachmentReference colorReference = {
       0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
@@ -149,6 +186,24 @@ VulkanRenderTarget* createColorDepthRenderTarget(
   dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
   dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+  if (sharedDepth) {
+    // The shared depth was written by its own pass and read by the passes in
+    // between, compute included
+    dependencies[0].srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependencies[0].dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                    VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask |=
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstAccessMask |=
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dependencyFlags = 0;
+    dependencies[1].srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].srcAccessMask |=
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  }
+
   // Create the actual renderpass
   VkRenderPassCreateInfo renderPassInfo = {};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -362,7 +417,8 @@ void recreateColorDepthRenderTargetResources(vks::VulkanRenderTarget* newTarget,
   depthStencilView.subresourceRange.baseArrayLayer = 0;
   depthStencilView.subresourceRange.layerCount = 1;
 
-  for (uint32_t i = 0; i < imageCount; i++) {
+  // Shared depth attachments belong to their own target
+  for (uint32_t i = 0; i < imageCount && !newTarget->sharedDepth; i++) {
     VK_CHECK_RESULT(vkCreateImage(newTarget->device->logicalDevice, &image,
                                   nullptr,
                                   &newTarget->framebuffers[i].depth.image));
@@ -389,7 +445,9 @@ void recreateColorDepthRenderTargetResources(vks::VulkanRenderTarget* newTarget,
   for (uint32_t i = 0; i < imageCount; i++) {
     VkImageView attachments[2];
     attachments[0] = newTarget->framebuffers[i].color.view;
-    attachments[1] = newTarget->framebuffers[i].depth.view;
+    attachments[1] = newTarget->sharedDepth
+                         ? newTarget->sharedDepth->framebuffers[i].depth.view
+                         : newTarget->framebuffers[i].depth.view;
 
     VkFramebufferCreateInfo fbufCreateInfo =
         vks::initializers::framebufferCreateInfo();
@@ -423,6 +481,12 @@ void recreateDepthRenderTargetResources(vks::VulkanRenderTarget* newTarget,
                        newTarget->framebuffers[i].depth.view, nullptr);
     vkFreeMemory(newTarget->device->logicalDevice,
                  newTarget->framebuffers[i].depth.memory, nullptr);
+    vkDestroyImage(newTarget->device->logicalDevice,
+                   newTarget->framebuffers[i].color.image, nullptr);
+    vkDestroyImageView(newTarget->device->logicalDevice,
+                       newTarget->framebuffers[i].color.view, nullptr);
+    vkFreeMemory(newTarget->device->logicalDevice,
+                 newTarget->framebuffers[i].color.memory, nullptr);
     vkDestroyFramebuffer(newTarget->device->logicalDevice,
                          newTarget->framebuffers[i].framebuffer, nullptr);
   }
@@ -438,9 +502,10 @@ void recreateDepthRenderTargetResources(vks::VulkanRenderTarget* newTarget,
   image.arrayLayers = 1;
   image.samples = VK_SAMPLE_COUNT_1_BIT;
   image.tiling = VK_IMAGE_TILING_OPTIMAL;
-  // We will sample directly from the Depth attachment
-  image.usage =
-      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  // We will sample directly from the Depth attachment, cached depth (e.g.
+  // static shadow casters) is copied into it
+  image.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 
   VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
   VkMemoryRequirements memReqs;
@@ -482,14 +547,50 @@ void recreateDepthRenderTargetResources(vks::VulkanRenderTarget* newTarget,
                                       &newTarget->framebuffers[i].depth.view));
   }
 
+  // Optional color attachment, sampled after the pass
+  const bool hasColor = newTarget->colorFormat != VK_FORMAT_UNDEFINED;
+  image.format = newTarget->colorFormat;
+  image.usage =
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+  VkImageViewCreateInfo colorView = vks::initializers::imageViewCreateInfo();
+  colorView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  colorView.format = newTarget->colorFormat;
+  colorView.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+  for (uint32_t i = 0; hasColor && i < imageCount; i++) {
+    VK_CHECK_RESULT(vkCreateImage(newTarget->device->logicalDevice, &image,
+                                  nullptr,
+                                  &newTarget->framebuffers[i].color.image));
+    vkGetImageMemoryRequirements(newTarget->device->logicalDevice,
+                                 newTarget->framebuffers[i].color.image,
+                                 &memReqs);
+    memAlloc.allocationSize = memReqs.size;
+    memAlloc.memoryTypeIndex = newTarget->device->getMemoryType(
+        memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VK_CHECK_RESULT(vkAllocateMemory(newTarget->device->logicalDevice,
+                                     &memAlloc, nullptr,
+                                     &newTarget->framebuffers[i].color.memory));
+    VK_CHECK_RESULT(vkBindImageMemory(newTarget->device->logicalDevice,
+                                      newTarget->framebuffers[i].color.image,
+                                      newTarget->framebuffers[i].color.memory,
+                                      0));
+
+    colorView.image = newTarget->framebuffers[i].color.image;
+    VK_CHECK_RESULT(vkCreateImageView(newTarget->device->logicalDevice,
+                                      &colorView, nullptr,
+                                      &newTarget->framebuffers[i].color.view));
+  }
+
   for (uint32_t i = 0; i < imageCount; i++) {
-    VkImageView attachments[1];
+    VkImageView attachments[2];
     attachments[0] = newTarget->framebuffers[i].depth.view;
+    attachments[1] = newTarget->framebuffers[i].color.view;
 
     VkFramebufferCreateInfo fbufCreateInfo =
         vks::initializers::framebufferCreateInfo();
     fbufCreateInfo.renderPass = newTarget->renderPass;
-    fbufCreateInfo.attachmentCount = 1;
+    fbufCreateInfo.attachmentCount = hasColor ? 2 : 1;
     fbufCreateInfo.pAttachments = attachments;
     fbufCreateInfo.width = width;
     fbufCreateInfo.height = height;
@@ -604,6 +705,32 @@ void recreateColorRenderTargetResources(vks::VulkanRenderTarget* newTarget,
   }
 }
 
+VkFramebuffer createFramebuffer(vks::VulkanRenderTarget* target,
+                                VkImageView colorView, uint32_t frame,
+                                uint32_t width, uint32_t height) {
+  VkImageView attachments[2];
+  attachments[0] = colorView;
+  uint32_t attachmentCount = 1;
+  if (target->sharedDepth) {
+    attachments[attachmentCount++] =
+        target->sharedDepth->framebuffers[frame].depth.view;
+  }
+
+  VkFramebufferCreateInfo fbufCreateInfo =
+      vks::initializers::framebufferCreateInfo();
+  fbufCreateInfo.renderPass = target->renderPass;
+  fbufCreateInfo.attachmentCount = attachmentCount;
+  fbufCreateInfo.pAttachments = attachments;
+  fbufCreateInfo.width = width;
+  fbufCreateInfo.height = height;
+  fbufCreateInfo.layers = 1;
+
+  VkFramebuffer framebuffer;
+  VK_CHECK_RESULT(vkCreateFramebuffer(target->device->logicalDevice,
+                                      &fbufCreateInfo, nullptr, &framebuffer));
+  return framebuffer;
+}
+
 void createImageFromBuffer(vks::VulkanRenderTarget* target, void** imageData,
                            float dataSize, uint32_t width, uint32_t height,
                            VkFormat imageFormat, VkQueue copyQueue) {
@@ -4,14 +4,20 @@
 
 namespace vks {
 namespace rendering {
+// With sharedDepth the target loads the depth attachment of that depth target
+// instead of clearing one of its own
 vks::VulkanRenderTarget* createColorDepthRenderTarget(
     VulkanDevice* device, VkFormat colorFormat, VkFormat depthFormat,
     uint32_t imageCount, float width, float height,
-    std::string vertexShaderPath, std::string fragmentShaderPath);
+    std::string vertexShaderPath, std::string fragmentShaderPath,
+    vks::VulkanRenderTarget* sharedDepth = nullptr);
+// With a color format the fragment shader also writes a color attachment,
+// e.g. the motion vectors of the camera prepass
 vks::VulkanRenderTarget* createDepthRenderTarget(
     vks::VulkanDevice* device, VkFormat depthFormat, VkFilter samplerFilter,
     uint32_t imageCount, float depthMapWidth, float depthMapHeight,
-    std::string vertexShaderPath);
+    std::string vertexShaderPath, VkFormat colorFormat = VK_FORMAT_UNDEFINED,
+    std::string fragmentShaderPath = "");
 vks::VulkanRenderTarget* createColorRenderTarget(
     VulkanDevice* device, VkFormat colorFormat, uint32_t imageCount,
     float width, float height, std::string vertexShaderPath,
@@ -27,6 +33,13 @@ void recreateColorRenderTargetResources(vks::VulkanRenderTarget* newTarget,
                                         uint32_t imageCount, uint32_t width,
                                         uint32_t height);
 
+// Framebuffer of the target's render pass around a color attachment owned
+// elsewhere, e.g. by the render graph. For targets created without images,
+// the depth attachment of frame comes from sharedDepth
+VkFramebuffer createFramebuffer(vks::VulkanRenderTarget* target,
+                                VkImageView colorView, uint32_t frame,
+                                uint32_t width, uint32_t height);
+
 void createImageFromBuffer(vks::VulkanRenderTarget* target, void** imageData,
                            float dataSize, uint32_t width, uint32_t height,
                            VkFormat imageFormat, VkQueue copyQueue);
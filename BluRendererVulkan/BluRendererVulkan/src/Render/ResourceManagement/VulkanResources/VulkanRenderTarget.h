@@ -30,6 +30,8 @@ class VulkanRenderTarget {
   std::string fragmentShaderPath;
   VkFormat colorFormat;
   VkFormat depthFormat;
+  // Depth target whose attachments are used instead of owned ones
+  VulkanRenderTarget* sharedDepth{nullptr};
 
   std::vector<VkCommandBuffer> cmdBufs;
 